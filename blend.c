@@ -0,0 +1,241 @@
+#include "blend.h"
+
+/*
+Integer blending, 8 pixels at a time:
+- Channels are widened to 16 bits, Dest * Factor + Addend is at most 65535 with saturating adds, then divided by 255 with a shift and an add.
+- Source over: Factor = 255 - SourceAlpha, Addend = Source * SourceAlpha, with the alpha channel of Source taken as 255 so the result alpha is Sa + Da * (1 - Sa).
+- Premultiplied: Factor = 255 - SourceAlpha, Addend = Source * 255.
+- Additive: Factor = 255, Addend = Source * SourceAlpha, saturated at 255.
+- Multiply: Factor = Source, Addend = 0.
+- Opaque: Factor = 0, Addend = Source * 255, so the same kernel copies too.
+BlendPixel is the same math one channel at a time, for span edges and for transparent triangles.
+*/
+
+inline uint32 BlendPixel(uint32 Dest, uint32 Source, blend_mode Mode)
+{
+    uint32 SourceAlpha = Source >> 24;
+    
+    uint32 Result = 0;
+    for(uint32 Shift = 0; Shift < 32; Shift += 8)
+    {
+        uint32 DestChannel = (Dest >> Shift) & 0xFF;
+        uint32 SourceChannel = (Source >> Shift) & 0xFF;
+        
+        uint32 Factor = 0;
+        uint32 Addend = SourceChannel * 255;
+        switch(Mode)
+        {
+            case Blend_SourceOver:
+            {
+                Factor = 255 - SourceAlpha;
+                Addend = ((Shift == 24) ? 255 : SourceChannel) * SourceAlpha;
+            }break;
+            case Blend_Premultiplied:
+            {
+                Factor = 255 - SourceAlpha;
+            }break;
+            case Blend_Additive:
+            {
+                Factor = 255;
+                Addend = SourceChannel * SourceAlpha;
+            }break;
+            case Blend_Multiply:
+            {
+                Factor = SourceChannel;
+                Addend = 0;
+            }break;
+            default:
+            {
+            }break;
+        }
+        
+        uint32 Value = (DestChannel * Factor) + Addend + 128;
+        Value = (Value > 0xFFFF) ? 0xFFFF : Value;
+        Value = Value + (Value >> 8);
+        Value = ((Value > 0xFFFF) ? 0xFFFF : Value) >> 8;
+        
+        Result |= Value << Shift;
+    }
+    
+    return Result;
+}
+
+//Source holds 16 bit channels
+inline blend_terms GetBlendTerms(__m256i Source, blend_mode Mode)
+{
+    __m256i Max = _mm256_set1_epi16(255);
+    __m256i Round = _mm256_set1_epi16(128);
+    
+    //Alpha of every pixel in all four of its channels
+    __m256i Alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(Source, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    
+    blend_terms Result;
+    Result.Factor = _mm256_setzero_si256();
+    Result.Addend = _mm256_mullo_epi16(Source, Max);
+    
+    switch(Mode)
+    {
+        case Blend_SourceOver:
+        {
+            __m256i OpaqueSource = _mm256_or_si256(Source, _mm256_set1_epi64x(0x00FF000000000000LL));
+            Result.Factor = _mm256_sub_epi16(Max, Alpha);
+            Result.Addend = _mm256_mullo_epi16(OpaqueSource, Alpha);
+        }break;
+        case Blend_Premultiplied:
+        {
+            Result.Factor = _mm256_sub_epi16(Max, Alpha);
+        }break;
+        case Blend_Additive:
+        {
+            Result.Factor = Max;
+            Result.Addend = _mm256_mullo_epi16(Source, Alpha);
+        }break;
+        case Blend_Multiply:
+        {
+            Result.Factor = Source;
+            Result.Addend = _mm256_setzero_si256();
+        }break;
+        default:
+        {
+        }break;
+    }
+    
+    Result.Addend = _mm256_adds_epu16(Result.Addend, Round);
+    
+    return Result;
+}
+
+//Dest holds 16 bit channels
+inline __m256i ApplyBlendTerms(__m256i Dest, blend_terms *Terms)
+{
+    __m256i Value = _mm256_adds_epu16(_mm256_mullo_epi16(Dest, Terms->Factor), Terms->Addend);
+    Value = _mm256_srli_epi16(_mm256_adds_epu16(Value, _mm256_srli_epi16(Value, 8)), 8);
+    
+    return Value;
+}
+
+//8 pixels against one color, the widening works per 128 bit lane and the pack puts the pixels back in order
+inline __m256i BlendColor8(__m256i Dest, blend_terms *Terms)
+{
+    __m256i Zero = _mm256_setzero_si256();
+    __m256i Low = ApplyBlendTerms(_mm256_unpacklo_epi8(Dest, Zero), Terms);
+    __m256i High = ApplyBlendTerms(_mm256_unpackhi_epi8(Dest, Zero), Terms);
+    
+    return _mm256_packus_epi16(Low, High);
+}
+
+//Blends Source over Dest pixel by pixel, for compositing one image onto another
+static void
+BlendSpan(uint32 *Dest, uint32 *Source, uint32 Count, blend_mode Mode)
+{
+    __m256i Zero = _mm256_setzero_si256();
+    
+    uint32 Index = 0;
+    for(; (Index + 8) <= Count; Index += 8)
+    {
+        __m256i DestPixels = _mm256_loadu_si256((__m256i *)(Dest + Index));
+        __m256i SourcePixels = _mm256_loadu_si256((__m256i *)(Source + Index));
+        
+        blend_terms LowTerms = GetBlendTerms(_mm256_unpacklo_epi8(SourcePixels, Zero), Mode);
+        blend_terms HighTerms = GetBlendTerms(_mm256_unpackhi_epi8(SourcePixels, Zero), Mode);
+        
+        __m256i Low = ApplyBlendTerms(_mm256_unpacklo_epi8(DestPixels, Zero), &LowTerms);
+        __m256i High = ApplyBlendTerms(_mm256_unpackhi_epi8(DestPixels, Zero), &HighTerms);
+        
+        _mm256_storeu_si256((__m256i *)(Dest + Index), _mm256_packus_epi16(Low, High));
+    }
+    
+    for(; Index < Count; ++Index)
+    {
+        Dest[Index] = BlendPixel(Dest[Index], Source[Index], Mode);
+    }
+}
+
+static void
+BlendColorSpan(uint32 *Dest, uint32 Count, uint32 Color, blend_mode Mode)
+{
+    blend_terms Terms = GetBlendTerms(_mm256_unpacklo_epi8(_mm256_set1_epi32((int32)Color), _mm256_setzero_si256()), Mode);
+    
+    uint32 Index = 0;
+    for(; (Index + 8) <= Count; Index += 8)
+    {
+        __m256i *Pixels = (__m256i *)(Dest + Index);
+        _mm256_storeu_si256(Pixels, BlendColor8(_mm256_loadu_si256(Pixels), &Terms));
+    }
+    
+    for(; Index < Count; ++Index)
+    {
+        Dest[Index] = BlendPixel(Dest[Index], Color, Mode);
+    }
+}
+
+/*
+Blends Color into pixels X1 to X2 of row Y, X2 is exclusive. Pending fast clears have to be resolved by the caller.
+Tiled buffers blend the same row of two tiles side by side as one 8 pixel register.
+*/
+static void
+BlendPixelSpan(win32_pixel_buffer *Buffer, uint32 X1, uint32 X2, uint32 Y, uint32 Color, blend_mode Mode)
+{
+    if(Mode == Blend_Opaque)
+    {
+        FillPixelSpan(Buffer, X1, X2, Y, Color);
+        return;
+    }
+    
+    uint32 *Pixels = (uint32 *)Buffer->Memory;
+    uint32 PixelIndex = GetPixelIndex(Buffer, X1, Y);
+    
+    if(!Buffer->IsTiled)
+    {
+        BlendColorSpan(Pixels + PixelIndex, X2 - X1, Color, Mode);
+        return;
+    }
+    
+    uint32 X = X1;
+    while((X < X2) && ((X & (PIXEL_TILE_WIDTH - 1)) != 0))
+    {
+        Pixels[PixelIndex] = BlendPixel(Pixels[PixelIndex], Color, Mode);
+        PixelIndex = GetNextPixelIndex(Buffer, PixelIndex, X++);
+    }
+    
+    blend_terms Terms = GetBlendTerms(_mm256_unpacklo_epi8(_mm256_set1_epi32((int32)Color), _mm256_setzero_si256()), Mode);
+    for(; (X + (2 * PIXEL_TILE_WIDTH)) <= X2; X += 2 * PIXEL_TILE_WIDTH)
+    {
+        __m128i *Left = (__m128i *)(Pixels + PixelIndex);
+        __m128i *Right = (__m128i *)(Pixels + PixelIndex + PIXEL_TILE_SIZE);
+        
+        __m256i Blended = BlendColor8(_mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128(Left)), _mm_load_si128(Right), 1), &Terms);
+        _mm_store_si128(Left, _mm256_castsi256_si128(Blended));
+        _mm_store_si128(Right, _mm256_extracti128_si256(Blended, 1));
+        
+        PixelIndex += 2 * PIXEL_TILE_SIZE;
+    }
+    
+    for(; X < X2; ++X)
+    {
+        Pixels[PixelIndex] = BlendPixel(Pixels[PixelIndex], Color, Mode);
+        PixelIndex = GetNextPixelIndex(Buffer, PixelIndex, X);
+    }
+}
+
+//Overlays and the like, Max is exclusive and the rect is clipped to the buffer
+static void
+BlendRect(win32_pixel_buffer *Buffer, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY, uint32 Color, blend_mode Mode)
+{
+    MinX = ClampInt32(MinX, 0, Buffer->Width);
+    MinY = ClampInt32(MinY, 0, Buffer->Height);
+    MaxX = ClampInt32(MaxX, 0, Buffer->Width);
+    MaxY = ClampInt32(MaxY, 0, Buffer->Height);
+    
+    if(MinX >= MaxX)
+    {
+        return;
+    }
+    
+    ResolveFastClearRect(Buffer, MinX, MinY, MaxX, MaxY);
+    
+    for(int32 Y = MinY; Y < MaxY; ++Y)
+    {
+        BlendPixelSpan(Buffer, MinX, MaxX, Y, Color, Mode);
+    }
+}
@@ -0,0 +1,20 @@
+/* date = October 19th 2026 7:25 pm */
+
+#ifndef BLEND_H
+#define BLEND_H
+
+//Frames of each blend method drawn by BenchmarkBlend
+#define BLEND_BENCHMARK_FRAMES 16
+
+/*
+Every blend mode is Result = (Dest * Factor + Addend) / 255 per channel, with 16 bit Factor and Addend.
+Addend includes the +128 that makes the divide round, so terms of a constant color are worked out once per span.
+Terms are for 16 bit channels, 4 pixels per 128 bit lane.
+*/
+typedef struct
+{
+    __m256i Factor;
+    __m256i Addend;
+}blend_terms;
+
+#endif //BLEND_H
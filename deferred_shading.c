@@ -0,0 +1,370 @@
+#include "deferred_shading.h"
+
+/*
+Deferred shading, opaque triangles are drawn in two passes:
+- The raster pass is the usual batched setup and small triangle path. Every pixel that passes the depth test gets its depth,
+  its textured color in Albedo and the face normal of its triangle in Normals, nothing is lit.
+- The lighting pass runs once over the light tiles drawn to, and lights every pixel with a normal with the lights of its tile,
+  see light_culling.c, 8 pixels at a time. Rows of light tiles are shared out to the threads of the work queue.
+Lighting then costs the same per pixel whatever the triangle count and the overdraw, and 12 bytes per pixel hold all it needs.
+Blended instances are drawn forward and lit as they rasterize, DrawMeshInstances resolves the G-buffer before the first one.
+Not for multisampled buffers, nor together with the visibility buffer, the span buffer or the depth pre-pass.
+*/
+
+static void
+ResetGBufferBounds(win32_pixel_buffer *Buffer)
+{
+    Buffer->GBuffer.MinX = Buffer->Width;
+    Buffer->GBuffer.MinY = Buffer->Height;
+    Buffer->GBuffer.MaxX = 0;
+    Buffer->GBuffer.MaxY = 0;
+}
+
+//Zeroed pages are the empty state, like the visibility buffer. Queue may be 0.
+static void
+AllocateGBuffer(win32_pixel_buffer *Buffer, work_queue *Queue)
+{
+    g_buffer *GBuffer = &Buffer->GBuffer;
+    if(GBuffer->Albedo)
+    {
+        return;
+    }
+    
+    Assert(Buffer->Multisample.SampleCount == 1);
+    Assert(!Buffer->Visibility.Ids && !Buffer->SpanBuffer.Spans);
+    
+    //Planes start on cache lines, like the pixels
+    uint64 PlaneSize = ((uint64)GetPixelCount(Buffer) * sizeof(uint32) + 63) & ~63;
+    uint8 *Planes = (uint8 *)VirtualAlloc(0, (SIZE_T)(2 * PlaneSize), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Assert(Planes);
+    
+    GBuffer->Albedo = (uint32 *)Planes;
+    GBuffer->Normals = (uint32 *)(Planes + PlaneSize);
+    GBuffer->Queue = Queue;
+    
+    ResetGBufferBounds(Buffer);
+}
+
+static void
+ReleaseGBuffer(win32_pixel_buffer *Buffer)
+{
+    if(Buffer->GBuffer.Albedo)
+    {
+        VirtualFree(Buffer->GBuffer.Albedo, 0, MEM_RELEASE);
+        Buffer->GBuffer.Albedo = 0;
+        Buffer->GBuffer.Normals = 0;
+    }
+}
+
+//Float bounding box of an opaque triangle, grown to whole pixels like GrowTransparencyBounds
+static void
+GrowGBufferBounds(win32_pixel_buffer *Buffer, real32 MinX, real32 MinY, real32 MaxX, real32 MaxY)
+{
+    g_buffer *GBuffer = &Buffer->GBuffer;
+    
+    int32 PixelMinX = (int32)fmaxf(floorf(MinX), 0.0f);
+    int32 PixelMinY = (int32)fmaxf(floorf(MinY), 0.0f);
+    int32 PixelMaxX = (int32)fminf(ceilf(MaxX) + 1.0f, (real32)Buffer->Width);
+    int32 PixelMaxY = (int32)fminf(ceilf(MaxY) + 1.0f, (real32)Buffer->Height);
+    
+    GBuffer->MinX = (PixelMinX < GBuffer->MinX) ? PixelMinX : GBuffer->MinX;
+    GBuffer->MinY = (PixelMinY < GBuffer->MinY) ? PixelMinY : GBuffer->MinY;
+    GBuffer->MaxX = (PixelMaxX > GBuffer->MaxX) ? PixelMaxX : GBuffer->MaxX;
+    GBuffer->MaxY = (PixelMaxY > GBuffer->MaxY) ? PixelMaxY : GBuffer->MaxY;
+}
+
+/*
+Octahedral encoding, the normal is projected onto the octahedron |X| + |Y| + |Z| = 1 and the half with Z < 0 is folded over the other.
+X and Y are what is left, 16 bits each. Normal does not have to be unit length, only not 0.
+*/
+inline uint32 PackNormal(vec3 Normal)
+{
+    real32 U = 0.0f;
+    real32 V = 0.0f;
+    
+    real32 Length = fabsf(Normal.X) + fabsf(Normal.Y) + fabsf(Normal.Z);
+    if(Length > 0.0f)
+    {
+        U = Normal.X / Length;
+        V = Normal.Y / Length;
+        
+        if(Normal.Z < 0.0f)
+        {
+            real32 FoldedU = (1.0f - fabsf(V)) * ((U >= 0.0f) ? 1.0f : -1.0f);
+            real32 FoldedV = (1.0f - fabsf(U)) * ((V >= 0.0f) ? 1.0f : -1.0f);
+            U = FoldedU;
+            V = FoldedV;
+        }
+    }
+    
+    uint32 PackedU = (uint32)(GBUFFER_NORMAL_BIAS + (int32)roundf(U * GBUFFER_NORMAL_SCALE));
+    uint32 PackedV = (uint32)(GBUFFER_NORMAL_BIAS + (int32)roundf(V * GBUFFER_NORMAL_SCALE));
+    
+    uint32 Result = (PackedU << 16) | PackedV;
+    return Result;
+}
+
+//Unit normal of a packed one, LightGBufferGroup unfolds 8 at a time the same way
+inline vec3 UnpackNormal(uint32 Packed)
+{
+    vec3 Result;
+    Result.X = (real32)((int32)(Packed >> 16) - GBUFFER_NORMAL_BIAS) * (1.0f / GBUFFER_NORMAL_SCALE);
+    Result.Y = (real32)((int32)(Packed & 0xFFFF) - GBUFFER_NORMAL_BIAS) * (1.0f / GBUFFER_NORMAL_SCALE);
+    Result.Z = 1.0f - fabsf(Result.X) - fabsf(Result.Y);
+    
+    if(Result.Z < 0.0f)
+    {
+        real32 X = Result.X;
+        Result.X = (1.0f - fabsf(Result.Y)) * ((X >= 0.0f) ? 1.0f : -1.0f);
+        Result.Y = (1.0f - fabsf(X)) * ((Result.Y >= 0.0f) ? 1.0f : -1.0f);
+    }
+    
+    Result = NormalizeVec3(Result);
+    return Result;
+}
+
+//One pixel of the lighting pass, for the columns of a linear buffer that do not fill a group of 8
+inline void LightGBufferPixel(win32_pixel_buffer *Buffer, uint32 PixelIndex, uint32 X, uint32 Y, bool32 IsLit)
+{
+    g_buffer *GBuffer = &Buffer->GBuffer;
+    
+    uint32 Packed = GBuffer->Normals[PixelIndex];
+    if(Packed)
+    {
+        uint32 Color = GBuffer->Albedo[PixelIndex];
+        if(IsLit)
+        {
+            Color = LightTexel(&Buffer->Lighting, Color, X, Y, 1.0f / Buffer->Depth[PixelIndex], UnpackNormal(Packed));
+        }
+        
+        ((uint32 *)Buffer->Memory)[PixelIndex] = Color;
+        GBuffer->Normals[PixelIndex] = 0;
+    }
+}
+
+/*
+LightTexel for the 8 pixels from PixelIndex on at (PixelX, PixelY), all of them in the light tile whose IndexCount lights start at Indices.
+Every light is applied to all 8 and masked off where it falls short or faces away, so the sums come out as in LightTexel.
+Pixels without a normal are left alone, the others get their normal zeroed.
+*/
+static void
+LightGBufferGroup(win32_pixel_buffer *Buffer, uint32 PixelIndex, __m256 PixelX, __m256 PixelY, uint16 *Indices, uint32 IndexCount, bool32 IsLit)
+{
+    g_buffer *GBuffer = &Buffer->GBuffer;
+    light_tiles *Lighting = &Buffer->Lighting;
+    
+    __m256i Zero = _mm256_setzero_si256();
+    __m256i Packed = _mm256_loadu_si256((__m256i *)(GBuffer->Normals + PixelIndex));
+    __m256i Unused = _mm256_cmpeq_epi32(Packed, Zero);
+    if(_mm256_movemask_ps(_mm256_castsi256_ps(Unused)) == 0xFF)
+    {
+        return;
+    }
+    
+    __m256i Texels = _mm256_loadu_si256((__m256i *)(GBuffer->Albedo + PixelIndex));
+    
+    if(IsLit)
+    {
+        __m256 One = _mm256_set1_ps(1.0f);
+        __m256 ZeroPs = _mm256_setzero_ps();
+        __m256 SignMask = _mm256_set1_ps(-0.0f);
+        __m256 Max = _mm256_set1_ps(255.0f);
+        __m256i ChannelMask = _mm256_set1_epi32(0xFF);
+        
+        //Pixels without a normal have a depth of 0, their lanes go to infinity and are masked off by the blend at the end
+        __m256 Z = _mm256_div_ps(One, _mm256_loadu_ps(Buffer->Depth + PixelIndex));
+        __m256 PositionX = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(PixelX, _mm256_set1_ps(Lighting->RasterToViewX)), _mm256_set1_ps(Lighting->ViewOffsetX)), Z);
+        __m256 PositionY = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(PixelY, _mm256_set1_ps(Lighting->RasterToViewY)), _mm256_set1_ps(Lighting->ViewOffsetY)), Z);
+        __m256 PositionZ = Z;
+        
+        //UnpackNormal, the fold keeps the sign of the other axis
+        __m256i Bias = _mm256_set1_epi32(GBUFFER_NORMAL_BIAS);
+        __m256 Scale = _mm256_set1_ps(1.0f / GBUFFER_NORMAL_SCALE);
+        __m256 NormalX = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(Packed, 16), Bias)), Scale);
+        __m256 NormalY = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_and_si256(Packed, _mm256_set1_epi32(0xFFFF)), Bias)), Scale);
+        __m256 AbsX = _mm256_andnot_ps(SignMask, NormalX);
+        __m256 AbsY = _mm256_andnot_ps(SignMask, NormalY);
+        __m256 NormalZ = _mm256_sub_ps(_mm256_sub_ps(One, AbsX), AbsY);
+        
+        __m256 IsFolded = _mm256_cmp_ps(NormalZ, ZeroPs, _CMP_LT_OQ);
+        __m256 FoldedX = _mm256_or_ps(_mm256_sub_ps(One, AbsY), _mm256_and_ps(NormalX, SignMask));
+        __m256 FoldedY = _mm256_or_ps(_mm256_sub_ps(One, AbsX), _mm256_and_ps(NormalY, SignMask));
+        NormalX = _mm256_blendv_ps(NormalX, FoldedX, IsFolded);
+        NormalY = _mm256_blendv_ps(NormalY, FoldedY, IsFolded);
+        
+        __m256 Magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(NormalX, NormalX), _mm256_mul_ps(NormalY, NormalY)), _mm256_mul_ps(NormalZ, NormalZ)));
+        NormalX = _mm256_div_ps(NormalX, Magnitude);
+        NormalY = _mm256_div_ps(NormalY, Magnitude);
+        NormalZ = _mm256_div_ps(NormalZ, Magnitude);
+        
+        __m256 Red = _mm256_set1_ps(Lighting->Ambient.X);
+        __m256 Green = _mm256_set1_ps(Lighting->Ambient.Y);
+        __m256 Blue = _mm256_set1_ps(Lighting->Ambient.Z);
+        
+        for(uint32 Index = 0; Index < IndexCount; ++Index)
+        {
+            culled_light *Light = &Lighting->Lights[Indices[Index]];
+            
+            __m256 ToLightX = _mm256_sub_ps(_mm256_set1_ps(Light->Position.X), PositionX);
+            __m256 ToLightY = _mm256_sub_ps(_mm256_set1_ps(Light->Position.Y), PositionY);
+            __m256 ToLightZ = _mm256_sub_ps(_mm256_set1_ps(Light->Position.Z), PositionZ);
+            
+            __m256 DistanceSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ToLightX, ToLightX), _mm256_mul_ps(ToLightY, ToLightY)), _mm256_mul_ps(ToLightZ, ToLightZ));
+            __m256 Falloff = _mm256_sub_ps(One, _mm256_mul_ps(DistanceSquared, _mm256_set1_ps(Light->InvRadiusSquared)));
+            __m256 Facing = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(NormalX, ToLightX), _mm256_mul_ps(NormalY, ToLightY)), _mm256_mul_ps(NormalZ, ToLightZ));
+            
+            __m256 IsReached = _mm256_and_ps(_mm256_cmp_ps(Falloff, ZeroPs, _CMP_GT_OQ), _mm256_cmp_ps(Facing, ZeroPs, _CMP_GT_OQ));
+            if(_mm256_movemask_ps(IsReached) == 0)
+            {
+                continue;
+            }
+            
+            __m256 Intensity = _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(Falloff, Falloff), Facing), _mm256_sqrt_ps(DistanceSquared));
+            Intensity = _mm256_and_ps(Intensity, IsReached);
+            
+            Red = _mm256_add_ps(Red, _mm256_mul_ps(_mm256_set1_ps(Light->Color.X), Intensity));
+            Green = _mm256_add_ps(Green, _mm256_mul_ps(_mm256_set1_ps(Light->Color.Y), Intensity));
+            Blue = _mm256_add_ps(Blue, _mm256_mul_ps(_mm256_set1_ps(Light->Color.Z), Intensity));
+        }
+        
+        //Truncated like the casts of LightTexel
+        __m256i TexelRed = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(Texels, 16), ChannelMask)), Red), Max));
+        __m256i TexelGreen = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(Texels, 8), ChannelMask)), Green), Max));
+        __m256i TexelBlue = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(Texels, ChannelMask)), Blue), Max));
+        
+        Texels = _mm256_or_si256(_mm256_or_si256(_mm256_and_si256(Texels, _mm256_set1_epi32(0xFF000000)), _mm256_slli_epi32(TexelRed, 16)),
+                                 _mm256_or_si256(_mm256_slli_epi32(TexelGreen, 8), TexelBlue));
+    }
+    
+    uint32 *Pixels = (uint32 *)Buffer->Memory;
+    __m256i *Destination = (__m256i *)(Pixels + PixelIndex);
+    _mm256_storeu_si256(Destination, _mm256_blendv_epi8(Texels, _mm256_loadu_si256(Destination), Unused));
+    _mm256_storeu_si256((__m256i *)(GBuffer->Normals + PixelIndex), Zero);
+}
+
+//Linear buffers light 8 pixels of a row at a time, tiled ones two rows of a pixel tile
+static void
+LightGBufferTile(win32_pixel_buffer *Buffer, uint32 TileX, uint32 TileY)
+{
+    light_tiles *Lighting = &Buffer->Lighting;
+    bool32 IsLit = (Lighting->LightCount > 0);
+    
+    uint16 *Indices = 0;
+    uint32 IndexCount = 0;
+    if(IsLit)
+    {
+        uint32 Tile = (TileY * Lighting->TileCountX) + TileX;
+        Indices = Lighting->Indices + Lighting->Offsets[Tile];
+        IndexCount = Lighting->Offsets[Tile + 1] - Lighting->Offsets[Tile];
+    }
+    
+    uint32 MinX = TileX << LIGHT_TILE_SHIFT;
+    uint32 MinY = TileY << LIGHT_TILE_SHIFT;
+    uint32 MaxX = ((MinX + LIGHT_TILE_SIZE) < Buffer->Width) ? (MinX + LIGHT_TILE_SIZE) : Buffer->Width;
+    uint32 MaxY = ((MinY + LIGHT_TILE_SIZE) < Buffer->Height) ? (MinY + LIGHT_TILE_SIZE) : Buffer->Height;
+    
+    if(Buffer->IsTiled)
+    {
+        uint32 MaxPixelTileX = (MaxX + PIXEL_TILE_WIDTH - 1) >> PIXEL_TILE_SHIFT;
+        uint32 MaxPixelTileY = (MaxY + PIXEL_TILE_HEIGHT - 1) >> PIXEL_TILE_SHIFT;
+        
+        __m256 TileColumns = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 0.0f, 1.0f, 2.0f, 3.0f);
+        __m256 TileRows = _mm256_setr_ps(0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f);
+        
+        for(uint32 PixelTileY = MinY >> PIXEL_TILE_SHIFT; PixelTileY < MaxPixelTileY; ++PixelTileY)
+        {
+            for(uint32 PixelTileX = MinX >> PIXEL_TILE_SHIFT; PixelTileX < MaxPixelTileX; ++PixelTileX)
+            {
+                uint32 TileIndex = ((PixelTileY * Buffer->TileCountX) + PixelTileX) * PIXEL_TILE_SIZE;
+                __m256 PixelX = _mm256_add_ps(TileColumns, _mm256_set1_ps((real32)(PixelTileX << PIXEL_TILE_SHIFT)));
+                __m256 PixelY = _mm256_add_ps(TileRows, _mm256_set1_ps((real32)(PixelTileY << PIXEL_TILE_SHIFT)));
+                
+                LightGBufferGroup(Buffer, TileIndex, PixelX, PixelY, Indices, IndexCount, IsLit);
+                LightGBufferGroup(Buffer, TileIndex + 8, PixelX, _mm256_add_ps(PixelY, _mm256_set1_ps(2.0f)), Indices, IndexCount, IsLit);
+            }
+        }
+    }
+    else
+    {
+        __m256 Columns = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        
+        for(uint32 Y = MinY; Y < MaxY; ++Y)
+        {
+            uint32 X = MinX;
+            uint32 PixelIndex = (Y * Buffer->Width) + X;
+            __m256 PixelY = _mm256_set1_ps((real32)Y);
+            
+            for(; (X + 8) <= MaxX; X += 8, PixelIndex += 8)
+            {
+                LightGBufferGroup(Buffer, PixelIndex, _mm256_add_ps(Columns, _mm256_set1_ps((real32)X)), PixelY, Indices, IndexCount, IsLit);
+            }
+            
+            for(; X < MaxX; ++X, ++PixelIndex)
+            {
+                LightGBufferPixel(Buffer, PixelIndex, X, Y, IsLit);
+            }
+        }
+    }
+}
+
+//Work queue callback, every thread of the lighting pass takes rows of light tiles until none are left. Nothing is pushed to Arena.
+static void
+LightGBufferRows(memory_arena *Arena, void *Data)
+{
+    win32_pixel_buffer *Buffer = (win32_pixel_buffer *)Data;
+    g_buffer *GBuffer = &Buffer->GBuffer;
+    
+    uint32 MinTileX = GBuffer->MinX >> LIGHT_TILE_SHIFT;
+    uint32 MaxTileX = (GBuffer->MaxX + LIGHT_TILE_SIZE - 1) >> LIGHT_TILE_SHIFT;
+    uint32 MaxTileY = (GBuffer->MaxY + LIGHT_TILE_SIZE - 1) >> LIGHT_TILE_SHIFT;
+    
+    for(;;)
+    {
+        uint32 TileY = (uint32)(InterlockedIncrement(&GBuffer->NextTileY) - 1);
+        if(TileY >= MaxTileY)
+        {
+            break;
+        }
+        
+        for(uint32 TileX = MinTileX; TileX < MaxTileX; ++TileX)
+        {
+            LightGBufferTile(Buffer, TileX, TileY);
+        }
+    }
+}
+
+/*
+Lights every pixel drawn to since the last resolve and empties the G-buffer again, GetLinearPixels does this before presenting.
+Lights have to be culled for the frame by then, without any the albedo is copied unlit.
+*/
+static void
+ResolveGBuffer(win32_pixel_buffer *Buffer)
+{
+    g_buffer *GBuffer = &Buffer->GBuffer;
+    if(!GBuffer->Albedo || (GBuffer->MinX >= GBuffer->MaxX) || (GBuffer->MinY >= GBuffer->MaxY))
+    {
+        return;
+    }
+    
+    ResolveFastClearRect(Buffer, GBuffer->MinX, GBuffer->MinY, GBuffer->MaxX, GBuffer->MaxY);
+    
+    GBuffer->NextTileY = GBuffer->MinY >> LIGHT_TILE_SHIFT;
+    
+    work_queue *Queue = GBuffer->Queue;
+    if(Queue)
+    {
+        for(uint32 ThreadIndex = 0; ThreadIndex < Queue->ThreadCount; ++ThreadIndex)
+        {
+            AddWorkQueueEntry(Queue, LightGBufferRows, Buffer);
+        }
+    }
+    
+    //The resolving thread takes rows too, then helps with whatever entries no worker has picked up yet
+    LightGBufferRows(Queue ? GetWorkQueueCallerArena(Queue) : 0, Buffer);
+    if(Queue)
+    {
+        CompleteAllWork(Queue);
+    }
+    
+    ResetGBufferBounds(Buffer);
+}
@@ -0,0 +1,12 @@
+/* date = October 19th 2026 11:10 pm */
+
+#ifndef DEFERRED_SHADING_H
+#define DEFERRED_SHADING_H
+
+//Octahedral normals are stored as 32768 + round(Value * 32767) per axis, so a stored normal is never 0
+#define GBUFFER_NORMAL_SCALE 32767.0f
+#define GBUFFER_NORMAL_BIAS 32768
+
+#define DEFERRED_BENCHMARK_FRAMES 8
+
+#endif //DEFERRED_SHADING_H
@@ -0,0 +1,31 @@
+#include "depth_prepass.h"
+
+/*
+Depth pre-pass, for buffers without a visibility buffer:
+- DrawMeshInstances submits the opaque instances twice. The depth pass steps nothing but 1/z and writes the depth of the nearest surface,
+  the color pass then textures an opaque fragment only where its 1/z is equal to that depth and leaves the depth as it is.
+- Both passes run the same setup and the same steps for 1/z, so the visible fragment meets the depth it wrote bit for bit.
+- Blended instances are only drawn in the color pass, tested against the final opaque depth as always.
+Every fragment is textured once whatever the overdraw, in exchange for transforming, sorting and rasterizing the opaque geometry twice.
+The counts of both passes give the overdraw forward drawing would have had, GetMeasuredOverdraw.
+*/
+
+static void
+ResetDepthPrePassCounts(win32_pixel_buffer *Buffer)
+{
+    Buffer->DepthPrePass.DepthFragmentCount = 0;
+    Buffer->DepthPrePass.ShadedFragmentCount = 0;
+}
+
+//Fragments that passed the depth test per visible fragment, what forward drawing textures per pixel in the same submission order
+static real32
+GetMeasuredOverdraw(win32_pixel_buffer *Buffer)
+{
+    real32 Result = 0.0f;
+    if(Buffer->DepthPrePass.ShadedFragmentCount)
+    {
+        Result = (real32)Buffer->DepthPrePass.DepthFragmentCount / (real32)Buffer->DepthPrePass.ShadedFragmentCount;
+    }
+    
+    return Result;
+}
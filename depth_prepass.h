@@ -0,0 +1,21 @@
+/* date = October 19th 2026 9:05 pm */
+
+#ifndef DEPTH_PREPASS_H
+#define DEPTH_PREPASS_H
+
+//What the raster kernels of a triangle_batch write, the batch is flushed before it changes
+typedef enum
+{
+    //Depth test, shade and write, every fragment that passes is textured
+    RasterPass_Forward,
+    
+    //Opaque triangles only, 1/z is stepped and written and nothing is textured
+    RasterPass_Depth,
+    
+    //After RasterPass_Depth, opaque triangles are only textured where their 1/z equals the depth, blended ones are drawn as in RasterPass_Forward
+    RasterPass_Color,
+}raster_pass;
+
+#define DEPTH_PREPASS_BENCHMARK_FRAMES 8
+
+#endif //DEPTH_PREPASS_H
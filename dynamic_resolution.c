@@ -0,0 +1,239 @@
+#include "dynamic_resolution.h"
+
+/*
+Dynamic resolution, frames are drawn smaller while they take too long and upscaled to the output:
+- UpdateDynamicResolution takes the time of every frame, drawing and upscaling together, into a moving average.
+- Over the high water mark of the budget the size steps down by an eighth per axis. When the average scaled to the pixel count
+  of the next size up is under the low water mark, it steps up again. Every step waits a few frames for the average to settle.
+- The caller draws into a buffer of Width x Height, and makes a new one whenever UpdateDynamicResolution reports a step.
+- UpscalePixelBuffer fills the output bilinearly a row at a time. The two source rows are blended into one, 8 pixels at a time,
+  and that row is sampled at the columns of the output with gathers.
+Drawing cost follows the pixel count, so every eighth per axis is a fifth to a quarter of it.
+*/
+
+static void
+SetDynamicResolutionSize(dynamic_resolution *Resolution, uint32 Eighths)
+{
+    Resolution->Eighths = Eighths;
+    Resolution->Width = (Resolution->OutputWidth * Eighths) / DYNAMIC_RESOLUTION_MAX_EIGHTHS;
+    Resolution->Height = (Resolution->OutputHeight * Eighths) / DYNAMIC_RESOLUTION_MAX_EIGHTHS;
+}
+
+//Starts at the full output size
+static void
+InitializeDynamicResolution(dynamic_resolution *Resolution, uint32 OutputWidth, uint32 OutputHeight, real32 BudgetSeconds)
+{
+    Resolution->OutputWidth = OutputWidth;
+    Resolution->OutputHeight = OutputHeight;
+    Resolution->BudgetSeconds = BudgetSeconds;
+    Resolution->AverageSeconds = 0.0f;
+    Resolution->SettleFrameCount = DYNAMIC_RESOLUTION_SETTLE_FRAMES;
+    Resolution->StepCount = 0;
+    
+    SetDynamicResolutionSize(Resolution, DYNAMIC_RESOLUTION_MAX_EIGHTHS);
+}
+
+//Returns true when the size has changed, frames from the next one on have to be drawn at the new Width x Height
+static bool32
+UpdateDynamicResolution(dynamic_resolution *Resolution, real32 FrameSeconds)
+{
+    //The first frame at a new size faults the pages of its buffer in, it is left out of the average
+    bool32 IsFirstFrame = (Resolution->StepCount > 0) && (Resolution->SettleFrameCount == DYNAMIC_RESOLUTION_SETTLE_FRAMES);
+    
+    if(Resolution->AverageSeconds == 0.0f)
+    {
+        Resolution->AverageSeconds = FrameSeconds;
+    }
+    else if(!IsFirstFrame)
+    {
+        Resolution->AverageSeconds += DYNAMIC_RESOLUTION_SMOOTHING * (FrameSeconds - Resolution->AverageSeconds);
+    }
+    
+    if(Resolution->SettleFrameCount > 0)
+    {
+        --Resolution->SettleFrameCount;
+        return false;
+    }
+    
+    uint32 Eighths = Resolution->Eighths;
+    real32 AverageSeconds = Resolution->AverageSeconds;
+    
+    if((AverageSeconds > (Resolution->BudgetSeconds * DYNAMIC_RESOLUTION_HIGH_WATER)) && (Eighths > DYNAMIC_RESOLUTION_MIN_EIGHTHS))
+    {
+        --Eighths;
+    }
+    else if(Eighths < DYNAMIC_RESOLUTION_MAX_EIGHTHS)
+    {
+        real32 Growth = (real32)((Eighths + 1) * (Eighths + 1)) / (real32)(Eighths * Eighths);
+        if((AverageSeconds * Growth) < (Resolution->BudgetSeconds * DYNAMIC_RESOLUTION_LOW_WATER))
+        {
+            ++Eighths;
+        }
+    }
+    
+    bool32 Result = (Eighths != Resolution->Eighths);
+    if(Result)
+    {
+        //Frame time follows the pixel count, the average carries over scaled to the new size
+        Resolution->AverageSeconds *= (real32)(Eighths * Eighths) / (real32)(Resolution->Eighths * Resolution->Eighths);
+        Resolution->SettleFrameCount = DYNAMIC_RESOLUTION_SETTLE_FRAMES;
+        ++Resolution->StepCount;
+        
+        SetDynamicResolutionSize(Resolution, Eighths);
+    }
+    
+    return Result;
+}
+
+//Per channel (A * (256 - Weight) + B * Weight) / 256, the sums fit 16 bits so red and blue, alpha and green go two at a time
+inline uint32 LerpPixel(uint32 A, uint32 B, uint32 Weight)
+{
+    uint32 InverseWeight = 256 - Weight;
+    
+    uint32 RedBlue = ((((A & 0x00FF00FF) * InverseWeight) + ((B & 0x00FF00FF) * Weight)) >> 8) & 0x00FF00FF;
+    uint32 AlphaGreen = ((((A >> 8) & 0x00FF00FF) * InverseWeight) + (((B >> 8) & 0x00FF00FF) * Weight)) & 0xFF00FF00;
+    
+    uint32 Result = RedBlue | AlphaGreen;
+    return Result;
+}
+
+//Row = LerpPixel(Above, Below, Weight) for Count pixels, channels widened to 16 bits for the multiplies
+static void
+BlendPixelRows(uint32 *Row, uint32 *Above, uint32 *Below, uint32 Count, uint32 Weight)
+{
+    __m256i Zero = _mm256_setzero_si256();
+    __m256i Weights = _mm256_set1_epi16((int16)Weight);
+    __m256i InverseWeights = _mm256_set1_epi16((int16)(256 - Weight));
+    
+    uint32 X = 0;
+    for(; (X + 8) <= Count; X += 8)
+    {
+        __m256i A = _mm256_loadu_si256((__m256i *)(Above + X));
+        __m256i B = _mm256_loadu_si256((__m256i *)(Below + X));
+        
+        __m256i Low = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(A, Zero), InverseWeights), _mm256_mullo_epi16(_mm256_unpacklo_epi8(B, Zero), Weights));
+        __m256i High = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(A, Zero), InverseWeights), _mm256_mullo_epi16(_mm256_unpackhi_epi8(B, Zero), Weights));
+        
+        _mm256_storeu_si256((__m256i *)(Row + X), _mm256_packus_epi16(_mm256_srli_epi16(Low, 8), _mm256_srli_epi16(High, 8)));
+    }
+    
+    for(; X < Count; ++X)
+    {
+        Row[X] = LerpPixel(Above[X], Below[X], Weight);
+    }
+}
+
+/*
+Destination[X] = LerpPixel(Row[Columns[X]], Row[Columns[X] + 1], Weight) for Count pixels, Row has its last pixel repeated once past the end.
+Weights holds every weight twice, in both 16 bit halves, so two unpacks spread it over the 4 channels of its pixel.
+*/
+static void
+ResampleRow(uint32 *Destination, uint32 *Row, int32 *Columns, uint32 *Weights, uint32 Count)
+{
+    __m256i Zero = _mm256_setzero_si256();
+    __m256i Full = _mm256_set1_epi16(256);
+    
+    uint32 X = 0;
+    for(; (X + 8) <= Count; X += 8)
+    {
+        __m256i Indices = _mm256_loadu_si256((__m256i *)(Columns + X));
+        __m256i Left = _mm256_i32gather_epi32((int const *)Row, Indices, 4);
+        __m256i Right = _mm256_i32gather_epi32((int const *)(Row + 1), Indices, 4);
+        
+        __m256i PixelWeights = _mm256_loadu_si256((__m256i *)(Weights + X));
+        __m256i InverseWeights = _mm256_sub_epi16(Full, PixelWeights);
+        
+        __m256i Low = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(Left, Zero), _mm256_unpacklo_epi32(InverseWeights, InverseWeights)),
+                                       _mm256_mullo_epi16(_mm256_unpacklo_epi8(Right, Zero), _mm256_unpacklo_epi32(PixelWeights, PixelWeights)));
+        __m256i High = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(Left, Zero), _mm256_unpackhi_epi32(InverseWeights, InverseWeights)),
+                                        _mm256_mullo_epi16(_mm256_unpackhi_epi8(Right, Zero), _mm256_unpackhi_epi32(PixelWeights, PixelWeights)));
+        
+        _mm256_storeu_si256((__m256i *)(Destination + X), _mm256_packus_epi16(_mm256_srli_epi16(Low, 8), _mm256_srli_epi16(High, 8)));
+    }
+    
+    for(; X < Count; ++X)
+    {
+        Destination[X] = LerpPixel(Row[Columns[X]], Row[Columns[X] + 1], Weights[X] & 0xFFFF);
+    }
+}
+
+//Source pixel left of the center of output pixel Index, and the weight of the one right of it in 256ths
+inline void GetUpscaleTap(uint32 Index, real32 Ratio, uint32 SourceCount, int32 *Tap, uint32 *Weight)
+{
+    real32 Position = fminf(fmaxf((((real32)Index + 0.5f) * Ratio) - 0.5f, 0.0f), (real32)(SourceCount - 1));
+    
+    *Tap = (int32)Position;
+    *Weight = (uint32)(((Position - (real32)*Tap) * 256.0f) + 0.5f);
+}
+
+/*
+Bilinear upscale of the final colors of Source to all of Output, which is resolved first so nothing pending lands on top later.
+Only the color of Output is written, neither its depth nor its samples.
+*/
+static void
+UpscalePixelBuffer(memory_arena *Arena, win32_pixel_buffer *Source, win32_pixel_buffer *Output)
+{
+    Assert((Source->Width <= Output->Width) && (Source->Height <= Output->Height));
+    
+    uint8 *SourcePixels = (uint8 *)GetLinearPixels(Source);
+    ResolvePixelBuffer(Output);
+    
+    temporary_memory UpscaleMemory = BeginTemporaryMemory(Arena);
+    
+    int32 *Columns = PushArray(Arena, Output->Width, int32);
+    uint32 *Weights = PushArray(Arena, Output->Width, uint32);
+    uint32 *Row = PushArray(Arena, Source->Width + 1, uint32);
+    
+    //Tiled outputs are resampled into a whole row of tiles and copied to the tiles 4 pixels at a time
+    uint32 *OutputRow = PushArray(Arena, Output->IsTiled ? (Output->TileCountX * PIXEL_TILE_WIDTH) : Output->Width, uint32);
+    
+    real32 RatioX = (real32)Source->Width / (real32)Output->Width;
+    real32 RatioY = (real32)Source->Height / (real32)Output->Height;
+    bool32 IsSameSize = ((Source->Width == Output->Width) && (Source->Height == Output->Height));
+    
+    for(uint32 X = 0; X < Output->Width; ++X)
+    {
+        uint32 Weight;
+        GetUpscaleTap(X, RatioX, Source->Width, &Columns[X], &Weight);
+        Weights[X] = Weight | (Weight << 16);
+    }
+    
+    uint32 *Pixels = (uint32 *)Output->Memory;
+    
+    for(uint32 Y = 0; Y < Output->Height; ++Y)
+    {
+        uint32 *Destination = Output->IsTiled ? OutputRow : (Pixels + (Y * Output->Width));
+        
+        if(IsSameSize)
+        {
+            uint32 *SourceRow = (uint32 *)(SourcePixels + (Y * Source->Stride));
+            for(uint32 X = 0; X < Output->Width; ++X)
+            {
+                Destination[X] = SourceRow[X];
+            }
+        }
+        else
+        {
+            int32 SourceY;
+            uint32 WeightY;
+            GetUpscaleTap(Y, RatioY, Source->Height, &SourceY, &WeightY);
+            uint32 BelowY = ((uint32)SourceY + 1 < Source->Height) ? (uint32)(SourceY + 1) : (uint32)SourceY;
+            
+            BlendPixelRows(Row, (uint32 *)(SourcePixels + (SourceY * Source->Stride)), (uint32 *)(SourcePixels + (BelowY * Source->Stride)), Source->Width, WeightY);
+            Row[Source->Width] = Row[Source->Width - 1];
+            
+            ResampleRow(Destination, Row, Columns, Weights, Output->Width);
+        }
+        
+        if(Output->IsTiled)
+        {
+            uint32 TileRowIndex = ((Y >> PIXEL_TILE_SHIFT) * Output->TileCountX * PIXEL_TILE_SIZE) + ((Y & (PIXEL_TILE_HEIGHT - 1)) * PIXEL_TILE_WIDTH);
+            for(uint32 TileX = 0; TileX < Output->TileCountX; ++TileX)
+            {
+                _mm_store_si128((__m128i *)(Pixels + TileRowIndex + (TileX * PIXEL_TILE_SIZE)), _mm_loadu_si128((__m128i *)(OutputRow + (TileX * PIXEL_TILE_WIDTH))));
+            }
+        }
+    }
+    
+    EndTemporaryMemory(UpscaleMemory);
+}
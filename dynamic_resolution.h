@@ -0,0 +1,39 @@
+/* date = October 19th 2026 11:50 pm */
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+//Render sizes per axis are 8/8 down to 4/8 of the output size
+#define DYNAMIC_RESOLUTION_MAX_EIGHTHS 8
+#define DYNAMIC_RESOLUTION_MIN_EIGHTHS 4
+
+//A frame over HIGH_WATER of the budget on average steps down, one predicted under LOW_WATER at the next size up steps up.
+//The gap between the two keeps the size from flipping back and forth.
+#define DYNAMIC_RESOLUTION_HIGH_WATER 0.95f
+#define DYNAMIC_RESOLUTION_LOW_WATER 0.75f
+
+//Weight of the newest frame in the average frame time, and frames after a step before the next one can be taken
+#define DYNAMIC_RESOLUTION_SMOOTHING 0.25f
+#define DYNAMIC_RESOLUTION_SETTLE_FRAMES 4
+
+#define DYNAMIC_RESOLUTION_BENCHMARK_FRAMES 48
+
+typedef struct
+{
+    uint32 OutputWidth;
+    uint32 OutputHeight;
+    
+    //Size frames are drawn at, Eighths / 8 of the output size per axis
+    uint32 Eighths;
+    uint32 Width;
+    uint32 Height;
+    
+    real32 BudgetSeconds;
+    real32 AverageSeconds;
+    
+    //Frames until the next step can be taken, and steps taken so far
+    uint32 SettleFrameCount;
+    uint32 StepCount;
+}dynamic_resolution;
+
+#endif //DYNAMIC_RESOLUTION_H
@@ -0,0 +1,302 @@
+#include "fill.h"
+
+/*
+Fills Count 32 bit values, colors or depths:
+- Scalar stores up to the first 32 byte boundary, then aligned 8 wide stores, then scalar stores for the rest.
+- Streaming stores skip the cache, for fills that are too big to stay in it and are not read again soon.
+  They are weakly ordered, whoever streams has to _mm_sfence before the memory is read.
+*/
+static void
+FillPixels32(uint32 *Pixels, uint64 Count, uint32 Value, bool32 IsStreaming)
+{
+    uint64 Index = 0;
+    while((Index < Count) && (((uintptr_t)(Pixels + Index) & 31) != 0))
+    {
+        Pixels[Index++] = Value;
+    }
+    
+    __m256i Wide = _mm256_set1_epi32((int32)Value);
+    if(IsStreaming)
+    {
+        for(; (Index + 8) <= Count; Index += 8)
+        {
+            _mm256_stream_si256((__m256i *)(Pixels + Index), Wide);
+        }
+    }
+    else
+    {
+        for(; (Index + 8) <= Count; Index += 8)
+        {
+            _mm256_store_si256((__m256i *)(Pixels + Index), Wide);
+        }
+    }
+    
+    while(Index < Count)
+    {
+        Pixels[Index++] = Value;
+    }
+}
+
+/*
+Fills a rectangle of Memory, Depth or the multisample colors, Max is exclusive and clamped to the buffer.
+Tiled buffers fill whole tiles, so the rectangle has to start and end on tile boundaries or the buffer edge,
+every tile row of it is then one contiguous run of memory.
+ValuesPerPixel is the sample count for arrays that keep the samples of a pixel next to each other.
+*/
+static void
+FillPixelRegion(win32_pixel_buffer *Buffer, uint32 *Pixels, uint32 ValuesPerPixel, uint32 MinX, uint32 MinY, uint32 MaxX, uint32 MaxY, uint32 Value, bool32 IsStreaming)
+{
+    if(Buffer->IsTiled)
+    {
+        uint32 MinTileX = MinX >> PIXEL_TILE_SHIFT;
+        uint32 MinTileY = MinY >> PIXEL_TILE_SHIFT;
+        uint32 MaxTileX = ClampInt32((MaxX + PIXEL_TILE_WIDTH - 1) >> PIXEL_TILE_SHIFT, 0, Buffer->TileCountX);
+        uint32 MaxTileY = ClampInt32((MaxY + PIXEL_TILE_HEIGHT - 1) >> PIXEL_TILE_SHIFT, 0, Buffer->TileCountY);
+        
+        for(uint32 TileY = MinTileY; TileY < MaxTileY; ++TileY)
+        {
+            uint32 *TileRow = Pixels + ((((TileY * Buffer->TileCountX) + MinTileX) * PIXEL_TILE_SIZE) * ValuesPerPixel);
+            FillPixels32(TileRow, (MaxTileX - MinTileX) * PIXEL_TILE_SIZE * ValuesPerPixel, Value, IsStreaming);
+        }
+    }
+    else
+    {
+        MaxX = ClampInt32(MaxX, 0, Buffer->Width);
+        MaxY = ClampInt32(MaxY, 0, Buffer->Height);
+        
+        for(uint32 Y = MinY; Y < MaxY; ++Y)
+        {
+            FillPixels32(Pixels + (((Y * Buffer->Width) + MinX) * ValuesPerPixel), (MaxX - MinX) * ValuesPerPixel, Value, IsStreaming);
+        }
+    }
+}
+
+//Colors pixels X1 to X2 of row Y, X2 is exclusive. Whole tile rows of a tiled buffer are one aligned 16 byte store.
+static void
+FillPixelSpan(win32_pixel_buffer *Buffer, uint32 X1, uint32 X2, uint32 Y, uint32 Color)
+{
+    uint32 *Pixels = (uint32 *)Buffer->Memory;
+    uint32 PixelIndex = GetPixelIndex(Buffer, X1, Y);
+    
+    if(!Buffer->IsTiled)
+    {
+        FillPixels32(Pixels + PixelIndex, X2 - X1, Color, false);
+        return;
+    }
+    
+    uint32 X = X1;
+    while((X < X2) && ((X & (PIXEL_TILE_WIDTH - 1)) != 0))
+    {
+        Pixels[PixelIndex] = Color;
+        PixelIndex = GetNextPixelIndex(Buffer, PixelIndex, X++);
+    }
+    
+    __m128i Wide = _mm_set1_epi32((int32)Color);
+    for(; (X + PIXEL_TILE_WIDTH) <= X2; X += PIXEL_TILE_WIDTH)
+    {
+        _mm_store_si128((__m128i *)(Pixels + PixelIndex), Wide);
+        PixelIndex += PIXEL_TILE_SIZE;
+    }
+    
+    while(X < X2)
+    {
+        Pixels[PixelIndex++] = Color;
+        ++X;
+    }
+}
+
+//Fills BlockCount blocks of one block row, side by side ones are one fill so linear rows stay long runs
+static void
+ResolveClearBlocks(win32_pixel_buffer *Buffer, uint32 BlockX, uint32 BlockY, uint32 BlockCount, uint8 Flags, bool32 IsStreaming)
+{
+    uint32 MinX = BlockX << CLEAR_BLOCK_SHIFT;
+    uint32 MinY = BlockY << CLEAR_BLOCK_SHIFT;
+    uint32 MaxX = MinX + (BlockCount << CLEAR_BLOCK_SHIFT);
+    uint32 MaxY = MinY + CLEAR_BLOCK_HEIGHT;
+    
+    uint32 SampleCount = Buffer->Multisample.SampleCount;
+    
+    if(Flags & CLEAR_BLOCK_COLOR)
+    {
+        FillPixelRegion(Buffer, (uint32 *)Buffer->Memory, 1, MinX, MinY, MaxX, MaxY, Buffer->ClearColor, IsStreaming);
+    }
+    
+    if(Flags & CLEAR_BLOCK_DEPTH)
+    {
+        FillPixelRegion(Buffer, (uint32 *)Buffer->Depth, SampleCount, MinX, MinY, MaxX, MaxY, 0, IsStreaming);
+    }
+    
+    if(Flags & CLEAR_BLOCK_SAMPLES)
+    {
+        FillPixelRegion(Buffer, Buffer->Multisample.Colors, SampleCount, MinX, MinY, MaxX, MaxY, Buffer->ClearColor, IsStreaming);
+    }
+}
+
+/*
+Every writer calls this with the pixels it is about to touch, Max is exclusive and may be outside the buffer.
+Pending blocks in there are filled with normal stores, so they are still in the cache when the draw reads depth and writes color.
+Costs one compare when nothing is pending.
+*/
+static void
+ResolveFastClearRect(win32_pixel_buffer *Buffer, int32 MinX, int32 MinY, int32 MaxX, int32 MaxY)
+{
+    if(Buffer->PendingClearBlockCount == 0)
+    {
+        return;
+    }
+    
+    MinX = ClampInt32(MinX, 0, Buffer->Width);
+    MinY = ClampInt32(MinY, 0, Buffer->Height);
+    MaxX = ClampInt32(MaxX, 0, Buffer->Width);
+    MaxY = ClampInt32(MaxY, 0, Buffer->Height);
+    
+    if((MinX >= MaxX) || (MinY >= MaxY))
+    {
+        return;
+    }
+    
+    uint32 MaxBlockX = (uint32)(MaxX - 1) >> CLEAR_BLOCK_SHIFT;
+    uint32 MaxBlockY = (uint32)(MaxY - 1) >> CLEAR_BLOCK_SHIFT;
+    
+    for(uint32 BlockY = (uint32)MinY >> CLEAR_BLOCK_SHIFT; BlockY <= MaxBlockY; ++BlockY)
+    {
+        uint8 *Flags = Buffer->ClearBlocks + (BlockY * Buffer->ClearBlockCountX);
+        for(uint32 BlockX = (uint32)MinX >> CLEAR_BLOCK_SHIFT; BlockX <= MaxBlockX; ++BlockX)
+        {
+            if(Flags[BlockX])
+            {
+                ResolveClearBlocks(Buffer, BlockX, BlockY, 1, Flags[BlockX], false);
+                Flags[BlockX] = 0;
+                --Buffer->PendingClearBlockCount;
+            }
+        }
+    }
+}
+
+//Same for a float bounding box of vertices, grown to whole pixels so every pixel center in it is covered
+static void
+ResolveFastClearBounds(win32_pixel_buffer *Buffer, real32 MinX, real32 MinY, real32 MaxX, real32 MaxY)
+{
+    if(Buffer->PendingClearBlockCount == 0)
+    {
+        return;
+    }
+    
+    //Clamped as floats first, vertices far off screen do not fit in an int32
+    MinX = fmaxf(floorf(MinX), 0.0f);
+    MinY = fmaxf(floorf(MinY), 0.0f);
+    MaxX = fminf(ceilf(MaxX) + 1.0f, (real32)Buffer->Width);
+    MaxY = fminf(ceilf(MaxY) + 1.0f, (real32)Buffer->Height);
+    
+    ResolveFastClearRect(Buffer, (int32)MinX, (int32)MinY, (int32)MaxX, (int32)MaxY);
+}
+
+/*
+Fills what is still pending in Flags for every block, with streaming stores since this is most of the screen at present time.
+Present only resolves the color, the depth of blocks nothing was drawn to is never written at all.
+*/
+static void
+ResolveFastClear(win32_pixel_buffer *Buffer, uint8 Flags)
+{
+    if(Buffer->PendingClearBlockCount == 0)
+    {
+        return;
+    }
+    
+    for(uint32 BlockY = 0; BlockY < Buffer->ClearBlockCountY; ++BlockY)
+    {
+        uint8 *BlockFlags = Buffer->ClearBlocks + (BlockY * Buffer->ClearBlockCountX);
+        
+        uint32 BlockX = 0;
+        while(BlockX < Buffer->ClearBlockCountX)
+        {
+            uint8 Resolved = BlockFlags[BlockX] & Flags;
+            
+            //Run of blocks that owe the same fills
+            uint32 RunEnd = BlockX + 1;
+            while((RunEnd < Buffer->ClearBlockCountX) && ((BlockFlags[RunEnd] & Flags) == Resolved))
+            {
+                ++RunEnd;
+            }
+            
+            if(Resolved)
+            {
+                ResolveClearBlocks(Buffer, BlockX, BlockY, RunEnd - BlockX, Resolved, true);
+                
+                for(; BlockX < RunEnd; ++BlockX)
+                {
+                    BlockFlags[BlockX] &= ~Resolved;
+                    if(BlockFlags[BlockX] == 0)
+                    {
+                        --Buffer->PendingClearBlockCount;
+                    }
+                }
+            }
+            
+            BlockX = RunEnd;
+        }
+    }
+    
+    _mm_sfence();
+}
+
+static void
+MarkFastClear(win32_pixel_buffer *Buffer, uint8 Flags)
+{
+    uint32 BlockCount = Buffer->ClearBlockCountX * Buffer->ClearBlockCountY;
+    for(uint32 BlockIndex = 0; BlockIndex < BlockCount; ++BlockIndex)
+    {
+        Buffer->ClearBlocks[BlockIndex] |= Flags;
+    }
+    
+    Buffer->PendingClearBlockCount = BlockCount;
+}
+
+//Color, and the sample colors of a multisampled buffer
+inline uint8 GetColorClearFlags(win32_pixel_buffer *Buffer)
+{
+    uint8 Result = CLEAR_BLOCK_COLOR;
+    
+    if(Buffer->Multisample.SampleCount > 1)
+    {
+        Result |= CLEAR_BLOCK_SAMPLES;
+    }
+    
+    return Result;
+}
+
+//A span buffer stands in for depth, emptying it is one count per scanline, see span_buffer.c
+static void
+ClearSpanBuffer(win32_pixel_buffer *Buffer)
+{
+    span_buffer *SpanBuffer = &Buffer->SpanBuffer;
+    if(SpanBuffer->Spans)
+    {
+        for(uint32 Y = 0; Y < Buffer->Height; ++Y)
+        {
+            SpanBuffer->Counts[Y] = 0;
+        }
+        
+        SpanBuffer->OverflowCount = 0;
+    }
+}
+
+/*
+Fast clear of color and depth, nothing is written here:
+- Every block is marked, the first draw that touches a block fills it through ResolveFastClearRect.
+- GetLinearPixels streams the clear color into the blocks nothing was drawn to, their samples and depth are never written.
+*/
+static void
+ClearPixelBuffer(win32_pixel_buffer *Buffer, uint32 Color)
+{
+    Buffer->ClearColor = Color;
+    MarkFastClear(Buffer, GetColorClearFlags(Buffer) | CLEAR_BLOCK_DEPTH);
+    ClearSpanBuffer(Buffer);
+}
+
+static void
+ClearDepthBuffer(win32_pixel_buffer *Buffer)
+{
+    MarkFastClear(Buffer, CLEAR_BLOCK_DEPTH);
+    ClearSpanBuffer(Buffer);
+}
@@ -0,0 +1,19 @@
+/* date = October 19th 2026 6:40 pm */
+
+#ifndef FILL_H
+#define FILL_H
+
+//Fast clears track blocks of 32 x 32 pixels, a whole number of tiles in both layouts
+#define CLEAR_BLOCK_SHIFT 5
+#define CLEAR_BLOCK_WIDTH (1 << CLEAR_BLOCK_SHIFT)
+#define CLEAR_BLOCK_HEIGHT (1 << CLEAR_BLOCK_SHIFT)
+
+//What a block still owes the buffer before anything is drawn to it
+#define CLEAR_BLOCK_COLOR 0x1
+#define CLEAR_BLOCK_DEPTH 0x2
+#define CLEAR_BLOCK_SAMPLES 0x4
+
+//Frames cleared with each method by BenchmarkClear
+#define CLEAR_BENCHMARK_FRAMES 16
+
+#endif //FILL_H
@@ -0,0 +1,257 @@
+#include "light_culling.h"
+
+/*
+Tiled forward+ lighting with point lights:
+- Lights are kept in a light_list, CullLights runs once per frame after they have moved and before anything lit is drawn.
+- Culling projects the bounding box of every light sphere to the screen, conservatively, and lists the light in every tile it covers.
+  Lights behind the near plane or past the far plane are dropped, lights crossing the near plane cover the whole screen.
+- The lists are compact, counted first, prefix summed into offsets and filled after, so the lights of a tile are next to each other.
+- The shading kernels light a texel with the lights of its tile only, at the camera relative position of the pixel rebuilt from its
+  distance and the face normal of the triangle. Shading cost follows the lights per tile, not the lights in the scene.
+The batched, small triangle, depth pre-pass and span buffer kernels are lit, the visibility buffer and multisampling shade unlit.
+*/
+
+static void
+InitializeLightList(light_list *List, memory_arena *Arena, uint32 MaxCount)
+{
+    Assert(MaxCount <= LIGHT_MAX_COUNT);
+    
+    List->Lights = PushArray(Arena, MaxCount, point_light);
+    List->Count = 0;
+    List->MaxCount = MaxCount;
+    List->Ambient = (vec3){0.0f, 0.0f, 0.0f};
+}
+
+//Returns the new light to be moved around later, or 0 when the list is full
+static point_light *
+AddPointLight(light_list *List, vec3 Position, real32 Radius, vec3 Color)
+{
+    point_light *Result = 0;
+    
+    if(List->Count < List->MaxCount)
+    {
+        Result = &List->Lights[List->Count++];
+        Result->Position = Position;
+        Result->Radius = Radius;
+        Result->Color = Color;
+    }
+    
+    return Result;
+}
+
+static void
+AllocateLightTiles(win32_pixel_buffer *Buffer, uint32 MaxLightCount)
+{
+    light_tiles *Lighting = &Buffer->Lighting;
+    if(Lighting->Offsets)
+    {
+        return;
+    }
+    
+    Assert(MaxLightCount <= LIGHT_MAX_COUNT);
+    
+    Lighting->TileCountX = (Buffer->Width + LIGHT_TILE_SIZE - 1) >> LIGHT_TILE_SHIFT;
+    Lighting->TileCountY = (Buffer->Height + LIGHT_TILE_SIZE - 1) >> LIGHT_TILE_SHIFT;
+    
+    uint32 TileCount = Lighting->TileCountX * Lighting->TileCountY;
+    Lighting->Offsets = (uint32 *)VirtualAlloc(0, (TileCount + 1) * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Lighting->Indices = (uint16 *)VirtualAlloc(0, LIGHT_MAX_INDEX_COUNT * sizeof(uint16), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Lighting->Lights = (culled_light *)VirtualAlloc(0, MaxLightCount * sizeof(culled_light), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Assert(Lighting->Offsets && Lighting->Indices && Lighting->Lights);
+    
+    Lighting->LightCount = 0;
+    Lighting->MaxLightCount = MaxLightCount;
+    Lighting->DroppedLightCount = 0;
+}
+
+static void
+ReleaseLightTiles(win32_pixel_buffer *Buffer)
+{
+    light_tiles *Lighting = &Buffer->Lighting;
+    if(Lighting->Offsets)
+    {
+        VirtualFree(Lighting->Offsets, 0, MEM_RELEASE);
+        VirtualFree(Lighting->Indices, 0, MEM_RELEASE);
+        VirtualFree(Lighting->Lights, 0, MEM_RELEASE);
+        Lighting->Offsets = 0;
+        Lighting->Indices = 0;
+        Lighting->Lights = 0;
+        Lighting->LightCount = 0;
+    }
+}
+
+/*
+Largest and smallest X / Z of a box from Center - Radius to Center + Radius, both in front of the camera.
+A positive X is largest at the nearest Z and a negative one at the farthest, and the other way around for the smallest.
+*/
+inline void GetProjectedRange(real32 Center, real32 CenterZ, real32 Radius, real32 *Min, real32 *Max)
+{
+    real32 High = Center + Radius;
+    real32 Low = Center - Radius;
+    
+    *Max = High / ((High > 0.0f) ? (CenterZ - Radius) : (CenterZ + Radius));
+    *Min = Low / ((Low < 0.0f) ? (CenterZ - Radius) : (CenterZ + Radius));
+}
+
+/*
+Builds the tile lists of the buffer for the lights of List as seen from View. Lights are numbered in list order,
+a tile lists them in that order. Without any light in List the buffer is drawn unlit again.
+*/
+static void
+CullLights(win32_pixel_buffer *Buffer, view *View, light_list *List)
+{
+    light_tiles *Lighting = &Buffer->Lighting;
+    Assert(Lighting->Offsets != 0);
+    Assert(List->Count <= Lighting->MaxLightCount);
+    
+    //Inverse of ProjectToRaster at a distance of 1
+    real32 ProjectionX = View->ScaleX * View->Projection.M[0][0];
+    real32 ProjectionY = View->ScaleY * View->Projection.M[1][1];
+    Lighting->RasterToViewX = 1.0f / (View->HalfWidth * ProjectionX);
+    Lighting->RasterToViewY = -1.0f / (View->HalfHeight * ProjectionY);
+    Lighting->ViewOffsetX = -1.0f / ProjectionX;
+    Lighting->ViewOffsetY = 1.0f / ProjectionY;
+    Lighting->Ambient = List->Ambient;
+    
+    uint32 TileCount = Lighting->TileCountX * Lighting->TileCountY;
+    uint32 *Offsets = Lighting->Offsets;
+    for(uint32 Tile = 0; Tile <= TileCount; ++Tile)
+    {
+        Offsets[Tile] = 0;
+    }
+    
+    //Rectangles and counts per tile, Offsets[Tile] counts the lights of Tile for now
+    uint32 IndexCount = 0;
+    Lighting->LightCount = 0;
+    Lighting->DroppedLightCount = 0;
+    
+    for(uint32 LightIndex = 0; LightIndex < List->Count; ++LightIndex)
+    {
+        point_light *Light = &List->Lights[LightIndex];
+        vec3 Center = SubtractVec3(Light->Position, View->CameraPos);
+        real32 Radius = Light->Radius;
+        
+        if(((Center.Z + Radius) <= View->NearZ) || ((Center.Z - Radius) >= View->FarZ) || (Radius <= 0.0f))
+        {
+            continue;
+        }
+        
+        real32 MinRasterX = 0.0f;
+        real32 MinRasterY = 0.0f;
+        real32 MaxRasterX = (real32)Buffer->Width;
+        real32 MaxRasterY = (real32)Buffer->Height;
+        
+        if((Center.Z - Radius) > View->NearZ)
+        {
+            real32 MinX, MaxX, MinY, MaxY;
+            GetProjectedRange(Center.X, Center.Z, Radius, &MinX, &MaxX);
+            GetProjectedRange(Center.Y, Center.Z, Radius, &MinY, &MaxY);
+            
+            //Raster Y grows downwards
+            MinRasterX = fmaxf(MinRasterX, ((ProjectionX * MinX) + 1.0f) * View->HalfWidth);
+            MaxRasterX = fminf(MaxRasterX, ((ProjectionX * MaxX) + 1.0f) * View->HalfWidth);
+            MinRasterY = fmaxf(MinRasterY, ((-ProjectionY * MaxY) + 1.0f) * View->HalfHeight);
+            MaxRasterY = fminf(MaxRasterY, ((-ProjectionY * MinY) + 1.0f) * View->HalfHeight);
+        }
+        
+        if((MinRasterX > MaxRasterX) || (MinRasterY > MaxRasterY))
+        {
+            continue;
+        }
+        
+        uint32 MaxTileX = (uint32)ceilf(MaxRasterX) >> LIGHT_TILE_SHIFT;
+        uint32 MaxTileY = (uint32)ceilf(MaxRasterY) >> LIGHT_TILE_SHIFT;
+        
+        culled_light *Culled = &Lighting->Lights[Lighting->LightCount];
+        Culled->MinTileX = (uint16)((uint32)MinRasterX >> LIGHT_TILE_SHIFT);
+        Culled->MinTileY = (uint16)((uint32)MinRasterY >> LIGHT_TILE_SHIFT);
+        Culled->MaxTileX = (uint16)((MaxTileX < Lighting->TileCountX) ? MaxTileX : (Lighting->TileCountX - 1));
+        Culled->MaxTileY = (uint16)((MaxTileY < Lighting->TileCountY) ? MaxTileY : (Lighting->TileCountY - 1));
+        
+        uint32 CoveredCount = (Culled->MaxTileX - Culled->MinTileX + 1) * (Culled->MaxTileY - Culled->MinTileY + 1);
+        if((IndexCount + CoveredCount) > LIGHT_MAX_INDEX_COUNT)
+        {
+            ++Lighting->DroppedLightCount;
+            continue;
+        }
+        IndexCount += CoveredCount;
+        
+        Culled->Position = Center;
+        Culled->InvRadiusSquared = 1.0f / (Radius * Radius);
+        Culled->Color = Light->Color;
+        
+        for(uint32 TileY = Culled->MinTileY; TileY <= Culled->MaxTileY; ++TileY)
+        {
+            for(uint32 TileX = Culled->MinTileX; TileX <= Culled->MaxTileX; ++TileX)
+            {
+                ++Offsets[(TileY * Lighting->TileCountX) + TileX];
+            }
+        }
+        
+        ++Lighting->LightCount;
+    }
+    
+    //Offsets[Tile] becomes the end of the list of Tile, the fill below moves it back to the start
+    uint32 End = 0;
+    for(uint32 Tile = 0; Tile < TileCount; ++Tile)
+    {
+        End += Offsets[Tile];
+        Offsets[Tile] = End;
+    }
+    Offsets[TileCount] = End;
+    
+    //Filled back to front, so every list ends up in light order
+    for(uint32 LightIndex = Lighting->LightCount; LightIndex > 0; --LightIndex)
+    {
+        culled_light *Culled = &Lighting->Lights[LightIndex - 1];
+        for(uint32 TileY = Culled->MinTileY; TileY <= Culled->MaxTileY; ++TileY)
+        {
+            for(uint32 TileX = Culled->MinTileX; TileX <= Culled->MaxTileX; ++TileX)
+            {
+                Lighting->Indices[--Offsets[(TileY * Lighting->TileCountX) + TileX]] = (uint16)(LightIndex - 1);
+            }
+        }
+    }
+}
+
+/*
+Texel lit by the lights of the tile of the pixel (X, Y), Z is the distance of the pixel and Normal the unit normal facing the camera.
+Light per light is Color * (1 - d^2 / r^2)^2 * max(dot(Normal, L), 0), alpha is left as it is.
+*/
+inline uint32 LightTexel(light_tiles *Lighting, uint32 Texel, uint32 X, uint32 Y, real32 Z, vec3 Normal)
+{
+    vec3 Position;
+    Position.X = (((real32)X * Lighting->RasterToViewX) + Lighting->ViewOffsetX) * Z;
+    Position.Y = (((real32)Y * Lighting->RasterToViewY) + Lighting->ViewOffsetY) * Z;
+    Position.Z = Z;
+    
+    real32 Red = Lighting->Ambient.X;
+    real32 Green = Lighting->Ambient.Y;
+    real32 Blue = Lighting->Ambient.Z;
+    
+    uint32 Tile = ((Y >> LIGHT_TILE_SHIFT) * Lighting->TileCountX) + (X >> LIGHT_TILE_SHIFT);
+    uint32 End = Lighting->Offsets[Tile + 1];
+    for(uint32 Index = Lighting->Offsets[Tile]; Index < End; ++Index)
+    {
+        culled_light *Light = &Lighting->Lights[Lighting->Indices[Index]];
+        vec3 ToLight = SubtractVec3(Light->Position, Position);
+        real32 DistanceSquared = DotVec3(ToLight, ToLight);
+        real32 Falloff = 1.0f - (DistanceSquared * Light->InvRadiusSquared);
+        real32 Facing = DotVec3(Normal, ToLight);
+        
+        if((Falloff > 0.0f) && (Facing > 0.0f))
+        {
+            real32 Intensity = Falloff * Falloff * Facing / sqrtf(DistanceSquared);
+            Red += Light->Color.X * Intensity;
+            Green += Light->Color.Y * Intensity;
+            Blue += Light->Color.Z * Intensity;
+        }
+    }
+    
+    real32 TexelRed = fminf((real32)((Texel >> 16) & 0xFF) * Red, 255.0f);
+    real32 TexelGreen = fminf((real32)((Texel >> 8) & 0xFF) * Green, 255.0f);
+    real32 TexelBlue = fminf((real32)(Texel & 0xFF) * Blue, 255.0f);
+    
+    uint32 Result = (Texel & 0xFF000000) | ((uint32)TexelRed << 16) | ((uint32)TexelGreen << 8) | (uint32)TexelBlue;
+    return Result;
+}
@@ -0,0 +1,18 @@
+/* date = October 19th 2026 10:30 pm */
+
+#ifndef LIGHT_CULLING_H
+#define LIGHT_CULLING_H
+
+//Screen tiles of 16 x 16 pixels have a light list each
+#define LIGHT_TILE_SHIFT 4
+#define LIGHT_TILE_SIZE (1 << LIGHT_TILE_SHIFT)
+
+//Light indices of all tiles together, a light that does not fit any more is left out of every tile
+#define LIGHT_MAX_INDEX_COUNT (1 << 20)
+
+//Indices into the lights are 16 bits
+#define LIGHT_MAX_COUNT 65535
+
+#define LIGHT_BENCHMARK_FRAMES 8
+
+#endif //LIGHT_CULLING_H
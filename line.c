@@ -5,6 +5,9 @@ static void DrawLineBresenham(win32_pixel_buffer *Buffer, vec2 VectorA, vec2 Vec
     vec2 SourceCoord = Vec2CoordToScreenCoord(Buffer, VectorA);
     vec2 DestCoord = Vec2CoordToScreenCoord(Buffer, VectorB);
     
+    ResolveFastClearBounds(Buffer, fminf(SourceCoord.X, DestCoord.X), fminf(SourceCoord.Y, DestCoord.Y),
+                           fmaxf(SourceCoord.X, DestCoord.X), fmaxf(SourceCoord.Y, DestCoord.Y));
+    
     uint32 SourceX = RoundReal32ToUInt32(SourceCoord.X);
     uint32 SourceY = RoundReal32ToUInt32(SourceCoord.Y);
     uint32 DestX = RoundReal32ToUInt32(DestCoord.X);
@@ -19,7 +22,7 @@ static void DrawLineBresenham(win32_pixel_buffer *Buffer, vec2 VectorA, vec2 Vec
         
         for(uint32 X = SourceX; X <= DestX; ++X)
         {
-            uint32 *Pixel = (uint32 *)((uint8 *)Buffer->Memory + (SourceY * Buffer->Stride) + (X * Buffer->BytesPerPixel));
+            uint32 *Pixel = GetPixel(Buffer, X, SourceY);
             *Pixel = Color;
         }
         
@@ -54,11 +57,11 @@ static void DrawLineBresenham(win32_pixel_buffer *Buffer, vec2 VectorA, vec2 Vec
         uint32 *Pixel;
         if(IsSteep)
         {
-            Pixel = (uint32 *)((uint8 *)Buffer->Memory + (PixelX * Buffer->Stride) + (PixelY * Buffer->BytesPerPixel));
+            Pixel = GetPixel(Buffer, PixelY, PixelX);
         }
         else
         {
-            Pixel = (uint32 *)((uint8 *)Buffer->Memory + (PixelY * Buffer->Stride) + (PixelX * Buffer->BytesPerPixel));
+            Pixel = GetPixel(Buffer, PixelX, PixelY);
         }
         
         *Pixel = Color;
@@ -87,6 +90,8 @@ DrawLineMidPoint(win32_pixel_buffer *Buffer, vec2 VectorA, vec2 VectorB,
     vec2 SourceCoord = Vec2CoordToScreenCoord(Buffer, VectorA);
     vec2 DestCoord = Vec2CoordToScreenCoord(Buffer, VectorB);
     
+    ResolveFastClearBounds(Buffer, fminf(SourceCoord.X, DestCoord.X), fminf(SourceCoord.Y, DestCoord.Y),
+                           fmaxf(SourceCoord.X, DestCoord.X), fmaxf(SourceCoord.Y, DestCoord.Y));
     
     uint32 SourceX = RoundReal32ToUInt32(SourceCoord.X);
     uint32 SourceY = RoundReal32ToUInt32(SourceCoord.Y);
@@ -127,11 +132,11 @@ DrawLineMidPoint(win32_pixel_buffer *Buffer, vec2 VectorA, vec2 VectorB,
         
         if(IsSteep)
         {
-            Pixel = (uint32 *)((uint8 *)Buffer->Memory + (X * Buffer->Stride) + (Y * Buffer->BytesPerPixel));
+            Pixel = GetPixel(Buffer, Y, X);
         }
         else
         {
-            Pixel = (uint32 *)((uint8 *)Buffer->Memory + (Y * Buffer->Stride) + (X * Buffer->BytesPerPixel));
+            Pixel = GetPixel(Buffer, X, Y);
         }
         
         *Pixel = Color;
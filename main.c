@@ -2,39 +2,135 @@
 #include "stdint.h"
 #include "stdio.h"
 #include "math.h"
+#include "immintrin.h"
 
 #include "main.h"
 #include "renderer_utilities.c"
+#include "profiler.c"
+#include "work_queue.c"
+#include "fill.c"
+#include "blend.c"
+#include "transparency.c"
 
-#include "obj_parser.c"
 #include "vector.c"
+#include "weld.c"
+#include "obj_parser.c"
 #include "line.c"
 #include "random.h"
+#include "meshlet.c"
+#include "vertex_cache.c"
+#include "simplify.c"
+#include "quantize.c"
 #include "perspective_texture_map.c"
+#include "visibility.c"
+#include "depth_prepass.c"
+#include "light_culling.c"
+#include "multisample.c"
+#include "deferred_shading.c"
+#include "span_buffer.c"
+#include "raster_kernel.c"
+#include "small_triangle.c"
+#include "triangle_setup.c"
+#include "occlusion.c"
+#include "scene.c"
+#include "streaming.c"
+#include "tiled_buffer.c"
+#include "dynamic_resolution.c"
 
 static bool32 GlobalRunning;
 static win32_pixel_buffer GlobalPixelBuffer;
 static LARGE_INTEGER GlobalPerfFrequency;
 
+//Started once in WinMain, passes that split across threads add their entries here
+static work_queue GlobalWorkQueue;
+
+//Tiled buffers are padded to whole tiles, the window is shown the detiled copy with the padding cropped off.
+//SampleCount is 1, or MULTISAMPLE_COUNT for a multisampled buffer.
 static void 
-InitializeBitmapInfo(win32_pixel_buffer *Buffer, int32 Width, int32 Height)
+InitializeBitmapInfo(win32_pixel_buffer *Buffer, int32 Width, int32 Height, bool32 IsTiled, uint32 SampleCount, bool32 UseLargePages)
 {
+    Buffer->Width = Width;
+    Buffer->Height = Height;
+    Buffer->BytesPerPixel = 4;
+    Buffer->Stride = Buffer->Width * Buffer->BytesPerPixel;
+    
+    Buffer->IsTiled = IsTiled;
+    Buffer->TileCountX = (Width + PIXEL_TILE_WIDTH - 1) / PIXEL_TILE_WIDTH;
+    Buffer->TileCountY = (Height + PIXEL_TILE_HEIGHT - 1) / PIXEL_TILE_HEIGHT;
+    Buffer->LinearMemory = 0;
+    
+    int32 BitmapWidth = Width;
+    int32 BitmapHeight = Height;
+    if(IsTiled)
+    {
+        BitmapWidth = Buffer->TileCountX * PIXEL_TILE_WIDTH;
+        BitmapHeight = Buffer->TileCountY * PIXEL_TILE_HEIGHT;
+        Buffer->Stride = BitmapWidth * Buffer->BytesPerPixel;
+    }
+    
     BITMAPINFOHEADER *BitmapInfoHeader = &Buffer->BitmapInfo.bmiHeader;
     
     BitmapInfoHeader->biSize = sizeof(BITMAPINFOHEADER);
-    BitmapInfoHeader->biWidth = Width;
-    BitmapInfoHeader->biHeight = -Height;
+    BitmapInfoHeader->biWidth = BitmapWidth;
+    BitmapInfoHeader->biHeight = -BitmapHeight;
     BitmapInfoHeader->biPlanes = 1;
     BitmapInfoHeader->biBitCount = 32;
     BitmapInfoHeader->biCompression = BI_RGB;
     
-    Buffer->Width = Width;
-    Buffer->Height = Height;
-    Buffer->BytesPerPixel = 4;
-    Buffer->Stride = Buffer->Width * Buffer->BytesPerPixel;
+    uint64 PixelCount = GetPixelCount(Buffer);
+    Buffer->Memory = AllocatePixelMemory(PixelCount * Buffer->BytesPerPixel, UseLargePages);
+    Buffer->Depth = (real32 *)AllocatePixelMemory(PixelCount * SampleCount * sizeof(real32), UseLargePages);
     
-    uint32 BufferSize = Buffer->Height * Buffer->Stride;
-    Buffer->Memory = VirtualAlloc(0, BufferSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Buffer->Multisample.SampleCount = SampleCount;
+    Buffer->Multisample.Colors = 0;
+    if(SampleCount > 1)
+    {
+        Buffer->Multisample.Colors = (uint32 *)AllocatePixelMemory(PixelCount * SampleCount * sizeof(uint32), UseLargePages);
+    }
+    ResetMultisampleBounds(Buffer);
+    
+    if(IsTiled)
+    {
+        Buffer->LinearMemory = AllocatePixelMemory(PixelCount * Buffer->BytesPerPixel, false);
+    }
+    
+    //Zeroed, nothing is pending until the first clear
+    Buffer->ClearBlockCountX = (BitmapWidth + CLEAR_BLOCK_WIDTH - 1) >> CLEAR_BLOCK_SHIFT;
+    Buffer->ClearBlockCountY = (BitmapHeight + CLEAR_BLOCK_HEIGHT - 1) >> CLEAR_BLOCK_SHIFT;
+    Buffer->ClearBlocks = (uint8 *)VirtualAlloc(0, Buffer->ClearBlockCountX * Buffer->ClearBlockCountY, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Buffer->PendingClearBlockCount = 0;
+    Buffer->ClearColor = 0;
+    Buffer->Transparency.Red = 0;
+    Buffer->Visibility.Ids = 0;
+    Buffer->DepthPrePass.IsEnabled = false;
+    Buffer->SpanBuffer.Spans = 0;
+    Buffer->Lighting.Offsets = 0;
+    Buffer->Lighting.LightCount = 0;
+    Buffer->GBuffer.Albedo = 0;
+    ResetDepthPrePassCounts(Buffer);
+}
+
+static void
+ReleasePixelBuffer(win32_pixel_buffer *Buffer)
+{
+    VirtualFree(Buffer->Memory, 0, MEM_RELEASE);
+    VirtualFree(Buffer->Depth, 0, MEM_RELEASE);
+    VirtualFree(Buffer->ClearBlocks, 0, MEM_RELEASE);
+    ReleaseTransparencyBuffer(Buffer);
+    ReleaseVisibilityBuffer(Buffer);
+    ReleaseSpanBuffer(Buffer);
+    ReleaseLightTiles(Buffer);
+    ReleaseGBuffer(Buffer);
+    
+    if(Buffer->Multisample.Colors)
+    {
+        VirtualFree(Buffer->Multisample.Colors, 0, MEM_RELEASE);
+    }
+    
+    if(Buffer->LinearMemory)
+    {
+        VirtualFree(Buffer->LinearMemory, 0, MEM_RELEASE);
+    }
 }
 
 static void DrawPixelOnly(win32_pixel_buffer *Buffer, vec2 Vector, uint32 Color)
@@ -42,7 +138,8 @@ static void DrawPixelOnly(win32_pixel_buffer *Buffer, vec2 Vector, uint32 Color)
     uint32 X = RoundReal32ToUInt32(Vector.X);
     uint32 Y = RoundReal32ToUInt32(Vector.Y);
     
-    uint32 *Pixel = (uint32 *)((uint8 *)Buffer->Memory + (Y * Buffer->Stride) + (X * Buffer->BytesPerPixel));
+    ResolveFastClearRect(Buffer, X, Y, X + 1, Y + 1);
+    uint32 *Pixel = GetPixel(Buffer, X, Y);
     
     *Pixel = Color;
 }
@@ -121,7 +218,8 @@ static void DrawPixel(win32_pixel_buffer *Buffer, vec2 Vector, uint32 Color)
     uint32 X = RoundReal32ToUInt32(ScreenCoord.X);
     uint32 Y = RoundReal32ToUInt32(ScreenCoord.Y);
     
-    uint32 *Pixel = (uint32 *)((uint8 *)Buffer->Memory + (Y * Buffer->Stride) + (X * Buffer->BytesPerPixel));
+    ResolveFastClearRect(Buffer, X, Y, X + 1, Y + 1);
+    uint32 *Pixel = GetPixel(Buffer, X, Y);
     
     *Pixel = Color;
 }
@@ -133,15 +231,18 @@ static void DrawRect(win32_pixel_buffer *Buffer, vec2 LeftTop, vec2 RightBottom,
     int32 MaxX = (int32)RightBottom.X;
     int32 MaxY = (int32)RightBottom.Y;
     
-    uint8 *Row = (uint8 *)Buffer->Memory + (MinY * Buffer->Stride) + (MinX * Buffer->BytesPerPixel);
+    //A rect over the whole buffer is a fast clear of the color, the depth is left as it is
+    if((MinX <= 0) && (MinY <= 0) && (MaxX >= (int32)Buffer->Width) && (MaxY >= (int32)Buffer->Height))
+    {
+        Buffer->ClearColor = Color;
+        MarkFastClear(Buffer, GetColorClearFlags(Buffer));
+        return;
+    }
+    
+    ResolveFastClearRect(Buffer, MinX, MinY, MaxX, MaxY);
     for(int32 Y = MinY; Y < MaxY; ++Y)
     {
-        uint32 *Pixel = (uint32 *)Row;
-        for(int32 X = MinX; X < MaxX; ++X)
-        {
-            *Pixel++ = Color;
-        }
-        Row += Buffer->Stride;
+        FillPixelSpan(Buffer, MinX, MaxX, Y, Color);
     }
 }
 
@@ -157,6 +258,8 @@ DrawTriangle(win32_pixel_buffer *Buffer, vec2 PointA, vec2 PointB, vec2 PointC,
 static void
 Win32UpdateWindow(win32_pixel_buffer *Buffer, HDC DeviceContext, uint32 WindowWidth, uint32 WindowHeight)
 {
+    void *Pixels = GetLinearPixels(Buffer);
+    
     StretchDIBits(
                   DeviceContext,
                   0,
@@ -167,7 +270,7 @@ Win32UpdateWindow(win32_pixel_buffer *Buffer, HDC DeviceContext, uint32 WindowWi
                   0,
                   Buffer->Width,
                   Buffer->Height,
-                  Buffer->Memory,
+                  Pixels,
                   &Buffer->BitmapInfo,
                   DIB_RGB_COLORS,
                   SRCCOPY
@@ -200,6 +303,7 @@ LRESULT Win32WindowProcedure(
 
 static void ReadBitmap(file *File, char *FileName)
 {
+    BEGIN_PROFILE_ZONE(Load);
     HANDLE FileHandle = CreateFileA(FileName,
                                     GENERIC_READ,
                                     FILE_SHARE_READ,
@@ -214,11 +318,27 @@ static void ReadBitmap(file *File, char *FileName)
         
         if(GetFileSizeEx(FileHandle, &Size))
         {
-            File->Size = (uint32)Size.QuadPart;
+            File->Size = (uint64)Size.QuadPart;
+            
+            File->Contents = VirtualAlloc(0, (SIZE_T)File->Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
             
-            File->Contents = VirtualAlloc(0, File->Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-            DWORD BytesRead;
-            if(ReadFile(FileHandle, File->Contents, File->Size, &BytesRead, 0) && (File->Size == BytesRead))
+            //ReadFile takes a 32 bit size, so files of 4 GB and more are read in pieces
+            uint64 TotalRead = 0;
+            while(TotalRead < File->Size)
+            {
+                uint64 BytesLeft = File->Size - TotalRead;
+                DWORD BytesToRead = (BytesLeft > GIGABYTE(1)) ? (DWORD)GIGABYTE(1) : (DWORD)BytesLeft;
+                
+                DWORD BytesRead;
+                if(!ReadFile(FileHandle, (uint8 *)File->Contents + TotalRead, BytesToRead, &BytesRead, 0) || (BytesRead != BytesToRead))
+                {
+                    break;
+                }
+                
+                TotalRead += BytesRead;
+            }
+            
+            if(TotalRead == File->Size)
             {
                 CloseHandle(FileHandle);
             }
@@ -226,6 +346,7 @@ static void ReadBitmap(file *File, char *FileName)
         
         
     }
+    END_PROFILE_ZONE(Load);
 }
 
 static void
@@ -255,7 +376,7 @@ static void
 SaveBitmap(win32_pixel_buffer *Buffer, bitmap_header *BitmapHeader, uint32 *BitmapBits, char *FileName)
 {
     uint32 *Bits = BitmapBits;
-    uint8 *Row = (uint8 *)Buffer->Memory;
+    uint8 *Row = (uint8 *)GetLinearPixels(Buffer);
     for(int32 Y = 0; Y < BitmapHeader->Height; ++Y)
     {
         uint32 *Pixel = (uint32 *)Row;
@@ -271,50 +392,33 @@ SaveBitmap(win32_pixel_buffer *Buffer, bitmap_header *BitmapHeader, uint32 *Bitm
 
 
 
+/*
+Blends SourceColor over every GridWidth-th column and GridHeight-th row.
+Grid rows are one blended span each, the rows in between only blend the pixels on the grid columns, so no pixel is blended twice.
+*/
 static void
 DrawGrid(win32_pixel_buffer *Buffer, uint32 GridWidth, uint32 GridHeight, uint32 SourceColor)
 {
-    uint8* Row = (uint8*)Buffer->Memory;
-    
-    uint32 AlphaBitScan = 24;
-    uint32 RedBitScan = 16;
-    uint32 GreenBitScan = 8;
-    uint32 BlueBitScan = 0;
+    ResolveFastClearRect(Buffer, 0, 0, Buffer->Width, Buffer->Height);
     
-    uint32 AlphaMask = (0xFF << AlphaBitScan);
-    uint32 RedMask = (0xFF << RedBitScan);
-    uint32 GreenMask = (0xFF << GreenBitScan);
-    uint32 BlueMask = (0xFF << BlueBitScan);
+    uint32 *Pixels = (uint32 *)Buffer->Memory;
+    uint32 RowsToGridRow = GridHeight;
     
-    for(uint32 Y = 1; Y <= Buffer->Height; ++Y)
+    for(uint32 Y = 0; Y < Buffer->Height; ++Y)
     {
-        uint32 *Pixel = (uint32 *)Row; 
-        for(uint32 X = 1; X <= Buffer->Width; ++X)
+        if(--RowsToGridRow == 0)
         {
-            if(X % GridWidth == 0 || Y % GridHeight == 0)
+            BlendPixelSpan(Buffer, 0, Buffer->Width, Y, SourceColor, Blend_SourceOver);
+            RowsToGridRow = GridHeight;
+        }
+        else
+        {
+            for(uint32 X = GridWidth - 1; X < Buffer->Width; X += GridWidth)
             {
-                uint32 DestColor = *Pixel;
-                uint32 DestRed = (DestColor & RedMask) >> RedBitScan;
-                uint32 DestGreen = (DestColor & GreenMask) >> GreenBitScan;
-                uint32 DestBlue = (DestColor & BlueMask) >> BlueBitScan;
-                
-                uint32 SourceRed = (SourceColor & RedMask) >> RedBitScan;
-                uint32 SourceGreen = (SourceColor & GreenMask) >> GreenBitScan;
-                uint32 SourceBlue = (SourceColor & BlueMask) >> BlueBitScan;
-                
-                real32 Alpha = ((SourceColor & AlphaMask) >> AlphaBitScan) / 255.0f;
-                uint32 Red = (uint32)((1 - Alpha) * (real32)DestRed + (Alpha * (real32)SourceRed));
-                uint32 Green = (uint32)((1 - Alpha) * (real32)DestGreen + (Alpha * (real32)SourceGreen));
-                uint32 Blue = (uint32)((1 - Alpha) * (real32)DestBlue + (Alpha * (real32)SourceBlue));
-                
-                uint32 Color = (0xFF << AlphaBitScan) |
-                (Red << RedBitScan) | (Green << GreenBitScan) | (Blue << BlueBitScan);
-                
-                *Pixel = Color;
+                uint32 PixelIndex = GetPixelIndex(Buffer, X, Y);
+                Pixels[PixelIndex] = BlendPixel(Pixels[PixelIndex], SourceColor, Blend_SourceOver);
             }
-            ++Pixel;
         }
-        Row += Buffer->Stride;
     }
 }
 
@@ -379,12 +483,8 @@ void DrawHorizontalLine(win32_pixel_buffer *Buffer, uint32 X1, uint32 X2, uint32
         SwapUInt32(&X2, &X1);
     }
     
-    uint32 *Pixel = (uint32 *)((uint8 *)Buffer->Memory + (Y * Buffer->Stride) + (X1 * Buffer->BytesPerPixel));
-    
-    for(uint32 X = X1; X < X2; ++X)
-    {
-        *Pixel++ = Color;
-    }
+    ResolveFastClearRect(Buffer, X1, Y, X2, Y + 1);
+    FillPixelSpan(Buffer, X1, X2, Y, Color);
 }
 
 void FillFlatBottomTriangle(win32_pixel_buffer *Buffer, vec2 V1, vec2 V2, vec2 V3, uint32 Color)
@@ -532,10 +632,13 @@ uint32 StackPop(stack *Stack)
 
 void QuickSort(memory_arena *Arena, triangle *Array, uint32 ArraySize)
 {
+    temporary_memory StackMemory = BeginTemporaryMemory(Arena);
+    
+    //The larger partition is pushed, so at most log2(ArraySize) pairs are on the stack on top of the first 2 slots
     stack Stack;
-    Stack.Size = ((uint32)log2(ArraySize) * 2) + 2;
+    Stack.Size = ((uint32)log2(ArraySize) * 2) + 4;
     Stack.Pointer = 2;
-    Stack.Elements = PushArray(Arena, Stack.Size);
+    Stack.Elements = PushArray(Arena, Stack.Size, uint32);
     
     
     int32 L, R;
@@ -594,134 +697,283 @@ void QuickSort(memory_arena *Arena, triangle *Array, uint32 ArraySize)
             L = StackPop(&Stack);
         }
     } while(Stack.Pointer > 0);
-}
-
-mat4 CreatePerspectiveMatrix(real32 AngleOfView, real32 InvAspectRatio, real32 NearZ, real32 FarZ)
-{
-    mat4 Result = {{0}};
-    
-    real32 FOVScale = 1.0f / tanf(AngleOfView / 2.0f);
-    Result.M[0][0] = FOVScale * InvAspectRatio;
-    Result.M[1][1] = FOVScale;
-    Result.M[2][2] = (FarZ + NearZ) / (FarZ - NearZ);
-    Result.M[2][3] = (-2.0f * NearZ * FarZ) / (FarZ - NearZ);
-    Result.M[3][2] = 1.0f;
     
-    return Result;
+    EndTemporaryMemory(StackMemory);
 }
 
-static void 
-DrawMesh(memory_arena *Arena, win32_pixel_buffer *Buffer, mesh *Mesh, texture *Texture, real32 AngleX, real32 AngleY, real32 AngleZ, bool32 ToFillTriangle, uint32 Color)
+/*
+Draws every instance of one mesh, without touching the mesh itself.
+- Vertices are transformed and projected into one scratch array that every instance reuses, so nothing is allocated per instance.
+- A vertex is transformed the first time a triangle of a visible meshlet uses it, the triangles sharing it reuse the result.
+- Packed vertices are dequantized by the transform itself, the quantization scale and offset are folded into the instance matrix.
+- Meshlets and bounds stay in mesh space, the camera is moved into the space of each instance for the cone test.
+- Instances are drawn in the order they are given, with a depth pre-pass the opaque ones go through all of that twice.
+*/
+static void
+DrawMeshInstances(memory_arena *Arena, win32_pixel_buffer *Buffer, mesh *Mesh, texture *Texture, mesh_instance *Instances, uint32 InstanceCount)
 {
-    vec3 CameraPos = {0.0f, 0.0f, -10.0f};
-    light Light;
-    Light.Direction = (vec3){3.0f, -5.0f, 0.0f};
+    view View = CreateView(Buffer);
+    vec3 CameraPos = View.CameraPos;
     
-    real32 LightMagnitude = GetMagnitudeVec3(Light.Direction);
-    Light.NormalizedDirection = NormalizeVec3(Light.Direction);
+    frustum Frustum = BuildFrustum(View.Projection, View.ScaleX, View.ScaleY, View.NearZ, View.FarZ);
     
-    real32 HalfWidth = Buffer->Width / 2.0f;
-    real32 HalfHeight = Buffer->Height / 2.0f;
+    temporary_memory ScratchMemory = BeginTemporaryMemory(Arena);
     
-    for(uint32 VertexIndex = 0; VertexIndex < Mesh->VertexCount; ++VertexIndex)
-    {
-        vec3 RotatedX = RotateAlongX(Mesh->Vertices[VertexIndex], AngleX);
-        vec3 RotatedY = RotateAlongY(RotatedX, AngleY);
-        vec3 RotatedZ = RotateAlongZ(RotatedY, AngleZ);
-        
-        Mesh->Vertices[VertexIndex] = RotatedZ;
-    }
+    transformed_vertex *Vertices = PushArray(Arena, Mesh->VertexCount, transformed_vertex);
     
-    for(uint32 TriangleIndex = 0; TriangleIndex < Mesh->TriangleCount; ++TriangleIndex)
+    //Instance index + 1 of the last instance that transformed the vertex
+    uint32 *Stamps = PushArray(Arena, Mesh->VertexCount, uint32);
+    for(uint64 VertexIndex = 0; VertexIndex < Mesh->VertexCount; ++VertexIndex)
     {
-        triangle *Triangle = &Mesh->Triangles[TriangleIndex];
-        
-        vec3 Vertices[3];
-        Vertices[0] = Mesh->Vertices[Triangle->A - 1];
-        Vertices[1] = Mesh->Vertices[Triangle->B - 1];
-        Vertices[2] = Mesh->Vertices[Triangle->C - 1];
-        
-        Triangle->AverageZ = (Vertices[0].Z + Vertices[1].Z + Vertices[2].Z) / 3.0f;
+        Stamps[VertexIndex] = 0;
     }
     
-    QuickSort(Arena, Mesh->Triangles, Mesh->TriangleCount);
+    //Only the triangles of meshlets that survive culling are sorted and drawn
+    triangle *DrawTriangles = PushArray(Arena, Mesh->TriangleCount, triangle);
     
-    real32 AngleOfView = (PI / 3.0f); //In radians
-    real32 InvAspectRatio = 9.0f / 16.0f;
-    real32 NearZ = 5.0f;
-    real32 FarZ = 500.0f;
+    triangle_batch Batch = {0};
+    bool32 IsLit = (Buffer->Lighting.LightCount > 0);
     
-    mat4 PerspectiveMatrix = CreatePerspectiveMatrix(AngleOfView, InvAspectRatio, NearZ, FarZ);
+    //Opaque instances are drawn twice with a depth pre-pass, depth first and then color, see depth_prepass.c
+    bool32 UsePrePass = (Buffer->DepthPrePass.IsEnabled && !Buffer->Visibility.Ids && !Buffer->SpanBuffer.Spans && !Buffer->GBuffer.Albedo && (Buffer->Multisample.SampleCount == 1));
+    uint32 PassCount = UsePrePass ? 2 : 1;
     
-    for(uint32 TriangleIndex = 0; TriangleIndex < Mesh->TriangleCount; ++TriangleIndex)
+    for(uint32 PassIndex = 0; PassIndex < PassCount; ++PassIndex)
     {
-        triangle Triangle = Mesh->Triangles[TriangleIndex];
+        raster_pass Pass = !UsePrePass ? RasterPass_Forward : ((PassIndex == 0) ? RasterPass_Depth : RasterPass_Color);
         
-        vec3 Vertices[3];
-        Vertices[0] = Mesh->Vertices[Triangle.A - 1];
-        Vertices[1] = Mesh->Vertices[Triangle.B - 1];
-        Vertices[2] = Mesh->Vertices[Triangle.C - 1];
+        FlushTriangleBatch(&Batch, Buffer, Texture);
+        Batch.Pass = Pass;
         
-        vec2 TextureCoords[3];
-        TextureCoords[0] = Mesh->TextureCoords[Triangle.T1 - 1];
-        TextureCoords[1] = Mesh->TextureCoords[Triangle.T2 - 1];
-        TextureCoords[2] = Mesh->TextureCoords[Triangle.T3 - 1];
-        
-        vec3 Side1 = SubtractVec3(Vertices[1], Vertices[0]);
-        vec3 Side2 = SubtractVec3(Vertices[2], Vertices[0]);
-        
-        vec3 Normal = CrossVec3(Side1, Side2);
-        vec3 NormalizedNormal = NormalizeVec3(Normal);
-        vec3 CameraRay = SubtractVec3(CameraPos, Vertices[0]);
-        
-        real32 CullValue = DotVec3(NormalizedNormal, CameraRay);
-        uint32 NewColor = GetFlatShadingColor(NormalizedNormal, Light, Color);
-        
-        vec5 TextureVertices[3];
-        vec2 RasterVertices[3];
-        
-        for(uint32 VertexIndex = 0; VertexIndex < 3; ++VertexIndex)
+        for(uint32 InstanceIndex = 0; InstanceIndex < InstanceCount; ++InstanceIndex)
         {
-            vec3 RotatedVector = Vertices[VertexIndex];
-            RotatedVector.Z -= CameraPos.Z;
+            mesh_instance *Instance = &Instances[InstanceIndex];
+            if((Pass == RasterPass_Depth) && (Instance->BlendMode != Blend_Opaque))
+            {
+                continue;
+            }
+            
+            mat4 Transform = CreateInstanceTransform(Instance);
             
-            vec4 ProjectedVector = MultiplyMat4Vec3(PerspectiveMatrix, RotatedVector);
+            if(Instance->BlendMode != Batch.BlendMode)
+            {
+                FlushTriangleBatch(&Batch, Buffer, Texture);
+                Batch.BlendMode = Instance->BlendMode;
+                
+                if(Batch.BlendMode == Blend_Transparent)
+                {
+                    AllocateTransparencyBuffer(Buffer);
+                }
+                else if(Batch.BlendMode != Blend_Opaque)
+                {
+                    //Blends over the final color of what is behind it, so the opaque triangles so far are shaded first
+                    ResolveVisibility(Buffer);
+                    ResolveGBuffer(Buffer);
+                }
+            }
+            mat4 PackedTransform = CreateDequantizeTransform(&Transform, &Mesh->Quantization);
+            uint32 Stamp = InstanceIndex + 1;
+            
+            vec3 BoundsCenter = SubtractVec3(TransformPoint(&Transform, Mesh->BoundsCenter), CameraPos);
+            if(!IsSphereInFrustum(&Frustum, BoundsCenter, Mesh->BoundsRadius * Instance->Scale))
+            {
+                continue;
+            }
             
-            vec2 NDCVertices = (vec2){ProjectedVector.X / ProjectedVector.W, ProjectedVector.Y / ProjectedVector.W};
+            //Moving the camera instead of the meshlet keeps the cone test in mesh space
+            vec3 MeshCameraPos = InverseTransformPoint(&Transform, Instance->Scale, CameraPos);
             
-            real32 ScaleX = 25.0f;
-            real32 ScaleY = 25.0f;
+            BEGIN_PROFILE_ZONE(Transform);
+            uint32 DrawCount = 0;
             
-            real32 RasterX = (ScaleX * NDCVertices.X + 1) * HalfWidth;
-            real32 RasterY = (ScaleY * -NDCVertices.Y + 1) * HalfHeight;
-            TextureVertices[VertexIndex] = (vec5){RasterX, RasterY, RotatedVector.Z, TextureCoords[VertexIndex].X, TextureCoords[VertexIndex].Y};
-            RasterVertices[VertexIndex] = (vec2){RasterX, RasterY};
-        }
-        
-        if(CullValue > 0.0f)
-        {
-            if(ToFillTriangle)
+            for(uint64 MeshletIndex = 0; MeshletIndex < Mesh->MeshletCount; ++MeshletIndex)
             {
-                //char OutputBuffer[256];
-                //sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "{X:%f,Y:%f}, {X:%f,Y:%f}, {X:%f,Y:%f}\n", RasterVertices[0].X, RasterVertices[0].Y, RasterVertices[1].X, RasterVertices[1].Y, RasterVertices[2].X, RasterVertices[2].Y);
-                //OutputDebugStringA(OutputBuffer);
+                meshlet *Meshlet = &Mesh->Meshlets[MeshletIndex];
+                
+                vec3 Center = SubtractVec3(TransformPoint(&Transform, Meshlet->Center), CameraPos);
                 
-                TextureMap(Buffer, Texture, TextureVertices[0], TextureVertices[1], TextureVertices[2]);
-                //FillTriangle(Buffer, RasterVertices[0], RasterVertices[1], RasterVertices[2], NewColor);
+                if(!IsSphereInFrustum(&Frustum, Center, Meshlet->Radius * Instance->Scale) ||
+                   IsMeshletBackfacing(Meshlet, MeshCameraPos))
+                {
+                    continue;
+                }
                 
-                //DrawTriangle(Buffer, RasterVertices[0], RasterVertices[1], RasterVertices[2], 0xFFFFFFFF);
+                for(uint32 TriangleIndex = 0; TriangleIndex < Meshlet->TriangleCount; ++TriangleIndex)
+                {
+                    triangle *Triangle = &DrawTriangles[DrawCount++];
+                    *Triangle = Mesh->Triangles[Meshlet->FirstTriangle + TriangleIndex];
+                    
+                    uint32 Indices[3] = {Triangle->A - 1, Triangle->B - 1, Triangle->C - 1};
+                    for(uint32 Index = 0; Index < 3; ++Index)
+                    {
+                        uint32 VertexIndex = Indices[Index];
+                        if(Stamps[VertexIndex] != Stamp)
+                        {
+                            packed_vertex *Source = &Mesh->PackedVertices[VertexIndex];
+                            transformed_vertex *Transformed = &Vertices[VertexIndex];
+                            
+                            vec3 Quantized = {(real32)Source->Position[0], (real32)Source->Position[1], (real32)Source->Position[2]};
+                            Transformed->Position = TransformPoint(&PackedTransform, Quantized);
+                            
+                            vec3 Raster = ProjectToRaster(&View, Transformed->Position);
+                            vec2 TextureCoord = DequantizeTextureCoord(&Mesh->Quantization, Source);
+                            Transformed->Raster = (vec5){Raster.X, Raster.Y, Raster.Z, TextureCoord.X, TextureCoord.Y};
+                            
+                            Stamps[VertexIndex] = Stamp;
+                        }
+                    }
+                    
+                    Triangle->AverageZ = (Vertices[Indices[0]].Position.Z + Vertices[Indices[1]].Position.Z + Vertices[Indices[2]].Position.Z) / 3.0f;
+                }
             }
-            else
+            END_PROFILE_ZONE(Transform);
+            
+            //Front to back saves texturing what is hidden later, the depth and color passes of opaque instances do not depend on the order
+            bool32 IsOrderFree = (Pass != RasterPass_Forward) && (Instance->BlendMode == Blend_Opaque);
+            
+            //Small triangles of opaque instances are moved behind the rest unsorted, the depth test keeps them right wherever
+            //they land and they are drawn after the large ones in front of them. A span buffer has no depth test, so there
+            //every triangle stays in the sort.
+            uint32 SortCount = DrawCount;
+            if(!IsOrderFree && (Instance->BlendMode == Blend_Opaque) && !Buffer->SpanBuffer.Spans)
+            {
+                for(uint32 TriangleIndex = 0; TriangleIndex < SortCount;)
+                {
+                    triangle *Triangle = &DrawTriangles[TriangleIndex];
+                    if(IsSmallTriangle(Vertices[Triangle->A - 1].Raster, Vertices[Triangle->B - 1].Raster, Vertices[Triangle->C - 1].Raster))
+                    {
+                        triangle Temp = *Triangle;
+                        *Triangle = DrawTriangles[--SortCount];
+                        DrawTriangles[SortCount] = Temp;
+                    }
+                    else
+                    {
+                        ++TriangleIndex;
+                    }
+                }
+            }
+            
+            if(SortCount && !IsOrderFree)
+            {
+                BEGIN_PROFILE_ZONE(Sort);
+                QuickSort(Arena, DrawTriangles, SortCount);
+                END_PROFILE_ZONE(Sort);
+            }
+            
+            //Setup of the batches is sampled inside this zone, see FlushTriangleBatch
+            BEGIN_PROFILE_ZONE(Raster);
+            for(uint32 TriangleIndex = 0; TriangleIndex < DrawCount; ++TriangleIndex)
             {
-                //DrawTriangle(Buffer, RasterVertices[0], RasterVertices[1], RasterVertices[2], 0x22222222);
+                triangle Triangle = DrawTriangles[TriangleIndex];
+                
+                transformed_vertex *VertexA = &Vertices[Triangle.A - 1];
+                transformed_vertex *VertexB = &Vertices[Triangle.B - 1];
+                transformed_vertex *VertexC = &Vertices[Triangle.C - 1];
+                
+                vec3 Side1 = SubtractVec3(VertexB->Position, VertexA->Position);
+                vec3 Side2 = SubtractVec3(VertexC->Position, VertexA->Position);
+                
+                vec3 Normal = CrossVec3(Side1, Side2);
+                vec3 CameraRay = SubtractVec3(CameraPos, VertexA->Position);
+                
+                real32 CullValue = DotVec3(Normal, CameraRay);
+                
+                if(CullValue > 0.0f)
+                {
+                    //Only lit pixels need the normal, the culling above does not care for its length
+                    vec3 UnitNormal = IsLit ? NormalizeVec3(Normal) : Normal;
+                    PushTriangleBatch(&Batch, Buffer, Texture, VertexA->Raster, VertexB->Raster, VertexC->Raster, Instance->Color, UnitNormal);
+                    //TextureMap(Buffer, Texture, VertexA->Raster, VertexB->Raster, VertexC->Raster);
+                }
             }
+            END_PROFILE_ZONE(Raster);
+        }
+    }
+    
+    FlushTriangleBatch(&Batch, Buffer, Texture);
+    
+    EndTemporaryMemory(ScratchMemory);
+}
+
+static void 
+DrawMesh(memory_arena *Arena, win32_pixel_buffer *Buffer, mesh *Mesh, vec3 Position, texture *Texture, real32 AngleX, real32 AngleY, real32 AngleZ, bool32 ToFillTriangle, uint32 Color)
+{
+    if(ToFillTriangle)
+    {
+        mesh_instance Instance;
+        Instance.Position = Position;
+        Instance.Rotation = (vec3){AngleX, AngleY, AngleZ};
+        Instance.Scale = 1.0f;
+        Instance.Color = Color;
+        Instance.BlendMode = Blend_Opaque;
+        
+        DrawMeshInstances(Arena, Buffer, Mesh, Texture, &Instance, 1);
+    }
+}
+
+/*
+Draws a streaming mesh chunk by chunk, only the chunks in view are ever mapped.
+- Chunks are culled with the bounds in the chunk table, which is all of the file that stays in memory.
+- Visible chunks are drawn nearest first, each one through DrawMeshInstances as a mesh of its own.
+- Chunks still mapped from the frame before are drawn without touching the file again.
+*/
+static void
+DrawStreamingMesh(memory_arena *Arena, win32_pixel_buffer *Buffer, streaming_mesh *Stream, texture *Texture, mesh_instance *Instance)
+{
+    view View = CreateView(Buffer);
+    frustum Frustum = BuildFrustum(View.Projection, View.ScaleX, View.ScaleY, View.NearZ, View.FarZ);
+    mat4 Transform = CreateInstanceTransform(Instance);
+    
+    ++Stream->Frame;
+    
+    vec3 BoundsCenter = SubtractVec3(TransformPoint(&Transform, Stream->Header.BoundsCenter), View.CameraPos);
+    if(!IsSphereInFrustum(&Frustum, BoundsCenter, Stream->Header.BoundsRadius * Instance->Scale))
+    {
+        return;
+    }
+    
+    //Chunks are sorted with 32 bit values, a file has far fewer of them than that
+    Assert(Stream->Header.ChunkCount <= 0xFFFFFFFF);
+    uint32 ChunkCount = (uint32)Stream->Header.ChunkCount;
+    
+    temporary_memory ScratchMemory = BeginTemporaryMemory(Arena);
+    
+    uint32 *Keys = PushArray(Arena, ChunkCount, uint32);
+    uint32 *Values = PushArray(Arena, ChunkCount, uint32);
+    uint32 *TempKeys = PushArray(Arena, ChunkCount, uint32);
+    uint32 *TempValues = PushArray(Arena, ChunkCount, uint32);
+    uint32 VisibleCount = 0;
+    
+    for(uint32 ChunkIndex = 0; ChunkIndex < ChunkCount; ++ChunkIndex)
+    {
+        streaming_chunk *Chunk = &Stream->Chunks[ChunkIndex];
+        
+        vec3 Center = SubtractVec3(TransformPoint(&Transform, Chunk->BoundsCenter), View.CameraPos);
+        real32 Radius = Chunk->BoundsRadius * Instance->Scale;
+        
+        if(IsSphereInFrustum(&Frustum, Center, Radius))
+        {
+            //Distances are clamped to 0, so they are never negative
+            real32 Distance = fmaxf(GetMagnitudeVec3(Center) - Radius, 0.0f);
+            Keys[VisibleCount] = GetRealSortKey(Distance);
+            Values[VisibleCount] = ChunkIndex;
+            ++VisibleCount;
         }
     }
     
-    //char OutputBuffer[256];
-    //sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "%f\n", Mesh->Vertices[0].Y);
-    //OutputDebugStringA("SET\n");
+    RadixSortByKey(Keys, Values, TempKeys, TempValues, VisibleCount);
     
+    for(uint32 VisibleIndex = 0; VisibleIndex < VisibleCount; ++VisibleIndex)
+    {
+        //A chunk that could not be mapped is left out of this frame
+        mesh *Chunk = AcquireStreamingChunk(Stream, Values[VisibleIndex]);
+        if(Chunk)
+        {
+            DrawMeshInstances(Arena, Buffer, Chunk, Texture, Instance, 1);
+        }
+    }
+    
+    EndTemporaryMemory(ScratchMemory);
 }
 
 static LARGE_INTEGER Win32GetWallClock(void)
@@ -739,122 +991,1364 @@ static real32 Win32GetSecondsElapsed(LARGE_INTEGER StartCounter, LARGE_INTEGER E
     return Result;
 }
 
-int WINAPI WinMain(HINSTANCE Instance, 
-                   HINSTANCE PrevInstance, 
-                   PSTR CommandLine, 
-                   int ShowCode)
+//True when one of the space separated words of the command line is exactly Switch
+static bool32 Win32HasCommandLineSwitch(char *CommandLine, char *Switch)
 {
-    SetThreadDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
-    
-    //Set schedular granularity
-    bool32 SleepIsGranular = (timeBeginPeriod(1) == TIMERR_NOERROR);
+    char *At = CommandLine;
+    while(*At)
+    {
+        while(*At == ' ')
+        {
+            ++At;
+        }
+        
+        char *Letter = Switch;
+        while(*Letter && (*At == *Letter))
+        {
+            ++At;
+            ++Letter;
+        }
+        
+        if(!*Letter && ((*At == ' ') || !*At))
+        {
+            return true;
+        }
+        
+        while(*At && (*At != ' '))
+        {
+            ++At;
+        }
+    }
     
-    uint32 WindowHz = 30;
-    real32 TargetSecondsPerFrame = 1.0f / (real32)WindowHz;
+    return false;
+}
+
+/*
+Frame pipeline, the main thread draws the next frame while a present thread shows the last one:
+- The main thread takes a free back buffer in Win32BeginFrame and hands it over in Win32EndFrame. It only waits when every
+  back buffer is drawn and not shown yet.
+- The present thread waits for the flip time of each buffer, then detiles and blits it and frees it for drawing again.
+- Both threads sleep on a semaphore or in Sleep while they wait, neither spins.
+- Flips are due SecondsPerFrame apart from the first one, so sleeping a little short or long does not add up over frames.
+  A frame drawn too late for its flip is shown right away, and the flips after it are due from there.
+A frame then takes as long as drawing it, presenting only adds to it when it takes longer than drawing.
+*/
+static DWORD WINAPI
+Win32PresentThreadProc(void *Parameter)
+{
+    frame_pipeline *Pipeline = (frame_pipeline *)Parameter;
     
-    WNDCLASSA WindowClass = {0};
-    WindowClass.style = CS_OWNDC | CS_HREDRAW | CS_VREDRAW;
-    WindowClass.lpfnWndProc = &Win32WindowProcedure;
-    WindowClass.hInstance = Instance;
-    WindowClass.lpszClassName = "Win32 Renderer Class";
+    int64 CountsPerFrame = (int64)(Pipeline->SecondsPerFrame * (real32)GlobalPerfFrequency.QuadPart);
+    LARGE_INTEGER FlipWallClock = Win32GetWallClock();
     
-    if(RegisterClassA(&WindowClass))
+    for(;;)
     {
-        HWND WindowHandle = CreateWindowExA(
-                                            0,
-                                            WindowClass.lpszClassName,
-                                            "Renderer",
-                                            WS_OVERLAPPEDWINDOW | WS_VISIBLE,
-                                            CW_USEDEFAULT,
-                                            CW_USEDEFAULT,
-                                            CW_USEDEFAULT,
-                                            CW_USEDEFAULT,
-                                            0,
-                                            0,
-                                            Instance,
-                                            0);
+        WaitForSingleObjectEx(Pipeline->FilledSemaphore, INFINITE, false);
+        if(!Pipeline->IsRunning)
+        {
+            break;
+        }
         
-        if(WindowHandle)
+        //Sleep, with a granular scheduler Sleep(n) takes n to n + 1 ms so what is left below a millisecond is not waited for
+        real32 SecondsLeft = Win32GetSecondsElapsed(Win32GetWallClock(), FlipWallClock);
+        if(SecondsLeft >= 0.001f)
         {
-            QueryPerformanceFrequency(&GlobalPerfFrequency);
-            
-            InitializeBitmapInfo(&GlobalPixelBuffer, 2560, 1440);
-            GlobalPixelBuffer.tPerFrame = TargetSecondsPerFrame;
-            
-            memory_arena Arena;
-            Arena.Size = MEGABYTE(64);
-            Arena.Base = VirtualAlloc((void *)MEGABYTE(64), MEGABYTE(64), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-            Arena.Used = 0;
-            
-            bitmap_header BitmapHeader = {0};
-            BitmapHeader.FileType = 0x4D42;
-            BitmapHeader.FileSize = 4096070;
-            BitmapHeader.Reserved1 = 0;
-            BitmapHeader.Reserved2 = 0;
-            BitmapHeader.BitmapOffset = 70;
-            BitmapHeader.Size = 56;
-            BitmapHeader.Width = 2560;
-            BitmapHeader.Height = 1600;
-            BitmapHeader.Planes = 1;
-            BitmapHeader.BitsPerPixel = 32;
-            BitmapHeader.Compression = 3;
-            BitmapHeader.SizeOfBitmap = (BitmapHeader.Width * BitmapHeader.Height * 4);
-            BitmapHeader.HorzResolution = 2834;
-            BitmapHeader.VertResolution = 2834;
-            BitmapHeader.ColorsUsed = 0;
-            BitmapHeader.ColorsImportant = 0;
-            BitmapHeader.RedMask = 0x00FF0000;
-            BitmapHeader.GreenMask = 0x0000FF00;
-            BitmapHeader.BlueMask = 0x000000FF;
-            BitmapHeader.AlphaMask = 0xFF000000;
-            
-            uint32 *BitmapBits = (uint32 *)VirtualAlloc(0, BitmapHeader.SizeOfBitmap, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
-            
-            
-#define VERTEX_COUNT 8
-            vec3 Vertices[VERTEX_COUNT] = 
-            {
-                {-1.0f, -1.0f, -1.0f},
-                {-1.0f, 1.0f, -1.0f},
-                {1.0f, 1.0f, -1.0f},
-                {1.0f, -1.0f, -1.0f},
-                {1.0f, 1.0f, 1.0f},
-                {1.0f, -1.0f, 1.0f},
-                {-1.0f, 1.0f, 1.0f},
-                {-1.0f, -1.0f, 1.0f}
-            };
-            
-#define TRIANGLE_COUNT 12
-            triangle Triangles[TRIANGLE_COUNT] =
-            {
-                {1,2,3, 0XFFFF0000},
-                {1,3,4, 0XFFFF0000},
-                
-                {6,5,7, 0XFFFF00FF},
-                {6,7,8, 0XFFFF00FF},
-                
-                {8,7,2, 0XFF00FF00},
-                {8,2,1, 0XFF00FF00},
-                
-                {4,3,5, 0XFFFFFF00},
-                {4,5,6, 0XFFFFFF00},
-                
-                {2,7,5, 0XFF0000FF},
-                {2,5,3, 0XFF0000FF},
-                
-                {6,8,1, 0XFF00FFFF},
+            Sleep((uint32)(1000.0f * SecondsLeft));
+        }
+        
+        //Flip
+        win32_pixel_buffer *Buffer = &Pipeline->Buffers[Pipeline->NextBufferToPresent];
+        
+        RECT WindowDimensions;
+        GetClientRect(Pipeline->Window, &WindowDimensions);
+        
+        uint32 WindowWidth = WindowDimensions.right - WindowDimensions.left;
+        uint32 WindowHeight = WindowDimensions.bottom - WindowDimensions.top;
+        
+        LARGE_INTEGER PresentWallClock = Win32GetWallClock();
+        
+        BEGIN_PROFILE_ZONE(Present);
+        HDC DeviceContext = GetDC(Pipeline->Window);
+        Win32UpdateWindow(Buffer, DeviceContext, WindowWidth, WindowHeight);
+        ReleaseDC(Pipeline->Window, DeviceContext);
+        END_PROFILE_ZONE(Present);
+        
+        Pipeline->PresentSeconds += Win32GetSecondsElapsed(PresentWallClock, Win32GetWallClock());
+        ++Pipeline->PresentCount;
+        
+        //After Flip
+        FlipWallClock.QuadPart += CountsPerFrame;
+        if(FlipWallClock.QuadPart < PresentWallClock.QuadPart)
+        {
+            FlipWallClock.QuadPart = PresentWallClock.QuadPart + CountsPerFrame;
+        }
+        
+        Pipeline->NextBufferToPresent = (Pipeline->NextBufferToPresent + 1) % PRESENT_BUFFER_COUNT;
+        ReleaseSemaphore(Pipeline->FreeSemaphore, 1, 0);
+    }
+    
+    return 0;
+}
+
+//The back buffers are Width x Height, the size of the window buffer. With SecondsPerFrame 0 every frame is shown as soon as it is drawn.
+static void
+Win32StartFramePipeline(frame_pipeline *Pipeline, HWND Window, uint32 Width, uint32 Height, bool32 IsTiled, real32 SecondsPerFrame)
+{
+    for(uint32 BufferIndex = 0; BufferIndex < PRESENT_BUFFER_COUNT; ++BufferIndex)
+    {
+        InitializeBitmapInfo(&Pipeline->Buffers[BufferIndex], Width, Height, IsTiled, 1, false);
+    }
+    
+    Pipeline->NextBufferToDraw = 0;
+    Pipeline->NextBufferToPresent = 0;
+    Pipeline->Window = Window;
+    Pipeline->IsRunning = true;
+    Pipeline->SecondsPerFrame = SecondsPerFrame;
+    Pipeline->PresentCount = 0;
+    Pipeline->PresentSeconds = 0.0f;
+    
+    //The filled count goes one over the buffers, Win32StopFramePipeline wakes the thread with it
+    Pipeline->FreeSemaphore = CreateSemaphoreExA(0, PRESENT_BUFFER_COUNT, PRESENT_BUFFER_COUNT, 0, 0, SEMAPHORE_ALL_ACCESS);
+    Pipeline->FilledSemaphore = CreateSemaphoreExA(0, 0, PRESENT_BUFFER_COUNT + 1, 0, 0, SEMAPHORE_ALL_ACCESS);
+    Assert(Pipeline->FreeSemaphore && Pipeline->FilledSemaphore);
+    
+    Pipeline->Thread = CreateThread(0, 0, Win32PresentThreadProc, Pipeline, 0, 0);
+    Assert(Pipeline->Thread);
+}
+
+//Waits for a back buffer to draw the next frame into, it is only shown once Win32EndFrame hands it over
+static win32_pixel_buffer *
+Win32BeginFrame(frame_pipeline *Pipeline)
+{
+    WaitForSingleObjectEx(Pipeline->FreeSemaphore, INFINITE, false);
+    
+    win32_pixel_buffer *Result = &Pipeline->Buffers[Pipeline->NextBufferToDraw];
+    return Result;
+}
+
+static void
+Win32EndFrame(frame_pipeline *Pipeline)
+{
+    Pipeline->NextBufferToDraw = (Pipeline->NextBufferToDraw + 1) % PRESENT_BUFFER_COUNT;
+    ReleaseSemaphore(Pipeline->FilledSemaphore, 1, 0);
+}
+
+//Shows the frames still waiting, then ends the present thread and frees the back buffers
+static void
+Win32StopFramePipeline(frame_pipeline *Pipeline)
+{
+    for(uint32 BufferIndex = 0; BufferIndex < PRESENT_BUFFER_COUNT; ++BufferIndex)
+    {
+        WaitForSingleObjectEx(Pipeline->FreeSemaphore, INFINITE, false);
+    }
+    
+    Pipeline->IsRunning = false;
+    ReleaseSemaphore(Pipeline->FilledSemaphore, 1, 0);
+    WaitForSingleObjectEx(Pipeline->Thread, INFINITE, false);
+    
+    CloseHandle(Pipeline->Thread);
+    CloseHandle(Pipeline->FreeSemaphore);
+    CloseHandle(Pipeline->FilledSemaphore);
+    
+    for(uint32 BufferIndex = 0; BufferIndex < PRESENT_BUFFER_COUNT; ++BufferIndex)
+    {
+        ReleasePixelBuffer(&Pipeline->Buffers[BufferIndex]);
+    }
+}
+
+/*
+Draws the visible objects of a scene.
+- Occluders are rasterized into the occlusion buffer first.
+- The BVH query culls against the frustum and the occlusion buffer, and returns objects front to back so the depth test rejects as much as possible.
+*/
+static void
+DrawScene(memory_arena *Arena, win32_pixel_buffer *Buffer, occlusion_buffer *Occlusion, scene *Scene, texture *Texture, scene_stats *Stats)
+{
+    view View = CreateView(Buffer);
+    frustum Frustum = BuildFrustum(View.Projection, View.ScaleX, View.ScaleY, View.NearZ, View.FarZ);
+    
+    temporary_memory ScratchMemory = BeginTemporaryMemory(Arena);
+    
+    LARGE_INTEGER StartWallClock = Win32GetWallClock();
+    
+    ClearOcclusionBuffer(Occlusion);
+    
+    for(uint32 OccluderIndex = 0; OccluderIndex < Scene->OccluderCount; ++OccluderIndex)
+    {
+        render_object *Object = &Scene->Objects[Scene->Occluders[OccluderIndex]];
+        
+        //Occluders use the level that gets drawn, so they never hide more than is on screen
+        RasterizeOccluder(Arena, Occlusion, &View, SelectMeshLod(Object->Lod, &View, Object->Position), Object->Position);
+    }
+    
+    LARGE_INTEGER OccluderWallClock = Win32GetWallClock();
+    
+    uint32 *Visible = PushArray(Arena, Scene->ObjectCount, uint32);
+    uint32 VisibleCount = QueryScene(Scene, &View, &Frustum, Occlusion, Visible, &Stats->NodesVisited);
+    
+    LARGE_INTEGER QueryWallClock = Win32GetWallClock();
+    
+    for(uint32 VisibleIndex = 0; VisibleIndex < VisibleCount; ++VisibleIndex)
+    {
+        render_object *Object = &Scene->Objects[Visible[VisibleIndex]];
+        mesh *Mesh = SelectMeshLod(Object->Lod, &View, Object->Position);
+        DrawMesh(Arena, Buffer, Mesh, Object->Position, Texture, 0.0f, 0.0f, 0.0f, true, 0xFFFFFFFF);
+    }
+    
+    EndTemporaryMemory(ScratchMemory);
+    
+    Stats->ObjectCount = Scene->ObjectCount;
+    Stats->VisibleCount = VisibleCount;
+    Stats->OccluderSeconds = Win32GetSecondsElapsed(StartWallClock, OccluderWallClock);
+    Stats->QuerySeconds = Win32GetSecondsElapsed(OccluderWallClock, QueryWallClock);
+}
+
+#if BENCHMARKS
+#define BENCHMARK_INSTANCE_COUNT 12
+
+/*
+The bunnies the renderer benchmarks draw, a grid from close up to far away, so both long spans and small triangles are in the mix.
+Nearest first, or farthest first when IsReversed is set.
+*/
+static void
+InitializeBenchmarkInstances(mesh_instance *Instances, uint32 Count, bool32 IsReversed)
+{
+    for(uint32 InstanceIndex = 0; InstanceIndex < Count; ++InstanceIndex)
+    {
+        uint32 Order = IsReversed ? (Count - 1 - InstanceIndex) : InstanceIndex;
+        
+        mesh_instance *Instance = &Instances[InstanceIndex];
+        Instance->Position = (vec3){0.15f * ((real32)(Order % 4) - 1.5f), 0.12f * ((real32)(Order / 4) - 1.0f), 0.5f * (real32)Order};
+        Instance->Rotation = (vec3){0.0f, 0.5f * (real32)Order, 0.0f};
+        Instance->Scale = 1.0f;
+        Instance->Color = 0xFFFFFFFF;
+        Instance->BlendMode = Blend_Opaque;
+    }
+}
+
+//Count point lights scattered through the box the bunnies are in, NumberArray is spread over +-10^7
+static void
+ScatterBenchmarkLights(light_list *Lights, uint32 Count)
+{
+    Lights->Count = 0;
+    for(uint32 LightIndex = 0; LightIndex < Count; ++LightIndex)
+    {
+        real32 Random[6];
+        for(uint32 Index = 0; Index < ArrayCount(Random); ++Index)
+        {
+            Random[Index] = (real32)NumberArray[((LightIndex * 3) + Index) % ArrayCount(NumberArray)] * 1e-7f;
+        }
+        
+        vec3 Position = {0.3f * Random[0], 0.2f * Random[1], 2.75f + (3.0f * Random[2])};
+        vec3 Color = {1.0f + Random[3], 1.0f + Random[4], 1.0f + Random[5]};
+        AddPointLight(Lights, Position, 0.08f, Color);
+    }
+}
+
+/*
+Pixels that differ between the presented images of two buffers of the same size. MaxChannelDifference, when given,
+gets the largest difference of any one channel of those pixels.
+*/
+static uint32
+CountMismatchedPixels(win32_pixel_buffer *A, win32_pixel_buffer *B, uint32 *MaxChannelDifference)
+{
+    uint8 *RowA = (uint8 *)GetLinearPixels(A);
+    uint8 *RowB = (uint8 *)GetLinearPixels(B);
+    uint32 MismatchCount = 0;
+    
+    for(int32 Y = 0; Y < A->Height; ++Y)
+    {
+        for(int32 X = 0; X < A->Width; ++X)
+        {
+            uint32 PixelA = ((uint32 *)RowA)[X];
+            uint32 PixelB = ((uint32 *)RowB)[X];
+            if(PixelA == PixelB)
+            {
+                continue;
+            }
+            
+            ++MismatchCount;
+            if(MaxChannelDifference)
+            {
+                for(uint32 Shift = 0; Shift < 32; Shift += 8)
+                {
+                    int32 Difference = (int32)((PixelA >> Shift) & 0xFF) - (int32)((PixelB >> Shift) & 0xFF);
+                    uint32 AbsoluteDifference = (uint32)((Difference < 0) ? -Difference : Difference);
+                    *MaxChannelDifference = (AbsoluteDifference > *MaxChannelDifference) ? AbsoluteDifference : *MaxChannelDifference;
+                }
+            }
+        }
+        
+        RowA += A->Stride;
+        RowB += B->Stride;
+    }
+    
+    return MismatchCount;
+}
+
+//Times building, querying and refitting the BVH of a scene with SCENE_BENCHMARK_COUNT objects
+#define SCENE_BENCHMARK_COUNT 100000
+static void
+BenchmarkScene(win32_pixel_buffer *Buffer, mesh_lod *Lod)
+{
+    view View = CreateView(Buffer);
+    frustum Frustum = BuildFrustum(View.Projection, View.ScaleX, View.ScaleY, View.NearZ, View.FarZ);
+    
+    scene Scene;
+    InitializeScene(&Scene, SCENE_BENCHMARK_COUNT);
+    
+    //50 x 40 x 50 grid in front of the camera, most of it outside the narrow view
+    for(uint32 ObjectIndex = 0; ObjectIndex < SCENE_BENCHMARK_COUNT; ++ObjectIndex)
+    {
+        uint32 X = ObjectIndex % 50;
+        uint32 Y = (ObjectIndex / 50) % 40;
+        uint32 Z = ObjectIndex / (50 * 40);
+        AddSceneObject(&Scene, Lod, (vec3){(real32)X - 25.0f, (real32)Y - 20.0f, (real32)Z}, false);
+    }
+    
+    uint32 *Visible = (uint32 *)VirtualAlloc(0, SCENE_BENCHMARK_COUNT * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    uint32 NodesVisited = 0;
+    
+    LARGE_INTEGER StartWallClock = Win32GetWallClock();
+    BuildSceneBvh(&Scene);
+    LARGE_INTEGER BuildWallClock = Win32GetWallClock();
+    uint32 VisibleCount = QueryScene(&Scene, &View, &Frustum, 0, Visible, &NodesVisited);
+    LARGE_INTEGER QueryWallClock = Win32GetWallClock();
+    
+    for(uint32 ObjectIndex = 0; ObjectIndex < SCENE_BENCHMARK_COUNT; ObjectIndex += 100)
+    {
+        vec3 Position = Scene.Objects[ObjectIndex].Position;
+        MoveSceneObject(&Scene, ObjectIndex, (vec3){Position.X + 0.25f, Position.Y, Position.Z});
+    }
+    
+    LARGE_INTEGER RefitWallClock = Win32GetWallClock();
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Scene BVH, %u objects: build %.3fms, query %.1fus (%u visible, %u nodes), refit of %u moved objects %.1fus\n",
+              SCENE_BENCHMARK_COUNT, (1000.0f * Win32GetSecondsElapsed(StartWallClock, BuildWallClock)),
+              (1000000.0f * Win32GetSecondsElapsed(BuildWallClock, QueryWallClock)), VisibleCount, NodesVisited,
+              SCENE_BENCHMARK_COUNT / 100, (1000000.0f * Win32GetSecondsElapsed(QueryWallClock, RefitWallClock)));
+    OutputDebugStringA(OutputBuffer);
+    
+    VirtualFree(Visible, 0, MEM_RELEASE);
+    ReleaseScene(&Scene);
+}
+
+/*
+Draws the same frames into a linear and a tiled buffer of the given size and reports the time per frame of each.
+The tiled frames are detiled and checked against the linear ones, so both layouts have to produce the same picture.
+*/
+static void
+BenchmarkPixelLayout(memory_arena *Arena, mesh_lod *Lod, texture *Texture, uint32 Width, uint32 Height)
+{
+    mesh_instance Instances[BENCHMARK_INSTANCE_COUNT];
+    InitializeBenchmarkInstances(Instances, ArrayCount(Instances), false);
+    
+    win32_pixel_buffer Buffers[2];
+    real32 Seconds[2];
+    
+    for(uint32 Layout = 0; Layout < 2; ++Layout)
+    {
+        win32_pixel_buffer *Buffer = &Buffers[Layout];
+        InitializeBitmapInfo(Buffer, Width, Height, (Layout == 1), 1, false);
+        
+        //Frame 0 only faults the pages in, it is not timed
+        LARGE_INTEGER StartWallClock = Win32GetWallClock();
+        
+        for(uint32 Frame = 0; Frame <= PIXEL_LAYOUT_BENCHMARK_FRAMES; ++Frame)
+        {
+            if(Frame == 1)
+            {
+                StartWallClock = Win32GetWallClock();
+            }
+            
+            ClearPixelBuffer(Buffer, 0x00000000);
+            
+            view View = CreateView(Buffer);
+            mesh *Mesh = SelectMeshLod(Lod, &View, Instances[0].Position);
+            DrawMeshInstances(Arena, Buffer, Mesh, Texture, Instances, ArrayCount(Instances));
+        }
+        
+        Seconds[Layout] = Win32GetSecondsElapsed(StartWallClock, Win32GetWallClock()) / (real32)PIXEL_LAYOUT_BENCHMARK_FRAMES;
+    }
+    
+    //Pending clears are streamed out first, so only the detile is timed
+    GetLinearPixels(&Buffers[1]);
+    
+    LARGE_INTEGER DetileWallClock = Win32GetWallClock();
+    for(uint32 Frame = 0; Frame < PIXEL_LAYOUT_BENCHMARK_FRAMES; ++Frame)
+    {
+        DetileBuffer(&Buffers[1]);
+    }
+    real32 DetileSeconds = Win32GetSecondsElapsed(DetileWallClock, Win32GetWallClock()) / (real32)PIXEL_LAYOUT_BENCHMARK_FRAMES;
+    
+    uint32 MismatchCount = CountMismatchedPixels(&Buffers[0], &Buffers[1], 0);
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Pixel layout, %ux%u: linear %.3fms, tiled %.3fms per frame, detile %.3fms, %u mismatched pixels\n",
+              Width, Height, (1000.0f * Seconds[0]), (1000.0f * Seconds[1]), (1000.0f * DetileSeconds), MismatchCount);
+    OutputDebugStringA(OutputBuffer);
+    
+    ReleasePixelBuffer(&Buffers[0]);
+    ReleasePixelBuffer(&Buffers[1]);
+}
+
+/*
+Time per frame of clearing color and depth of a buffer of the given size:
+- Scalar, one store per pixel, the way DrawRect and ClearDepthBuffer used to clear.
+- 8 wide streaming stores over both buffers.
+- Fast clear, with nothing drawn, so present streams the color into every block and the depth is never written.
+*/
+static void
+BenchmarkClear(uint32 Width, uint32 Height, bool32 IsTiled)
+{
+    win32_pixel_buffer Buffer;
+    InitializeBitmapInfo(&Buffer, Width, Height, IsTiled, 1, false);
+    
+    uint32 PixelCount = GetPixelCount(&Buffer);
+    uint32 *Pixels = (uint32 *)Buffer.Memory;
+    real32 Seconds[3];
+    
+    for(uint32 Method = 0; Method < 3; ++Method)
+    {
+        //Frame 0 only faults the pages in, it is not timed
+        LARGE_INTEGER StartWallClock = Win32GetWallClock();
+        
+        for(uint32 Frame = 0; Frame <= CLEAR_BENCHMARK_FRAMES; ++Frame)
+        {
+            if(Frame == 1)
+            {
+                StartWallClock = Win32GetWallClock();
+            }
+            
+            if(Method == 0)
+            {
+                for(uint32 PixelIndex = 0; PixelIndex < PixelCount; ++PixelIndex)
+                {
+                    Pixels[PixelIndex] = 0x00000000;
+                    Buffer.Depth[PixelIndex] = 0.0f;
+                }
+            }
+            else if(Method == 1)
+            {
+                FillPixels32(Pixels, PixelCount, 0x00000000, true);
+                FillPixels32((uint32 *)Buffer.Depth, PixelCount, 0, true);
+                _mm_sfence();
+            }
+            else
+            {
+                ClearPixelBuffer(&Buffer, 0x00000000);
+                ResolveFastClear(&Buffer, CLEAR_BLOCK_COLOR);
+            }
+        }
+        
+        Seconds[Method] = Win32GetSecondsElapsed(StartWallClock, Win32GetWallClock()) / (real32)CLEAR_BENCHMARK_FRAMES;
+    }
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Clear, %ux%u: scalar %.3fms, streaming %.3fms, fast clear and present %.3fms per frame\n",
+              Width, Height, (1000.0f * Seconds[0]), (1000.0f * Seconds[1]), (1000.0f * Seconds[2]));
+    OutputDebugStringA(OutputBuffer);
+    
+    ReleasePixelBuffer(&Buffer);
+}
+
+/*
+Time per frame of blending one color over a whole buffer of the given size, against an opaque fill of it:
+- Scalar source over, BlendPixel on every pixel.
+- SIMD source over, premultiplied, additive and multiply through BlendRect.
+BlendSpan is also checked against BlendPixel on pixels of every color and alpha, the two have to agree exactly.
+*/
+static void
+BenchmarkBlend(uint32 Width, uint32 Height, bool32 IsTiled)
+{
+    win32_pixel_buffer Buffer;
+    InitializeBitmapInfo(&Buffer, Width, Height, IsTiled, 1, false);
+    
+    blend_mode Modes[] = {Blend_Opaque, Blend_SourceOver, Blend_SourceOver, Blend_Premultiplied, Blend_Additive, Blend_Multiply};
+    real32 Seconds[ArrayCount(Modes)];
+    
+    uint32 *Pixels = (uint32 *)Buffer.Memory;
+    uint32 PixelCount = GetPixelCount(&Buffer);
+    
+    for(uint32 Method = 0; Method < ArrayCount(Modes); ++Method)
+    {
+        //Frame 0 only faults the pages in, it is not timed
+        LARGE_INTEGER StartWallClock = Win32GetWallClock();
+        
+        for(uint32 Frame = 0; Frame <= BLEND_BENCHMARK_FRAMES; ++Frame)
+        {
+            if(Frame == 1)
+            {
+                StartWallClock = Win32GetWallClock();
+            }
+            
+            if(Method == 1)
+            {
+                for(uint32 PixelIndex = 0; PixelIndex < PixelCount; ++PixelIndex)
+                {
+                    Pixels[PixelIndex] = BlendPixel(Pixels[PixelIndex], 0x80336699, Blend_SourceOver);
+                }
+            }
+            else
+            {
+                BlendRect(&Buffer, 0, 0, Width, Height, 0x80336699, Modes[Method]);
+            }
+        }
+        
+        Seconds[Method] = Win32GetSecondsElapsed(StartWallClock, Win32GetWallClock()) / (real32)BLEND_BENCHMARK_FRAMES;
+    }
+    
+    //Source and dest values spread over every channel value, including 0 and 255 alpha
+    uint32 Dest[256];
+    uint32 Source[256];
+    uint32 MismatchCount = 0;
+    for(uint32 Mode = Blend_Opaque; Mode <= Blend_Multiply; ++Mode)
+    {
+        for(uint32 Round = 0; Round < 256; ++Round)
+        {
+            for(uint32 Index = 0; Index < ArrayCount(Dest); ++Index)
+            {
+                Dest[Index] = (Index * 0x9E3779B1) ^ (Round * 0x01010101);
+                Source[Index] = ((Index + Round) * 0x85EBCA6B) ^ (Index << 24);
+            }
+            
+            uint32 Expected[256];
+            for(uint32 Index = 0; Index < ArrayCount(Dest); ++Index)
+            {
+                Expected[Index] = BlendPixel(Dest[Index], Source[Index], (blend_mode)Mode);
+            }
+            
+            BlendSpan(Dest, Source, ArrayCount(Dest), (blend_mode)Mode);
+            for(uint32 Index = 0; Index < ArrayCount(Dest); ++Index)
+            {
+                MismatchCount += (Dest[Index] != Expected[Index]);
+            }
+        }
+    }
+    
+    char OutputBuffer[512];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Blend, %ux%u: opaque fill %.3fms, scalar source over %.3fms, source over %.3fms, premultiplied %.3fms, additive %.3fms, multiply %.3fms per frame, %u mismatches against BlendPixel\n",
+              Width, Height, (1000.0f * Seconds[0]), (1000.0f * Seconds[1]), (1000.0f * Seconds[2]), (1000.0f * Seconds[3]), (1000.0f * Seconds[4]), (1000.0f * Seconds[5]), MismatchCount);
+    OutputDebugStringA(OutputBuffer);
+    
+    ReleasePixelBuffer(&Buffer);
+}
+
+/*
+Time per frame of the bunnies of BenchmarkPixelLayout, aliased and with 4x MSAA, clear and present included.
+Both buffers are presented every frame, so the 4x time has the resolve in it.
+*/
+static void
+BenchmarkMultisample(memory_arena *Arena, mesh_lod *Lod, texture *Texture, uint32 Width, uint32 Height, bool32 IsTiled)
+{
+    mesh_instance Instances[BENCHMARK_INSTANCE_COUNT];
+    InitializeBenchmarkInstances(Instances, ArrayCount(Instances), false);
+    
+    uint32 SampleCounts[2] = {1, MULTISAMPLE_COUNT};
+    win32_pixel_buffer Buffers[2];
+    real32 Seconds[2];
+    
+    for(uint32 Method = 0; Method < 2; ++Method)
+    {
+        win32_pixel_buffer *Buffer = &Buffers[Method];
+        InitializeBitmapInfo(Buffer, Width, Height, IsTiled, SampleCounts[Method], false);
+        
+        //Frame 0 only faults the pages in, it is not timed
+        LARGE_INTEGER StartWallClock = Win32GetWallClock();
+        
+        for(uint32 Frame = 0; Frame <= MULTISAMPLE_BENCHMARK_FRAMES; ++Frame)
+        {
+            if(Frame == 1)
+            {
+                StartWallClock = Win32GetWallClock();
+            }
+            
+            ClearPixelBuffer(Buffer, 0x00000000);
+            
+            view View = CreateView(Buffer);
+            mesh *Mesh = SelectMeshLod(Lod, &View, Instances[0].Position);
+            DrawMeshInstances(Arena, Buffer, Mesh, Texture, Instances, ArrayCount(Instances));
+            GetLinearPixels(Buffer);
+        }
+        
+        Seconds[Method] = Win32GetSecondsElapsed(StartWallClock, Win32GetWallClock()) / (real32)MULTISAMPLE_BENCHMARK_FRAMES;
+    }
+    
+    //Pixels the samples changed, the edges that were smoothed
+    uint32 EdgeCount = CountMismatchedPixels(&Buffers[0], &Buffers[1], 0);
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Multisample, %ux%u: aliased %.3fms, %ux MSAA %.3fms per frame (%.2fx), %u pixels changed\n",
+              Width, Height, (1000.0f * Seconds[0]), MULTISAMPLE_COUNT, (1000.0f * Seconds[1]), (Seconds[1] / Seconds[0]), EdgeCount);
+    OutputDebugStringA(OutputBuffer);
+    
+    ReleasePixelBuffer(&Buffers[0]);
+    ReleasePixelBuffer(&Buffers[1]);
+}
+
+/*
+Time per frame of the bunnies of BenchmarkPixelLayout drawn forward, where every pixel that passes the depth test is textured,
+and through a visibility buffer, where only the pixels visible at the end are. Present is included in both.
+*/
+static void
+BenchmarkVisibility(memory_arena *Arena, mesh_lod *Lod, texture *Texture, uint32 Width, uint32 Height, bool32 IsTiled)
+{
+    mesh_instance Instances[BENCHMARK_INSTANCE_COUNT];
+    InitializeBenchmarkInstances(Instances, ArrayCount(Instances), false);
+    
+    win32_pixel_buffer Buffers[2];
+    real32 Seconds[2];
+    
+    for(uint32 Method = 0; Method < 2; ++Method)
+    {
+        win32_pixel_buffer *Buffer = &Buffers[Method];
+        InitializeBitmapInfo(Buffer, Width, Height, IsTiled, 1, false);
+        if(Method == 1)
+        {
+            AllocateVisibilityBuffer(Buffer);
+        }
+        
+        //Frame 0 only faults the pages in, it is not timed
+        LARGE_INTEGER StartWallClock = Win32GetWallClock();
+        
+        for(uint32 Frame = 0; Frame <= VISIBILITY_BENCHMARK_FRAMES; ++Frame)
+        {
+            if(Frame == 1)
+            {
+                StartWallClock = Win32GetWallClock();
+            }
+            
+            ClearPixelBuffer(Buffer, 0x00000000);
+            
+            view View = CreateView(Buffer);
+            mesh *Mesh = SelectMeshLod(Lod, &View, Instances[0].Position);
+            DrawMeshInstances(Arena, Buffer, Mesh, Texture, Instances, ArrayCount(Instances));
+            GetLinearPixels(Buffer);
+        }
+        
+        Seconds[Method] = Win32GetSecondsElapsed(StartWallClock, Win32GetWallClock()) / (real32)VISIBILITY_BENCHMARK_FRAMES;
+    }
+    
+    //Texels can differ where the stepped and the evaluated u/z, v/z land on either side of a texel edge
+    uint32 MismatchCount = CountMismatchedPixels(&Buffers[0], &Buffers[1], 0);
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Visibility buffer, %ux%u: forward %.3fms, visibility buffer %.3fms per frame, %u mismatched pixels\n",
+              Width, Height, (1000.0f * Seconds[0]), (1000.0f * Seconds[1]), MismatchCount);
+    OutputDebugStringA(OutputBuffer);
+    
+    ReleasePixelBuffer(&Buffers[0]);
+    ReleasePixelBuffer(&Buffers[1]);
+}
+
+/*
+Time per frame of bunnies drawn forward and with a depth pre-pass, in layouts of growing overdraw:
+the grid of BenchmarkVisibility nearest first and farthest first, then a column of bunnies right behind each other, farthest first.
+The overdraw is measured by the pre-pass itself, the overdraw where the pre-pass starts to pay off is fit through the results.
+*/
+static void
+BenchmarkDepthPrePass(memory_arena *Arena, mesh_lod *Lod, texture *Texture, uint32 Width, uint32 Height, bool32 IsTiled)
+{
+    real32 Overdraw[3];
+    real32 Ratio[3];
+    
+    for(uint32 Layout = 0; Layout < ArrayCount(Overdraw); ++Layout)
+    {
+        mesh_instance Instances[BENCHMARK_INSTANCE_COUNT];
+        InitializeBenchmarkInstances(Instances, ArrayCount(Instances), (Layout > 0));
+        if(Layout == 2)
+        {
+            for(uint32 InstanceIndex = 0; InstanceIndex < ArrayCount(Instances); ++InstanceIndex)
+            {
+                uint32 Order = ArrayCount(Instances) - 1 - InstanceIndex;
+                Instances[InstanceIndex].Position = (vec3){0.01f * (real32)(Order % 3), 0.0f, 0.1f * (real32)Order};
+            }
+        }
+        
+        win32_pixel_buffer Buffers[2];
+        real32 Seconds[2];
+        
+        for(uint32 Method = 0; Method < 2; ++Method)
+        {
+            win32_pixel_buffer *Buffer = &Buffers[Method];
+            InitializeBitmapInfo(Buffer, Width, Height, IsTiled, 1, false);
+            Buffer->DepthPrePass.IsEnabled = (Method == 1);
+            
+            //Frame 0 only faults the pages in, it is not timed
+            LARGE_INTEGER StartWallClock = Win32GetWallClock();
+            
+            for(uint32 Frame = 0; Frame <= DEPTH_PREPASS_BENCHMARK_FRAMES; ++Frame)
+            {
+                if(Frame == 1)
+                {
+                    ResetDepthPrePassCounts(Buffer);
+                    StartWallClock = Win32GetWallClock();
+                }
+                
+                ClearPixelBuffer(Buffer, 0x00000000);
+                
+                view View = CreateView(Buffer);
+                mesh *Mesh = SelectMeshLod(Lod, &View, (vec3){0.0f, 0.0f, 0.0f});
+                DrawMeshInstances(Arena, Buffer, Mesh, Texture, Instances, ArrayCount(Instances));
+                GetLinearPixels(Buffer);
+            }
+            
+            Seconds[Method] = Win32GetSecondsElapsed(StartWallClock, Win32GetWallClock()) / (real32)DEPTH_PREPASS_BENCHMARK_FRAMES;
+        }
+        
+        //Only pixels where two surfaces meet at exactly the same depth can differ, forward keeps the first and the pre-pass the last
+        uint32 MismatchCount = CountMismatchedPixels(&Buffers[0], &Buffers[1], 0);
+        
+        Overdraw[Layout] = GetMeasuredOverdraw(&Buffers[1]);
+        Ratio[Layout] = Seconds[1] / Seconds[0];
+        
+        char OutputBuffer[256];
+        sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Depth pre-pass, %ux%u, layout %u: overdraw %.2f, forward %.3fms, pre-pass %.3fms per frame (%.2fx), %u mismatched pixels\n",
+                  Width, Height, Layout, Overdraw[Layout], (1000.0f * Seconds[0]), (1000.0f * Seconds[1]), Ratio[Layout], MismatchCount);
+        OutputDebugStringA(OutputBuffer);
+        
+        ReleasePixelBuffer(&Buffers[0]);
+        ReleasePixelBuffer(&Buffers[1]);
+    }
+    
+    //Least squares line through (overdraw, time ratio), the pre-pass pays off where it drops below 1
+    real32 MeanOverdraw = (Overdraw[0] + Overdraw[1] + Overdraw[2]) / 3.0f;
+    real32 MeanRatio = (Ratio[0] + Ratio[1] + Ratio[2]) / 3.0f;
+    real32 Covariance = 0.0f;
+    real32 Variance = 0.0f;
+    for(uint32 Layout = 0; Layout < ArrayCount(Overdraw); ++Layout)
+    {
+        Covariance += (Overdraw[Layout] - MeanOverdraw) * (Ratio[Layout] - MeanRatio);
+        Variance += (Overdraw[Layout] - MeanOverdraw) * (Overdraw[Layout] - MeanOverdraw);
+    }
+    
+    char OutputBuffer[256];
+    real32 Slope = (Variance > 0.0f) ? (Covariance / Variance) : 0.0f;
+    if(Slope < 0.0f)
+    {
+        real32 BreakEven = MeanOverdraw + ((1.0f - MeanRatio) / Slope);
+        sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Depth pre-pass pays off above an overdraw of about %.2f\n", BreakEven);
+    }
+    else
+    {
+        sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Depth pre-pass did not get cheaper with overdraw between %.2f and %.2f\n",
+                  fminf(Overdraw[0], fminf(Overdraw[1], Overdraw[2])), fmaxf(Overdraw[0], fmaxf(Overdraw[1], Overdraw[2])));
+    }
+    OutputDebugStringA(OutputBuffer);
+}
+
+/*
+Time per frame and memory of the hidden surface removal of the grid of BenchmarkVisibility, nearest first,
+with the depth buffer and with a span buffer in its place. Present is included in both.
+*/
+static void
+BenchmarkSpanBuffer(memory_arena *Arena, mesh_lod *Lod, texture *Texture, char *MeshName, uint32 Width, uint32 Height, bool32 IsTiled)
+{
+    mesh_instance Instances[BENCHMARK_INSTANCE_COUNT];
+    InitializeBenchmarkInstances(Instances, ArrayCount(Instances), false);
+    
+    win32_pixel_buffer Buffers[2];
+    real32 Seconds[2];
+    uint32 MaxSpanCount = 0;
+    uint32 OverflowCount = 0;
+    
+    for(uint32 Method = 0; Method < 2; ++Method)
+    {
+        win32_pixel_buffer *Buffer = &Buffers[Method];
+        InitializeBitmapInfo(Buffer, Width, Height, IsTiled, 1, false);
+        if(Method == 1)
+        {
+            AllocateSpanBuffer(Buffer);
+        }
+        
+        //Frame 0 only faults the pages in, it is not timed
+        LARGE_INTEGER StartWallClock = Win32GetWallClock();
+        
+        for(uint32 Frame = 0; Frame <= SPAN_BUFFER_BENCHMARK_FRAMES; ++Frame)
+        {
+            if(Frame == 1)
+            {
+                StartWallClock = Win32GetWallClock();
+            }
+            
+            ClearPixelBuffer(Buffer, 0x00000000);
+            
+            view View = CreateView(Buffer);
+            mesh *Mesh = SelectMeshLod(Lod, &View, Instances[0].Position);
+            DrawMeshInstances(Arena, Buffer, Mesh, Texture, Instances, ArrayCount(Instances));
+            GetLinearPixels(Buffer);
+        }
+        
+        Seconds[Method] = Win32GetSecondsElapsed(StartWallClock, Win32GetWallClock()) / (real32)SPAN_BUFFER_BENCHMARK_FRAMES;
+    }
+    
+    //The runs of the last frame are still there until the next clear
+    for(uint32 Y = 0; Y < Height; ++Y)
+    {
+        MaxSpanCount = (Buffers[1].SpanBuffer.Counts[Y] > MaxSpanCount) ? Buffers[1].SpanBuffer.Counts[Y] : MaxSpanCount;
+    }
+    OverflowCount = Buffers[1].SpanBuffer.OverflowCount;
+    
+    //Pixels differ where triangles overlap out of the order they were drawn in, and where stepped u/z, v/z land on the other side of a texel edge
+    uint32 MismatchCount = CountMismatchedPixels(&Buffers[0], &Buffers[1], 0);
+    
+    char OutputBuffer[512];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer),
+              "Span buffer, %s, %ux%u: depth buffer %.3fms and %.1f KB, span buffer %.3fms and %.1f KB per frame, at most %u of %u runs per scanline, %u overflows, %u mismatched pixels\n",
+              MeshName, Width, Height, (1000.0f * Seconds[0]), (real32)(GetPixelCount(&Buffers[0]) * sizeof(real32)) / 1024.0f,
+              (1000.0f * Seconds[1]), (real32)GetSpanBufferSize(&Buffers[1]) / 1024.0f, MaxSpanCount, SPAN_BUFFER_MAX_SPANS, OverflowCount, MismatchCount);
+    OutputDebugStringA(OutputBuffer);
+    
+    ReleasePixelBuffer(&Buffers[0]);
+    ReleasePixelBuffer(&Buffers[1]);
+}
+
+/*
+Time per frame of the bunnies of BenchmarkVisibility lit by a growing number of point lights spread through the grid,
+with the lights per tile that tiled culling leaves to the shading kernels. Culling and present are included.
+Run aliased and with 4x MSAA, whose triangles are lit by DrawMultisampleTriangle instead of the raster kernels.
+*/
+static void
+BenchmarkLights(memory_arena *Arena, mesh_lod *Lod, texture *Texture, uint32 Width, uint32 Height, bool32 IsTiled)
+{
+    mesh_instance Instances[BENCHMARK_INSTANCE_COUNT];
+    InitializeBenchmarkInstances(Instances, ArrayCount(Instances), false);
+    
+    uint32 LightCounts[] = {0, 16, 128, 1024};
+    uint32 SampleCounts[2] = {1, MULTISAMPLE_COUNT};
+    
+    temporary_memory LightMemory = BeginTemporaryMemory(Arena);
+    light_list Lights;
+    InitializeLightList(&Lights, Arena, LightCounts[ArrayCount(LightCounts) - 1]);
+    Lights.Ambient = (vec3){0.2f, 0.2f, 0.2f};
+    
+    for(uint32 Method = 0; Method < ArrayCount(SampleCounts); ++Method)
+    {
+        win32_pixel_buffer Buffer;
+        InitializeBitmapInfo(&Buffer, Width, Height, IsTiled, SampleCounts[Method], false);
+        AllocateLightTiles(&Buffer, Lights.MaxCount);
+        
+        for(uint32 CountIndex = 0; CountIndex < ArrayCount(LightCounts); ++CountIndex)
+        {
+            ScatterBenchmarkLights(&Lights, LightCounts[CountIndex]);
+            
+            //Frame 0 only faults the pages in, it is not timed
+            LARGE_INTEGER StartWallClock = Win32GetWallClock();
+            
+            for(uint32 Frame = 0; Frame <= LIGHT_BENCHMARK_FRAMES; ++Frame)
+            {
+                if(Frame == 1)
+                {
+                    StartWallClock = Win32GetWallClock();
+                }
+                
+                ClearPixelBuffer(&Buffer, 0x00000000);
+                
+                view View = CreateView(&Buffer);
+                CullLights(&Buffer, &View, &Lights);
+                
+                mesh *Mesh = SelectMeshLod(Lod, &View, Instances[0].Position);
+                DrawMeshInstances(Arena, &Buffer, Mesh, Texture, Instances, ArrayCount(Instances));
+                GetLinearPixels(&Buffer);
+            }
+            
+            real32 Seconds = Win32GetSecondsElapsed(StartWallClock, Win32GetWallClock()) / (real32)LIGHT_BENCHMARK_FRAMES;
+            
+            light_tiles *Lighting = &Buffer.Lighting;
+            uint32 TileCount = Lighting->TileCountX * Lighting->TileCountY;
+            uint32 MaxTileLightCount = 0;
+            for(uint32 Tile = 0; Tile < TileCount; ++Tile)
+            {
+                uint32 TileLightCount = Lighting->Offsets[Tile + 1] - Lighting->Offsets[Tile];
+                MaxTileLightCount = (TileLightCount > MaxTileLightCount) ? TileLightCount : MaxTileLightCount;
+            }
+            
+            char OutputBuffer[256];
+            sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Lights, %ux%u %ux: %u point lights, %.3fms per frame, %.2f lights per tile on average and %u at most, %u dropped\n",
+                      Width, Height, SampleCounts[Method], LightCounts[CountIndex], (1000.0f * Seconds), (real32)Lighting->Offsets[TileCount] / (real32)TileCount,
+                      MaxTileLightCount, Lighting->DroppedLightCount);
+            OutputDebugStringA(OutputBuffer);
+        }
+        
+        ReleasePixelBuffer(&Buffer);
+    }
+    
+    EndTemporaryMemory(LightMemory);
+}
+
+/*
+Time per frame of the lit bunnies of BenchmarkLights, forward and deferred, with the lighting pass on one thread and on Queue.
+The lighting pass is timed on its own too. It costs per pixel, the forward kernels light every fragment that passes the depth test.
+Deferred pixels differ from forward ones by the rounding of the packed normals.
+*/
+static void
+BenchmarkDeferred(memory_arena *Arena, mesh_lod *Lod, texture *Texture, uint32 Width, uint32 Height, bool32 IsTiled, work_queue *Queue)
+{
+    mesh_instance Instances[BENCHMARK_INSTANCE_COUNT];
+    InitializeBenchmarkInstances(Instances, ArrayCount(Instances), false);
+    
+    uint32 LightCounts[] = {16, 128, 1024};
+    
+    temporary_memory LightMemory = BeginTemporaryMemory(Arena);
+    light_list Lights;
+    InitializeLightList(&Lights, Arena, LightCounts[ArrayCount(LightCounts) - 1]);
+    Lights.Ambient = (vec3){0.2f, 0.2f, 0.2f};
+    
+    //Forward, deferred on one thread, deferred on the queue
+    win32_pixel_buffer Buffers[3];
+    for(uint32 Method = 0; Method < ArrayCount(Buffers); ++Method)
+    {
+        InitializeBitmapInfo(&Buffers[Method], Width, Height, IsTiled, 1, false);
+        AllocateLightTiles(&Buffers[Method], Lights.MaxCount);
+        if(Method > 0)
+        {
+            AllocateGBuffer(&Buffers[Method], (Method == 2) ? Queue : 0);
+        }
+    }
+    
+    for(uint32 CountIndex = 0; CountIndex < ArrayCount(LightCounts); ++CountIndex)
+    {
+        ScatterBenchmarkLights(&Lights, LightCounts[CountIndex]);
+        
+        real32 Seconds[3];
+        real32 LightingSeconds[3];
+        
+        for(uint32 Method = 0; Method < ArrayCount(Buffers); ++Method)
+        {
+            win32_pixel_buffer *Buffer = &Buffers[Method];
+            LightingSeconds[Method] = 0.0f;
+            
+            //Frame 0 only faults the pages in, it is not timed
+            LARGE_INTEGER StartWallClock = Win32GetWallClock();
+            
+            for(uint32 Frame = 0; Frame <= DEFERRED_BENCHMARK_FRAMES; ++Frame)
+            {
+                if(Frame == 1)
+                {
+                    StartWallClock = Win32GetWallClock();
+                }
+                
+                ClearPixelBuffer(Buffer, 0x00000000);
+                
+                view View = CreateView(Buffer);
+                CullLights(Buffer, &View, &Lights);
+                
+                mesh *Mesh = SelectMeshLod(Lod, &View, Instances[0].Position);
+                DrawMeshInstances(Arena, Buffer, Mesh, Texture, Instances, ArrayCount(Instances));
+                
+                LARGE_INTEGER LightingWallClock = Win32GetWallClock();
+                ResolveGBuffer(Buffer);
+                if(Frame > 0)
+                {
+                    LightingSeconds[Method] += Win32GetSecondsElapsed(LightingWallClock, Win32GetWallClock());
+                }
+                
+                GetLinearPixels(Buffer);
+            }
+            
+            Seconds[Method] = Win32GetSecondsElapsed(StartWallClock, Win32GetWallClock()) / (real32)DEFERRED_BENCHMARK_FRAMES;
+            LightingSeconds[Method] /= (real32)DEFERRED_BENCHMARK_FRAMES;
+        }
+        
+        uint32 MaxDifference = 0;
+        uint32 MismatchCount = CountMismatchedPixels(&Buffers[0], &Buffers[2], &MaxDifference);
+        
+        uint32 ThreadCount = Queue ? (Queue->ThreadCount + 1) : 1;
+        
+        char OutputBuffer[320];
+        sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Deferred shading, %ux%u, %u point lights: forward %.3fms, deferred %.3fms on 1 thread and %.3fms on %u, "
+                  "lighting pass %.3fms and %.3fms, %u pixels differ from forward by %u at most\n",
+                  Width, Height, LightCounts[CountIndex], (1000.0f * Seconds[0]), (1000.0f * Seconds[1]), (1000.0f * Seconds[2]), ThreadCount,
+                  (1000.0f * LightingSeconds[1]), (1000.0f * LightingSeconds[2]), MismatchCount, MaxDifference);
+        OutputDebugStringA(OutputBuffer);
+    }
+    
+    for(uint32 Method = 0; Method < ArrayCount(Buffers); ++Method)
+    {
+        ReleasePixelBuffer(&Buffers[Method]);
+    }
+    EndTemporaryMemory(LightMemory);
+}
+
+/*
+The bunnies of BenchmarkVisibility, timed first at full size and at the smallest size the controller goes to. The budget is set
+halfway between the two, the controller has to find the size that holds it. Reports where it settles, the frame time over the
+last frames and the part of it the upscaler takes.
+*/
+static void
+BenchmarkDynamicResolution(memory_arena *Arena, mesh_lod *Lod, texture *Texture, uint32 Width, uint32 Height, bool32 IsTiled)
+{
+    mesh_instance Instances[BENCHMARK_INSTANCE_COUNT];
+    InitializeBenchmarkInstances(Instances, ArrayCount(Instances), false);
+    
+    win32_pixel_buffer Output;
+    InitializeBitmapInfo(&Output, Width, Height, IsTiled, 1, false);
+    
+    win32_pixel_buffer Buffer;
+    InitializeBitmapInfo(&Buffer, Width, Height, IsTiled, 1, false);
+    
+    dynamic_resolution Resolution;
+    InitializeDynamicResolution(&Resolution, Width, Height, 0.0f);
+    
+    //Frames 1 to 4 measure the full size, 6 to 9 the smallest, frames 0 and 5 only fault the pages in
+    uint32 MeasureFrameCount = 4;
+    uint32 TailFrameCount = 16;
+    uint32 ControlFrame = 2 * (MeasureFrameCount + 1);
+    uint32 FrameCount = ControlFrame + DYNAMIC_RESOLUTION_BENCHMARK_FRAMES;
+    
+    real32 EndSeconds[2] = {0.0f, 0.0f};
+    real32 TailSeconds = 0.0f;
+    real32 TailUpscaleSeconds = 0.0f;
+    
+    for(uint32 Frame = 0; Frame < FrameCount; ++Frame)
+    {
+        if(Frame == (MeasureFrameCount + 1))
+        {
+            ReleasePixelBuffer(&Buffer);
+            InitializeBitmapInfo(&Buffer, (Width * DYNAMIC_RESOLUTION_MIN_EIGHTHS) / DYNAMIC_RESOLUTION_MAX_EIGHTHS,
+                                 (Height * DYNAMIC_RESOLUTION_MIN_EIGHTHS) / DYNAMIC_RESOLUTION_MAX_EIGHTHS, IsTiled, 1, false);
+        }
+        else if(Frame == ControlFrame)
+        {
+            InitializeDynamicResolution(&Resolution, Width, Height, 0.5f * (EndSeconds[0] + EndSeconds[1]));
+            
+            ReleasePixelBuffer(&Buffer);
+            InitializeBitmapInfo(&Buffer, Resolution.Width, Resolution.Height, IsTiled, 1, false);
+        }
+        
+        LARGE_INTEGER StartWallClock = Win32GetWallClock();
+        
+        ClearPixelBuffer(&Buffer, 0x00000000);
+        
+        view View = CreateView(&Buffer);
+        mesh *Mesh = SelectMeshLod(Lod, &View, Instances[0].Position);
+        DrawMeshInstances(Arena, &Buffer, Mesh, Texture, Instances, ArrayCount(Instances));
+        
+        LARGE_INTEGER UpscaleWallClock = Win32GetWallClock();
+        UpscalePixelBuffer(Arena, &Buffer, &Output);
+        
+        LARGE_INTEGER EndWallClock = Win32GetWallClock();
+        real32 Seconds = Win32GetSecondsElapsed(StartWallClock, EndWallClock);
+        
+        if(Frame < ControlFrame)
+        {
+            uint32 End = Frame / (MeasureFrameCount + 1);
+            if((Frame % (MeasureFrameCount + 1)) != 0)
+            {
+                EndSeconds[End] += Seconds / (real32)MeasureFrameCount;
+            }
+            continue;
+        }
+        
+        if(Frame >= (FrameCount - TailFrameCount))
+        {
+            TailSeconds += Seconds / (real32)TailFrameCount;
+            TailUpscaleSeconds += Win32GetSecondsElapsed(UpscaleWallClock, EndWallClock) / (real32)TailFrameCount;
+        }
+        
+        if(UpdateDynamicResolution(&Resolution, Seconds))
+        {
+            ReleasePixelBuffer(&Buffer);
+            InitializeBitmapInfo(&Buffer, Resolution.Width, Resolution.Height, IsTiled, 1, false);
+        }
+    }
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Dynamic resolution, %ux%u: %.3fms per frame at full size, %.3fms at %u/%u, budget %.3fms\n",
+              Width, Height, (1000.0f * EndSeconds[0]), (1000.0f * EndSeconds[1]), DYNAMIC_RESOLUTION_MIN_EIGHTHS, DYNAMIC_RESOLUTION_MAX_EIGHTHS,
+              (1000.0f * Resolution.BudgetSeconds));
+    OutputDebugStringA(OutputBuffer);
+    
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Dynamic resolution settled at %ux%u after %u steps, %.3fms per frame over the last %u frames with %.3fms of upscaling\n",
+              Resolution.Width, Resolution.Height, Resolution.StepCount, (1000.0f * TailSeconds), TailFrameCount, (1000.0f * TailUpscaleSeconds));
+    OutputDebugStringA(OutputBuffer);
+    
+    ReleasePixelBuffer(&Buffer);
+    ReleasePixelBuffer(&Output);
+}
+
+/*
+The bunnies of BenchmarkVisibility drawn without presenting, drawn and presented one after the other on this thread, and
+drawn here while the present thread shows them. Flips are not waited for, so the pipelined frame time is the time of drawing or
+presenting, whichever is longer, where the serial one is the sum of the two.
+*/
+static void
+BenchmarkFramePipeline(memory_arena *Arena, mesh_lod *Lod, texture *Texture, HWND Window, uint32 Width, uint32 Height, bool32 IsTiled)
+{
+    mesh_instance Instances[BENCHMARK_INSTANCE_COUNT];
+    InitializeBenchmarkInstances(Instances, ArrayCount(Instances), false);
+    
+    win32_pixel_buffer Buffer;
+    InitializeBitmapInfo(&Buffer, Width, Height, IsTiled, 1, false);
+    
+    frame_pipeline Pipeline;
+    HDC DeviceContext = GetDC(Window);
+    
+    real32 Seconds[3];
+    for(uint32 Method = 0; Method < ArrayCount(Seconds); ++Method)
+    {
+        if(Method == 2)
+        {
+            Win32StartFramePipeline(&Pipeline, Window, Width, Height, IsTiled, 0.0f);
+        }
+        
+        //Frame 0 only faults the pages in, it is not timed
+        LARGE_INTEGER StartWallClock = Win32GetWallClock();
+        
+        for(uint32 Frame = 0; Frame <= FRAME_PIPELINE_BENCHMARK_FRAMES; ++Frame)
+        {
+            if(Frame == 1)
+            {
+                StartWallClock = Win32GetWallClock();
+            }
+            
+            win32_pixel_buffer *Target = (Method == 2) ? Win32BeginFrame(&Pipeline) : &Buffer;
+            
+            ClearPixelBuffer(Target, 0x00000000);
+            
+            view View = CreateView(Target);
+            mesh *Mesh = SelectMeshLod(Lod, &View, Instances[0].Position);
+            DrawMeshInstances(Arena, Target, Mesh, Texture, Instances, ArrayCount(Instances));
+            
+            if(Method == 1)
+            {
+                Win32UpdateWindow(Target, DeviceContext, Width, Height);
+            }
+            else if(Method == 2)
+            {
+                Win32EndFrame(&Pipeline);
+            }
+        }
+        
+        //The pipeline is only done once the last frame is shown
+        if(Method == 2)
+        {
+            Win32StopFramePipeline(&Pipeline);
+        }
+        
+        Seconds[Method] = Win32GetSecondsElapsed(StartWallClock, Win32GetWallClock()) / (real32)FRAME_PIPELINE_BENCHMARK_FRAMES;
+    }
+    
+    ReleaseDC(Window, DeviceContext);
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Frame pipeline, %ux%u: %.3fms per frame drawing only, %.3fms drawing then presenting, "
+              "%.3fms pipelined over %u back buffers with %.3fms per present\n",
+              Width, Height, (1000.0f * Seconds[0]), (1000.0f * Seconds[1]), (1000.0f * Seconds[2]), PRESENT_BUFFER_COUNT,
+              (1000.0f * Pipeline.PresentSeconds) / (real32)Pipeline.PresentCount);
+    OutputDebugStringA(OutputBuffer);
+    
+    ReleasePixelBuffer(&Buffer);
+}
+
+//Every benchmark once, at the size and layout of the window buffer
+static void
+RunBenchmarks(memory_arena *Arena, mesh_lod *Lod, texture *Texture, HWND Window, win32_pixel_buffer *Buffer)
+{
+    BenchmarkScene(Buffer, Lod);
+    BenchmarkPixelLayout(Arena, Lod, Texture, Buffer->Width, Buffer->Height);
+    BenchmarkClear(Buffer->Width, Buffer->Height, Buffer->IsTiled);
+    BenchmarkBlend(Buffer->Width, Buffer->Height, Buffer->IsTiled);
+    BenchmarkMultisample(Arena, Lod, Texture, Buffer->Width, Buffer->Height, Buffer->IsTiled);
+    BenchmarkVisibility(Arena, Lod, Texture, Buffer->Width, Buffer->Height, Buffer->IsTiled);
+    BenchmarkDepthPrePass(Arena, Lod, Texture, Buffer->Width, Buffer->Height, Buffer->IsTiled);
+    BenchmarkSpanBuffer(Arena, Lod, Texture, "bunny", Buffer->Width, Buffer->Height, Buffer->IsTiled);
+    BenchmarkLights(Arena, Lod, Texture, Buffer->Width, Buffer->Height, Buffer->IsTiled);
+    BenchmarkDeferred(Arena, Lod, Texture, Buffer->Width, Buffer->Height, Buffer->IsTiled, &GlobalWorkQueue);
+    BenchmarkDynamicResolution(Arena, Lod, Texture, Buffer->Width, Buffer->Height, Buffer->IsTiled);
+    BenchmarkFramePipeline(Arena, Lod, Texture, Window, Buffer->Width, Buffer->Height, Buffer->IsTiled);
+    
+    //The buddha is only loaded for the span buffer benchmark, a second mesh with more layers behind its front than the bunny
+    mesh BuddhaMesh = {0};
+    ReadObjectFile("./data/scaled_down_buddha.obj", &BuddhaMesh);
+    BuildMeshlets(&BuddhaMesh);
+    OptimizeVertexCache(&BuddhaMesh);
+    OptimizeVertexFetch(&BuddhaMesh);
+    
+    mesh_lod BuddhaLod;
+    BuildMeshLod(&BuddhaMesh, &BuddhaLod);
+    QuantizeMeshLod(&BuddhaLod);
+    
+    file BuddhaTextureFile;
+    ReadBitmap(&BuddhaTextureFile, "./data/buddha_atlas.bmp");
+    bitmap_header *BuddhaTextureHeader = (bitmap_header *)BuddhaTextureFile.Contents;
+    
+    texture BuddhaTexture;
+    BuddhaTexture.Width = BuddhaTextureHeader->Width;
+    BuddhaTexture.Height = BuddhaTextureHeader->Height;
+    BuddhaTexture.Bytes = (uint32 *)((uint8 *)BuddhaTextureFile.Contents + BuddhaTextureHeader->BitmapOffset);
+    BuddhaTexture.BytesPerTexel = (BuddhaTextureHeader->BitsPerPixel / 8);
+    
+    BenchmarkSpanBuffer(Arena, &BuddhaLod, &BuddhaTexture, "buddha", Buffer->Width, Buffer->Height, Buffer->IsTiled);
+}
+#endif
+
+int WINAPI WinMain(HINSTANCE Instance, 
+                   HINSTANCE PrevInstance, 
+                   PSTR CommandLine, 
+                   int ShowCode)
+{
+    SetThreadDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+    
+#if PROFILER
+    InitializeProfiler();
+#endif
+    
+    //Set schedular granularity, the present thread sleeps until each flip is due
+    timeBeginPeriod(1);
+    
+    uint32 WindowHz = 30;
+    real32 TargetSecondsPerFrame = 1.0f / (real32)WindowHz;
+    
+    WNDCLASSA WindowClass = {0};
+    WindowClass.style = CS_OWNDC | CS_HREDRAW | CS_VREDRAW;
+    WindowClass.lpfnWndProc = &Win32WindowProcedure;
+    WindowClass.hInstance = Instance;
+    WindowClass.lpszClassName = "Win32 Renderer Class";
+    
+    if(RegisterClassA(&WindowClass))
+    {
+        HWND WindowHandle = CreateWindowExA(
+                                            0,
+                                            WindowClass.lpszClassName,
+                                            "Renderer",
+                                            WS_OVERLAPPEDWINDOW | WS_VISIBLE,
+                                            CW_USEDEFAULT,
+                                            CW_USEDEFAULT,
+                                            CW_USEDEFAULT,
+                                            CW_USEDEFAULT,
+                                            0,
+                                            0,
+                                            Instance,
+                                            0);
+        
+        if(WindowHandle)
+        {
+            QueryPerformanceFrequency(&GlobalPerfFrequency);
+            
+            //Nothing is drawn into it any more, frames go to the render buffer and are shown from the back buffers of the
+            //frame pipeline, so only the size and layout of the window buffer are kept
+            GlobalPixelBuffer.Width = 2560;
+            GlobalPixelBuffer.Height = 1440;
+            //Tiles only pay off once raster is bound by memory rather than by shading, BenchmarkPixelLayout compares the two
+            GlobalPixelBuffer.IsTiled = false;
+            InitializeSmallTriangleMasks();
+            
+            occlusion_buffer Occlusion;
+            InitializeOcclusionBuffer(&Occlusion, GlobalPixelBuffer.Width, GlobalPixelBuffer.Height);
+            GlobalPixelBuffer.tPerFrame = TargetSecondsPerFrame;
+            
+            //Only the pages a frame actually touches get committed, so the reservation can be generous
+            memory_arena Arena;
+            InitializeArena(&Arena, GIGABYTE(1), (void *)MEGABYTE(64));
+            
+            InitializeWorkQueue(&GlobalWorkQueue, GetWorkerThreadCount());
+            
+            bitmap_header BitmapHeader = {0};
+            BitmapHeader.FileType = 0x4D42;
+            BitmapHeader.FileSize = 4096070;
+            BitmapHeader.Reserved1 = 0;
+            BitmapHeader.Reserved2 = 0;
+            BitmapHeader.BitmapOffset = 70;
+            BitmapHeader.Size = 56;
+            BitmapHeader.Width = 2560;
+            BitmapHeader.Height = 1600;
+            BitmapHeader.Planes = 1;
+            BitmapHeader.BitsPerPixel = 32;
+            BitmapHeader.Compression = 3;
+            BitmapHeader.SizeOfBitmap = (BitmapHeader.Width * BitmapHeader.Height * 4);
+            BitmapHeader.HorzResolution = 2834;
+            BitmapHeader.VertResolution = 2834;
+            BitmapHeader.ColorsUsed = 0;
+            BitmapHeader.ColorsImportant = 0;
+            BitmapHeader.RedMask = 0x00FF0000;
+            BitmapHeader.GreenMask = 0x0000FF00;
+            BitmapHeader.BlueMask = 0x000000FF;
+            BitmapHeader.AlphaMask = 0xFF000000;
+            
+            uint32 *BitmapBits = (uint32 *)VirtualAlloc(0, BitmapHeader.SizeOfBitmap, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            
+            
+#define VERTEX_COUNT 8
+            vertex Vertices[VERTEX_COUNT] = 
+            {
+                {{-1.0f, -1.0f, -1.0f}},
+                {{-1.0f, 1.0f, -1.0f}},
+                {{1.0f, 1.0f, -1.0f}},
+                {{1.0f, -1.0f, -1.0f}},
+                {{1.0f, 1.0f, 1.0f}},
+                {{1.0f, -1.0f, 1.0f}},
+                {{-1.0f, 1.0f, 1.0f}},
+                {{-1.0f, -1.0f, 1.0f}}
+            };
+            
+#define TRIANGLE_COUNT 12
+            triangle Triangles[TRIANGLE_COUNT] =
+            {
+                {1,2,3, 0XFFFF0000},
+                {1,3,4, 0XFFFF0000},
+                
+                {6,5,7, 0XFFFF00FF},
+                {6,7,8, 0XFFFF00FF},
+                
+                {8,7,2, 0XFF00FF00},
+                {8,2,1, 0XFF00FF00},
+                
+                {4,3,5, 0XFFFFFF00},
+                {4,5,6, 0XFFFFFF00},
+                
+                {2,7,5, 0XFF0000FF},
+                {2,5,3, 0XFF0000FF},
+                
+                {6,8,1, 0XFF00FFFF},
                 {6,1,4, 0XFF00FFFF}
             };
             
-            mesh Mesh;
+            mesh Mesh = {0};
             Mesh.VertexCount = VERTEX_COUNT;
-            Mesh.Vertices = (vec3 *)Vertices;
+            Mesh.Vertices = (vertex *)Vertices;
             Mesh.TriangleCount = TRIANGLE_COUNT;
             Mesh.Triangles = (triangle *)Triangles;
+            BuildMeshlets(&Mesh);
+            QuantizeMesh(&Mesh);
             
             mesh NewMesh = {0};
             char *FileName = "./data/scaled_down_bunny.obj";
             ReadObjectFile(FileName, &NewMesh);
+            real32 LoadedMissRatio = GetVertexCacheMissRatio(&NewMesh);
+            
+            BuildMeshlets(&NewMesh);
+            real32 MeshletMissRatio = GetVertexCacheMissRatio(&NewMesh);
+            
+            OptimizeVertexCache(&NewMesh);
+            OptimizeVertexFetch(&NewMesh);
+            
+            char OutputBuffer[256];
+            sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "ACMR: %.3f as loaded, %.3f in meshlet order, %.3f optimized\n", LoadedMissRatio, MeshletMissRatio, GetVertexCacheMissRatio(&NewMesh));
+            OutputDebugStringA(OutputBuffer);
+            
+            mesh_lod BunnyLod;
+            BuildMeshLod(&NewMesh, &BunnyLod);
+            
+            //The float vertices are only needed to build the chain, every level draws from one packed copy
+            QuantizeMeshLod(&BunnyLod);
+            NewMesh = BunnyLod.Levels[0];
+            
+            //The same bunny as a streaming file, drawn from mapped chunks like a scan too big to load would be.
+            //Run with -write-stream to convert the loaded bunny to that file first, without it a missing file only leaves it out.
+            if(Win32HasCommandLineSwitch(CommandLine, "-write-stream") &&
+               !WriteStreamingMesh("./data/scaled_down_bunny.mesh", &NewMesh))
+            {
+                OutputDebugStringA("Streaming: could not write ./data/scaled_down_bunny.mesh\n");
+            }
+            
+            streaming_mesh BunnyStream;
+            bool32 IsBunnyStreamOpen = OpenStreamingMesh(&BunnyStream, "./data/scaled_down_bunny.mesh");
+            if(!IsBunnyStreamOpen)
+            {
+                OutputDebugStringA("Streaming: could not open ./data/scaled_down_bunny.mesh, run with -write-stream to write it\n");
+            }
             
             file TextureFile;
             ReadBitmap(&TextureFile, "./data/bunny_atlas.bmp");
@@ -895,7 +2389,58 @@ int WINAPI WinMain(HINSTANCE Instance,
             uint32 Color = 0xC8A2C8;
             bool32 FillTriangles = true;
             
-            DrawMesh(&Arena, &GlobalPixelBuffer, &NewMesh, &Texture, AngleX, AngleY, AngleZ, FillTriangles, Color);
+            //One bunny in front hides a grid of bunnies behind it
+            scene Scene;
+            InitializeScene(&Scene, 16);
+            AddSceneObject(&Scene, &BunnyLod, (vec3){0.0f, 0.0f, -1.0f}, true);
+            
+            for(uint32 ObjectIndex = 0; ObjectIndex < 9; ++ObjectIndex)
+            {
+                uint32 Column = ObjectIndex % 3;
+                uint32 Row = ObjectIndex / 3;
+                AddSceneObject(&Scene, &BunnyLod, (vec3){0.1f * ((real32)Column - 1.0f), 0.1f * ((real32)Row - 1.0f), 60.0f}, false);
+            }
+            
+            BuildSceneBvh(&Scene);
+            
+#if BENCHMARKS
+            RunBenchmarks(&Arena, &BunnyLod, &Texture, WindowHandle, &GlobalPixelBuffer);
+#endif
+            
+            //A wall of tinted bunnies far behind the scene, drawn from one mesh
+#define INSTANCE_COUNT_X 32
+#define INSTANCE_COUNT_Y 18
+            uint32 InstanceCount = INSTANCE_COUNT_X * INSTANCE_COUNT_Y;
+            mesh_instance *Instances = (mesh_instance *)VirtualAlloc(0, InstanceCount * sizeof(mesh_instance), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            
+            for(uint32 InstanceIndex = 0; InstanceIndex < InstanceCount; ++InstanceIndex)
+            {
+                uint32 Column = InstanceIndex % INSTANCE_COUNT_X;
+                uint32 Row = InstanceIndex / INSTANCE_COUNT_X;
+                
+                mesh_instance *Instance = &Instances[InstanceIndex];
+                Instance->Position = (vec3){0.5f * ((real32)Column - 15.5f), 0.5f * ((real32)Row - 8.5f), 200.0f};
+                Instance->Rotation = (vec3){0.0f, 0.2f * (real32)Column, 0.0f};
+                Instance->Scale = 1.0f;
+                Instance->Color = 0xFF000000 | ((uint32)NumberArray[InstanceIndex] & 0x00FFFFFF);
+                Instance->BlendMode = Blend_Opaque;
+            }
+            
+            mesh_instance StreamInstance;
+            StreamInstance.Position = (vec3){0.3f, 0.0f, 10.0f};
+            StreamInstance.Rotation = (vec3){0.0f, 0.0f, 0.0f};
+            StreamInstance.Scale = 1.0f;
+            //See-through, composited over the wall when the frame is presented
+            StreamInstance.Color = 0xB0FFFFFF;
+            StreamInstance.BlendMode = Blend_Transparent;
+            
+            //Frames are drawn at whatever size holds the frame budget and upscaled into the window buffer, see dynamic_resolution.c
+            dynamic_resolution Resolution;
+            InitializeDynamicResolution(&Resolution, GlobalPixelBuffer.Width, GlobalPixelBuffer.Height, TargetSecondsPerFrame);
+            
+            //Multisampled like the window buffer was before the frame was scaled, the samples are resolved before the upscale reads them
+            win32_pixel_buffer RenderBuffer;
+            InitializeBitmapInfo(&RenderBuffer, Resolution.Width, Resolution.Height, GlobalPixelBuffer.IsTiled, MULTISAMPLE_COUNT, false);
             
             //FillFlatBottomTriangle(&GlobalPixelBuffer, PointA, PointB,  PointC, Color);
             
@@ -907,7 +2452,12 @@ int WINAPI WinMain(HINSTANCE Instance,
             
             //SaveBitmap(&GlobalPixelBuffer, &BitmapHeader, BitmapBits, "line.bmp");
             
-            LARGE_INTEGER FlipWallClock = Win32GetWallClock();
+            //Frames are drawn here and shown by a present thread, see Win32PresentThreadProc
+            frame_pipeline Pipeline;
+            Win32StartFramePipeline(&Pipeline, WindowHandle, GlobalPixelBuffer.Width, GlobalPixelBuffer.Height, GlobalPixelBuffer.IsTiled, TargetSecondsPerFrame);
+            
+            uint32 SceneFrameCount = 0;
+            
             GlobalRunning = true;
             
             while(GlobalRunning)
@@ -929,69 +2479,104 @@ int WINAPI WinMain(HINSTANCE Instance,
                     }
                 }
                 
-                //DrawRect(&GlobalPixelBuffer, (vec2){0, 0}, (vec2){(real32)GlobalPixelBuffer.Width, (real32)GlobalPixelBuffer.Height}, 0x00000000);
-                DrawPixel(&GlobalPixelBuffer, (vec2){0, 0}, 0xFFFF0000);
+                win32_pixel_buffer *BackBuffer = Win32BeginFrame(&Pipeline);
+                LARGE_INTEGER RenderWallClock = Win32GetWallClock();
+                BEGIN_PROFILE_ZONE(Frame);
                 
-                // NOTE(not-set): This functions is frame dependent, might want to change it to frame independent later!
+                for(uint32 InstanceIndex = 0; InstanceIndex < InstanceCount; ++InstanceIndex)
+                {
+                    Instances[InstanceIndex].Rotation.Y = (0.2f * (real32)(InstanceIndex % INSTANCE_COUNT_X)) + AngleY;
+                }
                 
-                //DrawMesh(&Arena, &GlobalPixelBuffer, &NewMesh, &Texture, AngleX, AngleY, AngleZ, FillTriangles, Color);
+                ClearPixelBuffer(&RenderBuffer, 0x00000000);
                 
-                //DrawMesh(&Arena, &GlobalPixelBuffer, &Mesh, &Texture, AngleX, AngleY, AngleZ, FillTriangles, Color);
+                //Nearest first, so the wall behind the scene fails the depth test early wherever the scene covers it
+                scene_stats SceneStats = {0};
+                DrawScene(&Arena, &RenderBuffer, &Occlusion, &Scene, &Texture, &SceneStats);
                 
-                AngleX = 0.01f;
-                AngleY = 0.01f;
-                AngleZ = 0.01f;
+                if((++SceneFrameCount % SCENE_STATS_PRINT_INTERVAL) == 0)
+                {
+                    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Scene: %u/%u visible, %u nodes, occluders %.3fms, query %.3fms\n",
+                              SceneStats.VisibleCount, SceneStats.ObjectCount, SceneStats.NodesVisited,
+                              (1000.0f * SceneStats.OccluderSeconds), (1000.0f * SceneStats.QuerySeconds));
+                    OutputDebugStringA(OutputBuffer);
+                }
                 
-                uint32 GridWidth = 10;
-                uint32 GridHeight = 10;
-                //DrawGrid(&GlobalPixelBuffer, GridWidth, GridHeight, 0x77333333);
+                view InstanceView = CreateView(&RenderBuffer);
+                mesh *InstanceMesh = SelectMeshLod(&BunnyLod, &InstanceView, Instances[0].Position);
+                DrawMeshInstances(&Arena, &RenderBuffer, InstanceMesh, &Texture, Instances, InstanceCount);
                 
+                if(IsBunnyStreamOpen)
+                {
+                    DrawStreamingMesh(&Arena, &RenderBuffer, &BunnyStream, &Texture, &StreamInstance);
+                }
                 
+                BEGIN_PROFILE_ZONE(Upscale);
+                UpscalePixelBuffer(&Arena, &RenderBuffer, BackBuffer);
+                END_PROFILE_ZONE(Upscale);
                 
-                LARGE_INTEGER WorkWallClock = Win32GetWallClock();
-                real32 WorkSeconds = Win32GetSecondsElapsed(FlipWallClock, WorkWallClock);
-                //Sleep
-                if(WorkSeconds < TargetSecondsPerFrame)
+                //Drawing and upscaling are what the size controls, waiting for a back buffer is left out
+                if(UpdateDynamicResolution(&Resolution, Win32GetSecondsElapsed(RenderWallClock, Win32GetWallClock())))
                 {
-                    if(SleepIsGranular)
-                    {
-                        uint32 SleepMS = (uint32)(1000.0f * (TargetSecondsPerFrame - WorkSeconds)) - 1;
-                        Sleep(SleepMS);
-                    }
-                    
-                    WorkWallClock = Win32GetWallClock();
-                    WorkSeconds = Win32GetSecondsElapsed(FlipWallClock, WorkWallClock);
+                    ReleasePixelBuffer(&RenderBuffer);
+                    InitializeBitmapInfo(&RenderBuffer, Resolution.Width, Resolution.Height, GlobalPixelBuffer.IsTiled, MULTISAMPLE_COUNT, false);
                     
-                    /*char OutputBuffer[256];
-                    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "B: %.2fms, ", (1000.0f * WorkSeconds));
-                    OutputDebugStringA(OutputBuffer);*/
-                    
-                    while(WorkSeconds < TargetSecondsPerFrame)
-                    {
-                        WorkWallClock = Win32GetWallClock();
-                        WorkSeconds = Win32GetSecondsElapsed(FlipWallClock, WorkWallClock);
-                    }
-                    
-                    /*sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "A: %.2fms\n", (1000.0f * WorkSeconds));
-                    OutputDebugStringA(OutputBuffer);*/
+                    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Dynamic resolution: %ux%u, %.3fms per frame on average\n",
+                              Resolution.Width, Resolution.Height, (1000.0f * Resolution.AverageSeconds));
+                    OutputDebugStringA(OutputBuffer);
                 }
                 
-                //Flip
-                RECT WindowDimensions;
-                GetClientRect(WindowHandle, &WindowDimensions);
+                //DrawRect(&GlobalPixelBuffer, (vec2){0, 0}, (vec2){(real32)GlobalPixelBuffer.Width, (real32)GlobalPixelBuffer.Height}, 0x00000000);
+                DrawPixel(BackBuffer, (vec2){0, 0}, 0xFFFF0000);
+                
+                // NOTE(not-set): This functions is frame dependent, might want to change it to frame independent later!
+                
+                //DrawMesh(&Arena, &GlobalPixelBuffer, &NewMesh, (vec3){0}, &Texture, AngleX, AngleY, AngleZ, FillTriangles, Color);
                 
-                uint32 WindowWidth = WindowDimensions.right - WindowDimensions.left;
-                uint32 WindowHeight = WindowDimensions.bottom - WindowDimensions.top;
+                //DrawMesh(&Arena, &GlobalPixelBuffer, &Mesh, (vec3){0}, &Texture, AngleX, AngleY, AngleZ, FillTriangles, Color);
                 
-                HDC DeviceContext = GetDC(WindowHandle);
-                Win32UpdateWindow(&GlobalPixelBuffer, DeviceContext, WindowWidth, WindowHeight);
-                ReleaseDC(WindowHandle, DeviceContext);
+                AngleX += 0.01f;
+                AngleY += 0.01f;
+                AngleZ += 0.01f;
+                
+                uint32 GridWidth = 10;
+                uint32 GridHeight = 10;
+                //DrawGrid(&GlobalPixelBuffer, GridWidth, GridHeight, 0x77333333);
+                
+                
+                
+                END_PROFILE_ZONE(Frame);
+                Win32EndFrame(&Pipeline);
+                
+                //Per frame data only lives in temporary memory, so every frame ends with the arenas back where they started
+                CheckArena(&Arena);
+                CheckWorkQueueArenas(&GlobalWorkQueue);
                 
-                //After Flip
-                FlipWallClock = Win32GetWallClock();
                 
+            }
+            
+            Win32StopFramePipeline(&Pipeline);
+            
+#if PROFILER
+            //Every thread is idle now, the trace holds the last frames and is only written when run with -profile-trace
+            PrintProfileSummary();
+            if(Win32HasCommandLineSwitch(CommandLine, "-profile-trace") &&
+               !WriteProfileTrace("./data/profile_trace.json"))
+            {
+                OutputDebugStringA("Profile: could not write ./data/profile_trace.json\n");
+            }
+#endif
+            
+            if(IsBunnyStreamOpen)
+            {
+                sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Streaming: %llu chunk maps, %llu hits, peak resident %llu bytes\n",
+                          BunnyStream.MapCount, BunnyStream.HitCount, BunnyStream.PeakResidentBytes);
+                OutputDebugStringA(OutputBuffer);
                 
+                CloseStreamingMesh(&BunnyStream);
             }
+            
+            ReleasePixelBuffer(&RenderBuffer);
         }
     }
     
@@ -22,11 +22,309 @@ typedef int32 bool32;
 #define PI 3.14159265359f
 
 #define ArrayCount(Array) (sizeof(Array)/sizeof(Array[0]))
-#define Assert(Expression) if(Expression == 0) { *(uint32 *)0 = 0;}
+#define Assert(Expression) if(!(Expression)) { *(uint32 *)0 = 0;}
 
-#define KILOBYTE(Value) (Value << 10)
-#define MEGABYTE(Value) (Value << 20)
-#define GIGABYTE(Value) (Value << 30)
+//64 bit, so sizes of 4 GB and more do not wrap around
+#define KILOBYTE(Value) ((uint64)(Value) << 10)
+#define MEGABYTE(Value) ((uint64)(Value) << 20)
+#define GIGABYTE(Value) ((uint64)(Value) << 30)
+
+//Build with BENCHMARKS 1 to time the renderer paths against each other once at startup, before the first frame
+#ifndef BENCHMARKS
+#define BENCHMARKS 0
+#endif
+
+//A tile of a tiled pixel buffer is one cache line of 4 x 4 pixels, stored row by row
+#define PIXEL_TILE_SHIFT 2
+#define PIXEL_TILE_WIDTH (1 << PIXEL_TILE_SHIFT)
+#define PIXEL_TILE_HEIGHT (1 << PIXEL_TILE_SHIFT)
+#define PIXEL_TILE_SIZE (PIXEL_TILE_WIDTH * PIXEL_TILE_HEIGHT)
+
+typedef struct
+{
+    real32 X;
+    real32 Y;
+}vec2;
+
+typedef struct
+{
+    real32 X;
+    real32 Y;
+    real32 Z;
+}vec3;
+
+typedef struct
+{
+    real32 X;
+    real32 Y;
+    real32 Z;
+    real32 W;
+}vec4;
+
+typedef struct
+{
+    real32 X;
+    real32 Y;
+    real32 Z;
+    real32 U;
+    real32 V;
+}vec5;
+
+typedef struct
+{
+    real32 M[4][4];
+}mat4;
+
+typedef struct
+{
+    uint32 Width;
+    uint32 Height;
+    uint32 BytesPerTexel;
+    uint32 *Bytes;
+}texture;
+
+//Everything the shading pass of a visibility buffer needs of a triangle, see visibility.c
+typedef struct
+{
+    //Plane equations of 1/z, u/z and v/z, values at the pixel position (X, Y) and their steps per pixel
+    real32 X;
+    real32 Y;
+    
+    real32 OneOverZ;
+    real32 dOneOverZdX;
+    real32 dOneOverZdY;
+    
+    real32 UOverZ;
+    real32 dUOverZdX;
+    real32 dUOverZdY;
+    
+    real32 VOverZ;
+    real32 dVOverZdX;
+    real32 dVOverZdY;
+    
+    uint32 Color;
+    texture *Texture;
+}visibility_triangle;
+
+typedef struct
+{
+    //Index + 1 of the visible triangle per pixel in the layout of the pixel buffer, 0 where none has been drawn since the last resolve.
+    //Allocated by AllocateVisibilityBuffer, buffers without them shade while they rasterize.
+    uint32 *Ids;
+    
+    visibility_triangle *Triangles;
+    uint32 TriangleCount;
+    
+    //Pixels written since the last resolve, Max is exclusive
+    int32 MinX;
+    int32 MinY;
+    int32 MaxX;
+    int32 MaxY;
+}visibility_buffer;
+
+//Weighted blended order independent transparency, see transparency.c
+typedef struct
+{
+    //Planes of one float per pixel in the layout of the pixel buffer, allocated by the first transparent draw.
+    //Sums of color * weight and of weight, and the coverage 1 - (1 - Alpha1) * (1 - Alpha2) * ..., all 0 when nothing is in them.
+    real32 *Red;
+    real32 *Green;
+    real32 *Blue;
+    real32 *Weight;
+    real32 *Coverage;
+    
+    //Pixels written since the last resolve, Max is exclusive
+    int32 MinX;
+    int32 MinY;
+    int32 MaxX;
+    int32 MaxY;
+}transparency_buffer;
+
+//Multisample anti-aliasing, see multisample.c
+typedef struct
+{
+    //1 for buffers that are not multisampled, Colors is 0 then
+    uint32 SampleCount;
+    
+    //SampleCount colors per pixel, the samples of a pixel next to each other in the layout of the pixel buffer
+    uint32 *Colors;
+    
+    //Pixels triangles were drawn to since the last resolve, Max is exclusive
+    int32 MinX;
+    int32 MinY;
+    int32 MaxX;
+    int32 MaxY;
+}multisample_buffer;
+
+//Pixels [Start, End) of a scanline that a span buffer has drawn to
+typedef struct
+{
+    int16 Start;
+    int16 End;
+}covered_span;
+
+//Span buffer hidden surface removal, see span_buffer.c
+typedef struct
+{
+    //SPAN_BUFFER_MAX_SPANS spans per scanline, sorted and apart from each other, the first Counts[Y] of them are in use.
+    //Allocated by AllocateSpanBuffer, emptied by every clear of depth.
+    covered_span *Spans;
+    uint16 *Counts;
+    
+    //Spans that found their scanline full, they were drawn but nothing behind them is hidden
+    uint32 OverflowCount;
+}span_buffer;
+
+typedef struct
+{
+    vec3 Direction;
+    vec3 NormalizedDirection;
+}light;
+
+//Point light, full Color at the center fading out to nothing at Radius. A Color of 1 lights a texel up to its own color.
+typedef struct
+{
+    vec3 Position;
+    real32 Radius;
+    vec3 Color;
+}point_light;
+
+//Lights of a scene, AddPointLight fills it and the lights can move between frames
+typedef struct
+{
+    point_light *Lights;
+    uint32 Count;
+    uint32 MaxCount;
+    
+    //Added to the light of every pixel, so nothing outside all the radii is black
+    vec3 Ambient;
+}light_list;
+
+//A light as the shading kernels use it, camera relative with its screen rectangle in light tiles
+typedef struct
+{
+    vec3 Position;
+    real32 InvRadiusSquared;
+    vec3 Color;
+    
+    //Inclusive
+    uint16 MinTileX;
+    uint16 MinTileY;
+    uint16 MaxTileX;
+    uint16 MaxTileY;
+}culled_light;
+
+//Tiled forward+ light culling, see light_culling.c
+typedef struct
+{
+    //Screen tiles of LIGHT_TILE_SIZE pixels
+    uint32 TileCountX;
+    uint32 TileCountY;
+    
+    //TileCountX * TileCountY + 1 offsets, the lights of tile T are Lights[Indices[Offsets[T]]] up to Lights[Indices[Offsets[T + 1] - 1]].
+    //Allocated by AllocateLightTiles, pixels are lit once CullLights has put lights in.
+    uint32 *Offsets;
+    uint16 *Indices;
+    
+    culled_light *Lights;
+    uint32 LightCount;
+    uint32 MaxLightCount;
+    
+    //Lights left out of every tile because Indices was full
+    uint32 DroppedLightCount;
+    vec3 Ambient;
+    
+    //Camera relative position of the pixel (X, Y) at distance Z is ((X * RasterToViewX) + ViewOffsetX, (Y * RasterToViewY) + ViewOffsetY, 1) * Z
+    real32 RasterToViewX;
+    real32 RasterToViewY;
+    real32 ViewOffsetX;
+    real32 ViewOffsetY;
+}light_tiles;
+
+//Address space is reserved up front and committed in ARENA_COMMIT_SIZE steps as the arena grows
+typedef struct
+{
+    void *Base;
+    uint64 Size;
+    uint64 Committed;
+    uint64 Used;
+    
+    //Highest Used so far, the memory a frame really needs
+    uint64 PeakUsed;
+    
+    //Open temporary memory scopes, 0 again at the end of every frame
+    uint32 TempCount;
+}memory_arena;
+
+//Entries a work queue holds at once, see work_queue.c
+#define WORK_QUEUE_ENTRY_COUNT 256
+//Worker threads of one queue at most
+#define WORK_QUEUE_MAX_THREAD_COUNT 16
+
+//Arena is the one of the thread the entry runs on, whatever the callback pushes has to be popped again before it returns
+typedef void work_queue_callback(memory_arena *Arena, void *Data);
+
+typedef struct
+{
+    work_queue_callback *Callback;
+    void *Data;
+}work_queue_entry;
+
+//One thread adds entries, the worker threads and that one take them
+typedef struct
+{
+    //Entries are added at NextEntryToWrite and taken at NextEntryToRead, both wrap around
+    LONG volatile NextEntryToWrite;
+    LONG volatile NextEntryToRead;
+    
+    //Entries added and entries done since the queue last ran empty
+    LONG volatile CompletionGoal;
+    LONG volatile CompletionCount;
+    
+    //Released once per entry, the workers sleep on it
+    HANDLE Semaphore;
+    uint32 ThreadCount;
+    
+    //One per worker, in the order they started, and the last one for the thread that adds the entries.
+    //A thread only ever pushes to its own, so no push takes a lock.
+    memory_arena Arenas[WORK_QUEUE_MAX_THREAD_COUNT + 1];
+    LONG volatile StartedThreadCount;
+    
+    work_queue_entry Entries[WORK_QUEUE_ENTRY_COUNT];
+}work_queue;
+
+//Deferred shading, see deferred_shading.c
+typedef struct
+{
+    //Planes of one uint32 per pixel in the layout of the pixel buffer, depth is the depth of the buffer.
+    //Albedo is the textured color before lighting, 8 bits per channel. Normals are octahedral with 16 bits per axis, 0 where nothing has been drawn since the last resolve.
+    //Allocated by AllocateGBuffer, buffers without them light while they rasterize.
+    uint32 *Albedo;
+    uint32 *Normals;
+    
+    //Worker threads that share the lighting pass, 0 lights on the resolving thread alone
+    work_queue *Queue;
+    
+    //Next row of light tiles for a thread of the lighting pass to take
+    LONG volatile NextTileY;
+    
+    //Pixels written since the last resolve, Max is exclusive
+    int32 MinX;
+    int32 MinY;
+    int32 MaxX;
+    int32 MaxY;
+}g_buffer;
+
+//Depth pre-pass for opaque mesh instances, see depth_prepass.c
+typedef struct
+{
+    //Off by default, buffers with a visibility buffer or multisampling ignore it
+    bool32 IsEnabled;
+    
+    //Fragments that passed the depth test of the depth pass and the equal test of the color pass since ResetDepthPrePassCounts
+    uint64 DepthFragmentCount;
+    uint64 ShadedFragmentCount;
+}depth_prepass;
 
 typedef struct
 {
@@ -35,10 +333,110 @@ typedef struct
     uint32 Height;
     uint32 Stride;
     uint32 BytesPerPixel;
+    
+    //1/z of the nearest surface drawn to each pixel, 0 where nothing has been drawn yet.
+    //Multisampled buffers have one per sample, at the index of the pixel times the sample count.
+    real32 *Depth;
+    
+    //Tiled buffers store Memory and Depth as rows of tiles, so the pixels of a few scanlines above each other share cache lines.
+    //Stride is then the pitch of LinearMemory, the detiled copy the window and bitmaps are made from.
+    bool32 IsTiled;
+    uint32 TileCountX;
+    uint32 TileCountY;
+    void *LinearMemory;
+    
+    //Fast clear state, one byte of CLEAR_BLOCK_ flags per block whose color still has to be set to ClearColor or whose depth to 0
+    uint8 *ClearBlocks;
+    uint32 ClearBlockCountX;
+    uint32 ClearBlockCountY;
+    uint32 PendingClearBlockCount;
+    uint32 ClearColor;
+    
+    transparency_buffer Transparency;
+    multisample_buffer Multisample;
+    visibility_buffer Visibility;
+    depth_prepass DepthPrePass;
+    span_buffer SpanBuffer;
+    light_tiles Lighting;
+    g_buffer GBuffer;
+    
     BITMAPINFO BitmapInfo;
     real32 tPerFrame;
 }win32_pixel_buffer;
 
+//Back buffers in flight between the thread that draws and the thread that presents, one drawn while another is on screen
+#define PRESENT_BUFFER_COUNT 3
+
+#define FRAME_PIPELINE_BENCHMARK_FRAMES 24
+
+typedef struct
+{
+    win32_pixel_buffer Buffers[PRESENT_BUFFER_COUNT];
+    
+    //Each index is only moved by its own thread, the semaphores count the buffers free to draw and the ones waiting to be shown
+    uint32 NextBufferToDraw;
+    uint32 NextBufferToPresent;
+    HANDLE FreeSemaphore;
+    HANDLE FilledSemaphore;
+    
+    HANDLE Thread;
+    HWND Window;
+    bool32 volatile IsRunning;
+    
+    //0 presents every buffer as soon as it is drawn
+    real32 SecondsPerFrame;
+    
+    uint32 PresentCount;
+    real32 PresentSeconds;
+}frame_pipeline;
+
+//Index into Memory and Depth, X and Y have to be inside the buffer
+inline uint32 GetPixelIndex(win32_pixel_buffer *Buffer, uint32 X, uint32 Y)
+{
+    uint32 Result = (Y * Buffer->Width) + X;
+    
+    if(Buffer->IsTiled)
+    {
+        uint32 Tile = ((Y >> PIXEL_TILE_SHIFT) * Buffer->TileCountX) + (X >> PIXEL_TILE_SHIFT);
+        Result = (Tile * PIXEL_TILE_SIZE) + ((Y & (PIXEL_TILE_HEIGHT - 1)) * PIXEL_TILE_WIDTH) + (X & (PIXEL_TILE_WIDTH - 1));
+    }
+    
+    return Result;
+}
+
+//Index of the pixel right of the one at X, a step out of a tile skips the other rows of the tile
+inline uint32 GetNextPixelIndex(win32_pixel_buffer *Buffer, uint32 Index, uint32 X)
+{
+    uint32 Result = Index + 1;
+    
+    if(Buffer->IsTiled && ((X & (PIXEL_TILE_WIDTH - 1)) == (PIXEL_TILE_WIDTH - 1)))
+    {
+        Result += PIXEL_TILE_SIZE - PIXEL_TILE_WIDTH;
+    }
+    
+    return Result;
+}
+
+inline uint32 *GetPixel(win32_pixel_buffer *Buffer, uint32 X, uint32 Y)
+{
+    uint32 *Result = (uint32 *)Buffer->Memory + GetPixelIndex(Buffer, X, Y);
+    
+    return Result;
+}
+
+//Pixels allocated for Memory and Depth, tiled buffers round up to whole tiles
+inline uint32 GetPixelCount(win32_pixel_buffer *Buffer)
+{
+    uint32 Result = Buffer->Width * Buffer->Height;
+    
+    if(Buffer->IsTiled)
+    {
+        Result = Buffer->TileCountX * Buffer->TileCountY * PIXEL_TILE_SIZE;
+    }
+    
+    return Result;
+}
+
 
 #pragma pack(push, 1)
 typedef struct
@@ -71,75 +469,151 @@ typedef struct
 }bitmap_header;
 #pragma pack(pop)
 
+//Interleaved so fetching a vertex is one contiguous 32 byte load
 typedef struct
 {
-    real32 X;
-    real32 Y;
-}vec2;
-
-typedef struct
-{
-    real32 X;
-    real32 Y;
-    real32 Z;
-}vec3;
+    vec3 Position;
+    vec2 TextureCoord;
+    vec3 Normal;
+}vertex;
 
+//Quantized vertex, 14 bytes instead of the 32 of a vertex.
+//Position and TextureCoord are 16 bits per axis across the range the mesh uses, Normal is 8 bits per axis from -127 to 127.
 typedef struct
 {
-    real32 X;
-    real32 Y;
-    real32 Z;
-    real32 W;
-}vec4;
+    uint16 Position[3];
+    uint16 TextureCoord[2];
+    int8 Normal[3];
+    uint8 Unused;
+}packed_vertex;
 
+//Value = Min + Quantized * Scale, shared by every vertex of a mesh
 typedef struct
 {
-    real32 X;
-    real32 Y;
-    real32 Z;
-    real32 U;
-    real32 V;
-}vec5;
+    vec3 PositionMin;
+    vec3 PositionScale;
+    vec2 TextureMin;
+    vec2 TextureScale;
+}vertex_quantization;
 
+//A vertex after the transform, kept so the triangles sharing it do not transform it again
 typedef struct
 {
-    real32 M[4][4];
-}mat4;
+    vec3 Position;
+    vec5 Raster;
+}transformed_vertex;
 
+//1-based indices into the vertices of the mesh
 typedef struct
 {
     uint32 A;
     uint32 B;
     uint32 C;
-    uint32 T1;
-    uint32 T2;
-    uint32 T3;
     uint32 Color;
     real32 AverageZ;
 }triangle;
 
 typedef struct
 {
-    vec3 *Vertices;
-    uint32 VertexCount;
-    triangle *Triangles;
+    uint32 FirstTriangle;
     uint32 TriangleCount;
-    vec2 *TextureCoords;
-    uint32 TextureCount;
+    
+    //Bounding sphere of the vertices
+    vec3 Center;
+    real32 Radius;
+    
+    //Every triangle normal is within acos(ConeCutoff) of ConeAxis.
+    //ConeCutoff <= 0 means the normals are too spread out for backface culling.
+    vec3 ConeAxis;
+    real32 ConeCutoff;
+}meshlet;
+
+//Counts are 64 bit, but triangles index with 32 bits, so a single mesh holds at most 4G vertices.
+//Bigger scans are drawn chunk by chunk from a streaming mesh, see streaming.h.
+typedef struct
+{
+    //Float vertices are only kept while the mesh is built at load, drawing uses the packed ones
+    vertex *Vertices;
+    packed_vertex *PackedVertices;
+    vertex_quantization Quantization;
+    uint64 VertexCount;
+    
+    triangle *Triangles;
+    uint64 TriangleCount;
+    meshlet *Meshlets;
+    uint64 MeshletCount;
+    
+    //Bounding sphere of the whole mesh
+    vec3 BoundsCenter;
+    real32 BoundsRadius;
 }mesh;
 
+//How drawn pixels combine with the ones in the buffer, colors are 0xAARRGGBB with straight alpha unless premultiplied
+typedef enum
+{
+    Blend_Opaque,
+    Blend_SourceOver,
+    Blend_Premultiplied,
+    Blend_Additive,
+    Blend_Multiply,
+    
+    //Mesh instances only, accumulated in any order and composited over the buffer when it is presented
+    Blend_Transparent,
+}blend_mode;
+
 typedef struct
 {
-    vec3 Direction;
-    vec3 NormalizedDirection;
-}light;
+    vec3 Position;
+    
+    //Radians, applied around X, then Y, then Z
+    vec3 Rotation;
+    real32 Scale;
+    
+    //Multiplied with the texture, 0xFFFFFFFF leaves it as it is
+    uint32 Color;
+    
+    //Anything but Blend_Opaque is depth tested without writing depth, the alpha of Color is the alpha of the instance
+    blend_mode BlendMode;
+}mesh_instance;
+
+#define MESH_LOD_COUNT 6
 
 typedef struct
 {
-    void *Base;
-    uint32 Size;
-    uint32 Used;
-}memory_arena;
+    //Levels[0] is the source mesh, the simplified levels share its vertices
+    mesh Levels[MESH_LOD_COUNT];
+    uint32 LevelCount;
+}mesh_lod;
+
+typedef struct
+{
+    mesh_lod *Lod;
+    vec3 Position;
+    bool32 IsOccluder;
+}render_object;
+
+typedef struct
+{
+    vec3 CameraPos;
+    mat4 Projection;
+    
+    real32 NearZ;
+    real32 FarZ;
+    
+    //Extra scale applied to NDC before mapping to raster coordinates
+    real32 ScaleX;
+    real32 ScaleY;
+    
+    real32 HalfWidth;
+    real32 HalfHeight;
+}view;
+
+//Everything pushed between BeginTemporaryMemory and EndTemporaryMemory is popped again by EndTemporaryMemory
+typedef struct
+{
+    memory_arena *Arena;
+    uint64 Used;
+}temporary_memory;
 
 typedef struct
 {
@@ -150,27 +624,95 @@ typedef struct
 
 typedef struct
 {
-    uint32 Size;
+    uint64 Size;
     void *Contents;
 }file;
 
-typedef struct
+#define ARENA_COMMIT_SIZE MEGABYTE(1)
+
+//Enough for any SIMD load, pushes that share cache lines between threads should ask for 64
+#define ARENA_DEFAULT_ALIGNMENT 16
+
+#define PushStruct(Arena, Type) (Type *)PushSize(Arena, sizeof(Type))
+#define PushArray(Arena, Count, Type) (Type *)PushSize(Arena, (Count) * sizeof(Type))
+#define PushSize(Arena, Size) PushSizeAligned(Arena, Size, ARENA_DEFAULT_ALIGNMENT)
+
+//Only reserves, nothing is committed until it is pushed. BaseAddress can be 0.
+inline void InitializeArena(memory_arena *Arena, uint64 Size, void *BaseAddress)
 {
-    uint32 Width;
-    uint32 Height;
-    uint32 BytesPerTexel;
-    uint32 *Bytes;
-}texture;
+    Arena->Base = VirtualAlloc(BaseAddress, (SIZE_T)Size, MEM_RESERVE, PAGE_READWRITE);
+    Arena->Size = Size;
+    Arena->Committed = 0;
+    Arena->Used = 0;
+    Arena->PeakUsed = 0;
+    Arena->TempCount = 0;
+    
+    Assert(Arena->Base);
+}
 
-//
-#define PushStruct(Arena, Size) PushSize(Arena, Size)
-#define PushArray(Arena, Array) PushSize(Arena, sizeof(Array))
+inline void *PushSizeAligned(memory_arena *Arena, size_t Size, uint32 Alignment)
+{
+    Assert((Alignment & (Alignment - 1)) == 0);
+    
+    uintptr_t Pointer = (uintptr_t)Arena->Base + Arena->Used;
+    uint32 AlignmentOffset = (uint32)((Alignment - (Pointer & (Alignment - 1))) & (Alignment - 1));
+    
+    //Used can only wrap around past the check if Size is close to 2^64
+    uint64 NewUsed = Arena->Used + AlignmentOffset + Size;
+    Assert(NewUsed >= Arena->Used);
+    Assert(NewUsed <= Arena->Size);
+    
+    //Only a push past the highest point the arena has reached commits, a frame that stays below it never calls the OS
+    if(NewUsed > Arena->Committed)
+    {
+        uint64 NewCommitted = (NewUsed + ARENA_COMMIT_SIZE - 1) & ~(uint64)(ARENA_COMMIT_SIZE - 1);
+        if(NewCommitted > Arena->Size)
+        {
+            NewCommitted = Arena->Size;
+        }
+        
+        void *Committed = VirtualAlloc((uint8 *)Arena->Base + Arena->Committed, (SIZE_T)(NewCommitted - Arena->Committed), MEM_COMMIT, PAGE_READWRITE);
+        Assert(Committed);
+        
+        Arena->Committed = NewCommitted;
+    }
+    
+    void *Result = (uint8 *)Arena->Base + Arena->Used + AlignmentOffset;
+    
+    Arena->Used = NewUsed;
+    if(Arena->Used > Arena->PeakUsed)
+    {
+        Arena->PeakUsed = Arena->Used;
+    }
+    
+    return Result;
+}
 
-inline void *PushSize(memory_arena *Arena, uint32 Size)
+inline temporary_memory BeginTemporaryMemory(memory_arena *Arena)
 {
-    void *Result = (uint8 *)Arena->Base + Arena->Used;
-    Arena->Used += Size;
+    temporary_memory Result;
+    Result.Arena = Arena;
+    Result.Used = Arena->Used;
+    
+    ++Arena->TempCount;
+    
     return Result;
 }
 
+inline void EndTemporaryMemory(temporary_memory TempMemory)
+{
+    memory_arena *Arena = TempMemory.Arena;
+    Assert(Arena->Used >= TempMemory.Used);
+    Assert(Arena->TempCount > 0);
+    
+    Arena->Used = TempMemory.Used;
+    --Arena->TempCount;
+}
+
+//Called at the end of a frame, every scope opened during the frame has to be closed again
+inline void CheckArena(memory_arena *Arena)
+{
+    Assert(Arena->TempCount == 0);
+}
+
 #endif //MAIN_H
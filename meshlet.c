@@ -0,0 +1,298 @@
+#include "meshlet.h"
+
+//Spreads the low 10 bits of Value so that there are two zero bits in between each of them
+inline uint32 SpreadBits10(uint32 Value)
+{
+    Value &= 0x3FF;
+    Value = (Value | (Value << 16)) & 0x030000FF;
+    Value = (Value | (Value << 8)) & 0x0300F00F;
+    Value = (Value | (Value << 4)) & 0x030C30C3;
+    Value = (Value | (Value << 2)) & 0x09249249;
+    
+    return Value;
+}
+
+//Sort key of a real32 that is never negative, the bits of such a value sort in the same order as the value
+inline uint32 GetRealSortKey(real32 Value)
+{
+    //Read through a union, a cast pointer would break strict aliasing
+    union
+    {
+        real32 Real;
+        uint32 Bits;
+    }Key;
+    Key.Real = Value;
+    
+    return Key.Bits;
+}
+
+//Least significant digit first, one byte per pass. The result ends up back in Keys and Values.
+static void
+RadixSortByKey(uint32 *Keys, uint32 *Values, uint32 *TempKeys, uint32 *TempValues, uint32 Count)
+{
+    for(uint32 Shift = 0; Shift < 32; Shift += 8)
+    {
+        uint32 Offsets[256] = {0};
+        for(uint32 Index = 0; Index < Count; ++Index)
+        {
+            ++Offsets[(Keys[Index] >> Shift) & 0xFF];
+        }
+        
+        uint32 Total = 0;
+        for(uint32 Digit = 0; Digit < 256; ++Digit)
+        {
+            uint32 DigitCount = Offsets[Digit];
+            Offsets[Digit] = Total;
+            Total += DigitCount;
+        }
+        
+        for(uint32 Index = 0; Index < Count; ++Index)
+        {
+            uint32 Destination = Offsets[(Keys[Index] >> Shift) & 0xFF]++;
+            TempKeys[Destination] = Keys[Index];
+            TempValues[Destination] = Values[Index];
+        }
+        
+        uint32 *SwapKeys = Keys;
+        Keys = TempKeys;
+        TempKeys = SwapKeys;
+        
+        uint32 *SwapValues = Values;
+        Values = TempValues;
+        TempValues = SwapValues;
+    }
+}
+
+static vec3
+GetTriangleNormal(mesh *Mesh, triangle *Triangle)
+{
+    vec3 Result = {0};
+    
+    vec3 Side1 = SubtractVec3(Mesh->Vertices[Triangle->B - 1].Position, Mesh->Vertices[Triangle->A - 1].Position);
+    vec3 Side2 = SubtractVec3(Mesh->Vertices[Triangle->C - 1].Position, Mesh->Vertices[Triangle->A - 1].Position);
+    vec3 Normal = CrossVec3(Side1, Side2);
+    
+    if(GetMagnitudeVec3(Normal) > 0.0f)
+    {
+        Result = NormalizeVec3(Normal);
+    }
+    
+    return Result;
+}
+
+static void
+ComputeMeshletBounds(mesh *Mesh, meshlet *Meshlet)
+{
+    triangle *Triangles = Mesh->Triangles + Meshlet->FirstTriangle;
+    
+    vec3 Min = Mesh->Vertices[Triangles[0].A - 1].Position;
+    vec3 Max = Min;
+    vec3 NormalSum = {0};
+    
+    for(uint32 TriangleIndex = 0; TriangleIndex < Meshlet->TriangleCount; ++TriangleIndex)
+    {
+        triangle *Triangle = &Triangles[TriangleIndex];
+        uint32 Indices[3] = {Triangle->A, Triangle->B, Triangle->C};
+        
+        for(uint32 Index = 0; Index < 3; ++Index)
+        {
+            vec3 Vertex = Mesh->Vertices[Indices[Index] - 1].Position;
+            Min = (vec3){fminf(Min.X, Vertex.X), fminf(Min.Y, Vertex.Y), fminf(Min.Z, Vertex.Z)};
+            Max = (vec3){fmaxf(Max.X, Vertex.X), fmaxf(Max.Y, Vertex.Y), fmaxf(Max.Z, Vertex.Z)};
+        }
+        
+        NormalSum = AddVec3(NormalSum, GetTriangleNormal(Mesh, Triangle));
+    }
+    
+    Meshlet->Center = (vec3){(Min.X + Max.X) * 0.5f, (Min.Y + Max.Y) * 0.5f, (Min.Z + Max.Z) * 0.5f};
+    Meshlet->Radius = 0.0f;
+    
+    for(uint32 TriangleIndex = 0; TriangleIndex < Meshlet->TriangleCount; ++TriangleIndex)
+    {
+        triangle *Triangle = &Triangles[TriangleIndex];
+        uint32 Indices[3] = {Triangle->A, Triangle->B, Triangle->C};
+        
+        for(uint32 Index = 0; Index < 3; ++Index)
+        {
+            real32 Distance = GetMagnitudeVec3(SubtractVec3(Mesh->Vertices[Indices[Index] - 1].Position, Meshlet->Center));
+            Meshlet->Radius = fmaxf(Meshlet->Radius, Distance);
+        }
+    }
+    
+    Meshlet->ConeAxis = (vec3){0.0f, 0.0f, 1.0f};
+    Meshlet->ConeCutoff = -1.0f;
+    
+    if(GetMagnitudeVec3(NormalSum) > 0.0f)
+    {
+        Meshlet->ConeAxis = NormalizeVec3(NormalSum);
+        Meshlet->ConeCutoff = 1.0f;
+        
+        for(uint32 TriangleIndex = 0; TriangleIndex < Meshlet->TriangleCount; ++TriangleIndex)
+        {
+            real32 Cosine = DotVec3(Meshlet->ConeAxis, GetTriangleNormal(Mesh, &Triangles[TriangleIndex]));
+            Meshlet->ConeCutoff = fminf(Meshlet->ConeCutoff, Cosine);
+        }
+    }
+}
+
+/*
+Meshlets are built once at load:
+- Triangles are sorted along a Morton curve through the centroids, so neighbouring triangles end up next to each other.
+- Runs of MESHLET_TRIANGLE_COUNT sorted triangles become one meshlet, with a bounding sphere and a normal cone.
+- Mesh->Triangles is reordered in place, every meshlet owns a contiguous range of it.
+*/
+static void
+BuildMeshlets(mesh *Mesh)
+{
+    if(!Mesh->TriangleCount)
+    {
+        return;
+    }
+    
+    //Triangles are sorted and meshlets address them with 32 bit indices
+    Assert(Mesh->TriangleCount <= 0xFFFFFFFF);
+    uint32 Count = (uint32)Mesh->TriangleCount;
+    
+    vec3 Min = Mesh->Vertices[0].Position;
+    vec3 Max = Min;
+    for(uint64 VertexIndex = 1; VertexIndex < Mesh->VertexCount; ++VertexIndex)
+    {
+        vec3 Vertex = Mesh->Vertices[VertexIndex].Position;
+        Min = (vec3){fminf(Min.X, Vertex.X), fminf(Min.Y, Vertex.Y), fminf(Min.Z, Vertex.Z)};
+        Max = (vec3){fmaxf(Max.X, Vertex.X), fmaxf(Max.Y, Vertex.Y), fmaxf(Max.Z, Vertex.Z)};
+    }
+    
+    Mesh->BoundsCenter = (vec3){(Min.X + Max.X) * 0.5f, (Min.Y + Max.Y) * 0.5f, (Min.Z + Max.Z) * 0.5f};
+    Mesh->BoundsRadius = 0.0f;
+    for(uint64 VertexIndex = 0; VertexIndex < Mesh->VertexCount; ++VertexIndex)
+    {
+        real32 Distance = GetMagnitudeVec3(SubtractVec3(Mesh->Vertices[VertexIndex].Position, Mesh->BoundsCenter));
+        Mesh->BoundsRadius = fmaxf(Mesh->BoundsRadius, Distance);
+    }
+    
+    vec3 Extent = SubtractVec3(Max, Min);
+    vec3 Scale;
+    Scale.X = (Extent.X > 0.0f) ? (1023.0f / Extent.X) : 0.0f;
+    Scale.Y = (Extent.Y > 0.0f) ? (1023.0f / Extent.Y) : 0.0f;
+    Scale.Z = (Extent.Z > 0.0f) ? (1023.0f / Extent.Z) : 0.0f;
+    
+    uint32 *SortMemory = (uint32 *)VirtualAlloc(0, 4 * Count * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    uint32 *Keys = SortMemory;
+    uint32 *Values = Keys + Count;
+    uint32 *TempKeys = Values + Count;
+    uint32 *TempValues = TempKeys + Count;
+    
+    for(uint32 TriangleIndex = 0; TriangleIndex < Count; ++TriangleIndex)
+    {
+        triangle *Triangle = &Mesh->Triangles[TriangleIndex];
+        vec3 Centroid = AddVec3(AddVec3(Mesh->Vertices[Triangle->A - 1].Position, Mesh->Vertices[Triangle->B - 1].Position), Mesh->Vertices[Triangle->C - 1].Position);
+        Centroid = (vec3){Centroid.X / 3.0f, Centroid.Y / 3.0f, Centroid.Z / 3.0f};
+        
+        uint32 X = (uint32)((Centroid.X - Min.X) * Scale.X);
+        uint32 Y = (uint32)((Centroid.Y - Min.Y) * Scale.Y);
+        uint32 Z = (uint32)((Centroid.Z - Min.Z) * Scale.Z);
+        
+        Keys[TriangleIndex] = SpreadBits10(X) | (SpreadBits10(Y) << 1) | (SpreadBits10(Z) << 2);
+        Values[TriangleIndex] = TriangleIndex;
+    }
+    
+    RadixSortByKey(Keys, Values, TempKeys, TempValues, Count);
+    
+    triangle *SortedTriangles = (triangle *)VirtualAlloc(0, Count * sizeof(triangle), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    for(uint32 TriangleIndex = 0; TriangleIndex < Count; ++TriangleIndex)
+    {
+        SortedTriangles[TriangleIndex] = Mesh->Triangles[Values[TriangleIndex]];
+    }
+    
+    for(uint32 TriangleIndex = 0; TriangleIndex < Count; ++TriangleIndex)
+    {
+        Mesh->Triangles[TriangleIndex] = SortedTriangles[TriangleIndex];
+    }
+    
+    VirtualFree(SortedTriangles, 0, MEM_RELEASE);
+    VirtualFree(SortMemory, 0, MEM_RELEASE);
+    
+    Mesh->MeshletCount = (Count + MESHLET_TRIANGLE_COUNT - 1) / MESHLET_TRIANGLE_COUNT;
+    Mesh->Meshlets = (meshlet *)VirtualAlloc(0, Mesh->MeshletCount * sizeof(meshlet), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    for(uint64 MeshletIndex = 0; MeshletIndex < Mesh->MeshletCount; ++MeshletIndex)
+    {
+        meshlet *Meshlet = &Mesh->Meshlets[MeshletIndex];
+        Meshlet->FirstTriangle = (uint32)(MeshletIndex * MESHLET_TRIANGLE_COUNT);
+        Meshlet->TriangleCount = Count - Meshlet->FirstTriangle;
+        if(Meshlet->TriangleCount > MESHLET_TRIANGLE_COUNT)
+        {
+            Meshlet->TriangleCount = MESHLET_TRIANGLE_COUNT;
+        }
+        
+        ComputeMeshletBounds(Mesh, Meshlet);
+    }
+}
+
+inline void
+SetFrustumPlane(frustum *Frustum, uint32 PlaneIndex, vec3 Normal, real32 Distance)
+{
+    real32 Magnitude = GetMagnitudeVec3(Normal);
+    
+    Frustum->Normals[PlaneIndex] = (vec3){Normal.X / Magnitude, Normal.Y / Magnitude, Normal.Z / Magnitude};
+    Frustum->Distances[PlaneIndex] = Distance / Magnitude;
+}
+
+//Side planes are taken from the rows of the projection matrix. ScaleX and ScaleY are the
+//extra scale DrawMesh applies to NDC, a point is on screen when -1 <= Scale * NDC <= 1.
+static frustum
+BuildFrustum(mat4 Projection, real32 ScaleX, real32 ScaleY, real32 NearZ, real32 FarZ)
+{
+    frustum Result;
+    
+    real32 *RowX = Projection.M[0];
+    real32 *RowY = Projection.M[1];
+    real32 *RowW = Projection.M[3];
+    
+    SetFrustumPlane(&Result, 0, (vec3){RowW[0] + ScaleX * RowX[0], RowW[1] + ScaleX * RowX[1], RowW[2] + ScaleX * RowX[2]}, RowW[3] + ScaleX * RowX[3]);
+    SetFrustumPlane(&Result, 1, (vec3){RowW[0] - ScaleX * RowX[0], RowW[1] - ScaleX * RowX[1], RowW[2] - ScaleX * RowX[2]}, RowW[3] - ScaleX * RowX[3]);
+    SetFrustumPlane(&Result, 2, (vec3){RowW[0] + ScaleY * RowY[0], RowW[1] + ScaleY * RowY[1], RowW[2] + ScaleY * RowY[2]}, RowW[3] + ScaleY * RowY[3]);
+    SetFrustumPlane(&Result, 3, (vec3){RowW[0] - ScaleY * RowY[0], RowW[1] - ScaleY * RowY[1], RowW[2] - ScaleY * RowY[2]}, RowW[3] - ScaleY * RowY[3]);
+    SetFrustumPlane(&Result, 4, (vec3){0.0f, 0.0f, 1.0f}, -NearZ);
+    SetFrustumPlane(&Result, 5, (vec3){0.0f, 0.0f, -1.0f}, FarZ);
+    
+    return Result;
+}
+
+static bool32
+IsSphereInFrustum(frustum *Frustum, vec3 Center, real32 Radius)
+{
+    for(uint32 PlaneIndex = 0; PlaneIndex < ArrayCount(Frustum->Normals); ++PlaneIndex)
+    {
+        if((DotVec3(Frustum->Normals[PlaneIndex], Center) + Frustum->Distances[PlaneIndex]) < -Radius)
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/*
+A triangle faces away when Dot(Normal, Vertex - CameraPos) >= 0.
+With D = Center - CameraPos, every normal in the cone makes an angle of at most (Phi + Theta) with D,
+where Phi is the angle between the cone axis and D and Theta = acos(ConeCutoff).
+So the whole meshlet faces away when |D| * cos(Phi + Theta) >= Radius.
+*/
+static bool32
+IsMeshletBackfacing(meshlet *Meshlet, vec3 CameraPos)
+{
+    if(Meshlet->ConeCutoff <= 0.0f)
+    {
+        return false;
+    }
+    
+    vec3 D = SubtractVec3(Meshlet->Center, CameraPos);
+    real32 AxisDotD = DotVec3(Meshlet->ConeAxis, D);
+    real32 Perpendicular = sqrtf(fmaxf(DotVec3(D, D) - (AxisDotD * AxisDotD), 0.0f));
+    real32 SinTheta = sqrtf(1.0f - (Meshlet->ConeCutoff * Meshlet->ConeCutoff));
+    
+    bool32 Result = ((AxisDotD * Meshlet->ConeCutoff) - (Perpendicular * SinTheta)) >= Meshlet->Radius;
+    
+    return Result;
+}
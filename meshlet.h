@@ -0,0 +1,16 @@
+/* date = October 19th 2026 11:55 am */
+
+#ifndef MESHLET_H
+#define MESHLET_H
+
+//Triangles per meshlet, the last meshlet of a mesh can have fewer
+#define MESHLET_TRIANGLE_COUNT 96
+
+typedef struct
+{
+    //Planes in camera space, a point P is inside when Dot(Normal, P) + Distance >= 0
+    vec3 Normals[6];
+    real32 Distances[6];
+}frustum;
+
+#endif //MESHLET_H
@@ -0,0 +1,333 @@
+#include "multisample.h"
+
+/*
+4x multisample anti-aliasing:
+- Coverage and depth are evaluated at 4 positions of a rotated grid in every pixel, the same pattern Direct3D uses.
+  Every row and every column of the pixel is crossed by one of them, so near vertical and near horizontal edges get 4 steps.
+- Depth and color are stored per sample, the 4 samples of a pixel are next to each other in the layout of the pixel buffer.
+- The texture is sampled once per pixel and triangle, at the pixel center when all samples are covered and at the first covered sample otherwise,
+  so edge pixels do not sample outside the triangle. Only the samples that pass the depth test take the color.
+- Lights are applied to that one color too, with the flat normal of the triangle, like the aliased kernels do.
+- Present averages the samples into Memory in the pixels drawn to since the last resolve.
+Samples on an edge belong to both triangles, a shared edge is written twice rather than left with a crack.
+Rects, lines and pixels are drawn into the resolved image, after ResolveMultisample, or the next resolve overwrites them.
+*/
+
+//Offsets from the pixel center
+static real32 GlobalSampleOffsetX[MULTISAMPLE_COUNT] = {-0.125f, 0.375f, -0.375f, 0.125f};
+static real32 GlobalSampleOffsetY[MULTISAMPLE_COUNT] = {-0.375f, -0.125f, 0.125f, 0.375f};
+
+static void
+ResetMultisampleBounds(win32_pixel_buffer *Buffer)
+{
+    Buffer->Multisample.MinX = Buffer->Width;
+    Buffer->Multisample.MinY = Buffer->Height;
+    Buffer->Multisample.MaxX = 0;
+    Buffer->Multisample.MaxY = 0;
+}
+
+static void
+DrawMultisampleTriangle(win32_pixel_buffer *Buffer, texture *Texture, vec5 V1, vec5 V2, vec5 V3, uint32 Color, vec3 Normal, blend_mode BlendMode)
+{
+    Assert(Buffer->Multisample.SampleCount == MULTISAMPLE_COUNT);
+    
+    vec5 Vertices[3] = {V1, V2, V3};
+    
+    //Twice the signed area, the edges of clockwise triangles are flipped so that inside is positive for either winding
+    real32 Area = ((V2.X - V1.X) * (V3.Y - V1.Y)) - ((V2.Y - V1.Y) * (V3.X - V1.X));
+    if(!(fabsf(Area) > 0.0f))
+    {
+        return;
+    }
+    real32 Sign = (Area > 0.0f) ? 1.0f : -1.0f;
+    
+    //Pixels with a sample inside the bounding box, clamped as floats first like ResolveFastClearBounds
+    real32 MinXReal = fmaxf(ceilf(fminf(V1.X, fminf(V2.X, V3.X)) - 0.375f), 0.0f);
+    real32 MinYReal = fmaxf(ceilf(fminf(V1.Y, fminf(V2.Y, V3.Y)) - 0.375f), 0.0f);
+    real32 MaxXReal = fminf(floorf(fmaxf(V1.X, fmaxf(V2.X, V3.X)) + 0.375f) + 1.0f, (real32)Buffer->Width);
+    real32 MaxYReal = fminf(floorf(fmaxf(V1.Y, fmaxf(V2.Y, V3.Y)) + 0.375f) + 1.0f, (real32)Buffer->Height);
+    
+    if((MinXReal >= MaxXReal) || (MinYReal >= MaxYReal))
+    {
+        return;
+    }
+    
+    int32 MinX = (int32)MinXReal;
+    int32 MinY = (int32)MinYReal;
+    int32 MaxX = (int32)MaxXReal;
+    int32 MaxY = (int32)MaxYReal;
+    
+    multisample_buffer *Multisample = &Buffer->Multisample;
+    Multisample->MinX = (MinX < Multisample->MinX) ? MinX : Multisample->MinX;
+    Multisample->MinY = (MinY < Multisample->MinY) ? MinY : Multisample->MinY;
+    Multisample->MaxX = (MaxX > Multisample->MaxX) ? MaxX : Multisample->MaxX;
+    Multisample->MaxY = (MaxY > Multisample->MaxY) ? MaxY : Multisample->MaxY;
+    
+    //Edge from vertex I to vertex I + 1, E(x, y) = A * (x - X0) + B * (y - Y0)
+    real32 EdgeA[3];
+    real32 EdgeB[3];
+    real32 EdgeMargin[3];
+    for(uint32 Index = 0; Index < 3; ++Index)
+    {
+        vec5 Start = Vertices[Index];
+        vec5 End = Vertices[(Index + 1) % 3];
+        
+        EdgeA[Index] = Sign * (Start.Y - End.Y);
+        EdgeB[Index] = Sign * (End.X - Start.X);
+        
+        //Most a sample of a pixel can be further inside than its center
+        EdgeMargin[Index] = 0.375f * (fabsf(EdgeA[Index]) + fabsf(EdgeB[Index]));
+    }
+    
+    gradient Gradients;
+    CalculateGradients(&Gradients, Vertices);
+    
+    __m128 SampleX = _mm_loadu_ps(GlobalSampleOffsetX);
+    __m128 SampleY = _mm_loadu_ps(GlobalSampleOffsetY);
+    __m128 Zero = _mm_setzero_ps();
+    
+    uint32 *Samples = Multisample->Colors;
+    real32 *Depth = Buffer->Depth;
+    
+    for(int32 Y = MinY; Y < MaxY; ++Y)
+    {
+        //Conservative span of the row, every edge cuts it from one side.
+        //Widened by a pixel either way, the sample tests decide the rest.
+        int32 XStart = MinX;
+        int32 XEnd = MaxX;
+        for(uint32 Index = 0; Index < 3; ++Index)
+        {
+            real32 RowValue = (EdgeB[Index] * ((real32)Y - Vertices[Index].Y)) + EdgeMargin[Index];
+            if(EdgeA[Index] > 0.0f)
+            {
+                real32 Limit = Vertices[Index].X - (RowValue / EdgeA[Index]);
+                int32 EdgeStart = (int32)fminf(fmaxf(ceilf(Limit) - 1.0f, MinXReal), MaxXReal);
+                XStart = (EdgeStart > XStart) ? EdgeStart : XStart;
+            }
+            else if(EdgeA[Index] < 0.0f)
+            {
+                real32 Limit = Vertices[Index].X - (RowValue / EdgeA[Index]);
+                int32 EdgeEnd = (int32)fminf(fmaxf(floorf(Limit) + 2.0f, MinXReal), MaxXReal);
+                XEnd = (EdgeEnd < XEnd) ? EdgeEnd : XEnd;
+            }
+            else if(RowValue < 0.0f)
+            {
+                XEnd = XStart;
+            }
+        }
+        
+        if(XStart >= XEnd)
+        {
+            continue;
+        }
+        
+        //Values at the samples of pixel XStart, every pixel to the right adds A or dOneOverZdX per column
+        __m128 RowSampleX = _mm_add_ps(SampleX, _mm_set1_ps((real32)XStart));
+        __m128 RowSampleY = _mm_add_ps(SampleY, _mm_set1_ps((real32)Y));
+        
+        __m128 RowEdge[3];
+        __m128 StepEdge[3];
+        for(uint32 Index = 0; Index < 3; ++Index)
+        {
+            __m128 DeltaX = _mm_sub_ps(RowSampleX, _mm_set1_ps(Vertices[Index].X));
+            __m128 DeltaY = _mm_sub_ps(RowSampleY, _mm_set1_ps(Vertices[Index].Y));
+            RowEdge[Index] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(EdgeA[Index]), DeltaX), _mm_mul_ps(_mm_set1_ps(EdgeB[Index]), DeltaY));
+            StepEdge[Index] = _mm_set1_ps(EdgeA[Index]);
+        }
+        
+        __m128 RowDepth = _mm_add_ps(_mm_set1_ps(Gradients.OneOverZ[0]),
+                                     _mm_add_ps(_mm_mul_ps(_mm_set1_ps(Gradients.dOneOverZdX), _mm_sub_ps(RowSampleX, _mm_set1_ps(V1.X))),
+                                                _mm_mul_ps(_mm_set1_ps(Gradients.dOneOverZdY), _mm_sub_ps(RowSampleY, _mm_set1_ps(V1.Y)))));
+        __m128 StepDepth = _mm_set1_ps(Gradients.dOneOverZdX);
+        
+        uint32 PixelIndex = GetPixelIndex(Buffer, XStart, Y);
+        for(int32 X = XStart; X < XEnd; ++X)
+        {
+            //Multiplied rather than stepped, so the rounding error does not grow along the row
+            __m128 Column = _mm_set1_ps((real32)(X - XStart));
+            
+            __m128 Inside = _mm_cmpge_ps(_mm_add_ps(RowEdge[0], _mm_mul_ps(StepEdge[0], Column)), Zero);
+            Inside = _mm_and_ps(Inside, _mm_cmpge_ps(_mm_add_ps(RowEdge[1], _mm_mul_ps(StepEdge[1], Column)), Zero));
+            Inside = _mm_and_ps(Inside, _mm_cmpge_ps(_mm_add_ps(RowEdge[2], _mm_mul_ps(StepEdge[2], Column)), Zero));
+            
+            int32 Coverage = _mm_movemask_ps(Inside);
+            if(Coverage)
+            {
+                real32 *SampleDepth = Depth + (PixelIndex * MULTISAMPLE_COUNT);
+                __m128 OldDepth = _mm_load_ps(SampleDepth);
+                __m128 NewDepth = _mm_add_ps(RowDepth, _mm_mul_ps(StepDepth, Column));
+                __m128 Pass = _mm_and_ps(Inside, _mm_cmpgt_ps(NewDepth, OldDepth));
+                
+                int32 PassMask = _mm_movemask_ps(Pass);
+                if(PassMask)
+                {
+                    //Centroid like shading position, inside the triangle even if the center is not
+                    real32 ShadeX = (real32)X - V1.X;
+                    real32 ShadeY = (real32)Y - V1.Y;
+                    if(Coverage != 0xF)
+                    {
+                        uint32 First = 0;
+                        while(!(Coverage & (1 << First)))
+                        {
+                            ++First;
+                        }
+                        
+                        ShadeX += GlobalSampleOffsetX[First];
+                        ShadeY += GlobalSampleOffsetY[First];
+                    }
+                    
+                    real32 OneOverZ = Gradients.OneOverZ[0] + (Gradients.dOneOverZdX * ShadeX) + (Gradients.dOneOverZdY * ShadeY);
+                    real32 UOverZ = Gradients.UOverZ[0] + (Gradients.dUOverZdX * ShadeX) + (Gradients.dUOverZdY * ShadeY);
+                    real32 VOverZ = Gradients.VOverZ[0] + (Gradients.dVOverZdX * ShadeX) + (Gradients.dVOverZdY * ShadeY);
+                    
+                    real32 Z = 1.0f / OneOverZ;
+                    uint32 PixelColor = ModulateColor(SampleTexture(Texture, UOverZ * Z, VOverZ * Z), Color);
+                    if(Buffer->Lighting.LightCount > 0)
+                    {
+                        PixelColor = LightTexel(&Buffer->Lighting, PixelColor, X, Y, Z, Normal);
+                    }
+                    
+                    uint32 *PixelSamples = Samples + (PixelIndex * MULTISAMPLE_COUNT);
+                    if(BlendMode == Blend_Opaque)
+                    {
+                        _mm_store_ps(SampleDepth, _mm_blendv_ps(OldDepth, NewDepth, Pass));
+                        
+                        __m128i OldColor = _mm_load_si128((__m128i *)PixelSamples);
+                        _mm_store_si128((__m128i *)PixelSamples, _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(OldColor), _mm_castsi128_ps(_mm_set1_epi32((int32)PixelColor)), Pass)));
+                    }
+                    else if(BlendMode == Blend_Transparent)
+                    {
+                        //One fragment for the pixel, as opaque as the share of samples it covers
+                        uint32 Alpha = ((PixelColor >> 24) * (uint32)_mm_popcnt_u32(PassMask) + 2) / MULTISAMPLE_COUNT;
+                        AccumulateTransparency(&Buffer->Transparency, PixelIndex, (PixelColor & 0x00FFFFFF) | (Alpha << 24), Z);
+                    }
+                    else
+                    {
+                        for(uint32 Sample = 0; Sample < MULTISAMPLE_COUNT; ++Sample)
+                        {
+                            if(PassMask & (1 << Sample))
+                            {
+                                PixelSamples[Sample] = BlendPixel(PixelSamples[Sample], PixelColor, BlendMode);
+                            }
+                        }
+                    }
+                }
+            }
+            
+            PixelIndex = GetNextPixelIndex(Buffer, PixelIndex, X);
+        }
+    }
+}
+
+/*
+Averages the samples of Count pixels from FirstIndex on into Memory, exactly, with the 4 samples of each channel summed in 16 bits.
+The samples of 2 pixels fill one AVX register, one per 128 bit lane.
+*/
+static void
+ResolveMultisampleRun(win32_pixel_buffer *Buffer, uint32 FirstIndex, uint32 Count)
+{
+    uint32 *Pixels = (uint32 *)Buffer->Memory;
+    uint32 *Samples = Buffer->Multisample.Colors;
+    
+    __m256i Zero = _mm256_setzero_si256();
+    __m256i Round = _mm256_set1_epi16(2);
+    __m256i PixelOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    
+    uint32 Index = FirstIndex;
+    uint32 EndIndex = FirstIndex + Count;
+    for(; (Index + 8) <= EndIndex; Index += 8)
+    {
+        __m256i *Source = (__m256i *)(Samples + (Index * MULTISAMPLE_COUNT));
+        
+        //Samples 0 + 2 and 1 + 3 of every channel, then both halves of the lane added, pixels 2N in lane 0 and 2N + 1 in lane 1
+        __m256i Sums[4];
+        for(uint32 Pair = 0; Pair < 4; ++Pair)
+        {
+            __m256i Pixels2 = _mm256_loadu_si256(Source + Pair);
+            __m256i Sum = _mm256_add_epi16(_mm256_unpacklo_epi8(Pixels2, Zero), _mm256_unpackhi_epi8(Pixels2, Zero));
+            Sums[Pair] = _mm256_add_epi16(Sum, _mm256_srli_si256(Sum, 8));
+        }
+        
+        //Lane 0 holds pixels 0, 2, 4, 6 and lane 1 pixels 1, 3, 5, 7 after the pack
+        __m256i Low = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(Sums[0], Sums[1]), Round), 2);
+        __m256i High = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(Sums[2], Sums[3]), Round), 2);
+        __m256i Result = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(Low, High), PixelOrder);
+        
+        _mm256_storeu_si256((__m256i *)(Pixels + Index), Result);
+    }
+    
+    __m128i SmallZero = _mm_setzero_si128();
+    for(; Index < EndIndex; ++Index)
+    {
+        __m128i PixelSamples = _mm_loadu_si128((__m128i *)(Samples + (Index * MULTISAMPLE_COUNT)));
+        __m128i Sum = _mm_add_epi16(_mm_unpacklo_epi8(PixelSamples, SmallZero), _mm_unpackhi_epi8(PixelSamples, SmallZero));
+        Sum = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(Sum, _mm_srli_si128(Sum, 8)), _mm_set1_epi16(2)), 2);
+        
+        Pixels[Index] = (uint32)_mm_cvtsi128_si32(_mm_packus_epi16(Sum, Sum));
+    }
+}
+
+/*
+Resolves the pixels triangles were drawn to since the last resolve, GetLinearPixels does this before presenting.
+Blocks whose samples are still pending a fast clear are skipped, their color is the clear color already or will be streamed in.
+*/
+static void
+ResolveMultisample(win32_pixel_buffer *Buffer)
+{
+    multisample_buffer *Multisample = &Buffer->Multisample;
+    if((Multisample->SampleCount <= 1) || (Multisample->MinX >= Multisample->MaxX) || (Multisample->MinY >= Multisample->MaxY))
+    {
+        return;
+    }
+    
+    uint32 MinX = Multisample->MinX;
+    uint32 MinY = Multisample->MinY;
+    uint32 MaxX = Multisample->MaxX;
+    uint32 MaxY = Multisample->MaxY;
+    uint32 RowStep = 1;
+    
+    //Whole tiles, so a run of them in a tile row is contiguous
+    if(Buffer->IsTiled)
+    {
+        MinX &= ~(PIXEL_TILE_WIDTH - 1);
+        MinY &= ~(PIXEL_TILE_HEIGHT - 1);
+        MaxX = (MaxX + PIXEL_TILE_WIDTH - 1) & ~(PIXEL_TILE_WIDTH - 1);
+        MaxY = (MaxY + PIXEL_TILE_HEIGHT - 1) & ~(PIXEL_TILE_HEIGHT - 1);
+        RowStep = PIXEL_TILE_HEIGHT;
+    }
+    
+    for(uint32 Y = MinY; Y < MaxY; Y += RowStep)
+    {
+        uint8 *Flags = Buffer->ClearBlocks + ((Y >> CLEAR_BLOCK_SHIFT) * Buffer->ClearBlockCountX);
+        
+        uint32 X = MinX;
+        while(X < MaxX)
+        {
+            //Run of blocks with their samples in place
+            uint32 RunX = X;
+            while((X < MaxX) && !(Flags[X >> CLEAR_BLOCK_SHIFT] & CLEAR_BLOCK_SAMPLES))
+            {
+                X = (X | (CLEAR_BLOCK_WIDTH - 1)) + 1;
+            }
+            X = (X < MaxX) ? X : MaxX;
+            
+            if(RunX < X)
+            {
+                uint32 Count = X - RunX;
+                if(Buffer->IsTiled)
+                {
+                    Count *= PIXEL_TILE_HEIGHT;
+                }
+                
+                ResolveMultisampleRun(Buffer, GetPixelIndex(Buffer, RunX, Y), Count);
+            }
+            
+            while((X < MaxX) && (Flags[X >> CLEAR_BLOCK_SHIFT] & CLEAR_BLOCK_SAMPLES))
+            {
+                X = (X | (CLEAR_BLOCK_WIDTH - 1)) + 1;
+            }
+        }
+    }
+    
+    ResetMultisampleBounds(Buffer);
+}
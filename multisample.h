@@ -0,0 +1,11 @@
+/* date = October 19th 2026 7:05 pm */
+
+#ifndef MULTISAMPLE_H
+#define MULTISAMPLE_H
+
+//Samples per pixel of a multisampled buffer, DrawMultisampleTriangle tests all of them in one SSE register
+#define MULTISAMPLE_COUNT 4
+
+#define MULTISAMPLE_BENCHMARK_FRAMES 16
+
+#endif //MULTISAMPLE_H
@@ -1,9 +1,15 @@
+//Reads the positions, texture coordinates and normals of the file, then welds them into one vertex per unique corner
 void ReadObjectFile(char *FileName, mesh *Mesh)
 {
+    BEGIN_PROFILE_ZONE(Load);
     FILE *FilePointer = fopen(FileName, "r");
     
     if(FilePointer)
     {
+        uint64 PositionCount = 0;
+        uint64 TextureCount = 0;
+        uint64 NormalCount = 0;
+        
         while(!feof(FilePointer))
         {
             unsigned char First = (unsigned char)getc(FilePointer);
@@ -11,17 +17,22 @@ void ReadObjectFile(char *FileName, mesh *Mesh)
             
             if(First == 'v' && Second == ' ')
             {
-                ++Mesh->VertexCount;
+                ++PositionCount;
             }
             else if(First == 'v' && Second == 't')
             {
-                ++Mesh->TextureCount;
+                ++TextureCount;
+            }
+            else if(First == 'v' && Second == 'n')
+            {
+                ++NormalCount;
             }
             else if(First == 'f' && Second == ' ')
             {
                 ++Mesh->TriangleCount;
             }
-            else
+            
+            if(Second != '\n')
             {
                 fscanf_s(FilePointer, "%*[^\n]");
                 getc(FilePointer);
@@ -32,15 +43,20 @@ void ReadObjectFile(char *FileName, mesh *Mesh)
         
         if(!FSeekReturnValue)
         {
-            Mesh->Vertices = (vec3 *)VirtualAlloc(0, sizeof(vec5) * Mesh->VertexCount, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            vec3 *Positions = (vec3 *)VirtualAlloc(0, sizeof(vec3) * PositionCount, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
             
-            Mesh->Triangles = (triangle *)VirtualAlloc(0, sizeof(triangle) * Mesh->TriangleCount, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            vec2 *TextureCoords = (vec2 *)VirtualAlloc(0, sizeof(vec2) * TextureCount, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            
+            vec3 *Normals = (vec3 *)VirtualAlloc(0, sizeof(vec3) * NormalCount, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
             
-            Mesh->TextureCoords = (vec2 *)VirtualAlloc(0, sizeof(vec2) * Mesh->TextureCount, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            vertex_key *Corners = (vertex_key *)VirtualAlloc(0, sizeof(vertex_key) * 3 * Mesh->TriangleCount, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
             
-            uint32 VertexIndex = 0;
-            uint32 TriangleIndex = 0;
-            uint32 TextureIndex = 0;
+            Mesh->Triangles = (triangle *)VirtualAlloc(0, sizeof(triangle) * Mesh->TriangleCount, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            
+            uint64 PositionIndex = 0;
+            uint64 TextureIndex = 0;
+            uint64 NormalIndex = 0;
+            uint64 TriangleIndex = 0;
             
             while(!feof(FilePointer))
             {
@@ -49,25 +65,32 @@ void ReadObjectFile(char *FileName, mesh *Mesh)
                 
                 if(First == 'v' && Second == ' ')
                 {
-                    vec3 *Vertex = &Mesh->Vertices[VertexIndex++];
-                    fscanf_s(FilePointer, "%f%f%f", &Vertex->X, &Vertex->Y, &Vertex->Z);
+                    vec3 *Position = &Positions[PositionIndex++];
+                    fscanf_s(FilePointer, "%f%f%f", &Position->X, &Position->Y, &Position->Z);
                     getc(FilePointer);
                 }
                 else if(First == 'v' && Second == 't')
                 {
-                    vec2 *Texture = &Mesh->TextureCoords[TextureIndex++];
+                    vec2 *Texture = &TextureCoords[TextureIndex++];
                     fscanf_s(FilePointer, "%f%f", &Texture->X, &Texture->Y);
                     getc(FilePointer);
                 }
+                else if(First == 'v' && Second == 'n')
+                {
+                    vec3 *Normal = &Normals[NormalIndex++];
+                    fscanf_s(FilePointer, "%f%f%f", &Normal->X, &Normal->Y, &Normal->Z);
+                    getc(FilePointer);
+                }
                 else if(First == 'f' && Second == ' ')
                 {
-                    triangle *Triangle = &Mesh->Triangles[TriangleIndex++];
-                    fscanf_s(FilePointer, "%d/%d/%*d%d/%d/%*d%d/%d/%*d", &Triangle->A, &Triangle->T1, &Triangle->B, &Triangle->T2, &Triangle->C, &Triangle->T3);
-                    //fscanf_s(FilePointer, "%d/%d%d/%d%d/%d", &Triangle->A, &Triangle->T1, &Triangle->B, &Triangle->T2, &Triangle->C, &Triangle->T3);
-                    //fscanf_s(FilePointer, "%d%d%d", &Triangle->A, &Triangle->B, &Triangle->C);
+                    vertex_key *Corner = &Corners[3 * TriangleIndex++];
+                    fscanf_s(FilePointer, "%u/%u/%u%u/%u/%u%u/%u/%u",
+                             &Corner[0].Position, &Corner[0].TextureCoord, &Corner[0].Normal,
+                             &Corner[1].Position, &Corner[1].TextureCoord, &Corner[1].Normal,
+                             &Corner[2].Position, &Corner[2].TextureCoord, &Corner[2].Normal);
                     getc(FilePointer);
                 }
-                else
+                else if(Second != '\n')
                 {
                     fscanf_s(FilePointer, "%*[^\n]");
                     getc(FilePointer);
@@ -75,6 +98,14 @@ void ReadObjectFile(char *FileName, mesh *Mesh)
             }
             
             fclose(FilePointer);
+            
+            WeldVertices(Mesh, Positions, TextureCoords, Normals, Corners);
+            
+            VirtualFree(Corners, 0, MEM_RELEASE);
+            VirtualFree(Normals, 0, MEM_RELEASE);
+            VirtualFree(TextureCoords, 0, MEM_RELEASE);
+            VirtualFree(Positions, 0, MEM_RELEASE);
         }
     }
-}
\ No newline at end of file
+    END_PROFILE_ZONE(Load);
+}
@@ -0,0 +1,482 @@
+#include "occlusion.h"
+
+//Depth of a tile nothing has been drawn to
+#define OCCLUSION_CLEAR_Z 1.0e30f
+
+static void
+InitializeOcclusionBuffer(occlusion_buffer *Occlusion, uint32 PixelWidth, uint32 PixelHeight)
+{
+    Occlusion->Width = PixelWidth / OCCLUSION_DOWNSCALE;
+    Occlusion->Height = PixelHeight / OCCLUSION_DOWNSCALE;
+    Occlusion->TileCountX = (Occlusion->Width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+    Occlusion->TileCountY = (Occlusion->Height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+    
+    uint32 TileCount = Occlusion->TileCountX * Occlusion->TileCountY;
+    Occlusion->Tiles = (occlusion_tile *)VirtualAlloc(0, TileCount * sizeof(occlusion_tile), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+static void
+ClearOcclusionBuffer(occlusion_buffer *Occlusion)
+{
+    uint32 TileCount = Occlusion->TileCountX * Occlusion->TileCountY;
+    for(uint32 TileIndex = 0; TileIndex < TileCount; ++TileIndex)
+    {
+        occlusion_tile *Tile = &Occlusion->Tiles[TileIndex];
+        Tile->Mask = 0;
+        Tile->ZMax0 = OCCLUSION_CLEAR_Z;
+        Tile->ZMax1 = 0.0f;
+    }
+}
+
+static void
+UpdateOcclusionTile(occlusion_tile *Tile, uint32 Mask, real32 ZMax)
+{
+    //Behind everything already in the tile
+    if(ZMax >= Tile->ZMax0)
+    {
+        return;
+    }
+    
+    //Start a new working layer when the triangle is much closer than the current one
+    real32 DistanceToWorking = Tile->ZMax1 - ZMax;
+    real32 DistanceBetweenLayers = Tile->ZMax0 - Tile->ZMax1;
+    if(DistanceToWorking > DistanceBetweenLayers)
+    {
+        Tile->ZMax1 = 0.0f;
+        Tile->Mask = 0;
+    }
+    
+    Tile->ZMax1 = fmaxf(Tile->ZMax1, ZMax);
+    Tile->Mask |= Mask;
+    
+    if(Tile->Mask == 0xFFFFFFFF)
+    {
+        Tile->ZMax0 = Tile->ZMax1;
+        Tile->ZMax1 = 0.0f;
+        Tile->Mask = 0;
+    }
+}
+
+/*
+Vertices are in occlusion buffer pixels, Z is the distance from the camera.
+Coverage is sampled at the centers of the low resolution pixels and added to the coverage of the occluder, RasterizeOccluder
+erases the pixels its outline passes through afterwards. The whole triangle is conservatively treated as being at its farthest vertex.
+*/
+static void
+RasterizeOcclusionTriangle(occluder_coverage *Coverage, vec3 V0, vec3 V1, vec3 V2)
+{
+    real32 Area = ((V1.X - V0.X) * (V2.Y - V0.Y)) - ((V2.X - V0.X) * (V1.Y - V0.Y));
+    if(Area == 0.0f)
+    {
+        return;
+    }
+    
+    real32 Sign = (Area > 0.0f) ? 1.0f : -1.0f;
+    
+    //Edge I is the edge from Vertices[I] to Vertices[I + 1], written as EdgeA * X + EdgeB * Y + EdgeC.
+    //It is positive on the inside of the triangle.
+    vec3 Vertices[3] = {V0, V1, V2};
+    real32 EdgeA[3];
+    real32 EdgeB[3];
+    real32 EdgeC[3];
+    for(uint32 Index = 0; Index < 3; ++Index)
+    {
+        vec3 From = Vertices[Index];
+        vec3 To = Vertices[(Index + 1) % 3];
+        
+        EdgeA[Index] = Sign * -(To.Y - From.Y);
+        EdgeB[Index] = Sign * (To.X - From.X);
+        EdgeC[Index] = Sign * (((To.Y - From.Y) * From.X) - ((To.X - From.X) * From.Y));
+    }
+    
+    real32 MinX = fminf(V0.X, fminf(V1.X, V2.X));
+    real32 MaxX = fmaxf(V0.X, fmaxf(V1.X, V2.X));
+    real32 MinY = fminf(V0.Y, fminf(V1.Y, V2.Y));
+    real32 MaxY = fmaxf(V0.Y, fmaxf(V1.Y, V2.Y));
+    real32 ZMax = fmaxf(V0.Z, fmaxf(V1.Z, V2.Z));
+    
+    if(MaxX < 0.0f || MaxY < 0.0f ||
+       MinX >= (real32)((Coverage->TileMaxX + 1) * OCCLUSION_TILE_WIDTH) || MinY >= (real32)((Coverage->TileMaxY + 1) * OCCLUSION_TILE_HEIGHT))
+    {
+        return;
+    }
+    
+    int32 TileMinX = ClampInt32((int32)MinX / OCCLUSION_TILE_WIDTH, Coverage->TileMinX, Coverage->TileMaxX);
+    int32 TileMaxX = ClampInt32((int32)MaxX / OCCLUSION_TILE_WIDTH, Coverage->TileMinX, Coverage->TileMaxX);
+    int32 TileMinY = ClampInt32((int32)MinY / OCCLUSION_TILE_HEIGHT, Coverage->TileMinY, Coverage->TileMaxY);
+    int32 TileMaxY = ClampInt32((int32)MaxY / OCCLUSION_TILE_HEIGHT, Coverage->TileMinY, Coverage->TileMaxY);
+    
+    __m256 ColumnOffsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    __m256 Zero = _mm256_setzero_ps();
+    
+    for(int32 TileY = TileMinY; TileY <= TileMaxY; ++TileY)
+    {
+        for(int32 TileX = TileMinX; TileX <= TileMaxX; ++TileX)
+        {
+            __m256 SampleX = _mm256_add_ps(_mm256_set1_ps((real32)(TileX * OCCLUSION_TILE_WIDTH)), ColumnOffsets);
+            
+            uint32 Mask = 0;
+            for(uint32 Row = 0; Row < OCCLUSION_TILE_HEIGHT; ++Row)
+            {
+                real32 SampleY = (real32)(TileY * OCCLUSION_TILE_HEIGHT + Row) + 0.5f;
+                
+                __m256 Inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+                for(uint32 Index = 0; Index < 3; ++Index)
+                {
+                    __m256 RowValue = _mm256_set1_ps((EdgeB[Index] * SampleY) + EdgeC[Index]);
+                    __m256 Value = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(EdgeA[Index]), SampleX), RowValue);
+                    Inside = _mm256_and_ps(Inside, _mm256_cmp_ps(Value, Zero, _CMP_GE_OQ));
+                }
+                
+                Mask |= (uint32)_mm256_movemask_ps(Inside) << (Row * OCCLUSION_TILE_WIDTH);
+            }
+            
+            if(Mask)
+            {
+                uint32 TileIndex = (TileY - Coverage->TileMinY) * Coverage->TileCountX + (TileX - Coverage->TileMinX);
+                Coverage->Masks[TileIndex] |= Mask;
+                Coverage->ZMax[TileIndex] = fmaxf(Coverage->ZMax[TileIndex], ZMax);
+            }
+        }
+    }
+}
+
+/*
+Clears every pixel the edge from From to To passes through, corners and borders included.
+A pixel the edge does not touch lies on one side of it only, so it is either all covered or not sampled as covered at all.
+*/
+static void
+EraseOccluderEdge(occluder_coverage *Coverage, vec3 From, vec3 To)
+{
+    //Rounding can move the edge by a fraction of a pixel, clearing a little more only makes the test more conservative
+    real32 Epsilon = 1.0f / 64.0f;
+    
+    real32 MinY = fminf(From.Y, To.Y) - Epsilon;
+    real32 MaxY = fmaxf(From.Y, To.Y) + Epsilon;
+    
+    int32 CoverageMinX = Coverage->TileMinX * OCCLUSION_TILE_WIDTH;
+    int32 CoverageMaxX = (Coverage->TileMaxX + 1) * OCCLUSION_TILE_WIDTH - 1;
+    int32 CoverageMinY = Coverage->TileMinY * OCCLUSION_TILE_HEIGHT;
+    int32 CoverageMaxY = (Coverage->TileMaxY + 1) * OCCLUSION_TILE_HEIGHT - 1;
+    
+    if(MaxY < (real32)CoverageMinY || MinY >= (real32)(CoverageMaxY + 1))
+    {
+        return;
+    }
+    
+    int32 PixelMinY = ClampInt32((int32)floorf(fmaxf(MinY, (real32)CoverageMinY)), CoverageMinY, CoverageMaxY);
+    int32 PixelMaxY = ClampInt32((int32)floorf(fminf(MaxY, (real32)CoverageMaxY)), CoverageMinY, CoverageMaxY);
+    
+    real32 DeltaY = To.Y - From.Y;
+    for(int32 PixelY = PixelMinY; PixelY <= PixelMaxY; ++PixelY)
+    {
+        //Where the edge is inside the row, a horizontal edge is inside it all the way
+        real32 RowMinX = fminf(From.X, To.X);
+        real32 RowMaxX = fmaxf(From.X, To.X);
+        if(DeltaY != 0.0f)
+        {
+            real32 TopY = fmaxf((real32)PixelY, MinY);
+            real32 BottomY = fminf((real32)(PixelY + 1), MaxY);
+            
+            real32 TopT = fminf(fmaxf((TopY - From.Y) / DeltaY, 0.0f), 1.0f);
+            real32 BottomT = fminf(fmaxf((BottomY - From.Y) / DeltaY, 0.0f), 1.0f);
+            real32 TopX = From.X + TopT * (To.X - From.X);
+            real32 BottomX = From.X + BottomT * (To.X - From.X);
+            
+            RowMinX = fminf(TopX, BottomX);
+            RowMaxX = fmaxf(TopX, BottomX);
+        }
+        
+        //Clamped as reals first, an edge far off screen would not fit an int32
+        RowMinX = fmaxf(RowMinX - Epsilon, (real32)(CoverageMinX - 1));
+        RowMaxX = fminf(RowMaxX + Epsilon, (real32)(CoverageMaxX + 1));
+        int32 PixelMinX = ClampInt32((int32)floorf(RowMinX), CoverageMinX, CoverageMaxX + 1);
+        int32 PixelMaxX = ClampInt32((int32)floorf(RowMaxX), CoverageMinX - 1, CoverageMaxX);
+        
+        uint32 RowIndex = (uint32)(PixelY - CoverageMinY) / OCCLUSION_TILE_HEIGHT;
+        uint32 RowShift = (uint32)(PixelY % OCCLUSION_TILE_HEIGHT) * OCCLUSION_TILE_WIDTH;
+        for(int32 PixelX = PixelMinX; PixelX <= PixelMaxX; ++PixelX)
+        {
+            uint32 TileIndex = RowIndex * Coverage->TileCountX + (uint32)(PixelX - CoverageMinX) / OCCLUSION_TILE_WIDTH;
+            Coverage->Masks[TileIndex] &= ~(1u << (RowShift + (uint32)(PixelX % OCCLUSION_TILE_WIDTH)));
+        }
+    }
+}
+
+inline uint32 HashOccluderKey(uint64 Key)
+{
+    uint32 Result = 2166136261u;
+    Result = (Result ^ (uint32)Key) * 16777619u;
+    Result = (Result ^ (uint32)(Key >> 32)) * 16777619u;
+    Result ^= Result >> 15;
+    
+    return Result;
+}
+
+/*
+Open addressing set of 64 bit keys, never more than half full, 0 is an empty slot.
+Returns the slot that holds Key, or the empty slot it would go into.
+*/
+inline uint64 FindOccluderKeySlot(uint64 *Table, uint64 TableSize, uint64 Key)
+{
+    uint64 Slot = HashOccluderKey(Key) & (TableSize - 1);
+    while(Table[Slot] && (Table[Slot] != Key))
+    {
+        Slot = (Slot + 1) & (TableSize - 1);
+    }
+    
+    return Slot;
+}
+
+static uint64 *
+PushOccluderKeyTable(memory_arena *Arena, uint64 KeyCount, uint64 *TableSize)
+{
+    *TableSize = 1;
+    while(*TableSize < (2 * KeyCount))
+    {
+        *TableSize <<= 1;
+    }
+    
+    uint64 *Result = PushArray(Arena, *TableSize, uint64);
+    for(uint64 Slot = 0; Slot < *TableSize; ++Slot)
+    {
+        Result[Slot] = 0;
+    }
+    
+    return Result;
+}
+
+/*
+Rasterizes the front facing triangles of a mesh as one occluder.
+- Coverage is sampled at pixel centers, so a pixel the outline of the occluder passes through can be claimed without being covered.
+- Every edge that no other drawn triangle runs back along is on that outline: it borders a back facing triangle, one that was left out
+  at the near plane, or the edge of an open mesh. The pixels those edges pass through are erased again.
+- Any other pixel whose center is covered lies wholly inside the occluder, so the occluder never hides what a full resolution pixel shows.
+Drawn triangles share edges the other way around only when they are on the same side, which is why only front facing triangles are drawn.
+*/
+static void
+RasterizeOccluder(memory_arena *Arena, occlusion_buffer *Occlusion, view *View, mesh *Mesh, vec3 Position)
+{
+    temporary_memory ScratchMemory = BeginTemporaryMemory(Arena);
+    
+    real32 ToOcclusionX = (real32)Occlusion->Width / (2.0f * View->HalfWidth);
+    real32 ToOcclusionY = (real32)Occlusion->Height / (2.0f * View->HalfHeight);
+    
+    vec3 *Raster = PushArray(Arena, Mesh->VertexCount, vec3);
+    for(uint32 VertexIndex = 0; VertexIndex < Mesh->VertexCount; ++VertexIndex)
+    {
+        vec3 Vertex = AddVec3(DequantizePosition(&Mesh->Quantization, &Mesh->PackedVertices[VertexIndex]), Position);
+        
+        Raster[VertexIndex] = ProjectToRaster(View, Vertex);
+        Raster[VertexIndex].X *= ToOcclusionX;
+        Raster[VertexIndex].Y *= ToOcclusionY;
+    }
+    
+    //Leaving out part of an occluder only makes the test more conservative
+    bool32 *IsDrawn = PushArray(Arena, Mesh->TriangleCount, bool32);
+    uint64 DrawnCount = 0;
+    
+    real32 MinX = OCCLUSION_CLEAR_Z;
+    real32 MaxX = -OCCLUSION_CLEAR_Z;
+    real32 MinY = OCCLUSION_CLEAR_Z;
+    real32 MaxY = -OCCLUSION_CLEAR_Z;
+    
+    for(uint64 TriangleIndex = 0; TriangleIndex < Mesh->TriangleCount; ++TriangleIndex)
+    {
+        triangle *Triangle = &Mesh->Triangles[TriangleIndex];
+        vec3 V0 = Raster[Triangle->A - 1];
+        vec3 V1 = Raster[Triangle->B - 1];
+        vec3 V2 = Raster[Triangle->C - 1];
+        
+        //Facing is taken from the winding on screen, the same one RasterizeOcclusionTriangle sees, so drawn twins never disagree about it
+        real32 Area = ((V1.X - V0.X) * (V2.Y - V0.Y)) - ((V2.X - V0.X) * (V1.Y - V0.Y));
+        bool32 InFrontOfNear = ((V0.Z >= View->NearZ) && (V1.Z >= View->NearZ) && (V2.Z >= View->NearZ));
+        
+        IsDrawn[TriangleIndex] = (InFrontOfNear && (Area > 0.0f));
+        if(IsDrawn[TriangleIndex])
+        {
+            MinX = fminf(MinX, fminf(V0.X, fminf(V1.X, V2.X)));
+            MaxX = fmaxf(MaxX, fmaxf(V0.X, fmaxf(V1.X, V2.X)));
+            MinY = fminf(MinY, fminf(V0.Y, fminf(V1.Y, V2.Y)));
+            MaxY = fmaxf(MaxY, fmaxf(V0.Y, fmaxf(V1.Y, V2.Y)));
+            ++DrawnCount;
+        }
+    }
+    
+    if(!DrawnCount || MaxX < 0.0f || MaxY < 0.0f || MinX >= Occlusion->Width || MinY >= Occlusion->Height)
+    {
+        EndTemporaryMemory(ScratchMemory);
+        return;
+    }
+    
+    occluder_coverage Coverage;
+    Coverage.TileMinX = ClampInt32((int32)fmaxf(MinX, 0.0f) / OCCLUSION_TILE_WIDTH, 0, Occlusion->TileCountX - 1);
+    Coverage.TileMaxX = ClampInt32((int32)fminf(MaxX, (real32)Occlusion->Width) / OCCLUSION_TILE_WIDTH, 0, Occlusion->TileCountX - 1);
+    Coverage.TileMinY = ClampInt32((int32)fmaxf(MinY, 0.0f) / OCCLUSION_TILE_HEIGHT, 0, Occlusion->TileCountY - 1);
+    Coverage.TileMaxY = ClampInt32((int32)fminf(MaxY, (real32)Occlusion->Height) / OCCLUSION_TILE_HEIGHT, 0, Occlusion->TileCountY - 1);
+    Coverage.TileCountX = (uint32)(Coverage.TileMaxX - Coverage.TileMinX + 1);
+    
+    uint32 CoverageTileCount = Coverage.TileCountX * (uint32)(Coverage.TileMaxY - Coverage.TileMinY + 1);
+    Coverage.Masks = PushArray(Arena, CoverageTileCount, uint32);
+    Coverage.ZMax = PushArray(Arena, CoverageTileCount, real32);
+    for(uint32 TileIndex = 0; TileIndex < CoverageTileCount; ++TileIndex)
+    {
+        Coverage.Masks[TileIndex] = 0;
+        Coverage.ZMax[TileIndex] = 0.0f;
+    }
+    
+    //Welding splits a seam into vertices with the same position, they all get the first one's index so their edges still pair up
+    uint64 PositionTableSize;
+    uint64 *PositionTable = PushOccluderKeyTable(Arena, Mesh->VertexCount, &PositionTableSize);
+    uint32 *PositionVertices = PushArray(Arena, PositionTableSize, uint32);
+    uint32 *Shared = PushArray(Arena, Mesh->VertexCount, uint32);
+    
+    for(uint32 VertexIndex = 0; VertexIndex < Mesh->VertexCount; ++VertexIndex)
+    {
+        //The quantized position takes 48 bits, the bit above them keeps a vertex at the origin from reading as an empty slot
+        uint16 *Bits = Mesh->PackedVertices[VertexIndex].Position;
+        uint64 PositionKey = (uint64)Bits[0] | ((uint64)Bits[1] << 16) | ((uint64)Bits[2] << 32) | ((uint64)1 << 48);
+        
+        uint64 Slot = FindOccluderKeySlot(PositionTable, PositionTableSize, PositionKey);
+        if(!PositionTable[Slot])
+        {
+            PositionTable[Slot] = PositionKey;
+            PositionVertices[Slot] = VertexIndex + 1;
+        }
+        
+        Shared[VertexIndex] = PositionVertices[Slot];
+    }
+    
+    //Edges of the drawn triangles, the shared index of the vertex they start at in the high half and of the one they end at in the low
+    uint64 EdgeTableSize;
+    uint64 *EdgeTable = PushOccluderKeyTable(Arena, 3 * DrawnCount, &EdgeTableSize);
+    
+    for(uint64 TriangleIndex = 0; TriangleIndex < Mesh->TriangleCount; ++TriangleIndex)
+    {
+        if(!IsDrawn[TriangleIndex])
+        {
+            continue;
+        }
+        
+        triangle *Triangle = &Mesh->Triangles[TriangleIndex];
+        RasterizeOcclusionTriangle(&Coverage, Raster[Triangle->A - 1], Raster[Triangle->B - 1], Raster[Triangle->C - 1]);
+        
+        for(uint32 Corner = 0; Corner < 3; ++Corner)
+        {
+            uint64 From = Shared[GetCornerVertex(Triangle, Corner) - 1];
+            uint64 To = Shared[GetCornerVertex(Triangle, (Corner + 1) % 3) - 1];
+            
+            uint64 Edge = (From << 32) | To;
+            EdgeTable[FindOccluderKeySlot(EdgeTable, EdgeTableSize, Edge)] = Edge;
+        }
+    }
+    
+    //Edges on the outline have no twin running the other way
+    for(uint64 TriangleIndex = 0; TriangleIndex < Mesh->TriangleCount; ++TriangleIndex)
+    {
+        if(!IsDrawn[TriangleIndex])
+        {
+            continue;
+        }
+        
+        triangle *Triangle = &Mesh->Triangles[TriangleIndex];
+        for(uint32 Corner = 0; Corner < 3; ++Corner)
+        {
+            uint32 From = GetCornerVertex(Triangle, Corner);
+            uint32 To = GetCornerVertex(Triangle, (Corner + 1) % 3);
+            
+            uint64 Twin = ((uint64)Shared[To - 1] << 32) | Shared[From - 1];
+            if(!EdgeTable[FindOccluderKeySlot(EdgeTable, EdgeTableSize, Twin)])
+            {
+                EraseOccluderEdge(&Coverage, Raster[From - 1], Raster[To - 1]);
+            }
+        }
+    }
+    
+    for(int32 TileY = Coverage.TileMinY; TileY <= Coverage.TileMaxY; ++TileY)
+    {
+        for(int32 TileX = Coverage.TileMinX; TileX <= Coverage.TileMaxX; ++TileX)
+        {
+            uint32 TileIndex = (TileY - Coverage.TileMinY) * Coverage.TileCountX + (TileX - Coverage.TileMinX);
+            if(Coverage.Masks[TileIndex])
+            {
+                UpdateOcclusionTile(&Occlusion->Tiles[TileY * Occlusion->TileCountX + TileX], Coverage.Masks[TileIndex], Coverage.ZMax[TileIndex]);
+            }
+        }
+    }
+    
+    EndTemporaryMemory(ScratchMemory);
+}
+
+//The box is hidden when its nearest point is behind ZMax0 in every tile its screen bounds touch
+static bool32
+IsBoxOccluded(occlusion_buffer *Occlusion, view *View, vec3 Min, vec3 Max)
+{
+    real32 NearestZ = Min.Z - View->CameraPos.Z;
+    if(NearestZ <= View->NearZ)
+    {
+        return false;
+    }
+    
+    real32 MinX = OCCLUSION_CLEAR_Z;
+    real32 MaxX = -OCCLUSION_CLEAR_Z;
+    real32 MinY = OCCLUSION_CLEAR_Z;
+    real32 MaxY = -OCCLUSION_CLEAR_Z;
+    
+    for(uint32 Corner = 0; Corner < 8; ++Corner)
+    {
+        vec3 Point;
+        Point.X = (Corner & 1) ? Max.X : Min.X;
+        Point.Y = (Corner & 2) ? Max.Y : Min.Y;
+        Point.Z = (Corner & 4) ? Max.Z : Min.Z;
+        
+        vec3 Raster = ProjectToRaster(View, Point);
+        MinX = fminf(MinX, Raster.X);
+        MaxX = fmaxf(MaxX, Raster.X);
+        MinY = fminf(MinY, Raster.Y);
+        MaxY = fmaxf(MaxY, Raster.Y);
+    }
+    
+    real32 ToOcclusionX = (real32)Occlusion->Width / (2.0f * View->HalfWidth);
+    real32 ToOcclusionY = (real32)Occlusion->Height / (2.0f * View->HalfHeight);
+    MinX *= ToOcclusionX;
+    MaxX *= ToOcclusionX;
+    MinY *= ToOcclusionY;
+    MaxY *= ToOcclusionY;
+    
+    //Off screen objects are left to frustum culling
+    if(MaxX < 0.0f || MaxY < 0.0f || MinX >= Occlusion->Width || MinY >= Occlusion->Height)
+    {
+        return false;
+    }
+    
+    int32 TileMinX = ClampInt32((int32)fmaxf(MinX, 0.0f) / OCCLUSION_TILE_WIDTH, 0, Occlusion->TileCountX - 1);
+    int32 TileMaxX = ClampInt32((int32)MaxX / OCCLUSION_TILE_WIDTH, 0, Occlusion->TileCountX - 1);
+    int32 TileMinY = ClampInt32((int32)fmaxf(MinY, 0.0f) / OCCLUSION_TILE_HEIGHT, 0, Occlusion->TileCountY - 1);
+    int32 TileMaxY = ClampInt32((int32)MaxY / OCCLUSION_TILE_HEIGHT, 0, Occlusion->TileCountY - 1);
+    
+    for(int32 TileY = TileMinY; TileY <= TileMaxY; ++TileY)
+    {
+        occlusion_tile *Tile = &Occlusion->Tiles[TileY * Occlusion->TileCountX + TileMinX];
+        for(int32 TileX = TileMinX; TileX <= TileMaxX; ++TileX, ++Tile)
+        {
+            if(NearestZ < Tile->ZMax0)
+            {
+                return false;
+            }
+        }
+    }
+    
+    return true;
+}
+
+static bool32
+IsSphereOccluded(occlusion_buffer *Occlusion, view *View, vec3 Center, real32 Radius)
+{
+    vec3 Min = {Center.X - Radius, Center.Y - Radius, Center.Z - Radius};
+    vec3 Max = {Center.X + Radius, Center.Y + Radius, Center.Z + Radius};
+    
+    bool32 Result = IsBoxOccluded(Occlusion, View, Min, Max);
+    
+    return Result;
+}
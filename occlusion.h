@@ -0,0 +1,49 @@
+/* date = October 19th 2026 1:20 pm */
+
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+//The occlusion buffer is this many times smaller than the pixel buffer on each axis
+#define OCCLUSION_DOWNSCALE 4
+
+//One bit of occlusion_tile::Mask per pixel, a tile row is one AVX register wide
+#define OCCLUSION_TILE_WIDTH 8
+#define OCCLUSION_TILE_HEIGHT 4
+
+/*
+Masked occlusion tile, depths are Z distances from the camera.
+- ZMax0 is the farthest depth of anything in the tile, every pixel of the tile is covered at or before it.
+- ZMax1 is the farthest depth of the working layer, which covers the pixels set in Mask.
+- When the working layer covers the whole tile it becomes the new ZMax0.
+*/
+typedef struct
+{
+    uint32 Mask;
+    real32 ZMax0;
+    real32 ZMax1;
+}occlusion_tile;
+
+//Coverage of one occluder over the tiles its screen bounds touch, gathered before any of it goes into the occlusion buffer
+typedef struct
+{
+    int32 TileMinX;
+    int32 TileMinY;
+    int32 TileMaxX;
+    int32 TileMaxY;
+    uint32 TileCountX;
+    
+    uint32 *Masks;
+    real32 *ZMax;
+}occluder_coverage;
+
+typedef struct
+{
+    occlusion_tile *Tiles;
+    
+    uint32 Width;
+    uint32 Height;
+    uint32 TileCountX;
+    uint32 TileCountY;
+}occlusion_buffer;
+
+#endif //OCCLUSION_H
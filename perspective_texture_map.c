@@ -138,6 +138,48 @@ void InitializeEdge(edge *Edge, gradient Gradients, vec5 V1, uint32 V1Index, vec
     Edge->OneOverZStep = (Edge->XStep * Gradients.dOneOverZdX) + Gradients.dOneOverZdY;
 }
 
+inline uint32 SampleTexture(texture *Texture, real32 U, real32 V)
+{
+    uint32 TextureWidth = Texture->Width;
+    uint32 TextureHeight = Texture->Height;
+    
+    uint32 TexelU = (uint32)(U * TextureWidth);
+    uint32 TexelV = (uint32)(V * TextureHeight);
+    
+    // NOTE(not-set): This operation might be hiding an error
+    TexelU = TexelU % TextureWidth;
+    TexelV = TexelV % TextureHeight;
+    
+    //24-bit to 32-bit conversion of bmp
+    uint8 *TexByte = (uint8 *)Texture->Bytes + (TexelV * TextureWidth * Texture->BytesPerTexel) + (TexelU * Texture->BytesPerTexel);
+    
+    //uint32 Alpha = *TexByte++;
+    uint32 Blue = *TexByte++;
+    uint32 Green = *TexByte++;
+    uint32 Red = *TexByte;
+    uint32 Result = (0xFF << 24) | (Red << 16) | (Green << 8) | (Blue << 0);
+    
+    return Result;
+}
+
+//Multiplies every channel of Texel by the one of Color, 0xFFFFFFFF leaves the texel as it is
+inline uint32 ModulateColor(uint32 Texel, uint32 Color)
+{
+    if(Color == 0xFFFFFFFF)
+    {
+        return Texel;
+    }
+    
+    uint32 Result = 0;
+    for(uint32 Shift = 0; Shift < 32; Shift += 8)
+    {
+        uint32 Channel = (((Texel >> Shift) & 0xFF) * ((Color >> Shift) & 0xFF) + 0xFF) >> 8;
+        Result |= Channel << Shift;
+    }
+    
+    return Result;
+}
+
 void DrawHorizontalScanline(win32_pixel_buffer *Buffer, texture *Texture, edge *Left, edge *Right, gradient Gradients)
 {
     uint32 XStart = (uint32)ceilf(Left->X);
@@ -151,32 +193,17 @@ void DrawHorizontalScanline(win32_pixel_buffer *Buffer, texture *Texture, edge *
     
     real32 VOverZ = Left->VOverZ + (XPreStep * Gradients.dVOverZdX);
     
-    uint32 *Pixel = (uint32 *)((uint8 *)Buffer->Memory + (Left->Y * Buffer->Stride) + (XStart * Buffer->BytesPerPixel));
-    
-    uint32 TextureWidth = Texture->Width;
-    uint32 TextureHeight = Texture->Height;
+    uint32 *Pixels = (uint32 *)Buffer->Memory;
+    uint32 PixelIndex = GetPixelIndex(Buffer, XStart, Left->Y);
     
     //Assert(Gradients.dOneOverZdX >= 0);
     //Assert(OneOverZ >= 0);
     //Assert(UOverZ < OneOverZ);
     for(uint32 X = XStart; X <= XEnd; ++X)
     {
-        uint32 U = (uint32)((UOverZ / OneOverZ) * TextureWidth);
-        uint32 V = (uint32)((VOverZ / OneOverZ) * TextureHeight);
-        
-        // NOTE(not-set): This operation might be hiding an error
-        U = U % TextureWidth;
-        V = V % TextureHeight;
-        
-        //24-bit to 32-bit conversion of bmp
-        uint8 *TexByte = (uint8 *)Texture->Bytes + (V * TextureWidth * Texture->BytesPerTexel) + (U * Texture->BytesPerTexel);
-        
-        //uint32 Alpha = *TexByte++;
-        uint32 Blue = *TexByte++;
-        uint32 Green = *TexByte++;
-        uint32 Red = *TexByte;
-        uint32 Color = (0xFF << 24) | (Red << 16) | (Green << 8) | (Blue << 0);
-        *Pixel++ = Color;
+        real32 Z = 1.0f / OneOverZ;
+        Pixels[PixelIndex] = SampleTexture(Texture, UOverZ * Z, VOverZ * Z);
+        PixelIndex = GetNextPixelIndex(Buffer, PixelIndex, X);
         
         OneOverZ += Gradients.dOneOverZdX;
         UOverZ += Gradients.dUOverZdX;
@@ -200,6 +227,9 @@ void TextureMap(win32_pixel_buffer *Buffer, texture *Texture, vec5 V1, vec5 V2,
 {
     //CreateTexture((uint32 *)TextureBytes);
     
+    ResolveFastClearBounds(Buffer, fminf(V1.X, fminf(V2.X, V3.X)), fminf(V1.Y, fminf(V2.Y, V3.Y)),
+                           fmaxf(V1.X, fmaxf(V2.X, V3.X)), fmaxf(V1.Y, fmaxf(V2.Y, V3.Y)));
+    
     vec5 SortedVertices[3] = {V1, V2, V3};
     SortVerticesVec5(SortedVertices);
     
@@ -0,0 +1,253 @@
+#include "profiler.h"
+
+/*
+Profiler for the stages of a frame:
+- A zone reads the cycle counter where it begins and ends, and the end writes one event to the ring of the thread it ran on.
+- Every thread gets its own ring the first time it records a zone, rings are never shared so recording takes no lock.
+- Stages that run too often for an event each, like setting up one batch of triangles, are sampled: one pass in
+  PROFILER_SAMPLE_RATE is timed and added to the totals that many times, without an event.
+- WriteProfileTrace writes the events still in the rings as Chrome trace JSON, for chrome://tracing or Perfetto.
+  PrintProfileSummary prints the totals of every stage per frame.
+Cycles are turned into time against the performance counter over the whole run, so no calibration is needed up front.
+*/
+
+static profiler GlobalProfiler;
+static __declspec(thread) profile_thread *GlobalProfileThread;
+
+static char *ProfileStageNames[ProfileStage_Count] =
+{
+    "Frame",
+    "Load",
+    "Transform",
+    "Sort",
+    "Setup",
+    "Raster",
+    "Upscale",
+    "Present",
+};
+
+static void
+InitializeProfiler(void)
+{
+    GlobalProfiler.ThreadCount = 0;
+    GlobalProfiler.StartCycles = __rdtsc();
+    QueryPerformanceCounter(&GlobalProfiler.StartCounter);
+}
+
+//The ring of the calling thread, made the first time the thread asks for it
+static profile_thread *
+GetProfileThread(void)
+{
+    profile_thread *Thread = GlobalProfileThread;
+    if(!Thread)
+    {
+        Thread = (profile_thread *)VirtualAlloc(0, sizeof(profile_thread), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        Assert(Thread);
+        Thread->ThreadId = GetCurrentThreadId();
+        
+        LONG ThreadIndex = InterlockedIncrement(&GlobalProfiler.ThreadCount) - 1;
+        Assert(ThreadIndex < PROFILER_MAX_THREAD_COUNT);
+        GlobalProfiler.Threads[ThreadIndex] = Thread;
+        
+        GlobalProfileThread = Thread;
+    }
+    
+    return Thread;
+}
+
+inline void RecordProfileEvent(profile_thread *Thread, profile_stage Stage, uint64 StartCycles, uint64 EndCycles)
+{
+    uint64 Cycles = EndCycles - StartCycles;
+    
+    profile_event *Event = &Thread->Events[Thread->EventCount & (PROFILER_EVENT_COUNT - 1)];
+    Event->StartCycles = StartCycles;
+    Event->Cycles = Cycles;
+    Event->Stage = Stage;
+    
+    Thread->StageCycles[Stage] += Cycles;
+    ++Thread->StageCounts[Stage];
+    
+    //The event has to be complete before a reader can see the new count
+    _WriteBarrier();
+    ++Thread->EventCount;
+}
+
+static void
+RecordProfileZone(profile_stage Stage, uint64 StartCycles)
+{
+    uint64 EndCycles = __rdtsc();
+    RecordProfileEvent(GetProfileThread(), Stage, StartCycles, EndCycles);
+}
+
+inline void RecordSampledProfileZone(profile_thread *Thread, profile_stage Stage, uint64 StartCycles)
+{
+    Thread->StageCycles[Stage] += PROFILER_SAMPLE_RATE * (__rdtsc() - StartCycles);
+    Thread->StageCounts[Stage] += PROFILER_SAMPLE_RATE;
+}
+
+//Cycle counter ticks per microsecond over everything since InitializeProfiler
+static real64
+GetProfileCyclesPerMicrosecond(void)
+{
+    uint64 Cycles = __rdtsc() - GlobalProfiler.StartCycles;
+    
+    LARGE_INTEGER Counter;
+    LARGE_INTEGER Frequency;
+    QueryPerformanceCounter(&Counter);
+    QueryPerformanceFrequency(&Frequency);
+    
+    real64 Microseconds = (1000000.0 * (real64)(Counter.QuadPart - GlobalProfiler.StartCounter.QuadPart)) / (real64)Frequency.QuadPart;
+    real64 Result = (real64)Cycles / Microseconds;
+    
+    return Result;
+}
+
+/*
+Writes the events of every ring as complete ("X") events of Chrome's trace format, one track per thread.
+Only call this while the other threads are idle, an event written during the call may show up half written.
+*/
+static bool32
+WriteProfileTrace(char *FileName)
+{
+    real64 CyclesPerMicrosecond = GetProfileCyclesPerMicrosecond();
+    uint32 ThreadCount = (uint32)GlobalProfiler.ThreadCount;
+    
+    //No line below takes more than this many bytes
+    uint64 LineSize = 160;
+    uint64 MaxSize = LineSize * ((uint64)ThreadCount * (PROFILER_EVENT_COUNT + 1) + 2);
+    char *Json = (char *)VirtualAlloc(0, MaxSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if(!Json)
+    {
+        return false;
+    }
+    
+    uint64 Size = 0;
+    Size += sprintf_s(Json + Size, MaxSize - Size, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    
+    char *Separator = "";
+    for(uint32 ThreadIndex = 0; ThreadIndex < ThreadCount; ++ThreadIndex)
+    {
+        profile_thread *Thread = GlobalProfiler.Threads[ThreadIndex];
+        if(!Thread)
+        {
+            continue;
+        }
+        
+        Size += sprintf_s(Json + Size, MaxSize - Size, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}",
+                          Separator, Thread->ThreadId, ThreadIndex);
+        Separator = ",\n";
+        
+        //A full ring starts with the oldest event, the one the next zone will overwrite
+        uint32 EventCount = Thread->EventCount;
+        uint32 FirstEvent = (EventCount > PROFILER_EVENT_COUNT) ? (EventCount - PROFILER_EVENT_COUNT) : 0;
+        
+        for(uint32 EventIndex = FirstEvent; EventIndex != EventCount; ++EventIndex)
+        {
+            profile_event *Event = &Thread->Events[EventIndex & (PROFILER_EVENT_COUNT - 1)];
+            
+            real64 Start = (real64)(Event->StartCycles - GlobalProfiler.StartCycles) / CyclesPerMicrosecond;
+            real64 Duration = (real64)Event->Cycles / CyclesPerMicrosecond;
+            
+            Size += sprintf_s(Json + Size, MaxSize - Size, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                              Separator, ProfileStageNames[Event->Stage], Thread->ThreadId, Start, Duration);
+        }
+    }
+    
+    Size += sprintf_s(Json + Size, MaxSize - Size, "\n]}\n");
+    
+    bool32 Result = false;
+    HANDLE FileHandle = CreateFileA(FileName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if(FileHandle != INVALID_HANDLE_VALUE)
+    {
+        DWORD BytesWritten;
+        Result = (WriteFile(FileHandle, Json, (DWORD)Size, &BytesWritten, 0) && (BytesWritten == (DWORD)Size));
+        CloseHandle(FileHandle);
+    }
+    
+    VirtualFree(Json, 0, MEM_RELEASE);
+    
+    return Result;
+}
+
+//Time of one zone, recorded into a ring of its own so the rings of the threads are left as they are
+static real64
+MeasureProfileZoneSeconds(real64 CyclesPerMicrosecond)
+{
+    profile_thread *Thread = (profile_thread *)VirtualAlloc(0, sizeof(profile_thread), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    uint64 StartCycles = __rdtsc();
+    for(uint32 ZoneIndex = 0; ZoneIndex < PROFILER_OVERHEAD_ZONE_COUNT; ++ZoneIndex)
+    {
+        uint64 ZoneStartCycles = __rdtsc();
+        RecordProfileEvent(Thread, ProfileStage_Frame, ZoneStartCycles, __rdtsc());
+    }
+    uint64 Cycles = __rdtsc() - StartCycles;
+    
+    VirtualFree(Thread, 0, MEM_RELEASE);
+    
+    real64 Result = ((real64)Cycles / CyclesPerMicrosecond) / (1000000.0 * PROFILER_OVERHEAD_ZONE_COUNT);
+    return Result;
+}
+
+/*
+Prints the time of every stage summed over all threads, per frame and as a share of the frame. Stages that run on several
+threads at once, or inside another stage, can add up to more than the frame. The overhead is what the zones recorded per frame
+would take at the measured time per zone.
+*/
+static void
+PrintProfileSummary(void)
+{
+    real64 CyclesPerMicrosecond = GetProfileCyclesPerMicrosecond();
+    
+    uint64 StageCycles[ProfileStage_Count] = {0};
+    uint64 StageCounts[ProfileStage_Count] = {0};
+    uint64 ZoneCount = 0;
+    
+    for(uint32 ThreadIndex = 0; ThreadIndex < (uint32)GlobalProfiler.ThreadCount; ++ThreadIndex)
+    {
+        profile_thread *Thread = GlobalProfiler.Threads[ThreadIndex];
+        if(!Thread)
+        {
+            continue;
+        }
+        
+        for(uint32 Stage = 0; Stage < ProfileStage_Count; ++Stage)
+        {
+            StageCycles[Stage] += Thread->StageCycles[Stage];
+            StageCounts[Stage] += Thread->StageCounts[Stage];
+        }
+        
+        //Sampled zones only read the counters on the passes they time
+        ZoneCount += Thread->EventCount + (Thread->StageCounts[ProfileStage_Setup] / PROFILER_SAMPLE_RATE);
+    }
+    
+    uint64 FrameCount = StageCounts[ProfileStage_Frame];
+    if(FrameCount == 0)
+    {
+        OutputDebugStringA("Profile: no frames recorded\n");
+        return;
+    }
+    
+    real64 FrameMilliseconds = ((real64)StageCycles[ProfileStage_Frame] / CyclesPerMicrosecond) / (1000.0 * (real64)FrameCount);
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Profile over %llu frames, %.3fms per frame:\n", (unsigned long long)FrameCount, FrameMilliseconds);
+    OutputDebugStringA(OutputBuffer);
+    
+    for(uint32 Stage = 0; Stage < ProfileStage_Count; ++Stage)
+    {
+        real64 Milliseconds = ((real64)StageCycles[Stage] / CyclesPerMicrosecond) / (1000.0 * (real64)FrameCount);
+        
+        sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "    %-10s %9.3fms per frame %6.1f%% %12llu zones%s\n",
+                  ProfileStageNames[Stage], Milliseconds, (100.0 * Milliseconds) / FrameMilliseconds, (unsigned long long)StageCounts[Stage],
+                  (Stage == ProfileStage_Setup) ? ", sampled inside Raster" : "");
+        OutputDebugStringA(OutputBuffer);
+    }
+    
+    real64 ZoneSeconds = MeasureProfileZoneSeconds(CyclesPerMicrosecond);
+    real64 ZonesPerFrame = (real64)ZoneCount / (real64)FrameCount;
+    
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Profiler overhead: %.0f zones per frame at %.1fns each, %.3f%% of the frame\n",
+              ZonesPerFrame, 1000000000.0 * ZoneSeconds, (100.0 * ZonesPerFrame * 1000.0 * ZoneSeconds) / FrameMilliseconds);
+    OutputDebugStringA(OutputBuffer);
+}
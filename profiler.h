@@ -0,0 +1,78 @@
+/* date = October 19th 2026 11:58 pm */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+//Build with PROFILER 0 and every zone compiles to nothing
+#ifndef PROFILER
+#define PROFILER 1
+#endif
+
+//Zones kept per thread for the trace, older ones are overwritten. The totals of the summary count every zone.
+#define PROFILER_EVENT_COUNT (1 << 16)
+//The main thread, the present thread and the workers of the work queue
+#define PROFILER_MAX_THREAD_COUNT 32
+//Sampled zones time one pass in this many and count it this many times over
+#define PROFILER_SAMPLE_RATE 16
+
+#define PROFILER_OVERHEAD_ZONE_COUNT 4096
+
+typedef enum
+{
+    ProfileStage_Frame,
+    ProfileStage_Load,
+    ProfileStage_Transform,
+    ProfileStage_Sort,
+    ProfileStage_Setup,
+    ProfileStage_Raster,
+    ProfileStage_Upscale,
+    ProfileStage_Present,
+    
+    ProfileStage_Count,
+}profile_stage;
+
+typedef struct
+{
+    uint64 StartCycles;
+    uint64 Cycles;
+    uint32 Stage;
+}profile_event;
+
+//Only the thread it belongs to writes to it, EventCount is moved on once the event is complete
+typedef struct
+{
+    uint32 ThreadId;
+    uint32 volatile EventCount;
+    uint32 SampleCounter;
+    
+    uint64 StageCycles[ProfileStage_Count];
+    uint64 StageCounts[ProfileStage_Count];
+    
+    profile_event Events[PROFILER_EVENT_COUNT];
+}profile_thread;
+
+typedef struct
+{
+    profile_thread *Threads[PROFILER_MAX_THREAD_COUNT];
+    LONG volatile ThreadCount;
+    
+    //Where the clocks stood when profiling started, the cycle counter is converted to time against the performance counter
+    uint64 StartCycles;
+    LARGE_INTEGER StartCounter;
+}profiler;
+
+#if PROFILER
+#define BEGIN_PROFILE_ZONE(Name) uint64 ProfileZoneStart_##Name = __rdtsc()
+#define END_PROFILE_ZONE(Name) RecordProfileZone(ProfileStage_##Name, ProfileZoneStart_##Name)
+#define BEGIN_SAMPLED_PROFILE_ZONE(Name) profile_thread *ProfileThread_##Name = GetProfileThread(); \
+uint64 ProfileZoneStart_##Name = ((++ProfileThread_##Name->SampleCounter % PROFILER_SAMPLE_RATE) == 0) ? __rdtsc() : 0
+#define END_SAMPLED_PROFILE_ZONE(Name) do { if(ProfileZoneStart_##Name) \
+{ RecordSampledProfileZone(ProfileThread_##Name, ProfileStage_##Name, ProfileZoneStart_##Name); } } while(0)
+#else
+#define BEGIN_PROFILE_ZONE(Name)
+#define END_PROFILE_ZONE(Name)
+#define BEGIN_SAMPLED_PROFILE_ZONE(Name)
+#define END_SAMPLED_PROFILE_ZONE(Name)
+#endif
+
+#endif //PROFILER_H
@@ -0,0 +1,173 @@
+#include "quantize.h"
+
+//Rounds to the nearest step, so the error is at most half a step
+inline uint16 QuantizeUnorm16(real32 Value, real32 Min, real32 InvScale)
+{
+    real32 Steps = ((Value - Min) * InvScale) + 0.5f;
+    uint16 Result = (uint16)fminf(fmaxf(Steps, 0.0f), QUANTIZE_MAX);
+    
+    return Result;
+}
+
+inline int8 QuantizeSnorm8(real32 Value)
+{
+    int8 Result = (int8)RoundReal32ToInt32(fminf(fmaxf(Value, -1.0f), 1.0f) * QUANTIZE_NORMAL_MAX);
+    
+    return Result;
+}
+
+inline vec3 DequantizePosition(vertex_quantization *Quantization, packed_vertex *Vertex)
+{
+    vec3 Result;
+    Result.X = Quantization->PositionMin.X + ((real32)Vertex->Position[0] * Quantization->PositionScale.X);
+    Result.Y = Quantization->PositionMin.Y + ((real32)Vertex->Position[1] * Quantization->PositionScale.Y);
+    Result.Z = Quantization->PositionMin.Z + ((real32)Vertex->Position[2] * Quantization->PositionScale.Z);
+    
+    return Result;
+}
+
+inline vec2 DequantizeTextureCoord(vertex_quantization *Quantization, packed_vertex *Vertex)
+{
+    vec2 Result;
+    Result.X = Quantization->TextureMin.X + ((real32)Vertex->TextureCoord[0] * Quantization->TextureScale.X);
+    Result.Y = Quantization->TextureMin.Y + ((real32)Vertex->TextureCoord[1] * Quantization->TextureScale.Y);
+    
+    return Result;
+}
+
+//Not renormalized, the length is within about 1% of 1
+inline vec3 DequantizeNormal(packed_vertex *Vertex)
+{
+    real32 Scale = 1.0f / QUANTIZE_NORMAL_MAX;
+    vec3 Result = {(real32)Vertex->Normal[0] * Scale, (real32)Vertex->Normal[1] * Scale, (real32)Vertex->Normal[2] * Scale};
+    
+    return Result;
+}
+
+//Folds the dequantization into the transform, so the quantized position goes through TransformPoint as it is
+static mat4
+CreateDequantizeTransform(mat4 *Transform, vertex_quantization *Quantization)
+{
+    mat4 Result = *Transform;
+    
+    real32 Scale[3] = {Quantization->PositionScale.X, Quantization->PositionScale.Y, Quantization->PositionScale.Z};
+    vec3 Min = TransformPoint(Transform, Quantization->PositionMin);
+    
+    for(uint32 Row = 0; Row < 3; ++Row)
+    {
+        for(uint32 Column = 0; Column < 3; ++Column)
+        {
+            Result.M[Row][Column] *= Scale[Column];
+        }
+    }
+    
+    Result.M[0][3] = Min.X;
+    Result.M[1][3] = Min.Y;
+    Result.M[2][3] = Min.Z;
+    
+    return Result;
+}
+
+/*
+Builds the packed vertices of a mesh from its float vertices, the float vertices are left alone.
+- Positions are quantized across the bounding box of the vertices and texture coordinates across their range,
+  so the error on every axis is at most half a step: Extent / QUANTIZE_MAX / 2.
+- The largest error of every vertex is measured and checked against that bound.
+*/
+static void
+QuantizeMesh(mesh *Mesh)
+{
+    if(!Mesh->VertexCount)
+    {
+        return;
+    }
+    
+    vec3 PositionMin = Mesh->Vertices[0].Position;
+    vec3 PositionMax = PositionMin;
+    vec2 TextureMin = Mesh->Vertices[0].TextureCoord;
+    vec2 TextureMax = TextureMin;
+    
+    for(uint64 VertexIndex = 1; VertexIndex < Mesh->VertexCount; ++VertexIndex)
+    {
+        vertex *Vertex = &Mesh->Vertices[VertexIndex];
+        PositionMin = (vec3){fminf(PositionMin.X, Vertex->Position.X), fminf(PositionMin.Y, Vertex->Position.Y), fminf(PositionMin.Z, Vertex->Position.Z)};
+        PositionMax = (vec3){fmaxf(PositionMax.X, Vertex->Position.X), fmaxf(PositionMax.Y, Vertex->Position.Y), fmaxf(PositionMax.Z, Vertex->Position.Z)};
+        TextureMin = (vec2){fminf(TextureMin.X, Vertex->TextureCoord.X), fminf(TextureMin.Y, Vertex->TextureCoord.Y)};
+        TextureMax = (vec2){fmaxf(TextureMax.X, Vertex->TextureCoord.X), fmaxf(TextureMax.Y, Vertex->TextureCoord.Y)};
+    }
+    
+    vertex_quantization *Quantization = &Mesh->Quantization;
+    Quantization->PositionMin = PositionMin;
+    Quantization->PositionScale = (vec3){(PositionMax.X - PositionMin.X) / QUANTIZE_MAX, (PositionMax.Y - PositionMin.Y) / QUANTIZE_MAX, (PositionMax.Z - PositionMin.Z) / QUANTIZE_MAX};
+    Quantization->TextureMin = TextureMin;
+    Quantization->TextureScale = (vec2){(TextureMax.X - TextureMin.X) / QUANTIZE_MAX, (TextureMax.Y - TextureMin.Y) / QUANTIZE_MAX};
+    
+    //A flat axis has a scale of 0, every vertex quantizes to 0 on it
+    vec3 PositionInvScale;
+    PositionInvScale.X = (Quantization->PositionScale.X > 0.0f) ? (1.0f / Quantization->PositionScale.X) : 0.0f;
+    PositionInvScale.Y = (Quantization->PositionScale.Y > 0.0f) ? (1.0f / Quantization->PositionScale.Y) : 0.0f;
+    PositionInvScale.Z = (Quantization->PositionScale.Z > 0.0f) ? (1.0f / Quantization->PositionScale.Z) : 0.0f;
+    
+    vec2 TextureInvScale;
+    TextureInvScale.X = (Quantization->TextureScale.X > 0.0f) ? (1.0f / Quantization->TextureScale.X) : 0.0f;
+    TextureInvScale.Y = (Quantization->TextureScale.Y > 0.0f) ? (1.0f / Quantization->TextureScale.Y) : 0.0f;
+    
+    Mesh->PackedVertices = (packed_vertex *)VirtualAlloc(0, Mesh->VertexCount * sizeof(packed_vertex), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    real32 PositionError = 0.0f;
+    real32 TextureError = 0.0f;
+    
+    for(uint64 VertexIndex = 0; VertexIndex < Mesh->VertexCount; ++VertexIndex)
+    {
+        vertex *Vertex = &Mesh->Vertices[VertexIndex];
+        packed_vertex *Packed = &Mesh->PackedVertices[VertexIndex];
+        
+        Packed->Position[0] = QuantizeUnorm16(Vertex->Position.X, PositionMin.X, PositionInvScale.X);
+        Packed->Position[1] = QuantizeUnorm16(Vertex->Position.Y, PositionMin.Y, PositionInvScale.Y);
+        Packed->Position[2] = QuantizeUnorm16(Vertex->Position.Z, PositionMin.Z, PositionInvScale.Z);
+        Packed->TextureCoord[0] = QuantizeUnorm16(Vertex->TextureCoord.X, TextureMin.X, TextureInvScale.X);
+        Packed->TextureCoord[1] = QuantizeUnorm16(Vertex->TextureCoord.Y, TextureMin.Y, TextureInvScale.Y);
+        Packed->Normal[0] = QuantizeSnorm8(Vertex->Normal.X);
+        Packed->Normal[1] = QuantizeSnorm8(Vertex->Normal.Y);
+        Packed->Normal[2] = QuantizeSnorm8(Vertex->Normal.Z);
+        Packed->Unused = 0;
+        
+        vec3 Position = DequantizePosition(Quantization, Packed);
+        vec2 TextureCoord = DequantizeTextureCoord(Quantization, Packed);
+        
+        PositionError = fmaxf(PositionError, fmaxf(fabsf(Position.X - Vertex->Position.X), fmaxf(fabsf(Position.Y - Vertex->Position.Y), fabsf(Position.Z - Vertex->Position.Z))));
+        TextureError = fmaxf(TextureError, fmaxf(fabsf(TextureCoord.X - Vertex->TextureCoord.X), fabsf(TextureCoord.Y - Vertex->TextureCoord.Y)));
+    }
+    
+    real32 PositionBound = 0.5f * fmaxf(Quantization->PositionScale.X, fmaxf(Quantization->PositionScale.Y, Quantization->PositionScale.Z));
+    real32 TextureBound = 0.5f * fmaxf(Quantization->TextureScale.X, Quantization->TextureScale.Y);
+    
+    //Float rounding in the dequantization can add a tiny bit on top of half a step
+    Assert(PositionError <= (1.01f * PositionBound) + 1.0e-6f);
+    Assert(TextureError <= (1.01f * TextureBound) + 1.0e-6f);
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Quantized %llu vertices: %llu -> %llu bytes, position error %g (bound %g), UV error %g (bound %g)\n",
+              Mesh->VertexCount, Mesh->VertexCount * (uint64)sizeof(vertex), Mesh->VertexCount * (uint64)sizeof(packed_vertex),
+              PositionError, PositionBound, TextureError, TextureBound);
+    OutputDebugStringA(OutputBuffer);
+}
+
+//Quantizes the shared vertices once for every level and frees the float vertices, which are only needed to build the chain
+static void
+QuantizeMeshLod(mesh_lod *Lod)
+{
+    mesh *Source = &Lod->Levels[0];
+    QuantizeMesh(Source);
+    
+    VirtualFree(Source->Vertices, 0, MEM_RELEASE);
+    Source->Vertices = 0;
+    
+    for(uint32 LevelIndex = 1; LevelIndex < Lod->LevelCount; ++LevelIndex)
+    {
+        mesh *Level = &Lod->Levels[LevelIndex];
+        Level->Vertices = 0;
+        Level->PackedVertices = Source->PackedVertices;
+        Level->Quantization = Source->Quantization;
+    }
+}
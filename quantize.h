@@ -0,0 +1,12 @@
+/* date = October 19th 2026 6:25 pm */
+
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+//Largest value of a 16 bit quantized component
+#define QUANTIZE_MAX 65535.0f
+
+//Largest value of an 8 bit quantized normal component
+#define QUANTIZE_NORMAL_MAX 127.0f
+
+#endif //QUANTIZE_H
@@ -0,0 +1,128 @@
+#include "raster_kernel.h"
+
+/*
+The per pixel work of the scanline and the small triangle loops:
+- Both loops walk the covered pixels the same way for every kernel and hand each one to DrawKernelPixel.
+- The kernel stays the same for a whole flush, so the switch in DrawKernelPixel always goes the same way.
+- The pre-pass depth and color kernels step 1/z through the same loop, so a visible fragment matches the depth it wrote exactly.
+*/
+
+static raster_kernel
+GetRasterKernel(win32_pixel_buffer *Buffer, blend_mode BlendMode, raster_pass Pass)
+{
+    raster_kernel Result = RasterKernel_Forward;
+    
+    //Only one of the visibility, span and G-buffers is set up at a time, and DrawMeshInstances uses a pre-pass only without them
+    if(Buffer->Visibility.Ids && (BlendMode == Blend_Opaque))
+    {
+        Result = RasterKernel_Visibility;
+    }
+    else if(Pass == RasterPass_Depth)
+    {
+        Result = RasterKernel_Depth;
+    }
+    else if(BlendMode == Blend_Opaque)
+    {
+        if(Buffer->SpanBuffer.Spans)
+        {
+            Result = RasterKernel_SpanBuffer;
+        }
+        else if(Buffer->GBuffer.Albedo)
+        {
+            Result = RasterKernel_GBuffer;
+        }
+        else if(Pass == RasterPass_Color)
+        {
+            Result = RasterKernel_EqualDepth;
+        }
+    }
+    
+    return Result;
+}
+
+/*
+Depth test and write of one covered pixel, for every kernel but RasterKernel_SpanBuffer. U/z and v/z are only read by the kernels
+that texture, PackedNormal only by RasterKernel_GBuffer. Returns whether the fragment passed the depth test.
+*/
+inline bool32
+DrawKernelPixel(win32_pixel_buffer *Buffer, texture *Texture, raster_kernel Kernel, blend_mode BlendMode, uint32 PixelIndex, int32 X, int32 Y,
+                real32 OneOverZ, real32 UOverZ, real32 VOverZ, uint32 Color, vec3 Normal, uint32 PackedNormal)
+{
+    real32 *Depth = Buffer->Depth;
+    
+    //Hidden pixels skip the divide and the texture fetch
+    bool32 IsVisible = (Kernel == RasterKernel_EqualDepth) ? (OneOverZ == Depth[PixelIndex]) : (OneOverZ > Depth[PixelIndex]);
+    if(!IsVisible)
+    {
+        return false;
+    }
+    
+    switch(Kernel)
+    {
+        case RasterKernel_Visibility:
+        {
+            Depth[PixelIndex] = OneOverZ;
+            Buffer->Visibility.Ids[PixelIndex] = Color;
+        }break;
+        
+        case RasterKernel_Depth:
+        {
+            Depth[PixelIndex] = OneOverZ;
+        }break;
+        
+        case RasterKernel_GBuffer:
+        {
+            real32 Z = 1.0f / OneOverZ;
+            Depth[PixelIndex] = OneOverZ;
+            Buffer->GBuffer.Albedo[PixelIndex] = ModulateColor(SampleTexture(Texture, UOverZ * Z, VOverZ * Z), Color);
+            Buffer->GBuffer.Normals[PixelIndex] = PackedNormal;
+        }break;
+        
+        default:
+        {
+            uint32 *Pixels = (uint32 *)Buffer->Memory;
+            
+            real32 Z = 1.0f / OneOverZ;
+            uint32 Shaded = ModulateColor(SampleTexture(Texture, UOverZ * Z, VOverZ * Z), Color);
+            if(Buffer->Lighting.LightCount > 0)
+            {
+                Shaded = LightTexel(&Buffer->Lighting, Shaded, X, Y, Z, Normal);
+            }
+            
+            //The pre-pass wrote the depth already, translucent pixels are depth tested but leave the depth of what is behind them
+            if(Kernel == RasterKernel_EqualDepth)
+            {
+                Pixels[PixelIndex] = Shaded;
+            }
+            else if(BlendMode == Blend_Opaque)
+            {
+                Depth[PixelIndex] = OneOverZ;
+                Pixels[PixelIndex] = Shaded;
+            }
+            else if(BlendMode == Blend_Transparent)
+            {
+                AccumulateTransparency(&Buffer->Transparency, PixelIndex, Shaded, Z);
+            }
+            else
+            {
+                Pixels[PixelIndex] = BlendPixel(Pixels[PixelIndex], Shaded, BlendMode);
+            }
+        }break;
+    }
+    
+    return true;
+}
+
+//Adds the fragments that passed to the counts of the pre-pass, the overdraw is measured from them
+inline void
+CountKernelFragments(win32_pixel_buffer *Buffer, raster_kernel Kernel, uint32 FragmentCount)
+{
+    if(Kernel == RasterKernel_Depth)
+    {
+        Buffer->DepthPrePass.DepthFragmentCount += FragmentCount;
+    }
+    else if(Kernel == RasterKernel_EqualDepth)
+    {
+        Buffer->DepthPrePass.ShadedFragmentCount += FragmentCount;
+    }
+}
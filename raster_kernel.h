@@ -0,0 +1,28 @@
+/* date = October 19th 2026 11:59 pm */
+
+#ifndef RASTER_KERNEL_H
+#define RASTER_KERNEL_H
+
+//What a covered pixel of a triangle_batch does, picked once per flush from the buffer, the blend mode and the raster_pass
+typedef enum
+{
+    //Depth test, shade and write, or blend for blended triangles
+    RasterKernel_Forward,
+    
+    //Opaque triangles of a visibility buffer, depth and the triangle index are written
+    RasterKernel_Visibility,
+    
+    //RasterPass_Depth, only depth is written
+    RasterKernel_Depth,
+    
+    //RasterPass_Color for opaque triangles, only the fragment whose 1/z equals the depth is shaded and depth is left as it is
+    RasterKernel_EqualDepth,
+    
+    //Opaque triangles of deferred shading, the unlit texel and the normal go into the G-buffer
+    RasterKernel_GBuffer,
+    
+    //Opaque triangles of a span buffer, drawn a span at a time instead of a pixel at a time
+    RasterKernel_SpanBuffer,
+}raster_kernel;
+
+#endif //RASTER_KERNEL_H
@@ -34,4 +34,20 @@ inline int32 RoundReal32ToInt32(real32 Value)
     int32 Result = (int32)roundf(Value);
     
     return Result;
-}
\ No newline at end of file
+}
+
+inline int32 ClampInt32(int32 Value, int32 Min, int32 Max)
+{
+    int32 Result = Value;
+    
+    if(Result < Min)
+    {
+        Result = Min;
+    }
+    else if(Result > Max)
+    {
+        Result = Max;
+    }
+    
+    return Result;
+}
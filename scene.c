@@ -0,0 +1,361 @@
+#include "scene.h"
+
+static void
+InitializeScene(scene *Scene, uint32 MaxObjectCount)
+{
+    Scene->ObjectCount = 0;
+    Scene->MaxObjectCount = MaxObjectCount;
+    Scene->NodeCount = 0;
+    Scene->OccluderCount = 0;
+    
+    Scene->Objects = (render_object *)VirtualAlloc(0, MaxObjectCount * sizeof(render_object), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    //Halving down to leaves leaves fewer than 2 * MaxObjectCount nodes
+    Scene->Nodes = (bvh_node *)VirtualAlloc(0, 2 * MaxObjectCount * sizeof(bvh_node), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    Scene->ObjectOrder = (uint32 *)VirtualAlloc(0, 3 * MaxObjectCount * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Scene->ObjectLeaves = Scene->ObjectOrder + MaxObjectCount;
+    Scene->Occluders = Scene->ObjectLeaves + MaxObjectCount;
+}
+
+static void
+ReleaseScene(scene *Scene)
+{
+    VirtualFree(Scene->Objects, 0, MEM_RELEASE);
+    VirtualFree(Scene->Nodes, 0, MEM_RELEASE);
+    VirtualFree(Scene->ObjectOrder, 0, MEM_RELEASE);
+}
+
+//The BVH has to be rebuilt before the new object shows up in queries
+static uint32
+AddSceneObject(scene *Scene, mesh_lod *Lod, vec3 Position, bool32 IsOccluder)
+{
+    Assert(Scene->ObjectCount < Scene->MaxObjectCount);
+    
+    uint32 ObjectIndex = Scene->ObjectCount++;
+    
+    render_object *Object = &Scene->Objects[ObjectIndex];
+    Object->Lod = Lod;
+    Object->Position = Position;
+    Object->IsOccluder = IsOccluder;
+    
+    if(IsOccluder)
+    {
+        Scene->Occluders[Scene->OccluderCount++] = ObjectIndex;
+    }
+    
+    return ObjectIndex;
+}
+
+inline void GetObjectBounds(render_object *Object, vec3 *Min, vec3 *Max)
+{
+    mesh *Source = &Object->Lod->Levels[0];
+    vec3 Center = AddVec3(Source->BoundsCenter, Object->Position);
+    real32 Radius = Source->BoundsRadius;
+    
+    *Min = (vec3){Center.X - Radius, Center.Y - Radius, Center.Z - Radius};
+    *Max = (vec3){Center.X + Radius, Center.Y + Radius, Center.Z + Radius};
+}
+
+static void
+ComputeNodeBounds(scene *Scene, bvh_node *Node)
+{
+    vec3 Min;
+    vec3 Max;
+    
+    if(Node->Count)
+    {
+        GetObjectBounds(&Scene->Objects[Scene->ObjectOrder[Node->First]], &Min, &Max);
+        
+        for(uint32 Index = 1; Index < Node->Count; ++Index)
+        {
+            vec3 ObjectMin;
+            vec3 ObjectMax;
+            GetObjectBounds(&Scene->Objects[Scene->ObjectOrder[Node->First + Index]], &ObjectMin, &ObjectMax);
+            
+            Min = (vec3){fminf(Min.X, ObjectMin.X), fminf(Min.Y, ObjectMin.Y), fminf(Min.Z, ObjectMin.Z)};
+            Max = (vec3){fmaxf(Max.X, ObjectMax.X), fmaxf(Max.Y, ObjectMax.Y), fmaxf(Max.Z, ObjectMax.Z)};
+        }
+    }
+    else
+    {
+        bvh_node *Left = &Scene->Nodes[Node->First];
+        bvh_node *Right = &Scene->Nodes[Node->First + 1];
+        
+        Min = (vec3){fminf(Left->Min.X, Right->Min.X), fminf(Left->Min.Y, Right->Min.Y), fminf(Left->Min.Z, Right->Min.Z)};
+        Max = (vec3){fmaxf(Left->Max.X, Right->Max.X), fmaxf(Left->Max.Y, Right->Max.Y), fmaxf(Left->Max.Z, Right->Max.Z)};
+    }
+    
+    Node->Min = Min;
+    Node->Max = Max;
+}
+
+/*
+The BVH is built at load and whenever objects are added:
+- Objects are sorted along a Morton curve through their centers, with the same radix sort as the meshlets.
+- Ranges of sorted objects are split in halves until they fit in a leaf, so the tree stays balanced.
+- Nodes are created breadth first, children after their parents, so walking the nodes backwards computes the bounds bottom up.
+*/
+static void
+BuildSceneBvh(scene *Scene)
+{
+    Scene->NodeCount = 0;
+    
+    uint32 Count = Scene->ObjectCount;
+    if(!Count)
+    {
+        return;
+    }
+    
+    vec3 Min = AddVec3(Scene->Objects[0].Lod->Levels[0].BoundsCenter, Scene->Objects[0].Position);
+    vec3 Max = Min;
+    for(uint32 ObjectIndex = 1; ObjectIndex < Count; ++ObjectIndex)
+    {
+        render_object *Object = &Scene->Objects[ObjectIndex];
+        vec3 Center = AddVec3(Object->Lod->Levels[0].BoundsCenter, Object->Position);
+        Min = (vec3){fminf(Min.X, Center.X), fminf(Min.Y, Center.Y), fminf(Min.Z, Center.Z)};
+        Max = (vec3){fmaxf(Max.X, Center.X), fmaxf(Max.Y, Center.Y), fmaxf(Max.Z, Center.Z)};
+    }
+    
+    vec3 Extent = SubtractVec3(Max, Min);
+    vec3 Scale;
+    Scale.X = (Extent.X > 0.0f) ? (1023.0f / Extent.X) : 0.0f;
+    Scale.Y = (Extent.Y > 0.0f) ? (1023.0f / Extent.Y) : 0.0f;
+    Scale.Z = (Extent.Z > 0.0f) ? (1023.0f / Extent.Z) : 0.0f;
+    
+    uint32 *SortMemory = (uint32 *)VirtualAlloc(0, 3 * Count * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    uint32 *Keys = SortMemory;
+    uint32 *TempKeys = Keys + Count;
+    uint32 *TempValues = TempKeys + Count;
+    
+    for(uint32 ObjectIndex = 0; ObjectIndex < Count; ++ObjectIndex)
+    {
+        render_object *Object = &Scene->Objects[ObjectIndex];
+        vec3 Center = AddVec3(Object->Lod->Levels[0].BoundsCenter, Object->Position);
+        
+        uint32 X = (uint32)((Center.X - Min.X) * Scale.X);
+        uint32 Y = (uint32)((Center.Y - Min.Y) * Scale.Y);
+        uint32 Z = (uint32)((Center.Z - Min.Z) * Scale.Z);
+        
+        Keys[ObjectIndex] = SpreadBits10(X) | (SpreadBits10(Y) << 1) | (SpreadBits10(Z) << 2);
+        Scene->ObjectOrder[ObjectIndex] = ObjectIndex;
+    }
+    
+    RadixSortByKey(Keys, Scene->ObjectOrder, TempKeys, TempValues, Count);
+    
+    VirtualFree(SortMemory, 0, MEM_RELEASE);
+    
+    //Until a node is reached by the loop, First and Count are the range of sorted objects under it
+    bvh_node *Root = &Scene->Nodes[0];
+    Root->First = 0;
+    Root->Count = Count;
+    Root->Parent = 0;
+    Scene->NodeCount = 1;
+    
+    for(uint32 NodeIndex = 0; NodeIndex < Scene->NodeCount; ++NodeIndex)
+    {
+        bvh_node *Node = &Scene->Nodes[NodeIndex];
+        
+        if(Node->Count > SCENE_LEAF_SIZE)
+        {
+            uint32 Half = Node->Count / 2;
+            
+            bvh_node *Left = &Scene->Nodes[Scene->NodeCount];
+            bvh_node *Right = Left + 1;
+            
+            Left->First = Node->First;
+            Left->Count = Half;
+            Left->Parent = NodeIndex;
+            
+            Right->First = Node->First + Half;
+            Right->Count = Node->Count - Half;
+            Right->Parent = NodeIndex;
+            
+            Node->First = Scene->NodeCount;
+            Node->Count = 0;
+            Scene->NodeCount += 2;
+        }
+        else
+        {
+            for(uint32 Index = 0; Index < Node->Count; ++Index)
+            {
+                Scene->ObjectLeaves[Scene->ObjectOrder[Node->First + Index]] = NodeIndex;
+            }
+        }
+    }
+    
+    for(uint32 NodeIndex = Scene->NodeCount; NodeIndex > 0; --NodeIndex)
+    {
+        ComputeNodeBounds(Scene, &Scene->Nodes[NodeIndex - 1]);
+    }
+}
+
+/*
+Refits the leaf of the object and then its ancestors, stopping at the first node whose bounds do not change.
+The tree itself is kept, so objects that move far from where they were built make the queries slower, not wrong.
+*/
+static void
+MoveSceneObject(scene *Scene, uint32 ObjectIndex, vec3 Position)
+{
+    Scene->Objects[ObjectIndex].Position = Position;
+    
+    uint32 NodeIndex = Scene->ObjectLeaves[ObjectIndex];
+    for(;;)
+    {
+        bvh_node *Node = &Scene->Nodes[NodeIndex];
+        vec3 OldMin = Node->Min;
+        vec3 OldMax = Node->Max;
+        
+        ComputeNodeBounds(Scene, Node);
+        
+        bool32 Unchanged = ((OldMin.X == Node->Min.X) && (OldMin.Y == Node->Min.Y) && (OldMin.Z == Node->Min.Z) &&
+                            (OldMax.X == Node->Max.X) && (OldMax.Y == Node->Max.Y) && (OldMax.Z == Node->Max.Z));
+        
+        if(Unchanged || (NodeIndex == 0))
+        {
+            break;
+        }
+        
+        NodeIndex = Node->Parent;
+    }
+}
+
+/*
+Tests a box, relative to the camera, against the frustum planes in PlaneMask.
+Planes the box is completely inside of are taken out of PlaneMask, so the children of the box skip them.
+*/
+static bool32
+IsBoxInFrustum(frustum *Frustum, vec3 Min, vec3 Max, uint32 *PlaneMask)
+{
+    for(uint32 PlaneIndex = 0; PlaneIndex < ArrayCount(Frustum->Normals); ++PlaneIndex)
+    {
+        if(!(*PlaneMask & (1 << PlaneIndex)))
+        {
+            continue;
+        }
+        
+        vec3 Normal = Frustum->Normals[PlaneIndex];
+        real32 Distance = Frustum->Distances[PlaneIndex];
+        
+        //Corners farthest along and farthest against the plane normal
+        vec3 Inner = {(Normal.X > 0.0f) ? Max.X : Min.X, (Normal.Y > 0.0f) ? Max.Y : Min.Y, (Normal.Z > 0.0f) ? Max.Z : Min.Z};
+        vec3 Outer = {(Normal.X > 0.0f) ? Min.X : Max.X, (Normal.Y > 0.0f) ? Min.Y : Max.Y, (Normal.Z > 0.0f) ? Min.Z : Max.Z};
+        
+        if((DotVec3(Normal, Inner) + Distance) < 0.0f)
+        {
+            return false;
+        }
+        
+        if((DotVec3(Normal, Outer) + Distance) >= 0.0f)
+        {
+            *PlaneMask &= ~(1 << PlaneIndex);
+        }
+    }
+    
+    return true;
+}
+
+/*
+Writes the visible objects to Visible, nearest first, and returns how many there are.
+- Subtrees outside the frustum are skipped, subtrees completely inside it stop testing planes.
+- With an occlusion buffer, subtrees behind the occluders are skipped too.
+- The nearer child of every node is visited first, so objects come out roughly front to back.
+*/
+static uint32
+QueryScene(scene *Scene, view *View, frustum *Frustum, occlusion_buffer *Occlusion, uint32 *Visible, uint32 *NodesVisited)
+{
+    uint32 VisibleCount = 0;
+    *NodesVisited = 0;
+    
+    if(!Scene->NodeCount)
+    {
+        return 0;
+    }
+    
+    uint32 StackNodes[SCENE_STACK_SIZE];
+    uint32 StackMasks[SCENE_STACK_SIZE];
+    uint32 StackCount = 0;
+    
+    StackNodes[StackCount] = 0;
+    StackMasks[StackCount] = (1 << ArrayCount(Frustum->Normals)) - 1;
+    ++StackCount;
+    
+    vec3 CameraPos = View->CameraPos;
+    
+    while(StackCount)
+    {
+        --StackCount;
+        bvh_node *Node = &Scene->Nodes[StackNodes[StackCount]];
+        uint32 PlaneMask = StackMasks[StackCount];
+        
+        ++*NodesVisited;
+        
+        if(PlaneMask && !IsBoxInFrustum(Frustum, SubtractVec3(Node->Min, CameraPos), SubtractVec3(Node->Max, CameraPos), &PlaneMask))
+        {
+            continue;
+        }
+        
+        if(Occlusion && IsBoxOccluded(Occlusion, View, Node->Min, Node->Max))
+        {
+            continue;
+        }
+        
+        if(Node->Count)
+        {
+            for(uint32 Index = 0; Index < Node->Count; ++Index)
+            {
+                uint32 ObjectIndex = Scene->ObjectOrder[Node->First + Index];
+                
+                vec3 Min;
+                vec3 Max;
+                GetObjectBounds(&Scene->Objects[ObjectIndex], &Min, &Max);
+                
+                uint32 ObjectMask = PlaneMask;
+                if(ObjectMask && !IsBoxInFrustum(Frustum, SubtractVec3(Min, CameraPos), SubtractVec3(Max, CameraPos), &ObjectMask))
+                {
+                    continue;
+                }
+                
+                if(Occlusion && (Node->Count > 1) && IsBoxOccluded(Occlusion, View, Min, Max))
+                {
+                    continue;
+                }
+                
+                Visible[VisibleCount++] = ObjectIndex;
+            }
+        }
+        else
+        {
+            Assert((StackCount + 2) <= SCENE_STACK_SIZE);
+            
+            uint32 Near = Node->First;
+            uint32 Far = Node->First + 1;
+            
+            bvh_node *Left = &Scene->Nodes[Near];
+            bvh_node *Right = &Scene->Nodes[Far];
+            
+            vec3 LeftCenter = {(Left->Min.X + Left->Max.X) * 0.5f, (Left->Min.Y + Left->Max.Y) * 0.5f, (Left->Min.Z + Left->Max.Z) * 0.5f};
+            vec3 RightCenter = {(Right->Min.X + Right->Max.X) * 0.5f, (Right->Min.Y + Right->Max.Y) * 0.5f, (Right->Min.Z + Right->Max.Z) * 0.5f};
+            
+            vec3 ToLeft = SubtractVec3(LeftCenter, CameraPos);
+            vec3 ToRight = SubtractVec3(RightCenter, CameraPos);
+            
+            if(DotVec3(ToRight, ToRight) < DotVec3(ToLeft, ToLeft))
+            {
+                Near = Node->First + 1;
+                Far = Node->First;
+            }
+            
+            //The near child is pushed last so it is popped first
+            StackNodes[StackCount] = Far;
+            StackMasks[StackCount] = PlaneMask;
+            ++StackCount;
+            
+            StackNodes[StackCount] = Near;
+            StackMasks[StackCount] = PlaneMask;
+            ++StackCount;
+        }
+    }
+    
+    return VisibleCount;
+}
@@ -0,0 +1,55 @@
+/* date = October 19th 2026 4:05 pm */
+
+#ifndef SCENE_H
+#define SCENE_H
+
+//Most objects a BVH leaf holds
+#define SCENE_LEAF_SIZE 4
+
+//Traversal stack, the tree is split in halves so it is never deeper than 32 levels
+#define SCENE_STACK_SIZE 64
+
+//Node of the scene BVH, children are always stored after their parent
+typedef struct
+{
+    vec3 Min;
+    vec3 Max;
+    
+    //Inner nodes have Count == 0 and their children at Nodes[First] and Nodes[First + 1].
+    //Leaves hold the objects ObjectOrder[First] up to ObjectOrder[First + Count].
+    uint32 First;
+    uint32 Count;
+    uint32 Parent;
+}bvh_node;
+
+typedef struct
+{
+    render_object *Objects;
+    uint32 ObjectCount;
+    uint32 MaxObjectCount;
+    
+    //Object indices in leaf order, and the leaf node every object is in
+    uint32 *ObjectOrder;
+    uint32 *ObjectLeaves;
+    
+    bvh_node *Nodes;
+    uint32 NodeCount;
+    
+    uint32 *Occluders;
+    uint32 OccluderCount;
+}scene;
+
+//Frames between two prints of the scene stats, printing to the debugger every frame would slow the frame down
+#define SCENE_STATS_PRINT_INTERVAL 120
+
+typedef struct
+{
+    uint32 ObjectCount;
+    uint32 VisibleCount;
+    uint32 NodesVisited;
+    
+    real32 OccluderSeconds;
+    real32 QuerySeconds;
+}scene_stats;
+
+#endif //SCENE_H
@@ -0,0 +1,444 @@
+#include "simplify.h"
+
+inline uint32 GetCornerVertex(triangle *Triangle, uint32 Corner)
+{
+    uint32 Result = (Corner == 0) ? Triangle->A : ((Corner == 1) ? Triangle->B : Triangle->C);
+    
+    return Result;
+}
+
+//Returns 3 when the vertex is not a corner of the triangle
+inline uint32 FindCorner(triangle *Triangle, uint32 Vertex)
+{
+    uint32 Result = (Triangle->A == Vertex) ? 0 : ((Triangle->B == Vertex) ? 1 : ((Triangle->C == Vertex) ? 2 : 3));
+    
+    return Result;
+}
+
+inline void SetCorner(triangle *Triangle, uint32 Corner, uint32 Vertex)
+{
+    if(Corner == 0)
+    {
+        Triangle->A = Vertex;
+    }
+    else if(Corner == 1)
+    {
+        Triangle->B = Vertex;
+    }
+    else
+    {
+        Triangle->C = Vertex;
+    }
+}
+
+static void
+AddPlaneQuadric(quadric *Quadric, vec3 Normal, real32 Distance, real32 Weight)
+{
+    real32 A = Normal.X;
+    real32 B = Normal.Y;
+    real32 C = Normal.Z;
+    real32 D = Distance;
+    
+    Quadric->Q[0] += Weight * A * A;
+    Quadric->Q[1] += Weight * A * B;
+    Quadric->Q[2] += Weight * A * C;
+    Quadric->Q[3] += Weight * A * D;
+    Quadric->Q[4] += Weight * B * B;
+    Quadric->Q[5] += Weight * B * C;
+    Quadric->Q[6] += Weight * B * D;
+    Quadric->Q[7] += Weight * C * C;
+    Quadric->Q[8] += Weight * C * D;
+    Quadric->Q[9] += Weight * D * D;
+}
+
+//Weighted sum of the squared distances from P to the planes in the quadric
+inline real32 EvaluateQuadric(quadric *Quadric, vec3 P)
+{
+    real32 *Q = Quadric->Q;
+    
+    real32 Result = (Q[0] * P.X * P.X) + (2.0f * Q[1] * P.X * P.Y) + (2.0f * Q[2] * P.X * P.Z) + (2.0f * Q[3] * P.X) +
+        (Q[4] * P.Y * P.Y) + (2.0f * Q[5] * P.Y * P.Z) + (2.0f * Q[6] * P.Y) +
+        (Q[7] * P.Z * P.Z) + (2.0f * Q[8] * P.Z) + Q[9];
+    
+    return fmaxf(Result, 0.0f);
+}
+
+static void
+BuildVertexAdjacency(vertex_adjacency *Adjacency, triangle *Triangles, uint32 TriangleCount, uint32 VertexCount)
+{
+    for(uint32 VertexIndex = 0; VertexIndex <= VertexCount; ++VertexIndex)
+    {
+        Adjacency->Offsets[VertexIndex] = 0;
+    }
+    
+    for(uint32 TriangleIndex = 0; TriangleIndex < TriangleCount; ++TriangleIndex)
+    {
+        ++Adjacency->Offsets[Triangles[TriangleIndex].A];
+        ++Adjacency->Offsets[Triangles[TriangleIndex].B];
+        ++Adjacency->Offsets[Triangles[TriangleIndex].C];
+    }
+    
+    //Offsets[Vertex] ends up as the end of the list of Vertex, which is the start of the next one
+    uint32 Total = 0;
+    for(uint32 VertexIndex = 0; VertexIndex <= VertexCount; ++VertexIndex)
+    {
+        uint32 Count = Adjacency->Offsets[VertexIndex];
+        Adjacency->Offsets[VertexIndex] = Total;
+        Total += Count;
+    }
+    
+    for(uint32 TriangleIndex = 0; TriangleIndex < TriangleCount; ++TriangleIndex)
+    {
+        triangle *Triangle = &Triangles[TriangleIndex];
+        Adjacency->Triangles[Adjacency->Offsets[Triangle->A]++] = TriangleIndex;
+        Adjacency->Triangles[Adjacency->Offsets[Triangle->B]++] = TriangleIndex;
+        Adjacency->Triangles[Adjacency->Offsets[Triangle->C]++] = TriangleIndex;
+    }
+}
+
+/*
+Border vertices, with an edge that only one triangle uses, are never removed.
+Welding splits UV seams and hard normal edges into separate vertices, so those show up as borders too.
+*/
+static bool32
+IsVertexLocked(mesh *Mesh, vertex_adjacency *Adjacency, uint32 Vertex)
+{
+    uint32 First = Adjacency->Offsets[Vertex - 1];
+    uint32 OnePastLast = Adjacency->Offsets[Vertex];
+    
+    for(uint32 Index = First; Index < OnePastLast; ++Index)
+    {
+        triangle *Triangle = &Mesh->Triangles[Adjacency->Triangles[Index]];
+        uint32 Corner = FindCorner(Triangle, Vertex);
+        
+        //Every edge leaving the vertex has to come back in through another triangle
+        uint32 Next = GetCornerVertex(Triangle, (Corner + 1) % 3);
+        bool32 HasTwin = false;
+        
+        for(uint32 OtherIndex = First; OtherIndex < OnePastLast; ++OtherIndex)
+        {
+            triangle *Other = &Mesh->Triangles[Adjacency->Triangles[OtherIndex]];
+            if(GetCornerVertex(Other, (FindCorner(Other, Vertex) + 2) % 3) == Next)
+            {
+                HasTwin = true;
+                break;
+            }
+        }
+        
+        if(!HasTwin)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+/*
+A collapse of Vertex into Target is rejected when:
+- Vertex and Target share neighbours other than the ones across their edge, which would fold the surface onto itself.
+- A remaining triangle around Vertex turns more than about 75 degrees.
+Marks holds a stamp per vertex, Stamp and Stamp + 1 are used by this call.
+*/
+static bool32
+IsCollapseValid(mesh *Mesh, vertex_adjacency *Adjacency, uint32 Vertex, uint32 Target, uint32 *Marks, uint32 Stamp)
+{
+    for(uint32 Index = Adjacency->Offsets[Target - 1]; Index < Adjacency->Offsets[Target]; ++Index)
+    {
+        triangle *Triangle = &Mesh->Triangles[Adjacency->Triangles[Index]];
+        Marks[Triangle->A - 1] = Stamp;
+        Marks[Triangle->B - 1] = Stamp;
+        Marks[Triangle->C - 1] = Stamp;
+    }
+    
+    uint32 EdgeTriangleCount = 0;
+    uint32 SharedCount = 0;
+    
+    vec3 TargetPosition = Mesh->Vertices[Target - 1].Position;
+    
+    for(uint32 Index = Adjacency->Offsets[Vertex - 1]; Index < Adjacency->Offsets[Vertex]; ++Index)
+    {
+        triangle *Triangle = &Mesh->Triangles[Adjacency->Triangles[Index]];
+        if(FindCorner(Triangle, Target) < 3)
+        {
+            ++EdgeTriangleCount;
+            continue;
+        }
+        
+        uint32 Corner = FindCorner(Triangle, Vertex);
+        for(uint32 Offset = 1; Offset < 3; ++Offset)
+        {
+            uint32 Other = GetCornerVertex(Triangle, (Corner + Offset) % 3);
+            if(Marks[Other - 1] == Stamp)
+            {
+                Marks[Other - 1] = Stamp + 1;
+                ++SharedCount;
+            }
+        }
+        
+        vec3 Before = GetTriangleNormal(Mesh, Triangle);
+        
+        vec3 Positions[3] = {Mesh->Vertices[Triangle->A - 1].Position, Mesh->Vertices[Triangle->B - 1].Position, Mesh->Vertices[Triangle->C - 1].Position};
+        Positions[Corner] = TargetPosition;
+        
+        vec3 After = CrossVec3(SubtractVec3(Positions[1], Positions[0]), SubtractVec3(Positions[2], Positions[0]));
+        real32 AfterLength = GetMagnitudeVec3(After);
+        
+        if((AfterLength == 0.0f) || (DotVec3(Before, After) < 0.25f * AfterLength))
+        {
+            return false;
+        }
+    }
+    
+    //Neighbours across the edge are seen through the triangles that do not hold the edge, once each
+    bool32 Result = (SharedCount == EdgeTriangleCount);
+    
+    return Result;
+}
+
+/*
+Quadric error edge collapse, after Garland and Heckbert.
+- Vertices keep their positions, a removed vertex is moved onto one of its neighbours, so Result shares Source's vertices and only gets new triangles.
+- Collapses run in passes, every pass sorts the cheapest collapse of each vertex by error and applies the ones whose neighbourhood has not been touched yet.
+- Border vertices are locked, so UV seams and open edges keep their exact shape.
+*/
+static void
+SimplifyMesh(mesh *Source, mesh *Result, uint32 TargetTriangleCount)
+{
+    *Result = *Source;
+    Result->Meshlets = 0;
+    Result->MeshletCount = 0;
+    Result->Triangles = (triangle *)VirtualAlloc(0, Source->TriangleCount * sizeof(triangle), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    for(uint64 TriangleIndex = 0; TriangleIndex < Source->TriangleCount; ++TriangleIndex)
+    {
+        Result->Triangles[TriangleIndex] = Source->Triangles[TriangleIndex];
+    }
+    
+    //Adjacency and candidates are indexed with 32 bits, levels of streaming chunks stay far below that
+    Assert((3 * Source->TriangleCount) <= 0xFFFFFFFF);
+    uint32 VertexCount = (uint32)Source->VertexCount;
+    
+    quadric *Quadrics = (quadric *)VirtualAlloc(0, VertexCount * sizeof(quadric), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    uint32 *WorkMemory = (uint32 *)VirtualAlloc(0, ((8 * VertexCount) + 1 + (3 * Source->TriangleCount)) * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    vertex_adjacency Adjacency;
+    Adjacency.Offsets = WorkMemory;
+    Adjacency.Triangles = Adjacency.Offsets + VertexCount + 1;
+    
+    uint32 *Targets = Adjacency.Triangles + (3 * Source->TriangleCount);
+    uint32 *Marks = Targets + VertexCount;
+    uint32 *Keys = Marks + VertexCount;
+    uint32 *Values = Keys + VertexCount;
+    uint32 *TempKeys = Values + VertexCount;
+    uint32 *TempValues = TempKeys + VertexCount;
+    
+    bool32 *Touched = (bool32 *)(TempValues + VertexCount);
+    
+    for(uint64 TriangleIndex = 0; TriangleIndex < Result->TriangleCount; ++TriangleIndex)
+    {
+        triangle *Triangle = &Result->Triangles[TriangleIndex];
+        
+        vec3 Point = Result->Vertices[Triangle->A - 1].Position;
+        vec3 Normal = CrossVec3(SubtractVec3(Result->Vertices[Triangle->B - 1].Position, Point), SubtractVec3(Result->Vertices[Triangle->C - 1].Position, Point));
+        real32 Length = GetMagnitudeVec3(Normal);
+        
+        if(Length > 0.0f)
+        {
+            //Area weighted, so big flat triangles resist collapses that slivers do not
+            Normal = NormalizeVec3(Normal);
+            real32 Distance = -DotVec3(Normal, Point);
+            
+            AddPlaneQuadric(&Quadrics[Triangle->A - 1], Normal, Distance, 0.5f * Length);
+            AddPlaneQuadric(&Quadrics[Triangle->B - 1], Normal, Distance, 0.5f * Length);
+            AddPlaneQuadric(&Quadrics[Triangle->C - 1], Normal, Distance, 0.5f * Length);
+        }
+    }
+    
+    //Marks only ever compares against fresh stamps, so it never needs clearing
+    uint32 Stamp = 1;
+    
+    while(Result->TriangleCount > TargetTriangleCount)
+    {
+        BuildVertexAdjacency(&Adjacency, Result->Triangles, (uint32)Result->TriangleCount, VertexCount);
+        
+        uint32 CandidateCount = 0;
+        
+        for(uint32 Vertex = 1; Vertex <= VertexCount; ++Vertex)
+        {
+            if((Adjacency.Offsets[Vertex - 1] == Adjacency.Offsets[Vertex]) || IsVertexLocked(Result, &Adjacency, Vertex))
+            {
+                continue;
+            }
+            
+            real32 BestError = 0.0f;
+            uint32 BestTarget = 0;
+            
+            for(uint32 Index = Adjacency.Offsets[Vertex - 1]; Index < Adjacency.Offsets[Vertex]; ++Index)
+            {
+                triangle *Triangle = &Result->Triangles[Adjacency.Triangles[Index]];
+                uint32 Target = GetCornerVertex(Triangle, (FindCorner(Triangle, Vertex) + 1) % 3);
+                
+                real32 Error = EvaluateQuadric(&Quadrics[Vertex - 1], Result->Vertices[Target - 1].Position);
+                if(!BestTarget || (Error < BestError))
+                {
+                    BestError = Error;
+                    BestTarget = Target;
+                }
+            }
+            
+            //The bits of a positive real32 sort in the same order as its value
+            Targets[Vertex - 1] = BestTarget;
+            Keys[CandidateCount] = GetRealSortKey(BestError);
+            Values[CandidateCount] = Vertex;
+            ++CandidateCount;
+        }
+        
+        RadixSortByKey(Keys, Values, TempKeys, TempValues, CandidateCount);
+        
+        for(uint32 Vertex = 1; Vertex <= VertexCount; ++Vertex)
+        {
+            Touched[Vertex - 1] = false;
+        }
+        
+        uint32 CollapseCount = 0;
+        
+        for(uint32 CandidateIndex = 0; (CandidateIndex < CandidateCount) && (Result->TriangleCount > TargetTriangleCount); ++CandidateIndex)
+        {
+            uint32 Vertex = Values[CandidateIndex];
+            uint32 Target = Targets[Vertex - 1];
+            
+            //Adjacency is only up to date around vertices no collapse has touched this pass
+            if(Touched[Vertex - 1] || Touched[Target - 1])
+            {
+                continue;
+            }
+            
+            if(!IsCollapseValid(Result, &Adjacency, Vertex, Target, Marks, Stamp))
+            {
+                Stamp += 2;
+                continue;
+            }
+            
+            Stamp += 2;
+            
+            for(uint32 Index = Adjacency.Offsets[Vertex - 1]; Index < Adjacency.Offsets[Vertex]; ++Index)
+            {
+                triangle *Triangle = &Result->Triangles[Adjacency.Triangles[Index]];
+                
+                Touched[Triangle->A - 1] = true;
+                Touched[Triangle->B - 1] = true;
+                Touched[Triangle->C - 1] = true;
+                
+                if(FindCorner(Triangle, Target) < 3)
+                {
+                    //Degenerate after the collapse, removed when the pass compacts the triangles
+                    Triangle->A = 0;
+                    --Result->TriangleCount;
+                }
+                else
+                {
+                    SetCorner(Triangle, FindCorner(Triangle, Vertex), Target);
+                }
+            }
+            
+            for(uint32 Index = 0; Index < ArrayCount(Quadrics[0].Q); ++Index)
+            {
+                Quadrics[Target - 1].Q[Index] += Quadrics[Vertex - 1].Q[Index];
+            }
+            
+            ++CollapseCount;
+        }
+        
+        uint32 WriteIndex = 0;
+        for(uint32 TriangleIndex = 0; WriteIndex < Result->TriangleCount; ++TriangleIndex)
+        {
+            if(Result->Triangles[TriangleIndex].A)
+            {
+                Result->Triangles[WriteIndex++] = Result->Triangles[TriangleIndex];
+            }
+        }
+        
+        if(!CollapseCount)
+        {
+            break;
+        }
+    }
+    
+    VirtualFree(WorkMemory, 0, MEM_RELEASE);
+    VirtualFree(Quadrics, 0, MEM_RELEASE);
+}
+
+/*
+Builds the LOD chain at load, each level is simplified from the one before it.
+The chain ends early when locked seams and borders keep a level from getting meaningfully smaller.
+*/
+static void
+BuildMeshLod(mesh *Source, mesh_lod *Lod)
+{
+    Lod->Levels[0] = *Source;
+    Lod->LevelCount = 1;
+    
+    while(Lod->LevelCount < MESH_LOD_COUNT)
+    {
+        mesh *Previous = &Lod->Levels[Lod->LevelCount - 1];
+        mesh *Level = &Lod->Levels[Lod->LevelCount];
+        
+        uint32 TargetTriangleCount = (uint32)(Previous->TriangleCount * LOD_REDUCTION);
+        if(TargetTriangleCount < LOD_MIN_TRIANGLE_COUNT)
+        {
+            break;
+        }
+        
+        SimplifyMesh(Previous, Level, TargetTriangleCount);
+        
+        if(Level->TriangleCount > (uint32)(Previous->TriangleCount * 0.9f))
+        {
+            VirtualFree(Level->Triangles, 0, MEM_RELEASE);
+            break;
+        }
+        
+        BuildMeshlets(Level);
+        OptimizeVertexCache(Level);
+        ++Lod->LevelCount;
+    }
+    
+    char OutputBuffer[256];
+    for(uint32 LevelIndex = 0; LevelIndex < Lod->LevelCount; ++LevelIndex)
+    {
+        sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "LOD %u: %llu triangles\n", LevelIndex, Lod->Levels[LevelIndex].TriangleCount);
+        OutputDebugStringA(OutputBuffer);
+    }
+}
+
+/*
+Picks the most detailed level whose triangles still cover LOD_PIXELS_PER_TRIANGLE pixels on average.
+The covered area is estimated from the projected bounding sphere.
+*/
+static mesh *
+SelectMeshLod(mesh_lod *Lod, view *View, vec3 Position)
+{
+    mesh *Source = &Lod->Levels[0];
+    
+    real32 Distance = (Source->BoundsCenter.Z + Position.Z) - View->CameraPos.Z;
+    if(Distance <= View->NearZ)
+    {
+        return Source;
+    }
+    
+    real32 RadiusX = (Source->BoundsRadius * View->Projection.M[0][0] * View->ScaleX * View->HalfWidth) / Distance;
+    real32 RadiusY = (Source->BoundsRadius * View->Projection.M[1][1] * View->ScaleY * View->HalfHeight) / Distance;
+    real32 TriangleBudget = (PI * RadiusX * RadiusY) / LOD_PIXELS_PER_TRIANGLE;
+    
+    mesh *Result = &Lod->Levels[Lod->LevelCount - 1];
+    for(uint32 LevelIndex = 0; LevelIndex < Lod->LevelCount; ++LevelIndex)
+    {
+        if((real32)Lod->Levels[LevelIndex].TriangleCount <= TriangleBudget)
+        {
+            Result = &Lod->Levels[LevelIndex];
+            break;
+        }
+    }
+    
+    return Result;
+}
@@ -0,0 +1,28 @@
+/* date = October 19th 2026 2:35 pm */
+
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+//Every LOD level aims for this fraction of the triangles of the level before it
+#define LOD_REDUCTION 0.5f
+
+//No level is built below this many triangles
+#define LOD_MIN_TRIANGLE_COUNT 256
+
+//Screen area, in pixels, a triangle of the picked level should cover on average
+#define LOD_PIXELS_PER_TRIANGLE 8.0f
+
+//Symmetric 4x4 plane quadric, only the upper triangle is stored: AA AB AC AD BB BC BD CC CD DD
+typedef struct
+{
+    real32 Q[10];
+}quadric;
+
+//Triangles around every vertex, Triangles[Offsets[Vertex - 1]] up to Triangles[Offsets[Vertex]]
+typedef struct
+{
+    uint32 *Offsets;
+    uint32 *Triangles;
+}vertex_adjacency;
+
+#endif //SIMPLIFY_H
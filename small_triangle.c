@@ -0,0 +1,236 @@
+#include "small_triangle.h"
+
+//SmallSpanMasks[Start][End] has the bits Start up to (not including) End set
+static uint8 SmallSpanMasks[SMALL_TRIANGLE_BLOCK + 1][SMALL_TRIANGLE_BLOCK + 1];
+
+static void
+InitializeSmallTriangleMasks(void)
+{
+    for(uint32 Start = 0; Start <= SMALL_TRIANGLE_BLOCK; ++Start)
+    {
+        for(uint32 End = 0; End <= SMALL_TRIANGLE_BLOCK; ++End)
+        {
+            uint32 Mask = 0;
+            for(uint32 Bit = Start; Bit < End; ++Bit)
+            {
+                Mask |= (1 << Bit);
+            }
+            
+            SmallSpanMasks[Start][End] = (uint8)Mask;
+        }
+    }
+}
+
+//Only the block size test of SetupSmallTriangle, triangles off the buffer edges still go the large path there
+static bool32
+IsSmallTriangle(vec5 V1, vec5 V2, vec5 V3)
+{
+    int32 MinX = (int32)ceilf(fminf(V1.X, fminf(V2.X, V3.X)));
+    int32 MaxX = (int32)ceilf(fmaxf(V1.X, fmaxf(V2.X, V3.X)));
+    int32 MinY = (int32)ceilf(fminf(V1.Y, fminf(V2.Y, V3.Y)));
+    int32 MaxY = (int32)ceilf(fmaxf(V1.Y, fmaxf(V2.Y, V3.Y)));
+    
+    bool32 Result = ((MaxX - MinX) <= SMALL_TRIANGLE_BLOCK) && ((MaxY - MinY) <= SMALL_TRIANGLE_BLOCK);
+    
+    return Result;
+}
+
+/*
+Samples are at integer pixel coordinates, same as the scanline loop which covers the rows
+[ceil(TopY), ceil(BottomY)) and the columns [ceil(LeftX), ceil(RightX)) of each row.
+- Every non horizontal edge bounds the row either from the left or from the right, depending on which side the third vertex is.
+- The span of a row is looked up in SmallSpanMasks, so the coverage is known before any gradient is computed.
+- Triangles that cover no sample are dropped right here.
+*/
+static small_triangle_result
+SetupSmallTriangle(win32_pixel_buffer *Buffer, small_triangle *Small, vec5 V1, vec5 V2, vec5 V3)
+{
+    vec5 Vertices[3] = {V1, V2, V3};
+    
+    real32 MinXReal = fminf(V1.X, fminf(V2.X, V3.X));
+    real32 MaxXReal = fmaxf(V1.X, fmaxf(V2.X, V3.X));
+    real32 MinYReal = fminf(V1.Y, fminf(V2.Y, V3.Y));
+    real32 MaxYReal = fmaxf(V1.Y, fmaxf(V2.Y, V3.Y));
+    
+    int32 MinX = (int32)ceilf(MinXReal);
+    int32 MaxX = (int32)ceilf(MaxXReal);
+    int32 MinY = (int32)ceilf(MinYReal);
+    int32 MaxY = (int32)ceilf(MaxYReal);
+    
+    if(MinX >= MaxX || MinY >= MaxY)
+    {
+        return SmallTriangle_Empty;
+    }
+    
+    if((MaxX - MinX) > SMALL_TRIANGLE_BLOCK || (MaxY - MinY) > SMALL_TRIANGLE_BLOCK ||
+       MinX < 0 || MinY < 0 || MaxX > (int32)Buffer->Width || MaxY > (int32)Buffer->Height)
+    {
+        return SmallTriangle_Large;
+    }
+    
+    real32 EdgeX[3];
+    real32 EdgeY[3];
+    real32 EdgeInvSlope[3];
+    bool32 EdgeIsLeft[3];
+    uint32 EdgeCount = 0;
+    
+    for(uint32 Index = 0; Index < 3; ++Index)
+    {
+        vec5 P = Vertices[Index];
+        vec5 Q = Vertices[(Index + 1) % 3];
+        vec5 R = Vertices[(Index + 2) % 3];
+        
+        if(P.Y != Q.Y)
+        {
+            real32 InvSlope = (Q.X - P.X) / (Q.Y - P.Y);
+            real32 XAtR = P.X + ((R.Y - P.Y) * InvSlope);
+            
+            if(R.X == XAtR)
+            {
+                //Zero area
+                return SmallTriangle_Empty;
+            }
+            
+            EdgeX[EdgeCount] = P.X;
+            EdgeY[EdgeCount] = P.Y;
+            EdgeInvSlope[EdgeCount] = InvSlope;
+            EdgeIsLeft[EdgeCount] = (R.X > XAtR);
+            ++EdgeCount;
+        }
+    }
+    
+    uint64 Coverage = 0;
+    for(int32 Y = MinY; Y < MaxY; ++Y)
+    {
+        int32 Left = MinX;
+        int32 Right = MaxX;
+        
+        for(uint32 Index = 0; Index < EdgeCount; ++Index)
+        {
+            int32 X = (int32)ceilf(EdgeX[Index] + ((Y - EdgeY[Index]) * EdgeInvSlope[Index]));
+            
+            if(EdgeIsLeft[Index])
+            {
+                Left = (X > Left) ? X : Left;
+            }
+            else
+            {
+                Right = (X < Right) ? X : Right;
+            }
+        }
+        
+        if(Left < Right)
+        {
+            uint32 Start = ClampInt32(Left - MinX, 0, SMALL_TRIANGLE_BLOCK);
+            uint32 End = ClampInt32(Right - MinX, 0, SMALL_TRIANGLE_BLOCK);
+            Coverage |= (uint64)SmallSpanMasks[Start][End] << ((Y - MinY) * SMALL_TRIANGLE_BLOCK);
+        }
+    }
+    
+    if(!Coverage)
+    {
+        return SmallTriangle_Empty;
+    }
+    
+    gradient Gradients;
+    CalculateGradients(&Gradients, Vertices);
+    
+    real32 XPreStep = MinX - V1.X;
+    real32 YPreStep = MinY - V1.Y;
+    
+    Small->Coverage = Coverage;
+    Small->MinX = MinX;
+    Small->MinY = MinY;
+    
+    Small->OneOverZ = Gradients.OneOverZ[0] + (XPreStep * Gradients.dOneOverZdX) + (YPreStep * Gradients.dOneOverZdY);
+    Small->UOverZ = Gradients.UOverZ[0] + (XPreStep * Gradients.dUOverZdX) + (YPreStep * Gradients.dUOverZdY);
+    Small->VOverZ = Gradients.VOverZ[0] + (XPreStep * Gradients.dVOverZdX) + (YPreStep * Gradients.dVOverZdY);
+    
+    Small->dOneOverZdX = Gradients.dOneOverZdX;
+    Small->dOneOverZdY = Gradients.dOneOverZdY;
+    Small->dUOverZdX = Gradients.dUOverZdX;
+    Small->dUOverZdY = Gradients.dUOverZdY;
+    Small->dVOverZdX = Gradients.dVOverZdX;
+    Small->dVOverZdY = Gradients.dVOverZdY;
+    
+    return SmallTriangle_Covered;
+}
+
+//Every kernel but RasterKernel_SpanBuffer, 1/z, u/z and v/z are evaluated at each covered pixel from the values at (MinX, MinY)
+static void
+DrawSmallTriangle(win32_pixel_buffer *Buffer, texture *Texture, small_triangle *Small, raster_kernel Kernel, blend_mode BlendMode)
+{
+    uint32 PackedNormal = (Kernel == RasterKernel_GBuffer) ? PackNormal(Small->Normal) : 0;
+    uint32 FragmentCount = 0;
+    
+    real32 RowOneOverZ = Small->OneOverZ;
+    real32 RowUOverZ = Small->UOverZ;
+    real32 RowVOverZ = Small->VOverZ;
+    
+    for(uint32 Y = 0; Y < SMALL_TRIANGLE_BLOCK; ++Y)
+    {
+        uint64 RemainingRows = Small->Coverage >> (Y * SMALL_TRIANGLE_BLOCK);
+        if(!RemainingRows)
+        {
+            break;
+        }
+        
+        uint32 RowBits = (uint32)RemainingRows & 0xFF;
+        
+        uint32 PixelIndex = GetPixelIndex(Buffer, Small->MinX, Small->MinY + Y);
+        for(uint32 X = 0; RowBits; ++X, RowBits >>= 1)
+        {
+            if(RowBits & 1)
+            {
+                FragmentCount += DrawKernelPixel(Buffer, Texture, Kernel, BlendMode, PixelIndex, Small->MinX + X, Small->MinY + Y,
+                                                 RowOneOverZ + (X * Small->dOneOverZdX), RowUOverZ + (X * Small->dUOverZdX),
+                                                 RowVOverZ + (X * Small->dVOverZdX), Small->Color, Small->Normal, PackedNormal);
+            }
+            
+            PixelIndex = GetNextPixelIndex(Buffer, PixelIndex, Small->MinX + X);
+        }
+        
+        RowOneOverZ += Small->dOneOverZdY;
+        RowUOverZ += Small->dUOverZdY;
+        RowVOverZ += Small->dVOverZdY;
+    }
+    
+    CountKernelFragments(Buffer, Kernel, FragmentCount);
+}
+
+//Span buffer, every covered row of the block is one contiguous span
+static void
+DrawSmallSpanBufferTriangle(win32_pixel_buffer *Buffer, texture *Texture, small_triangle *Small)
+{
+    real32 RowOneOverZ = Small->OneOverZ;
+    real32 RowUOverZ = Small->UOverZ;
+    real32 RowVOverZ = Small->VOverZ;
+    
+    for(uint32 Y = 0; Y < SMALL_TRIANGLE_BLOCK; ++Y)
+    {
+        uint64 RemainingRows = Small->Coverage >> (Y * SMALL_TRIANGLE_BLOCK);
+        if(!RemainingRows)
+        {
+            break;
+        }
+        
+        uint32 RowBits = (uint32)RemainingRows & 0xFF;
+        if(RowBits)
+        {
+            uint32 Start = 0;
+            while(!(RowBits & (1 << Start)))
+            {
+                ++Start;
+            }
+            
+            uint32 End = Start + _mm_popcnt_u32(RowBits);
+            DrawSpanBufferSpan(Buffer, Texture, Small->MinY + Y, Small->MinX + Start, Small->MinX + End, Small->Color, Small->Normal,
+                               RowOneOverZ + (Start * Small->dOneOverZdX), RowUOverZ + (Start * Small->dUOverZdX), RowVOverZ + (Start * Small->dVOverZdX),
+                               Small->dOneOverZdX, Small->dUOverZdX, Small->dVOverZdX);
+        }
+        
+        RowOneOverZ += Small->dOneOverZdY;
+        RowUOverZ += Small->dUOverZdY;
+        RowVOverZ += Small->dVOverZdY;
+    }
+}
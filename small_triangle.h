@@ -0,0 +1,42 @@
+/* date = October 19th 2026 10:40 am */
+
+#ifndef SMALL_TRIANGLE_H
+#define SMALL_TRIANGLE_H
+
+//Triangles whose sample bounding box fits in a block of this size skip the scanline setup.
+//One bit per pixel of the block, so the coverage of a block fits in a uint64.
+#define SMALL_TRIANGLE_BLOCK 8
+
+typedef enum
+{
+    SmallTriangle_Large,
+    SmallTriangle_Empty,
+    SmallTriangle_Covered,
+}small_triangle_result;
+
+typedef struct
+{
+    uint64 Coverage;
+    
+    int32 MinX;
+    int32 MinY;
+    
+    //Values at the sample (MinX, MinY)
+    real32 OneOverZ;
+    real32 UOverZ;
+    real32 VOverZ;
+    
+    real32 dOneOverZdX;
+    real32 dOneOverZdY;
+    real32 dUOverZdX;
+    real32 dUOverZdY;
+    real32 dVOverZdX;
+    real32 dVOverZdY;
+    
+    uint32 Color;
+    
+    //Unit face normal for lighting, see light_culling.c
+    vec3 Normal;
+}small_triangle;
+
+#endif //SMALL_TRIANGLE_H
@@ -0,0 +1,174 @@
+#include "span_buffer.h"
+
+/*
+Span buffer (S-buffer) hidden surface removal, for opaque triangles drawn front to back:
+- Every scanline keeps the pixels drawn to so far as sorted runs, covered_span [Start, End), with gaps between them.
+- A scanline span of a triangle is clipped against the runs of its scanline. Only the gaps are textured and written,
+  then the span is merged with the runs it overlaps or touches. Triangles sharing an edge meet exactly, so a surface without holes
+  stays one run per scanline and a hidden span is rejected after looking at a couple of runs.
+- Depth is neither tested nor written, the order of the triangles decides what is in front. DrawMeshInstances sorts the triangles
+  of an instance nearest first, instances have to be given nearest first as well. Where triangles overlap out of that order, or intersect,
+  the one drawn first wins.
+Memory is SPAN_BUFFER_MAX_SPANS runs per scanline instead of a float per pixel. Blended triangles are drawn forward against the depth buffer,
+which the span buffer leaves empty, so they do not mix with it.
+*/
+
+//Not for multisampled buffers or buffers with a visibility buffer, it replaces their depth test
+static void
+AllocateSpanBuffer(win32_pixel_buffer *Buffer)
+{
+    span_buffer *SpanBuffer = &Buffer->SpanBuffer;
+    if(SpanBuffer->Spans)
+    {
+        return;
+    }
+    
+    Assert(Buffer->Multisample.SampleCount == 1);
+    Assert(!Buffer->Visibility.Ids);
+    
+    SpanBuffer->Spans = (covered_span *)VirtualAlloc(0, (SIZE_T)Buffer->Height * SPAN_BUFFER_MAX_SPANS * sizeof(covered_span), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    SpanBuffer->Counts = (uint16 *)VirtualAlloc(0, (SIZE_T)Buffer->Height * sizeof(uint16), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    SpanBuffer->OverflowCount = 0;
+    Assert(SpanBuffer->Spans && SpanBuffer->Counts);
+}
+
+static void
+ReleaseSpanBuffer(win32_pixel_buffer *Buffer)
+{
+    if(Buffer->SpanBuffer.Spans)
+    {
+        VirtualFree(Buffer->SpanBuffer.Spans, 0, MEM_RELEASE);
+        VirtualFree(Buffer->SpanBuffer.Counts, 0, MEM_RELEASE);
+        Buffer->SpanBuffer.Spans = 0;
+        Buffer->SpanBuffer.Counts = 0;
+    }
+}
+
+//Bytes of the runs and counts, what a span buffer takes in place of the depth buffer
+static uint64
+GetSpanBufferSize(win32_pixel_buffer *Buffer)
+{
+    uint64 Result = (uint64)Buffer->Height * ((SPAN_BUFFER_MAX_SPANS * sizeof(covered_span)) + sizeof(uint16));
+    return Result;
+}
+
+/*
+Draws the scanline span [XStart, XEnd) of row Y where nothing has been drawn yet, the values are those at XStart.
+A span that finds its scanline full is drawn without being recorded, OverflowCount counts them.
+*/
+static void
+DrawSpanBufferSpan(win32_pixel_buffer *Buffer, texture *Texture, int32 Y, int32 XStart, int32 XEnd, uint32 Color, vec3 Normal,
+                   real32 OneOverZ, real32 UOverZ, real32 VOverZ, real32 dOneOverZdX, real32 dUOverZdX, real32 dVOverZdX)
+{
+    if(XStart >= XEnd)
+    {
+        return;
+    }
+    
+    span_buffer *SpanBuffer = &Buffer->SpanBuffer;
+    covered_span *Spans = SpanBuffer->Spans + (Y * SPAN_BUFFER_MAX_SPANS);
+    uint32 Count = SpanBuffer->Counts[Y];
+    
+    //Runs that end before XStart neither overlap nor touch the span
+    uint32 First = 0;
+    while((First < Count) && (Spans[First].End < XStart))
+    {
+        ++First;
+    }
+    
+    int32 GapStarts[SPAN_BUFFER_MAX_SPANS + 1];
+    int32 GapEnds[SPAN_BUFFER_MAX_SPANS + 1];
+    uint32 GapCount = 0;
+    
+    int32 X = XStart;
+    int32 MergedStart = XStart;
+    int32 MergedEnd = XEnd;
+    
+    uint32 Last = First;
+    for(; (Last < Count) && (Spans[Last].Start <= XEnd); ++Last)
+    {
+        if(Spans[Last].Start > X)
+        {
+            GapStarts[GapCount] = X;
+            GapEnds[GapCount++] = Spans[Last].Start;
+        }
+        
+        X = (Spans[Last].End > X) ? Spans[Last].End : X;
+        MergedStart = (Spans[Last].Start < MergedStart) ? Spans[Last].Start : MergedStart;
+        MergedEnd = (Spans[Last].End > MergedEnd) ? Spans[Last].End : MergedEnd;
+    }
+    
+    if(X < XEnd)
+    {
+        GapStarts[GapCount] = X;
+        GapEnds[GapCount++] = XEnd;
+    }
+    
+    //Hidden behind what is drawn, the runs already cover the whole span
+    if(!GapCount)
+    {
+        return;
+    }
+    
+    //Runs First up to Last are replaced by the merged one
+    uint32 MergedCount = Last - First;
+    if(MergedCount == 0)
+    {
+        if(Count < SPAN_BUFFER_MAX_SPANS)
+        {
+            for(uint32 Index = Count; Index > First; --Index)
+            {
+                Spans[Index] = Spans[Index - 1];
+            }
+            
+            Spans[First].Start = (int16)MergedStart;
+            Spans[First].End = (int16)MergedEnd;
+            SpanBuffer->Counts[Y] = (uint16)(Count + 1);
+        }
+        else
+        {
+            ++SpanBuffer->OverflowCount;
+        }
+    }
+    else
+    {
+        Spans[First].Start = (int16)MergedStart;
+        Spans[First].End = (int16)MergedEnd;
+        
+        for(uint32 Index = Last; Index < Count; ++Index)
+        {
+            Spans[Index - MergedCount + 1] = Spans[Index];
+        }
+        
+        SpanBuffer->Counts[Y] = (uint16)(Count - MergedCount + 1);
+    }
+    
+    uint32 *Pixels = (uint32 *)Buffer->Memory;
+    bool32 IsLit = (Buffer->Lighting.LightCount > 0);
+    
+    for(uint32 GapIndex = 0; GapIndex < GapCount; ++GapIndex)
+    {
+        real32 Offset = (real32)(GapStarts[GapIndex] - XStart);
+        real32 GapOneOverZ = OneOverZ + (Offset * dOneOverZdX);
+        real32 GapUOverZ = UOverZ + (Offset * dUOverZdX);
+        real32 GapVOverZ = VOverZ + (Offset * dVOverZdX);
+        
+        uint32 PixelIndex = GetPixelIndex(Buffer, GapStarts[GapIndex], Y);
+        for(int32 GapX = GapStarts[GapIndex]; GapX < GapEnds[GapIndex]; ++GapX)
+        {
+            real32 Z = 1.0f / GapOneOverZ;
+            uint32 TexelColor = ModulateColor(SampleTexture(Texture, GapUOverZ * Z, GapVOverZ * Z), Color);
+            if(IsLit)
+            {
+                TexelColor = LightTexel(&Buffer->Lighting, TexelColor, GapX, Y, Z, Normal);
+            }
+            
+            Pixels[PixelIndex] = TexelColor;
+            
+            PixelIndex = GetNextPixelIndex(Buffer, PixelIndex, GapX);
+            GapOneOverZ += dOneOverZdX;
+            GapUOverZ += dUOverZdX;
+            GapVOverZ += dVOverZdX;
+        }
+    }
+}
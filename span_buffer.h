@@ -0,0 +1,11 @@
+/* date = October 19th 2026 9:50 pm */
+
+#ifndef SPAN_BUFFER_H
+#define SPAN_BUFFER_H
+
+//Covered runs a scanline of a span buffer can hold, a silhouette crossing the scanline takes one more
+#define SPAN_BUFFER_MAX_SPANS 32
+
+#define SPAN_BUFFER_BENCHMARK_FRAMES 8
+
+#endif //SPAN_BUFFER_H
@@ -0,0 +1,452 @@
+#include "streaming.h"
+
+//Offsets of the triangles and meshlets from the start of the chunk, the vertices come first
+static void
+GetStreamingChunkLayout(streaming_chunk *Chunk, uint64 *TriangleOffset, uint64 *MeshletOffset)
+{
+    *TriangleOffset = (((uint64)Chunk->VertexCount * sizeof(packed_vertex)) + 15) & ~(uint64)15;
+    *MeshletOffset = *TriangleOffset + ((uint64)Chunk->TriangleCount * sizeof(triangle));
+}
+
+//WriteFile and ReadFile take 32 bit sizes, so anything bigger goes through in pieces
+static bool32
+WriteStreamingBytes(HANDLE File, uint64 Offset, void *Bytes, uint64 Size)
+{
+    LARGE_INTEGER Position;
+    Position.QuadPart = (LONGLONG)Offset;
+    if(!SetFilePointerEx(File, Position, 0, FILE_BEGIN))
+    {
+        return false;
+    }
+    
+    uint64 TotalWritten = 0;
+    while(TotalWritten < Size)
+    {
+        uint64 BytesLeft = Size - TotalWritten;
+        DWORD BytesToWrite = (BytesLeft > GIGABYTE(1)) ? (DWORD)GIGABYTE(1) : (DWORD)BytesLeft;
+        
+        DWORD BytesWritten;
+        if(!WriteFile(File, (uint8 *)Bytes + TotalWritten, BytesToWrite, &BytesWritten, 0) || (BytesWritten != BytesToWrite))
+        {
+            return false;
+        }
+        
+        TotalWritten += BytesWritten;
+    }
+    
+    return true;
+}
+
+static bool32
+ReadStreamingBytes(HANDLE File, uint64 Offset, void *Bytes, uint64 Size)
+{
+    LARGE_INTEGER Position;
+    Position.QuadPart = (LONGLONG)Offset;
+    if(!SetFilePointerEx(File, Position, 0, FILE_BEGIN))
+    {
+        return false;
+    }
+    
+    uint64 TotalRead = 0;
+    while(TotalRead < Size)
+    {
+        uint64 BytesLeft = Size - TotalRead;
+        DWORD BytesToRead = (BytesLeft > GIGABYTE(1)) ? (DWORD)GIGABYTE(1) : (DWORD)BytesLeft;
+        
+        DWORD BytesRead;
+        if(!ReadFile(File, (uint8 *)Bytes + TotalRead, BytesToRead, &BytesRead, 0) || (BytesRead != BytesToRead))
+        {
+            return false;
+        }
+        
+        TotalRead += BytesRead;
+    }
+    
+    return true;
+}
+
+//The header is written last, the first STREAMING_CHUNK_ALIGNMENT bytes are kept for it
+static bool32
+BeginStreamingMesh(streaming_writer *Writer, char *FileName)
+{
+    Writer->File = CreateFileA(FileName, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+    if(Writer->File == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    
+    Writer->Offset = STREAMING_CHUNK_ALIGNMENT;
+    Writer->Header = (streaming_header){0};
+    Writer->Header.Magic = STREAMING_MAGIC;
+    Writer->Header.Version = STREAMING_VERSION;
+    
+    //Reserved, so a table of millions of chunks stays one array
+    InitializeArena(&Writer->TableArena, GIGABYTE(1), 0);
+    Writer->Chunks = (streaming_chunk *)Writer->TableArena.Base;
+    
+    return true;
+}
+
+/*
+Appends one chunk, only the chunk itself has to be in memory, so a converter can feed a scan bigger than RAM piece by piece.
+The chunk needs packed vertices, meshlets and bounds. Its triangles have to index its own vertices and its meshlets its own triangles.
+*/
+static bool32
+AddStreamingChunk(streaming_writer *Writer, mesh *Chunk)
+{
+    Assert(Chunk->VertexCount <= 0xFFFFFFFF);
+    Assert(Chunk->TriangleCount <= 0xFFFFFFFF);
+    Assert(Chunk->MeshletCount <= 0xFFFFFFFF);
+    
+    //Alignment 1 keeps the entries packed, the table is written out as it is
+    streaming_chunk *Entry = (streaming_chunk *)PushSizeAligned(&Writer->TableArena, sizeof(streaming_chunk), 1);
+    Entry->Offset = Writer->Offset;
+    Entry->VertexCount = (uint32)Chunk->VertexCount;
+    Entry->TriangleCount = (uint32)Chunk->TriangleCount;
+    Entry->MeshletCount = (uint32)Chunk->MeshletCount;
+    Entry->Unused = 0;
+    Entry->Quantization = Chunk->Quantization;
+    Entry->BoundsCenter = Chunk->BoundsCenter;
+    Entry->BoundsRadius = Chunk->BoundsRadius;
+    
+    uint64 TriangleOffset;
+    uint64 MeshletOffset;
+    GetStreamingChunkLayout(Entry, &TriangleOffset, &MeshletOffset);
+    Entry->Size = MeshletOffset + (Chunk->MeshletCount * sizeof(meshlet));
+    
+    //Skipped bytes read back as zeros, so the padding is never written
+    bool32 Result = (WriteStreamingBytes(Writer->File, Entry->Offset, Chunk->PackedVertices, Chunk->VertexCount * sizeof(packed_vertex)) &&
+                     WriteStreamingBytes(Writer->File, Entry->Offset + TriangleOffset, Chunk->Triangles, Chunk->TriangleCount * sizeof(triangle)) &&
+                     WriteStreamingBytes(Writer->File, Entry->Offset + MeshletOffset, Chunk->Meshlets, Chunk->MeshletCount * sizeof(meshlet)));
+    
+    Writer->Offset = (Entry->Offset + Entry->Size + STREAMING_CHUNK_ALIGNMENT - 1) & ~(uint64)(STREAMING_CHUNK_ALIGNMENT - 1);
+    
+    ++Writer->Header.ChunkCount;
+    Writer->Header.VertexCount += Chunk->VertexCount;
+    Writer->Header.TriangleCount += Chunk->TriangleCount;
+    
+    return Result;
+}
+
+//Writes the chunk table and the header, the bounds of the whole file are put together from the chunk spheres
+static bool32
+EndStreamingMesh(streaming_writer *Writer)
+{
+    streaming_header *Header = &Writer->Header;
+    
+    if(Header->ChunkCount)
+    {
+        vec3 Min = Writer->Chunks[0].BoundsCenter;
+        vec3 Max = Min;
+        for(uint64 ChunkIndex = 0; ChunkIndex < Header->ChunkCount; ++ChunkIndex)
+        {
+            streaming_chunk *Chunk = &Writer->Chunks[ChunkIndex];
+            vec3 Radius = {Chunk->BoundsRadius, Chunk->BoundsRadius, Chunk->BoundsRadius};
+            vec3 ChunkMin = SubtractVec3(Chunk->BoundsCenter, Radius);
+            vec3 ChunkMax = AddVec3(Chunk->BoundsCenter, Radius);
+            Min = (vec3){fminf(Min.X, ChunkMin.X), fminf(Min.Y, ChunkMin.Y), fminf(Min.Z, ChunkMin.Z)};
+            Max = (vec3){fmaxf(Max.X, ChunkMax.X), fmaxf(Max.Y, ChunkMax.Y), fmaxf(Max.Z, ChunkMax.Z)};
+        }
+        
+        Header->BoundsCenter = (vec3){(Min.X + Max.X) * 0.5f, (Min.Y + Max.Y) * 0.5f, (Min.Z + Max.Z) * 0.5f};
+        Header->BoundsRadius = 0.0f;
+        for(uint64 ChunkIndex = 0; ChunkIndex < Header->ChunkCount; ++ChunkIndex)
+        {
+            streaming_chunk *Chunk = &Writer->Chunks[ChunkIndex];
+            real32 Distance = GetMagnitudeVec3(SubtractVec3(Chunk->BoundsCenter, Header->BoundsCenter)) + Chunk->BoundsRadius;
+            Header->BoundsRadius = fmaxf(Header->BoundsRadius, Distance);
+        }
+    }
+    
+    Header->TableOffset = Writer->Offset;
+    
+    bool32 Result = (WriteStreamingBytes(Writer->File, Header->TableOffset, Writer->Chunks, Header->ChunkCount * sizeof(streaming_chunk)) &&
+                     WriteStreamingBytes(Writer->File, 0, Header, sizeof(streaming_header)));
+    
+    CloseHandle(Writer->File);
+    VirtualFree(Writer->TableArena.Base, 0, MEM_RELEASE);
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Streaming mesh: %llu chunks, %llu triangles, %llu bytes\n",
+              Header->ChunkCount, Header->TriangleCount, Header->TableOffset + (Header->ChunkCount * (uint64)sizeof(streaming_chunk)));
+    OutputDebugStringA(OutputBuffer);
+    
+    return Result;
+}
+
+/*
+Splits a quantized mesh into chunks of STREAMING_CHUNK_MESHLET_COUNT meshlets and writes them out.
+- Meshlets are in Morton order, so a run of them is a compact piece of the surface with a tight bounding sphere.
+- Vertices are renumbered in the order the chunk first uses them, vertices on a chunk border are stored in both chunks.
+- Every chunk keeps the quantization of the mesh.
+*/
+static bool32
+WriteStreamingMesh(char *FileName, mesh *Mesh)
+{
+    streaming_writer Writer;
+    if(!BeginStreamingMesh(&Writer, FileName))
+    {
+        return false;
+    }
+    
+    uint32 MaxTriangleCount = STREAMING_CHUNK_MESHLET_COUNT * MESHLET_TRIANGLE_COUNT;
+    
+    //1-based index of every mesh vertex in the current chunk, 0 when the chunk does not use it yet
+    uint32 *Map = (uint32 *)VirtualAlloc(0, Mesh->VertexCount * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    uint32 *Sources = (uint32 *)VirtualAlloc(0, 3 * MaxTriangleCount * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    packed_vertex *Vertices = (packed_vertex *)VirtualAlloc(0, 3 * MaxTriangleCount * sizeof(packed_vertex), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    triangle *Triangles = (triangle *)VirtualAlloc(0, MaxTriangleCount * sizeof(triangle), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    meshlet *Meshlets = (meshlet *)VirtualAlloc(0, STREAMING_CHUNK_MESHLET_COUNT * sizeof(meshlet), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    bool32 Result = true;
+    
+    for(uint64 FirstMeshlet = 0; Result && (FirstMeshlet < Mesh->MeshletCount); FirstMeshlet += STREAMING_CHUNK_MESHLET_COUNT)
+    {
+        mesh Chunk = {0};
+        Chunk.PackedVertices = Vertices;
+        Chunk.Quantization = Mesh->Quantization;
+        Chunk.Triangles = Triangles;
+        Chunk.Meshlets = Meshlets;
+        
+        Chunk.MeshletCount = Mesh->MeshletCount - FirstMeshlet;
+        if(Chunk.MeshletCount > STREAMING_CHUNK_MESHLET_COUNT)
+        {
+            Chunk.MeshletCount = STREAMING_CHUNK_MESHLET_COUNT;
+        }
+        
+        for(uint64 MeshletIndex = 0; MeshletIndex < Chunk.MeshletCount; ++MeshletIndex)
+        {
+            meshlet *Source = &Mesh->Meshlets[FirstMeshlet + MeshletIndex];
+            meshlet *Meshlet = &Meshlets[MeshletIndex];
+            *Meshlet = *Source;
+            Meshlet->FirstTriangle = (uint32)Chunk.TriangleCount;
+            
+            for(uint32 TriangleIndex = 0; TriangleIndex < Source->TriangleCount; ++TriangleIndex)
+            {
+                triangle *Triangle = &Triangles[Chunk.TriangleCount++];
+                *Triangle = Mesh->Triangles[Source->FirstTriangle + TriangleIndex];
+                
+                uint32 *Indices[3] = {&Triangle->A, &Triangle->B, &Triangle->C};
+                for(uint32 Index = 0; Index < 3; ++Index)
+                {
+                    uint32 VertexIndex = *Indices[Index] - 1;
+                    if(!Map[VertexIndex])
+                    {
+                        Sources[Chunk.VertexCount] = VertexIndex;
+                        Vertices[Chunk.VertexCount] = Mesh->PackedVertices[VertexIndex];
+                        Map[VertexIndex] = (uint32)++Chunk.VertexCount;
+                    }
+                    
+                    *Indices[Index] = Map[VertexIndex];
+                }
+            }
+        }
+        
+        vec3 Min = DequantizePosition(&Mesh->Quantization, &Vertices[0]);
+        vec3 Max = Min;
+        for(uint64 VertexIndex = 1; VertexIndex < Chunk.VertexCount; ++VertexIndex)
+        {
+            vec3 Position = DequantizePosition(&Mesh->Quantization, &Vertices[VertexIndex]);
+            Min = (vec3){fminf(Min.X, Position.X), fminf(Min.Y, Position.Y), fminf(Min.Z, Position.Z)};
+            Max = (vec3){fmaxf(Max.X, Position.X), fmaxf(Max.Y, Position.Y), fmaxf(Max.Z, Position.Z)};
+        }
+        
+        Chunk.BoundsCenter = (vec3){(Min.X + Max.X) * 0.5f, (Min.Y + Max.Y) * 0.5f, (Min.Z + Max.Z) * 0.5f};
+        for(uint64 VertexIndex = 0; VertexIndex < Chunk.VertexCount; ++VertexIndex)
+        {
+            real32 Distance = GetMagnitudeVec3(SubtractVec3(DequantizePosition(&Mesh->Quantization, &Vertices[VertexIndex]), Chunk.BoundsCenter));
+            Chunk.BoundsRadius = fmaxf(Chunk.BoundsRadius, Distance);
+        }
+        
+        Result = AddStreamingChunk(&Writer, &Chunk);
+        
+        for(uint64 VertexIndex = 0; VertexIndex < Chunk.VertexCount; ++VertexIndex)
+        {
+            Map[Sources[VertexIndex]] = 0;
+        }
+    }
+    
+    VirtualFree(Meshlets, 0, MEM_RELEASE);
+    VirtualFree(Triangles, 0, MEM_RELEASE);
+    VirtualFree(Vertices, 0, MEM_RELEASE);
+    VirtualFree(Sources, 0, MEM_RELEASE);
+    VirtualFree(Map, 0, MEM_RELEASE);
+    
+    return EndStreamingMesh(&Writer) && Result;
+}
+
+static void
+UnmapStreamingSlot(streaming_mesh *Stream, streaming_slot *Slot)
+{
+    if(Slot->View)
+    {
+        UnmapViewOfFile(Slot->View);
+        Stream->ResidentBytes -= Stream->Chunks[Slot->ChunkIndex].Size;
+    }
+    
+    Slot->ChunkIndex = STREAMING_EMPTY_SLOT;
+    Slot->View = 0;
+}
+
+static void
+CloseStreamingMesh(streaming_mesh *Stream)
+{
+    for(uint32 SlotIndex = 0; SlotIndex < STREAMING_RESIDENT_CHUNK_COUNT; ++SlotIndex)
+    {
+        UnmapStreamingSlot(Stream, &Stream->Slots[SlotIndex]);
+    }
+    
+    if(Stream->Mapping)
+    {
+        CloseHandle(Stream->Mapping);
+    }
+    
+    CloseHandle(Stream->File);
+    VirtualFree(Stream->Chunks, 0, MEM_RELEASE);
+}
+
+//A chunk is mapped on its own, so it has to start on the alignment and its vertices, triangles and meshlets have to end inside the file
+static bool32
+IsStreamingChunkInFile(streaming_chunk *Chunk, uint64 FileSize)
+{
+    uint64 TriangleOffset;
+    uint64 MeshletOffset;
+    GetStreamingChunkLayout(Chunk, &TriangleOffset, &MeshletOffset);
+    uint64 LayoutSize = MeshletOffset + ((uint64)Chunk->MeshletCount * sizeof(meshlet));
+    
+    //Compared as what is left of the file, so a corrupt offset or size can not wrap around
+    bool32 Result = (((Chunk->Offset & (STREAMING_CHUNK_ALIGNMENT - 1)) == 0) &&
+                     (Chunk->Offset <= FileSize) && (Chunk->Size <= (FileSize - Chunk->Offset)) &&
+                     (LayoutSize <= Chunk->Size));
+    
+    return Result;
+}
+
+/*
+Only the header and the chunk table are read, chunks are mapped when they are drawn.
+Files whose table or chunks reach past the end of the file are rejected here, so drawing never maps past it.
+*/
+static bool32
+OpenStreamingMesh(streaming_mesh *Stream, char *FileName)
+{
+    *Stream = (streaming_mesh){0};
+    
+    Stream->File = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if(Stream->File == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    
+    if(!ReadStreamingBytes(Stream->File, 0, &Stream->Header, sizeof(streaming_header)) ||
+       (Stream->Header.Magic != STREAMING_MAGIC) || (Stream->Header.Version != STREAMING_VERSION))
+    {
+        CloseHandle(Stream->File);
+        return false;
+    }
+    
+    LARGE_INTEGER FileSize;
+    uint64 TableOffset = Stream->Header.TableOffset;
+    if(!GetFileSizeEx(Stream->File, &FileSize) || (TableOffset > (uint64)FileSize.QuadPart) ||
+       (Stream->Header.ChunkCount > (((uint64)FileSize.QuadPart - TableOffset) / sizeof(streaming_chunk))))
+    {
+        CloseHandle(Stream->File);
+        return false;
+    }
+    
+    uint64 TableSize = Stream->Header.ChunkCount * sizeof(streaming_chunk);
+    Stream->Chunks = (streaming_chunk *)VirtualAlloc(0, (SIZE_T)TableSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Stream->Mapping = CreateFileMappingA(Stream->File, 0, PAGE_READONLY, 0, 0, 0);
+    
+    if(!ReadStreamingBytes(Stream->File, TableOffset, Stream->Chunks, TableSize) || !Stream->Mapping)
+    {
+        CloseStreamingMesh(Stream);
+        return false;
+    }
+    
+    for(uint64 ChunkIndex = 0; ChunkIndex < Stream->Header.ChunkCount; ++ChunkIndex)
+    {
+        if(!IsStreamingChunkInFile(&Stream->Chunks[ChunkIndex], (uint64)FileSize.QuadPart))
+        {
+            CloseStreamingMesh(Stream);
+            return false;
+        }
+    }
+    
+    for(uint32 SlotIndex = 0; SlotIndex < STREAMING_RESIDENT_CHUNK_COUNT; ++SlotIndex)
+    {
+        Stream->Slots[SlotIndex].ChunkIndex = STREAMING_EMPTY_SLOT;
+    }
+    
+    return true;
+}
+
+/*
+Returns the chunk as a mesh that points into its mapped view, or 0 when the view could not be mapped.
+A chunk that is not mapped takes the slot of the least recently drawn chunk, whose view is unmapped,
+so no more than STREAMING_RESIDENT_CHUNK_COUNT chunks are ever resident and the OS can drop the pages of the rest.
+*/
+static mesh *
+AcquireStreamingChunk(streaming_mesh *Stream, uint64 ChunkIndex)
+{
+    streaming_slot *Victim = &Stream->Slots[0];
+    
+    for(uint32 SlotIndex = 0; SlotIndex < STREAMING_RESIDENT_CHUNK_COUNT; ++SlotIndex)
+    {
+        streaming_slot *Slot = &Stream->Slots[SlotIndex];
+        if(Slot->ChunkIndex == ChunkIndex)
+        {
+            Slot->LastUsed = Stream->Frame;
+            ++Stream->HitCount;
+            
+            return &Slot->Mesh;
+        }
+        
+        if((Slot->ChunkIndex == STREAMING_EMPTY_SLOT) ||
+           ((Victim->ChunkIndex != STREAMING_EMPTY_SLOT) && (Slot->LastUsed < Victim->LastUsed)))
+        {
+            Victim = Slot;
+        }
+    }
+    
+    BEGIN_PROFILE_ZONE(Load);
+    UnmapStreamingSlot(Stream, Victim);
+    
+    streaming_chunk *Chunk = &Stream->Chunks[ChunkIndex];
+    Victim->View = MapViewOfFile(Stream->Mapping, FILE_MAP_READ, (DWORD)(Chunk->Offset >> 32), (DWORD)Chunk->Offset, (SIZE_T)Chunk->Size);
+    END_PROFILE_ZONE(Load);
+    
+    //The slot stays empty, so the next draw of the chunk tries again
+    if(!Victim->View)
+    {
+        return 0;
+    }
+    
+    Victim->ChunkIndex = ChunkIndex;
+    Victim->LastUsed = Stream->Frame;
+    
+    uint64 TriangleOffset;
+    uint64 MeshletOffset;
+    GetStreamingChunkLayout(Chunk, &TriangleOffset, &MeshletOffset);
+    
+    //Drawing only reads the mesh, so it can point straight into the read only view
+    mesh *Mesh = &Victim->Mesh;
+    *Mesh = (mesh){0};
+    Mesh->PackedVertices = (packed_vertex *)Victim->View;
+    Mesh->Quantization = Chunk->Quantization;
+    Mesh->VertexCount = Chunk->VertexCount;
+    Mesh->Triangles = (triangle *)((uint8 *)Victim->View + TriangleOffset);
+    Mesh->TriangleCount = Chunk->TriangleCount;
+    Mesh->Meshlets = (meshlet *)((uint8 *)Victim->View + MeshletOffset);
+    Mesh->MeshletCount = Chunk->MeshletCount;
+    Mesh->BoundsCenter = Chunk->BoundsCenter;
+    Mesh->BoundsRadius = Chunk->BoundsRadius;
+    
+    Stream->ResidentBytes += Chunk->Size;
+    if(Stream->ResidentBytes > Stream->PeakResidentBytes)
+    {
+        Stream->PeakResidentBytes = Stream->ResidentBytes;
+    }
+    ++Stream->MapCount;
+    
+    return Mesh;
+}
@@ -0,0 +1,99 @@
+/* date = October 19th 2026 5:10 pm */
+
+#ifndef STREAMING_H
+#define STREAMING_H
+
+//"STRM", first bytes of every streaming mesh file
+#define STREAMING_MAGIC 0x4D525453
+#define STREAMING_VERSION 1
+
+//Meshlets per chunk when a mesh in memory is split, 64 * 96 triangles
+#define STREAMING_CHUNK_MESHLET_COUNT 64
+
+//Chunks start on the allocation granularity, so every chunk can be mapped on its own
+#define STREAMING_CHUNK_ALIGNMENT KILOBYTE(64)
+
+//Most chunks mapped at the same time, this and the chunk size bound the resident set
+#define STREAMING_RESIDENT_CHUNK_COUNT 16
+
+#define STREAMING_EMPTY_SLOT 0xFFFFFFFFFFFFFFFF
+
+/*
+Streaming mesh file:
+- streaming_header at the start of the file.
+- Chunks at STREAMING_CHUNK_ALIGNMENT offsets, each one is a mesh of its own:
+  packed_vertex[VertexCount], triangle[TriangleCount] at a 16 byte offset, then meshlet[MeshletCount].
+  Triangles index the vertices of their chunk and meshlets the triangles of their chunk, so a chunk draws without the rest of the file.
+- streaming_chunk[ChunkCount] at TableOffset, after the last chunk.
+*/
+typedef struct
+{
+    uint32 Magic;
+    uint32 Version;
+    
+    uint64 ChunkCount;
+    uint64 TableOffset;
+    uint64 VertexCount;
+    uint64 TriangleCount;
+    
+    //Bounding sphere of every chunk together
+    vec3 BoundsCenter;
+    real32 BoundsRadius;
+}streaming_header;
+
+typedef struct
+{
+    uint64 Offset;
+    uint64 Size;
+    
+    uint32 VertexCount;
+    uint32 TriangleCount;
+    uint32 MeshletCount;
+    uint32 Unused;
+    
+    //WriteStreamingMesh gives every chunk the quantization of the whole mesh, a converter feeding AddStreamingChunk can quantize each chunk on its own
+    vertex_quantization Quantization;
+    vec3 BoundsCenter;
+    real32 BoundsRadius;
+}streaming_chunk;
+
+//Chunks are added one at a time, only the chunk table is kept in memory
+typedef struct
+{
+    HANDLE File;
+    uint64 Offset;
+    
+    streaming_header Header;
+    memory_arena TableArena;
+    streaming_chunk *Chunks;
+}streaming_writer;
+
+typedef struct
+{
+    uint64 ChunkIndex;
+    void *View;
+    mesh Mesh;
+    
+    //Frame of the last draw, the slot with the oldest one is evicted first
+    uint64 LastUsed;
+}streaming_slot;
+
+typedef struct
+{
+    HANDLE File;
+    HANDLE Mapping;
+    
+    streaming_header Header;
+    streaming_chunk *Chunks;
+    
+    streaming_slot Slots[STREAMING_RESIDENT_CHUNK_COUNT];
+    uint64 Frame;
+    
+    //Bytes of the chunks that are mapped right now, and the most there ever were
+    uint64 ResidentBytes;
+    uint64 PeakResidentBytes;
+    uint64 MapCount;
+    uint64 HitCount;
+}streaming_mesh;
+
+#endif //STREAMING_H
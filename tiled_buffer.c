@@ -0,0 +1,95 @@
+#include "tiled_buffer.h"
+
+/*
+Pixel memory is committed up front, optionally with large pages so a 2560 x 1440 buffer needs a handful of TLB entries instead of thousands.
+Large pages need the SeLockMemoryPrivilege of the user, without it or without large page support the buffer falls back to normal pages.
+*/
+static void *
+AllocatePixelMemory(uint64 Size, bool32 UseLargePages)
+{
+    void *Result = 0;
+    
+    if(UseLargePages)
+    {
+        uint64 LargePageSize = GetLargePageMinimum();
+        if(LargePageSize)
+        {
+            uint64 LargeSize = (Size + LargePageSize - 1) & ~(LargePageSize - 1);
+            Result = VirtualAlloc(0, (SIZE_T)LargeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        }
+    }
+    
+    if(!Result)
+    {
+        Result = VirtualAlloc(0, (SIZE_T)Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    }
+    
+    //VirtualAlloc hands out whole allocation granules, far more than a cache line
+    Assert(Result);
+    Assert(((uintptr_t)Result & (PIXEL_MEMORY_ALIGNMENT - 1)) == 0);
+    
+    return Result;
+}
+
+/*
+Copies the tiles into LinearMemory, one tile at a time:
+- A tile is four aligned 16 byte rows, each one goes to its own scanline of the linear copy.
+- The linear copy is only read by GDI or the bitmap writer, so it is written with streaming stores that do not pull it into the cache.
+*/
+static void
+DetileBuffer(win32_pixel_buffer *Buffer)
+{
+    __m128i *Tile = (__m128i *)Buffer->Memory;
+    uint8 *TileRow = (uint8 *)Buffer->LinearMemory;
+    
+    for(uint32 TileY = 0; TileY < Buffer->TileCountY; ++TileY)
+    {
+        __m128i *Row0 = (__m128i *)TileRow;
+        __m128i *Row1 = (__m128i *)(TileRow + Buffer->Stride);
+        __m128i *Row2 = (__m128i *)(TileRow + (2 * Buffer->Stride));
+        __m128i *Row3 = (__m128i *)(TileRow + (3 * Buffer->Stride));
+        
+        for(uint32 TileX = 0; TileX < Buffer->TileCountX; ++TileX)
+        {
+            _mm_stream_si128(Row0 + TileX, _mm_load_si128(Tile + 0));
+            _mm_stream_si128(Row1 + TileX, _mm_load_si128(Tile + 1));
+            _mm_stream_si128(Row2 + TileX, _mm_load_si128(Tile + 2));
+            _mm_stream_si128(Row3 + TileX, _mm_load_si128(Tile + 3));
+            
+            Tile += 4;
+        }
+        
+        TileRow += PIXEL_TILE_HEIGHT * Buffer->Stride;
+    }
+    
+    //Streaming stores are weakly ordered, they have to land before anyone reads the copy
+    _mm_sfence();
+}
+
+//Visible triangles are shaded, samples resolved, transparent surfaces composited and pending clears of the color streamed in, Memory holds the final colors after
+static void
+ResolvePixelBuffer(win32_pixel_buffer *Buffer)
+{
+    ResolveVisibility(Buffer);
+    ResolveGBuffer(Buffer);
+    ResolveMultisample(Buffer);
+    ResolveTransparency(Buffer);
+    ResolveFastClear(Buffer, CLEAR_BLOCK_COLOR);
+}
+
+//Rows of Stride bytes, the buffer is resolved and tiled buffers detiled first
+static void *
+GetLinearPixels(win32_pixel_buffer *Buffer)
+{
+    ResolvePixelBuffer(Buffer);
+    
+    void *Result = Buffer->Memory;
+    
+    if(Buffer->IsTiled)
+    {
+        DetileBuffer(Buffer);
+        Result = Buffer->LinearMemory;
+    }
+    
+    return Result;
+}
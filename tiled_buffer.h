@@ -0,0 +1,12 @@
+/* date = October 19th 2026 5:55 pm */
+
+#ifndef TILED_BUFFER_H
+#define TILED_BUFFER_H
+
+//Frames drawn with each layout by BenchmarkPixelLayout
+#define PIXEL_LAYOUT_BENCHMARK_FRAMES 8
+
+//Alignment of Memory and Depth, a tile never straddles two cache lines
+#define PIXEL_MEMORY_ALIGNMENT 64
+
+#endif //TILED_BUFFER_H
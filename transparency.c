@@ -0,0 +1,205 @@
+#include "transparency.h"
+
+/*
+Weighted blended order independent transparency:
+- A transparent fragment that passes the depth test adds Color * Alpha * Weight and Alpha * Weight to the sums of its pixel,
+  and takes its Alpha out of what still shows of the background. Sums and products do not care about order.
+- Weight falls off with the view distance, so the nearest of several overlapping surfaces dominates the average.
+- Depth is tested against the opaque surfaces but never written, transparent instances can be submitted in any order.
+- The planes use the layout of the pixel buffer, so in a tiled buffer a tile of every plane is one cache line too.
+- Resolving composites the weighted average over the buffer in the pixels written since the last resolve, then zeroes them for the next frame.
+Memory is a fixed 20 bytes per pixel, however many surfaces overlap. Intersecting surfaces blend, they do not sort.
+*/
+
+static void
+ResetTransparencyBounds(win32_pixel_buffer *Buffer)
+{
+    Buffer->Transparency.MinX = Buffer->Width;
+    Buffer->Transparency.MinY = Buffer->Height;
+    Buffer->Transparency.MaxX = 0;
+    Buffer->Transparency.MaxY = 0;
+}
+
+//Zeroed pages are the empty state, nothing has to be cleared before the first frame
+static void
+AllocateTransparencyBuffer(win32_pixel_buffer *Buffer)
+{
+    transparency_buffer *Transparency = &Buffer->Transparency;
+    if(Transparency->Red)
+    {
+        return;
+    }
+    
+    //Planes start on cache lines, like the pixels
+    uint64 PlaneSize = ((uint64)GetPixelCount(Buffer) * sizeof(real32) + 63) & ~63;
+    uint8 *Planes = (uint8 *)VirtualAlloc(0, (SIZE_T)(TRANSPARENCY_PLANE_COUNT * PlaneSize), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Assert(Planes);
+    
+    Transparency->Red = (real32 *)(Planes + (0 * PlaneSize));
+    Transparency->Green = (real32 *)(Planes + (1 * PlaneSize));
+    Transparency->Blue = (real32 *)(Planes + (2 * PlaneSize));
+    Transparency->Weight = (real32 *)(Planes + (3 * PlaneSize));
+    Transparency->Coverage = (real32 *)(Planes + (4 * PlaneSize));
+    
+    ResetTransparencyBounds(Buffer);
+}
+
+static void
+ReleaseTransparencyBuffer(win32_pixel_buffer *Buffer)
+{
+    if(Buffer->Transparency.Red)
+    {
+        VirtualFree(Buffer->Transparency.Red, 0, MEM_RELEASE);
+        Buffer->Transparency.Red = 0;
+    }
+}
+
+//Float bounding box of a transparent triangle, grown to whole pixels like ResolveFastClearBounds
+static void
+GrowTransparencyBounds(win32_pixel_buffer *Buffer, real32 MinX, real32 MinY, real32 MaxX, real32 MaxY)
+{
+    transparency_buffer *Transparency = &Buffer->Transparency;
+    
+    int32 PixelMinX = (int32)fmaxf(floorf(MinX), 0.0f);
+    int32 PixelMinY = (int32)fmaxf(floorf(MinY), 0.0f);
+    int32 PixelMaxX = (int32)fminf(ceilf(MaxX) + 1.0f, (real32)Buffer->Width);
+    int32 PixelMaxY = (int32)fminf(ceilf(MaxY) + 1.0f, (real32)Buffer->Height);
+    
+    Transparency->MinX = (PixelMinX < Transparency->MinX) ? PixelMinX : Transparency->MinX;
+    Transparency->MinY = (PixelMinY < Transparency->MinY) ? PixelMinY : Transparency->MinY;
+    Transparency->MaxX = (PixelMaxX > Transparency->MaxX) ? PixelMaxX : Transparency->MaxX;
+    Transparency->MaxY = (PixelMaxY > Transparency->MaxY) ? PixelMaxY : Transparency->MaxY;
+}
+
+//Z is the view distance of the fragment, Color has straight alpha
+inline void AccumulateTransparency(transparency_buffer *Transparency, uint32 PixelIndex, uint32 Color, real32 Z)
+{
+    real32 Alpha = (real32)(Color >> 24) * (1.0f / 255.0f);
+    
+    real32 Near = Z * (1.0f / 5.0f);
+    real32 Far = Z * (1.0f / 200.0f);
+    real32 Far3 = Far * Far * Far;
+    real32 Weight = 10.0f / (1e-5f + (Near * Near) + (Far3 * Far3));
+    Weight = Alpha * fminf(fmaxf(Weight, TRANSPARENCY_MIN_WEIGHT), TRANSPARENCY_MAX_WEIGHT);
+    
+    Transparency->Red[PixelIndex] += (real32)((Color >> 16) & 0xFF) * Weight;
+    Transparency->Green[PixelIndex] += (real32)((Color >> 8) & 0xFF) * Weight;
+    Transparency->Blue[PixelIndex] += (real32)(Color & 0xFF) * Weight;
+    Transparency->Weight[PixelIndex] += Weight;
+    
+    real32 Coverage = Transparency->Coverage[PixelIndex];
+    Transparency->Coverage[PixelIndex] = Coverage + Alpha - (Coverage * Alpha);
+}
+
+/*
+Result = Dest * (1 - Coverage) + (Sum / Weight) * Coverage per channel, alpha composites as if the average were opaque.
+Count pixels from FirstIndex on, 8 at a time, groups without any coverage are skipped.
+*/
+static void
+CompositeTransparencyRun(win32_pixel_buffer *Buffer, uint32 FirstIndex, uint32 Count)
+{
+    transparency_buffer *Transparency = &Buffer->Transparency;
+    uint32 *Pixels = (uint32 *)Buffer->Memory;
+    
+    __m256 Zero = _mm256_setzero_ps();
+    __m256 One = _mm256_set1_ps(1.0f);
+    __m256 Max = _mm256_set1_ps(255.0f);
+    __m256 MinWeight = _mm256_set1_ps(1e-5f);
+    __m256i ChannelMask = _mm256_set1_epi32(0xFF);
+    
+    uint32 Index = FirstIndex;
+    uint32 EndIndex = FirstIndex + Count;
+    for(; (Index + 8) <= EndIndex; Index += 8)
+    {
+        __m256 Coverage = _mm256_loadu_ps(Transparency->Coverage + Index);
+        if(_mm256_movemask_ps(_mm256_cmp_ps(Coverage, Zero, _CMP_GT_OQ)) == 0)
+        {
+            continue;
+        }
+        
+        __m256 Scale = _mm256_div_ps(Coverage, _mm256_max_ps(_mm256_loadu_ps(Transparency->Weight + Index), MinWeight));
+        __m256 Keep = _mm256_sub_ps(One, Coverage);
+        
+        __m256i Dest = _mm256_loadu_si256((__m256i *)(Pixels + Index));
+        __m256 Alpha = _mm256_cvtepi32_ps(_mm256_srli_epi32(Dest, 24));
+        __m256 Red = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(Dest, 16), ChannelMask));
+        __m256 Green = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(Dest, 8), ChannelMask));
+        __m256 Blue = _mm256_cvtepi32_ps(_mm256_and_si256(Dest, ChannelMask));
+        
+        Alpha = _mm256_add_ps(_mm256_mul_ps(Alpha, Keep), _mm256_mul_ps(Max, Coverage));
+        Red = _mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(Red, Keep), _mm256_mul_ps(_mm256_loadu_ps(Transparency->Red + Index), Scale)), Max);
+        Green = _mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(Green, Keep), _mm256_mul_ps(_mm256_loadu_ps(Transparency->Green + Index), Scale)), Max);
+        Blue = _mm256_min_ps(_mm256_add_ps(_mm256_mul_ps(Blue, Keep), _mm256_mul_ps(_mm256_loadu_ps(Transparency->Blue + Index), Scale)), Max);
+        
+        __m256i Result = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(_mm256_cvtps_epi32(Alpha), 24), _mm256_slli_epi32(_mm256_cvtps_epi32(Red), 16)),
+                                         _mm256_or_si256(_mm256_slli_epi32(_mm256_cvtps_epi32(Green), 8), _mm256_cvtps_epi32(Blue)));
+        _mm256_storeu_si256((__m256i *)(Pixels + Index), Result);
+        
+        _mm256_storeu_ps(Transparency->Red + Index, Zero);
+        _mm256_storeu_ps(Transparency->Green + Index, Zero);
+        _mm256_storeu_ps(Transparency->Blue + Index, Zero);
+        _mm256_storeu_ps(Transparency->Weight + Index, Zero);
+        _mm256_storeu_ps(Transparency->Coverage + Index, Zero);
+    }
+    
+    for(; Index < EndIndex; ++Index)
+    {
+        real32 Coverage = Transparency->Coverage[Index];
+        if(Coverage > 0.0f)
+        {
+            real32 Scale = Coverage / fmaxf(Transparency->Weight[Index], 1e-5f);
+            real32 Keep = 1.0f - Coverage;
+            
+            uint32 Dest = Pixels[Index];
+            real32 Alpha = ((real32)(Dest >> 24) * Keep) + (255.0f * Coverage);
+            real32 Red = fminf(((real32)((Dest >> 16) & 0xFF) * Keep) + (Transparency->Red[Index] * Scale), 255.0f);
+            real32 Green = fminf(((real32)((Dest >> 8) & 0xFF) * Keep) + (Transparency->Green[Index] * Scale), 255.0f);
+            real32 Blue = fminf(((real32)(Dest & 0xFF) * Keep) + (Transparency->Blue[Index] * Scale), 255.0f);
+            
+            //Rounded to nearest even like _mm256_cvtps_epi32, so a pixel comes out the same on either path
+            Pixels[Index] = ((uint32)_mm_cvtss_si32(_mm_set_ss(Alpha)) << 24) | ((uint32)_mm_cvtss_si32(_mm_set_ss(Red)) << 16) |
+                ((uint32)_mm_cvtss_si32(_mm_set_ss(Green)) << 8) | (uint32)_mm_cvtss_si32(_mm_set_ss(Blue));
+            
+            Transparency->Red[Index] = 0.0f;
+            Transparency->Green[Index] = 0.0f;
+            Transparency->Blue[Index] = 0.0f;
+            Transparency->Weight[Index] = 0.0f;
+            Transparency->Coverage[Index] = 0.0f;
+        }
+    }
+}
+
+//Composites everything transparent drawn since the last resolve, GetLinearPixels does this before presenting
+static void
+ResolveTransparency(win32_pixel_buffer *Buffer)
+{
+    transparency_buffer *Transparency = &Buffer->Transparency;
+    if(!Transparency->Red || (Transparency->MinX >= Transparency->MaxX) || (Transparency->MinY >= Transparency->MaxY))
+    {
+        return;
+    }
+    
+    ResolveFastClearRect(Buffer, Transparency->MinX, Transparency->MinY, Transparency->MaxX, Transparency->MaxY);
+    
+    //Runs of contiguous pixels, whole tiles of a tile row or one scanline
+    if(Buffer->IsTiled)
+    {
+        uint32 MinTileX = Transparency->MinX >> PIXEL_TILE_SHIFT;
+        uint32 MaxTileX = (Transparency->MaxX + PIXEL_TILE_WIDTH - 1) >> PIXEL_TILE_SHIFT;
+        uint32 MaxTileY = (Transparency->MaxY + PIXEL_TILE_HEIGHT - 1) >> PIXEL_TILE_SHIFT;
+        
+        for(uint32 TileY = Transparency->MinY >> PIXEL_TILE_SHIFT; TileY < MaxTileY; ++TileY)
+        {
+            CompositeTransparencyRun(Buffer, ((TileY * Buffer->TileCountX) + MinTileX) * PIXEL_TILE_SIZE, (MaxTileX - MinTileX) * PIXEL_TILE_SIZE);
+        }
+    }
+    else
+    {
+        for(int32 Y = Transparency->MinY; Y < Transparency->MaxY; ++Y)
+        {
+            CompositeTransparencyRun(Buffer, (Y * Buffer->Width) + Transparency->MinX, Transparency->MaxX - Transparency->MinX);
+        }
+    }
+    
+    ResetTransparencyBounds(Buffer);
+}
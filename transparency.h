@@ -0,0 +1,12 @@
+/* date = October 19th 2026 8:05 pm */
+
+#ifndef TRANSPARENCY_H
+#define TRANSPARENCY_H
+
+//Bounds of the depth weight, so near surfaces win without the sums overflowing and far ones still count
+#define TRANSPARENCY_MIN_WEIGHT 1e-2f
+#define TRANSPARENCY_MAX_WEIGHT 3e3f
+
+#define TRANSPARENCY_PLANE_COUNT 5
+
+#endif //TRANSPARENCY_H
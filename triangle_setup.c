@@ -0,0 +1,369 @@
+#include "triangle_setup.h"
+
+/*
+Triangle setup for SETUP_BATCH_SIZE triangles at a time.
+- Triangles are gathered into a triangle_batch with their vertices sorted top to bottom.
+- Once the batch is full, gradients, edge slopes and prestep values are computed with one AVX lane per triangle.
+- The results are written out as compact triangle_setup records which only contain what the scanline loop steps.
+*/
+
+static void
+SetupTriangleBatch(triangle_batch *Batch, triangle_setup *Setups)
+{
+    __m256 One = _mm256_set1_ps(1.0f);
+    
+    __m256 X[3];
+    __m256 Y[3];
+    __m256 OneOverZ[3];
+    __m256 UOverZ[3];
+    __m256 VOverZ[3];
+    
+    for(uint32 Index = 0; Index < 3; ++Index)
+    {
+        X[Index] = _mm256_loadu_ps(Batch->X[Index]);
+        Y[Index] = _mm256_loadu_ps(Batch->Y[Index]);
+        
+        OneOverZ[Index] = _mm256_div_ps(One, _mm256_loadu_ps(Batch->Z[Index]));
+        UOverZ[Index] = _mm256_mul_ps(_mm256_loadu_ps(Batch->U[Index]), OneOverZ[Index]);
+        VOverZ[Index] = _mm256_mul_ps(_mm256_loadu_ps(Batch->V[Index]), OneOverZ[Index]);
+    }
+    
+    //Same terms as CalculateGradients
+    __m256 Y02 = _mm256_sub_ps(Y[0], Y[2]);
+    __m256 Y12 = _mm256_sub_ps(Y[1], Y[2]);
+    __m256 X02 = _mm256_sub_ps(X[0], X[2]);
+    __m256 X12 = _mm256_sub_ps(X[1], X[2]);
+    
+    __m256 OneOverdX = _mm256_div_ps(One, _mm256_sub_ps(_mm256_mul_ps(Y02, X12), _mm256_mul_ps(X02, Y12)));
+    __m256 OneOverdY = _mm256_sub_ps(_mm256_setzero_ps(), OneOverdX);
+    
+#define GRADIENT_X(Attribute) _mm256_mul_ps(OneOverdX, _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(Attribute[1], Attribute[2]), Y02), _mm256_mul_ps(_mm256_sub_ps(Attribute[0], Attribute[2]), Y12)))
+#define GRADIENT_Y(Attribute) _mm256_mul_ps(OneOverdY, _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(Attribute[1], Attribute[2]), X02), _mm256_mul_ps(_mm256_sub_ps(Attribute[0], Attribute[2]), X12)))
+    
+    __m256 dOneOverZdX = GRADIENT_X(OneOverZ);
+    __m256 dOneOverZdY = GRADIENT_Y(OneOverZ);
+    __m256 dUOverZdX = GRADIENT_X(UOverZ);
+    __m256 dUOverZdY = GRADIENT_Y(UOverZ);
+    __m256 dVOverZdX = GRADIENT_X(VOverZ);
+    __m256 dVOverZdY = GRADIENT_Y(VOverZ);
+    
+#undef GRADIENT_X
+#undef GRADIENT_Y
+    
+    //The middle vertex is on the left when it lies left of the top to bottom edge
+    __m256 Cross = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(X[2], X[0]), _mm256_sub_ps(Y[1], Y[0])),
+                                 _mm256_mul_ps(_mm256_sub_ps(Y[2], Y[0]), _mm256_sub_ps(X[1], X[0])));
+    int32 MiddleIsLeftMask = _mm256_movemask_ps(_mm256_cmp_ps(Cross, _mm256_setzero_ps(), _CMP_GT_OQ));
+    
+    real32 LaneDX[3][SETUP_BATCH_SIZE];
+    _mm256_storeu_ps(LaneDX[0], dOneOverZdX);
+    _mm256_storeu_ps(LaneDX[1], dUOverZdX);
+    _mm256_storeu_ps(LaneDX[2], dVOverZdX);
+    
+    //TopToBottom, TopToMiddle, MiddleToBottom
+    uint32 EdgeStart[3] = {0, 0, 1};
+    uint32 EdgeEnd[3] = {2, 1, 2};
+    
+    for(uint32 EdgeIndex = 0; EdgeIndex < 3; ++EdgeIndex)
+    {
+        uint32 Start = EdgeStart[EdgeIndex];
+        uint32 End = EdgeEnd[EdgeIndex];
+        
+        __m256 YStart = _mm256_ceil_ps(Y[Start]);
+        __m256 YEnd = _mm256_ceil_ps(Y[End]);
+        
+        __m256 YPreStep = _mm256_sub_ps(YStart, Y[Start]);
+        __m256 XStep = _mm256_div_ps(_mm256_sub_ps(X[End], X[Start]), _mm256_sub_ps(Y[End], Y[Start]));
+        
+        //Flat edges have no scanlines, keep their step finite
+        XStep = _mm256_and_ps(XStep, _mm256_cmp_ps(YEnd, YStart, _CMP_GT_OQ));
+        
+        __m256 EdgeX = _mm256_add_ps(_mm256_mul_ps(YPreStep, XStep), X[Start]);
+        __m256 XPreStep = _mm256_sub_ps(EdgeX, X[Start]);
+        
+        __m256 EdgeOneOverZ = _mm256_add_ps(OneOverZ[Start], _mm256_add_ps(_mm256_mul_ps(YPreStep, dOneOverZdY), _mm256_mul_ps(XPreStep, dOneOverZdX)));
+        __m256 EdgeUOverZ = _mm256_add_ps(UOverZ[Start], _mm256_add_ps(_mm256_mul_ps(YPreStep, dUOverZdY), _mm256_mul_ps(XPreStep, dUOverZdX)));
+        __m256 EdgeVOverZ = _mm256_add_ps(VOverZ[Start], _mm256_add_ps(_mm256_mul_ps(YPreStep, dVOverZdY), _mm256_mul_ps(XPreStep, dVOverZdX)));
+        
+        __m256 OneOverZStep = _mm256_add_ps(_mm256_mul_ps(XStep, dOneOverZdX), dOneOverZdY);
+        __m256 UOverZStep = _mm256_add_ps(_mm256_mul_ps(XStep, dUOverZdX), dUOverZdY);
+        __m256 VOverZStep = _mm256_add_ps(_mm256_mul_ps(XStep, dVOverZdX), dVOverZdY);
+        
+        __m256i IntYStart = _mm256_cvtps_epi32(YStart);
+        __m256i IntHeight = _mm256_sub_epi32(_mm256_cvtps_epi32(YEnd), IntYStart);
+        
+        int32 LaneY[SETUP_BATCH_SIZE];
+        int32 LaneHeight[SETUP_BATCH_SIZE];
+        real32 LaneValues[8][SETUP_BATCH_SIZE];
+        
+        _mm256_storeu_si256((__m256i *)LaneY, IntYStart);
+        _mm256_storeu_si256((__m256i *)LaneHeight, IntHeight);
+        _mm256_storeu_ps(LaneValues[0], EdgeX);
+        _mm256_storeu_ps(LaneValues[1], XStep);
+        _mm256_storeu_ps(LaneValues[2], EdgeOneOverZ);
+        _mm256_storeu_ps(LaneValues[3], OneOverZStep);
+        _mm256_storeu_ps(LaneValues[4], EdgeUOverZ);
+        _mm256_storeu_ps(LaneValues[5], UOverZStep);
+        _mm256_storeu_ps(LaneValues[6], EdgeVOverZ);
+        _mm256_storeu_ps(LaneValues[7], VOverZStep);
+        
+        for(uint32 Lane = 0; Lane < Batch->Count; ++Lane)
+        {
+            setup_edge *Edges[3] = {&Setups[Lane].TopToBottom, &Setups[Lane].TopToMiddle, &Setups[Lane].MiddleToBottom};
+            setup_edge *Edge = Edges[EdgeIndex];
+            Edge->Y = LaneY[Lane];
+            Edge->Height = LaneHeight[Lane];
+            Edge->X = LaneValues[0][Lane];
+            Edge->XStep = LaneValues[1][Lane];
+            Edge->OneOverZ = LaneValues[2][Lane];
+            Edge->OneOverZStep = LaneValues[3][Lane];
+            Edge->UOverZ = LaneValues[4][Lane];
+            Edge->UOverZStep = LaneValues[5][Lane];
+            Edge->VOverZ = LaneValues[6][Lane];
+            Edge->VOverZStep = LaneValues[7][Lane];
+        }
+    }
+    
+    for(uint32 Lane = 0; Lane < Batch->Count; ++Lane)
+    {
+        triangle_setup *Setup = &Setups[Lane];
+        Setup->dOneOverZdX = LaneDX[0][Lane];
+        Setup->dUOverZdX = LaneDX[1][Lane];
+        Setup->dVOverZdX = LaneDX[2][Lane];
+        Setup->Color = Batch->Color[Lane];
+        Setup->Normal = Batch->Normal[Lane];
+        Setup->MiddleIsLeft = (MiddleIsLeftMask >> Lane) & 1;
+    }
+}
+
+inline void StepSetupEdge(setup_edge *Edge)
+{
+    Edge->Y += 1;
+    Edge->X += Edge->XStep;
+    
+    Edge->OneOverZ += Edge->OneOverZStep;
+    Edge->UOverZ += Edge->UOverZStep;
+    Edge->VOverZ += Edge->VOverZStep;
+}
+
+static void
+DrawSetupScanline(win32_pixel_buffer *Buffer, texture *Texture, triangle_setup *Setup, setup_edge *Left, setup_edge *Right,
+                  raster_kernel Kernel, blend_mode BlendMode, uint32 PackedNormal)
+{
+    if(Left->Y < 0 || Left->Y >= (int32)Buffer->Height)
+    {
+        return;
+    }
+    
+    int32 XStart = (int32)ceilf(Left->X);
+    int32 XEnd = (int32)ceilf(Right->X);
+    
+    if(XStart < 0)
+    {
+        XStart = 0;
+    }
+    if(XEnd > (int32)Buffer->Width)
+    {
+        XEnd = Buffer->Width;
+    }
+    
+    real32 XPreStep = XStart - Left->X;
+    
+    real32 OneOverZ = Left->OneOverZ + (XPreStep * Setup->dOneOverZdX);
+    real32 UOverZ = Left->UOverZ + (XPreStep * Setup->dUOverZdX);
+    real32 VOverZ = Left->VOverZ + (XPreStep * Setup->dVOverZdX);
+    
+    if(Kernel == RasterKernel_SpanBuffer)
+    {
+        DrawSpanBufferSpan(Buffer, Texture, Left->Y, XStart, XEnd, Setup->Color, Setup->Normal,
+                           OneOverZ, UOverZ, VOverZ, Setup->dOneOverZdX, Setup->dUOverZdX, Setup->dVOverZdX);
+        return;
+    }
+    
+    //Color and depth share the layout, so one index walks both
+    uint32 PixelIndex = GetPixelIndex(Buffer, XStart, Left->Y);
+    uint32 FragmentCount = 0;
+    
+    for(int32 X = XStart; X < XEnd; ++X)
+    {
+        FragmentCount += DrawKernelPixel(Buffer, Texture, Kernel, BlendMode, PixelIndex, X, Left->Y,
+                                         OneOverZ, UOverZ, VOverZ, Setup->Color, Setup->Normal, PackedNormal);
+        
+        PixelIndex = GetNextPixelIndex(Buffer, PixelIndex, X);
+        OneOverZ += Setup->dOneOverZdX;
+        UOverZ += Setup->dUOverZdX;
+        VOverZ += Setup->dVOverZdX;
+    }
+    
+    CountKernelFragments(Buffer, Kernel, FragmentCount);
+}
+
+static void
+DrawSetupTriangle(win32_pixel_buffer *Buffer, texture *Texture, triangle_setup *Setup, raster_kernel Kernel, blend_mode BlendMode)
+{
+    uint32 PackedNormal = (Kernel == RasterKernel_GBuffer) ? PackNormal(Setup->Normal) : 0;
+    
+    setup_edge TopToBottom = Setup->TopToBottom;
+    setup_edge TopToMiddle = Setup->TopToMiddle;
+    setup_edge MiddleToBottom = Setup->MiddleToBottom;
+    
+    setup_edge *Left = Setup->MiddleIsLeft ? &TopToMiddle : &TopToBottom;
+    setup_edge *Right = Setup->MiddleIsLeft ? &TopToBottom : &TopToMiddle;
+    
+    for(int32 Height = TopToMiddle.Height; Height > 0; --Height)
+    {
+        DrawSetupScanline(Buffer, Texture, Setup, Left, Right, Kernel, BlendMode, PackedNormal);
+        StepSetupEdge(&TopToBottom);
+        StepSetupEdge(&TopToMiddle);
+    }
+    
+    Left = Setup->MiddleIsLeft ? &MiddleToBottom : &TopToBottom;
+    Right = Setup->MiddleIsLeft ? &TopToBottom : &MiddleToBottom;
+    
+    for(int32 Height = MiddleToBottom.Height; Height > 0; --Height)
+    {
+        DrawSetupScanline(Buffer, Texture, Setup, Left, Right, Kernel, BlendMode, PackedNormal);
+        StepSetupEdge(&TopToBottom);
+        StepSetupEdge(&MiddleToBottom);
+    }
+}
+
+static void
+FlushTriangleBatch(triangle_batch *Batch, win32_pixel_buffer *Buffer, texture *Texture)
+{
+    triangle_setup Setups[SETUP_BATCH_SIZE];
+    if(Batch->Count)
+    {
+        //Once per 8 triangles is too often for an event, the profiler only times a sample of the batches
+        BEGIN_SAMPLED_PROFILE_ZONE(Setup);
+        SetupTriangleBatch(Batch, Setups);
+        END_SAMPLED_PROFILE_ZONE(Setup);
+    }
+    
+    raster_kernel Kernel = GetRasterKernel(Buffer, Batch->BlendMode, Batch->Pass);
+    
+    for(uint32 OrderIndex = 0; OrderIndex < Batch->OrderCount; ++OrderIndex)
+    {
+        uint32 Entry = Batch->Order[OrderIndex];
+        if(Entry & BATCH_ORDER_SMALL)
+        {
+            small_triangle *Small = &Batch->SmallTriangles[Entry & ~BATCH_ORDER_SMALL];
+            if(Kernel == RasterKernel_SpanBuffer)
+            {
+                DrawSmallSpanBufferTriangle(Buffer, Texture, Small);
+            }
+            else
+            {
+                DrawSmallTriangle(Buffer, Texture, Small, Kernel, Batch->BlendMode);
+            }
+        }
+        else
+        {
+            DrawSetupTriangle(Buffer, Texture, &Setups[Entry], Kernel, Batch->BlendMode);
+        }
+    }
+    
+    Batch->Count = 0;
+    Batch->SmallCount = 0;
+    Batch->OrderCount = 0;
+}
+
+static void
+PushTriangleBatch(triangle_batch *Batch, win32_pixel_buffer *Buffer, texture *Texture, vec5 V1, vec5 V2, vec5 V3, uint32 Color, vec3 Normal)
+{
+    real32 MinX = fminf(V1.X, fminf(V2.X, V3.X));
+    real32 MinY = fminf(V1.Y, fminf(V2.Y, V3.Y));
+    real32 MaxX = fmaxf(V1.X, fmaxf(V2.X, V3.X));
+    real32 MaxY = fmaxf(V1.Y, fmaxf(V2.Y, V3.Y));
+    
+    //Pending clear blocks under the triangle are filled now, before it is queued for either path
+    ResolveFastClearBounds(Buffer, MinX, MinY, MaxX, MaxY);
+    
+    if(Batch->BlendMode == Blend_Transparent)
+    {
+        GrowTransparencyBounds(Buffer, MinX, MinY, MaxX, MaxY);
+    }
+    else if(Buffer->GBuffer.Albedo && (Batch->BlendMode == Blend_Opaque))
+    {
+        GrowGBufferBounds(Buffer, MinX, MinY, MaxX, MaxY);
+    }
+    
+    //Multisampled buffers test coverage per sample, there is nothing to batch
+    if(Buffer->Multisample.SampleCount > 1)
+    {
+        DrawMultisampleTriangle(Buffer, Texture, V1, V2, V3, Color, Normal, Batch->BlendMode);
+        return;
+    }
+    
+    //Opaque triangles of a visibility buffer carry their index from here on instead of the color, see visibility.c.
+    //They are only recorded once they are known to cover a pixel, culled ones take no index.
+    bool32 IsVisibility = (Buffer->Visibility.Ids && (Batch->BlendMode == Blend_Opaque));
+    
+    //Every index is taken, what is queued is drawn and everything recorded shaded before the list starts over
+    if(IsVisibility && (Buffer->Visibility.TriangleCount == VISIBILITY_MAX_TRIANGLE_COUNT))
+    {
+        FlushTriangleBatch(Batch, Buffer, Texture);
+        ResolveVisibility(Buffer);
+    }
+    
+    small_triangle *Small = &Batch->SmallTriangles[Batch->SmallCount];
+    small_triangle_result SmallResult = SetupSmallTriangle(Buffer, Small, V1, V2, V3);
+    
+    if(SmallResult == SmallTriangle_Empty)
+    {
+        return;
+    }
+    
+    if(SmallResult == SmallTriangle_Covered)
+    {
+        if(IsVisibility)
+        {
+            Color = RecordVisibilityTriangle(Buffer, Texture, V1, V2, V3, Color, MinX, MinY, MaxX, MaxY);
+        }
+        
+        Small->Color = Color;
+        Small->Normal = Normal;
+        Batch->Order[Batch->OrderCount++] = (uint8)(BATCH_ORDER_SMALL | Batch->SmallCount++);
+        
+        if(Batch->SmallCount == SMALL_TRIANGLE_QUEUE_SIZE)
+        {
+            FlushTriangleBatch(Batch, Buffer, Texture);
+        }
+        
+        return;
+    }
+    
+    vec5 SortedVertices[3] = {V1, V2, V3};
+    SortVerticesVec5(SortedVertices);
+    
+    //Triangles that do not cross a scanline center produce no pixels, and neither do ones beside, above or below the buffer
+    if((ceilf(SortedVertices[0].Y) == ceilf(SortedVertices[2].Y)) ||
+       (MaxX <= 0.0f) || (MaxY <= 0.0f) || (MinX >= (real32)Buffer->Width) || (MinY >= (real32)Buffer->Height))
+    {
+        return;
+    }
+    
+    if(IsVisibility)
+    {
+        Color = RecordVisibilityTriangle(Buffer, Texture, V1, V2, V3, Color, MinX, MinY, MaxX, MaxY);
+    }
+    
+    uint32 Lane = Batch->Count++;
+    for(uint32 Index = 0; Index < 3; ++Index)
+    {
+        Batch->X[Index][Lane] = SortedVertices[Index].X;
+        Batch->Y[Index][Lane] = SortedVertices[Index].Y;
+        Batch->Z[Index][Lane] = SortedVertices[Index].Z;
+        Batch->U[Index][Lane] = SortedVertices[Index].U;
+        Batch->V[Index][Lane] = SortedVertices[Index].V;
+    }
+    Batch->Color[Lane] = Color;
+    Batch->Normal[Lane] = Normal;
+    
+    Batch->Order[Batch->OrderCount++] = (uint8)Lane;
+    
+    if(Batch->Count == SETUP_BATCH_SIZE)
+    {
+        FlushTriangleBatch(Batch, Buffer, Texture);
+    }
+}
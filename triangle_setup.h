@@ -0,0 +1,73 @@
+/* date = October 19th 2026 9:12 am */
+
+#ifndef TRIANGLE_SETUP_H
+#define TRIANGLE_SETUP_H
+
+//Number of triangles set up together, one per AVX lane
+#define SETUP_BATCH_SIZE 8
+//Small triangles are queued next to the batch so that everything is drawn in submission order
+#define SMALL_TRIANGLE_QUEUE_SIZE 32
+//Entries of triangle_batch::Order with this bit set refer to SmallTriangles
+#define BATCH_ORDER_SMALL 0x80
+
+//Triangles waiting for setup, stored as structure of arrays so that every
+//vertex attribute of the batch can be loaded into a single register.
+//Vertices are already sorted top to bottom when they are pushed.
+typedef struct
+{
+    real32 X[3][SETUP_BATCH_SIZE];
+    real32 Y[3][SETUP_BATCH_SIZE];
+    real32 Z[3][SETUP_BATCH_SIZE];
+    real32 U[3][SETUP_BATCH_SIZE];
+    real32 V[3][SETUP_BATCH_SIZE];
+    uint32 Color[SETUP_BATCH_SIZE];
+    vec3 Normal[SETUP_BATCH_SIZE];
+    
+    uint32 Count;
+    
+    small_triangle SmallTriangles[SMALL_TRIANGLE_QUEUE_SIZE];
+    uint32 SmallCount;
+    
+    uint8 Order[SETUP_BATCH_SIZE + SMALL_TRIANGLE_QUEUE_SIZE];
+    uint32 OrderCount;
+    
+    //Shared by everything in the batch, the batch is flushed before either changes
+    blend_mode BlendMode;
+    raster_pass Pass;
+}triangle_batch;
+
+//Same stepping values as edge, without the copied end points
+typedef struct
+{
+    int32 Y;
+    int32 Height;
+    
+    real32 X;
+    real32 XStep;
+    
+    real32 OneOverZ;
+    real32 OneOverZStep;
+    
+    real32 UOverZ;
+    real32 UOverZStep;
+    
+    real32 VOverZ;
+    real32 VOverZStep;
+}setup_edge;
+
+typedef struct
+{
+    setup_edge TopToBottom;
+    setup_edge TopToMiddle;
+    setup_edge MiddleToBottom;
+    
+    real32 dOneOverZdX;
+    real32 dUOverZdX;
+    real32 dVOverZdX;
+    
+    uint32 Color;
+    vec3 Normal;
+    bool32 MiddleIsLeft;
+}triangle_setup;
+
+#endif //TRIANGLE_SETUP_H
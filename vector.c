@@ -146,6 +146,111 @@ vec4 MultiplyMat4Vec3(mat4 Matrix, vec3 V)
     return Result;
 }
 
+mat4 CreatePerspectiveMatrix(real32 AngleOfView, real32 InvAspectRatio, real32 NearZ, real32 FarZ)
+{
+    mat4 Result = {{0}};
+    
+    real32 FOVScale = 1.0f / tanf(AngleOfView / 2.0f);
+    Result.M[0][0] = FOVScale * InvAspectRatio;
+    Result.M[1][1] = FOVScale;
+    Result.M[2][2] = (FarZ + NearZ) / (FarZ - NearZ);
+    Result.M[2][3] = (-2.0f * NearZ * FarZ) / (FarZ - NearZ);
+    Result.M[3][2] = 1.0f;
+    
+    return Result;
+}
+
+//Scales, rotates around X, Y and Z like RotateAlongX/Y/Z, then moves to the instance position
+static mat4
+CreateInstanceTransform(mesh_instance *Instance)
+{
+    mat4 Result = {{0}};
+    
+    vec3 Axes[3] = {{1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+    for(uint32 Column = 0; Column < 3; ++Column)
+    {
+        vec3 Axis = RotateAlongX(Axes[Column], Instance->Rotation.X);
+        Axis = RotateAlongY(Axis, Instance->Rotation.Y);
+        Axis = RotateAlongZ(Axis, Instance->Rotation.Z);
+        
+        Result.M[0][Column] = Axis.X * Instance->Scale;
+        Result.M[1][Column] = Axis.Y * Instance->Scale;
+        Result.M[2][Column] = Axis.Z * Instance->Scale;
+    }
+    
+    Result.M[0][3] = Instance->Position.X;
+    Result.M[1][3] = Instance->Position.Y;
+    Result.M[2][3] = Instance->Position.Z;
+    Result.M[3][3] = 1.0f;
+    
+    return Result;
+}
+
+inline vec3 TransformPoint(mat4 *Transform, vec3 Point)
+{
+    vec3 Result;
+    Result.X = Transform->M[0][0] * Point.X + Transform->M[0][1] * Point.Y + Transform->M[0][2] * Point.Z + Transform->M[0][3];
+    Result.Y = Transform->M[1][0] * Point.X + Transform->M[1][1] * Point.Y + Transform->M[1][2] * Point.Z + Transform->M[1][3];
+    Result.Z = Transform->M[2][0] * Point.X + Transform->M[2][1] * Point.Y + Transform->M[2][2] * Point.Z + Transform->M[2][3];
+    
+    return Result;
+}
+
+//Inverse of an instance transform, the rotation part is orthogonal so its transpose undoes it
+static vec3
+InverseTransformPoint(mat4 *Transform, real32 Scale, vec3 Point)
+{
+    vec3 Offset = {Point.X - Transform->M[0][3], Point.Y - Transform->M[1][3], Point.Z - Transform->M[2][3]};
+    real32 InvScaleSquared = 1.0f / (Scale * Scale);
+    
+    vec3 Result;
+    Result.X = (Transform->M[0][0] * Offset.X + Transform->M[1][0] * Offset.Y + Transform->M[2][0] * Offset.Z) * InvScaleSquared;
+    Result.Y = (Transform->M[0][1] * Offset.X + Transform->M[1][1] * Offset.Y + Transform->M[2][1] * Offset.Z) * InvScaleSquared;
+    Result.Z = (Transform->M[0][2] * Offset.X + Transform->M[1][2] * Offset.Y + Transform->M[2][2] * Offset.Z) * InvScaleSquared;
+    
+    return Result;
+}
+
+static view
+CreateView(win32_pixel_buffer *Buffer)
+{
+    view Result;
+    
+    real32 AngleOfView = (PI / 3.0f); //In radians
+    real32 InvAspectRatio = 9.0f / 16.0f;
+    
+    Result.CameraPos = (vec3){0.0f, 0.0f, -10.0f};
+    Result.NearZ = 5.0f;
+    Result.FarZ = 500.0f;
+    Result.Projection = CreatePerspectiveMatrix(AngleOfView, InvAspectRatio, Result.NearZ, Result.FarZ);
+    
+    Result.ScaleX = 25.0f;
+    Result.ScaleY = 25.0f;
+    
+    Result.HalfWidth = Buffer->Width / 2.0f;
+    Result.HalfHeight = Buffer->Height / 2.0f;
+    
+    return Result;
+}
+
+//Returns the raster X and Y, and the Z distance from the camera
+static vec3
+ProjectToRaster(view *View, vec3 Point)
+{
+    vec3 Result;
+    
+    vec3 CameraRelative = SubtractVec3(Point, View->CameraPos);
+    vec4 ProjectedVector = MultiplyMat4Vec3(View->Projection, CameraRelative);
+    
+    vec2 NDCVertices = (vec2){ProjectedVector.X / ProjectedVector.W, ProjectedVector.Y / ProjectedVector.W};
+    
+    Result.X = (View->ScaleX * NDCVertices.X + 1) * View->HalfWidth;
+    Result.Y = (View->ScaleY * -NDCVertices.Y + 1) * View->HalfHeight;
+    Result.Z = CameraRelative.Z;
+    
+    return Result;
+}
+
 inline real32 GetMagnitudeVec3(vec3 V)
 {
     real32 Result;
@@ -0,0 +1,318 @@
+#include "vertex_cache.h"
+
+//Forsyth's vertex score, higher for vertices used recently and for vertices with few triangles left
+static real32
+GetVertexCacheScore(cache_vertex *Vertex)
+{
+    if(!Vertex->RemainingCount)
+    {
+        return -1.0f;
+    }
+    
+    real32 Result = 0.0f;
+    
+    if(Vertex->CachePosition >= 0)
+    {
+        if(Vertex->CachePosition < 3)
+        {
+            //The vertices of the last triangle all get the same score, so no winding direction is preferred
+            Result = 0.75f;
+        }
+        else
+        {
+            real32 Scale = 1.0f / (real32)(VERTEX_CACHE_SIZE - 3);
+            Result = powf(1.0f - ((real32)(Vertex->CachePosition - 3) * Scale), 1.5f);
+        }
+    }
+    
+    //Finishing off vertices with few triangles left lets them leave the cache sooner
+    Result += 2.0f / sqrtf((real32)Vertex->RemainingCount);
+    
+    return Result;
+}
+
+/*
+Reorders the triangles of one meshlet for vertex reuse, after Forsyth's linear speed vertex cache optimization:
+- Triangles are emitted one at a time, always the one whose vertices have the highest summed score.
+- The vertices of an emitted triangle move to the front of a simulated LRU cache, raising the score of their other triangles.
+- Only the triangles around the cache are searched, all remaining triangles are only searched when none of those are left.
+The meshlet keeps the same triangles, so its bounds and normal cone stay valid.
+Map has an entry per vertex of the mesh that has to be 0, it is used for local vertex numbers and left at 0.
+*/
+static void
+OptimizeMeshletTriangles(mesh *Mesh, meshlet *Meshlet, uint32 *Map)
+{
+    Assert(Meshlet->TriangleCount <= MESHLET_TRIANGLE_COUNT);
+    
+    triangle *Triangles = Mesh->Triangles + Meshlet->FirstTriangle;
+    uint32 Count = Meshlet->TriangleCount;
+    
+    cache_vertex Vertices[3 * MESHLET_TRIANGLE_COUNT];
+    uint32 Corners[3 * MESHLET_TRIANGLE_COUNT];
+    uint32 Adjacency[3 * MESHLET_TRIANGLE_COUNT];
+    real32 TriangleScores[MESHLET_TRIANGLE_COUNT];
+    bool32 Emitted[MESHLET_TRIANGLE_COUNT];
+    triangle Ordered[MESHLET_TRIANGLE_COUNT];
+    
+    uint32 VertexCount = 0;
+    
+    for(uint32 TriangleIndex = 0; TriangleIndex < Count; ++TriangleIndex)
+    {
+        triangle *Triangle = &Triangles[TriangleIndex];
+        uint32 Indices[3] = {Triangle->A - 1, Triangle->B - 1, Triangle->C - 1};
+        
+        for(uint32 Index = 0; Index < 3; ++Index)
+        {
+            if(!Map[Indices[Index]])
+            {
+                Map[Indices[Index]] = ++VertexCount;
+                Vertices[VertexCount - 1] = (cache_vertex){-1, 0, 0, 0.0f};
+            }
+            
+            uint32 Local = Map[Indices[Index]] - 1;
+            Corners[(3 * TriangleIndex) + Index] = Local;
+            ++Vertices[Local].RemainingCount;
+        }
+    }
+    
+    uint32 Total = 0;
+    for(uint32 VertexIndex = 0; VertexIndex < VertexCount; ++VertexIndex)
+    {
+        cache_vertex *Vertex = &Vertices[VertexIndex];
+        Vertex->First = Total;
+        Total += Vertex->RemainingCount;
+        Vertex->RemainingCount = 0;
+    }
+    
+    for(uint32 CornerIndex = 0; CornerIndex < (3 * Count); ++CornerIndex)
+    {
+        cache_vertex *Vertex = &Vertices[Corners[CornerIndex]];
+        Adjacency[Vertex->First + Vertex->RemainingCount++] = CornerIndex / 3;
+    }
+    
+    for(uint32 VertexIndex = 0; VertexIndex < VertexCount; ++VertexIndex)
+    {
+        Vertices[VertexIndex].Score = GetVertexCacheScore(&Vertices[VertexIndex]);
+    }
+    
+    for(uint32 TriangleIndex = 0; TriangleIndex < Count; ++TriangleIndex)
+    {
+        uint32 *TriangleCorners = &Corners[3 * TriangleIndex];
+        TriangleScores[TriangleIndex] = Vertices[TriangleCorners[0]].Score + Vertices[TriangleCorners[1]].Score + Vertices[TriangleCorners[2]].Score;
+        Emitted[TriangleIndex] = false;
+    }
+    
+    uint32 Cache[VERTEX_CACHE_SIZE + 3];
+    uint32 CacheCount = 0;
+    
+    for(uint32 OrderedIndex = 0; OrderedIndex < Count; ++OrderedIndex)
+    {
+        uint32 Best = Count;
+        real32 BestScore = -1.0f;
+        
+        for(uint32 CacheIndex = 0; CacheIndex < CacheCount; ++CacheIndex)
+        {
+            cache_vertex *Vertex = &Vertices[Cache[CacheIndex]];
+            for(uint32 Index = Vertex->First; Index < (Vertex->First + Vertex->RemainingCount); ++Index)
+            {
+                uint32 TriangleIndex = Adjacency[Index];
+                if(TriangleScores[TriangleIndex] > BestScore)
+                {
+                    Best = TriangleIndex;
+                    BestScore = TriangleScores[TriangleIndex];
+                }
+            }
+        }
+        
+        if(Best == Count)
+        {
+            for(uint32 TriangleIndex = 0; TriangleIndex < Count; ++TriangleIndex)
+            {
+                if(!Emitted[TriangleIndex] && (TriangleScores[TriangleIndex] > BestScore))
+                {
+                    Best = TriangleIndex;
+                    BestScore = TriangleScores[TriangleIndex];
+                }
+            }
+        }
+        
+        Emitted[Best] = true;
+        Ordered[OrderedIndex] = Triangles[Best];
+        
+        uint32 *BestCorners = &Corners[3 * Best];
+        
+        //Take the triangle out of the remaining triangles of its vertices
+        for(uint32 Index = 0; Index < 3; ++Index)
+        {
+            cache_vertex *Vertex = &Vertices[BestCorners[Index]];
+            uint32 OnePastLast = Vertex->First + Vertex->RemainingCount;
+            
+            for(uint32 AdjacencyIndex = Vertex->First; AdjacencyIndex < OnePastLast; ++AdjacencyIndex)
+            {
+                if(Adjacency[AdjacencyIndex] == Best)
+                {
+                    Adjacency[AdjacencyIndex] = Adjacency[OnePastLast - 1];
+                    --Vertex->RemainingCount;
+                    break;
+                }
+            }
+        }
+        
+        //The emitted vertices go to the front, the rest of the cache keeps its order behind them
+        uint32 NewCache[VERTEX_CACHE_SIZE + 3];
+        uint32 NewCount = 0;
+        
+        for(uint32 Index = 0; Index < 3; ++Index)
+        {
+            if((Index == 0) || ((BestCorners[Index] != BestCorners[0]) && ((Index == 1) || (BestCorners[Index] != BestCorners[1]))))
+            {
+                NewCache[NewCount++] = BestCorners[Index];
+            }
+        }
+        
+        for(uint32 CacheIndex = 0; CacheIndex < CacheCount; ++CacheIndex)
+        {
+            uint32 Local = Cache[CacheIndex];
+            if((Local != BestCorners[0]) && (Local != BestCorners[1]) && (Local != BestCorners[2]))
+            {
+                NewCache[NewCount++] = Local;
+            }
+        }
+        
+        //Vertices past the end of the cache have just been pushed out of it
+        for(uint32 CacheIndex = 0; CacheIndex < NewCount; ++CacheIndex)
+        {
+            cache_vertex *Vertex = &Vertices[NewCache[CacheIndex]];
+            Vertex->CachePosition = (CacheIndex < VERTEX_CACHE_SIZE) ? (int32)CacheIndex : -1;
+            Vertex->Score = GetVertexCacheScore(Vertex);
+        }
+        
+        CacheCount = (NewCount < VERTEX_CACHE_SIZE) ? NewCount : VERTEX_CACHE_SIZE;
+        for(uint32 CacheIndex = 0; CacheIndex < CacheCount; ++CacheIndex)
+        {
+            Cache[CacheIndex] = NewCache[CacheIndex];
+        }
+        
+        //Only the triangles around vertices whose score changed need a new score
+        for(uint32 CacheIndex = 0; CacheIndex < NewCount; ++CacheIndex)
+        {
+            cache_vertex *Vertex = &Vertices[NewCache[CacheIndex]];
+            for(uint32 Index = Vertex->First; Index < (Vertex->First + Vertex->RemainingCount); ++Index)
+            {
+                uint32 TriangleIndex = Adjacency[Index];
+                uint32 *TriangleCorners = &Corners[3 * TriangleIndex];
+                TriangleScores[TriangleIndex] = Vertices[TriangleCorners[0]].Score + Vertices[TriangleCorners[1]].Score + Vertices[TriangleCorners[2]].Score;
+            }
+        }
+    }
+    
+    for(uint32 TriangleIndex = 0; TriangleIndex < Count; ++TriangleIndex)
+    {
+        triangle *Triangle = &Triangles[TriangleIndex];
+        Map[Triangle->A - 1] = 0;
+        Map[Triangle->B - 1] = 0;
+        Map[Triangle->C - 1] = 0;
+        
+        Triangles[TriangleIndex] = Ordered[TriangleIndex];
+    }
+}
+
+//Reorders the triangles of every meshlet, the meshlets themselves stay in their Morton order
+static void
+OptimizeVertexCache(mesh *Mesh)
+{
+    uint32 *Map = (uint32 *)VirtualAlloc(0, Mesh->VertexCount * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    for(uint64 MeshletIndex = 0; MeshletIndex < Mesh->MeshletCount; ++MeshletIndex)
+    {
+        OptimizeMeshletTriangles(Mesh, &Mesh->Meshlets[MeshletIndex], Map);
+    }
+    
+    VirtualFree(Map, 0, MEM_RELEASE);
+}
+
+/*
+Renumbers the vertices in the order the triangles first use them and moves them to match,
+so transforming the triangles in order walks the vertex array forwards.
+Vertices no triangle uses go at the end. Meshes that share the vertex array, like the LOD levels, have to be built after this.
+*/
+static void
+OptimizeVertexFetch(mesh *Mesh)
+{
+    //1-based new index of every vertex, 0 until a triangle uses it
+    uint32 *Remap = (uint32 *)VirtualAlloc(0, Mesh->VertexCount * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    vertex *Vertices = (vertex *)VirtualAlloc(0, Mesh->VertexCount * sizeof(vertex), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    uint32 NextIndex = 0;
+    
+    for(uint64 TriangleIndex = 0; TriangleIndex < Mesh->TriangleCount; ++TriangleIndex)
+    {
+        triangle *Triangle = &Mesh->Triangles[TriangleIndex];
+        uint32 *Indices[3] = {&Triangle->A, &Triangle->B, &Triangle->C};
+        
+        for(uint32 Index = 0; Index < 3; ++Index)
+        {
+            uint32 VertexIndex = *Indices[Index] - 1;
+            if(!Remap[VertexIndex])
+            {
+                Remap[VertexIndex] = ++NextIndex;
+            }
+            
+            *Indices[Index] = Remap[VertexIndex];
+        }
+    }
+    
+    for(uint64 VertexIndex = 0; VertexIndex < Mesh->VertexCount; ++VertexIndex)
+    {
+        if(!Remap[VertexIndex])
+        {
+            Remap[VertexIndex] = ++NextIndex;
+        }
+        
+        Vertices[Remap[VertexIndex] - 1] = Mesh->Vertices[VertexIndex];
+    }
+    
+    for(uint64 VertexIndex = 0; VertexIndex < Mesh->VertexCount; ++VertexIndex)
+    {
+        Mesh->Vertices[VertexIndex] = Vertices[VertexIndex];
+    }
+    
+    VirtualFree(Vertices, 0, MEM_RELEASE);
+    VirtualFree(Remap, 0, MEM_RELEASE);
+}
+
+//Average cache miss ratio, vertices transformed per triangle with a FIFO cache of VERTEX_CACHE_FIFO_SIZE. 0.5 is the best a regular grid can do, 3 means no reuse at all.
+static real32
+GetVertexCacheMissRatio(mesh *Mesh)
+{
+    if(!Mesh->TriangleCount)
+    {
+        return 0.0f;
+    }
+    
+    //A vertex is in the cache when fewer than VERTEX_CACHE_FIFO_SIZE misses happened since its own
+    uint32 *MissTimes = (uint32 *)VirtualAlloc(0, Mesh->VertexCount * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    uint32 Time = VERTEX_CACHE_FIFO_SIZE + 1;
+    uint64 MissCount = 0;
+    
+    for(uint64 TriangleIndex = 0; TriangleIndex < Mesh->TriangleCount; ++TriangleIndex)
+    {
+        triangle *Triangle = &Mesh->Triangles[TriangleIndex];
+        uint32 Indices[3] = {Triangle->A - 1, Triangle->B - 1, Triangle->C - 1};
+        
+        for(uint32 Index = 0; Index < 3; ++Index)
+        {
+            if((Time - MissTimes[Indices[Index]]) > VERTEX_CACHE_FIFO_SIZE)
+            {
+                MissTimes[Indices[Index]] = Time++;
+                ++MissCount;
+            }
+        }
+    }
+    
+    VirtualFree(MissTimes, 0, MEM_RELEASE);
+    
+    real32 Result = (real32)MissCount / (real32)Mesh->TriangleCount;
+    
+    return Result;
+}
@@ -0,0 +1,24 @@
+/* date = October 19th 2026 5:40 pm */
+
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+
+//Size of the simulated LRU cache the triangle order is optimized for
+#define VERTEX_CACHE_SIZE 32
+
+//Size of the FIFO cache ACMR is measured with
+#define VERTEX_CACHE_FIFO_SIZE 16
+
+typedef struct
+{
+    //-1 when the vertex is not in the cache
+    int32 CachePosition;
+    
+    //Triangles not emitted yet are Triangles[First] up to Triangles[First + RemainingCount]
+    uint32 First;
+    uint32 RemainingCount;
+    
+    real32 Score;
+}cache_vertex;
+
+#endif //VERTEX_CACHE_H
@@ -0,0 +1,351 @@
+#include "visibility.h"
+
+/*
+Visibility buffer, opaque triangles are drawn in two passes:
+- The raster pass is the usual batched setup and small triangle path, but the scanline loops step nothing but 1/z,
+  and write the depth and the index of the triangle to every pixel that passes the depth test.
+  The plane equations of the triangle go into a list when it is pushed.
+- The shading pass runs once over the pixels drawn to, and textures every pixel that ended up with a triangle exactly once,
+  from the plane equations of that triangle at the pixel.
+Texturing then costs the same whatever the overdraw, what is hidden only costs a depth compare and two stores.
+Blended instances are drawn forward, DrawMeshInstances shades the visibility buffer before the first one so they blend over the final color.
+Not for multisampled buffers, their pixels can have more than one visible triangle.
+*/
+
+static void
+ResetVisibilityBounds(win32_pixel_buffer *Buffer)
+{
+    Buffer->Visibility.MinX = Buffer->Width;
+    Buffer->Visibility.MinY = Buffer->Height;
+    Buffer->Visibility.MaxX = 0;
+    Buffer->Visibility.MaxY = 0;
+}
+
+//Zeroed pages are the empty state, like the transparency planes
+static void
+AllocateVisibilityBuffer(win32_pixel_buffer *Buffer)
+{
+    visibility_buffer *Visibility = &Buffer->Visibility;
+    if(Visibility->Ids)
+    {
+        return;
+    }
+    
+    Assert(Buffer->Multisample.SampleCount == 1);
+    
+    Visibility->Ids = (uint32 *)VirtualAlloc(0, (SIZE_T)GetPixelCount(Buffer) * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Visibility->Triangles = (visibility_triangle *)VirtualAlloc(0, VISIBILITY_MAX_TRIANGLE_COUNT * sizeof(visibility_triangle), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Visibility->TriangleCount = 0;
+    Assert(Visibility->Ids && Visibility->Triangles);
+    
+    ResetVisibilityBounds(Buffer);
+}
+
+static void
+ReleaseVisibilityBuffer(win32_pixel_buffer *Buffer)
+{
+    if(Buffer->Visibility.Ids)
+    {
+        VirtualFree(Buffer->Visibility.Ids, 0, MEM_RELEASE);
+        VirtualFree(Buffer->Visibility.Triangles, 0, MEM_RELEASE);
+        Buffer->Visibility.Ids = 0;
+        Buffer->Visibility.Triangles = 0;
+    }
+}
+
+inline void ShadeVisibilityPixel(visibility_buffer *Visibility, uint32 *Pixels, uint32 PixelIndex, uint32 X, uint32 Y)
+{
+    visibility_triangle *Triangle = &Visibility->Triangles[Visibility->Ids[PixelIndex] - 1];
+    
+    real32 DeltaX = (real32)X - Triangle->X;
+    real32 DeltaY = (real32)Y - Triangle->Y;
+    
+    real32 OneOverZ = Triangle->OneOverZ + (Triangle->dOneOverZdX * DeltaX) + (Triangle->dOneOverZdY * DeltaY);
+    real32 UOverZ = Triangle->UOverZ + (Triangle->dUOverZdX * DeltaX) + (Triangle->dUOverZdY * DeltaY);
+    real32 VOverZ = Triangle->VOverZ + (Triangle->dVOverZdX * DeltaX) + (Triangle->dVOverZdY * DeltaY);
+    
+    real32 Z = 1.0f / OneOverZ;
+    Pixels[PixelIndex] = ModulateColor(SampleTexture(Triangle->Texture, UOverZ * Z, VOverZ * Z), Triangle->Color);
+    Visibility->Ids[PixelIndex] = 0;
+}
+
+/*
+Shades 8 pixels at once, their coordinates are in PixelX and PixelY:
+- The records of the 8 triangles are loaded as rows and transposed into one register per field, or broadcast when all 8 pixels are in one triangle.
+  Most groups straddle a few small triangles, and 16 loads and a transpose are cheaper than a gather per field.
+- Texels are gathered at the same texel as SampleTexture, which needs the texture width and height to be powers of two for the wrap to be a mask.
+  24 bit texels are gathered from the byte before them, so nothing is read past the last one.
+Groups with more than one texture or a texture that does not fit go through ShadeVisibilityPixel, both give the same colors.
+*/
+static void
+ShadeVisibilityGroup(visibility_buffer *Visibility, uint32 *Pixels, uint32 PixelIndex, __m256 PixelX, __m256 PixelY)
+{
+    __m256i Ids = _mm256_loadu_si256((__m256i *)(Visibility->Ids + PixelIndex));
+    __m256i Used = _mm256_cmpgt_epi32(Ids, _mm256_setzero_si256());
+    int32 UsedMask = _mm256_movemask_ps(_mm256_castsi256_ps(Used));
+    if(!UsedMask)
+    {
+        return;
+    }
+    
+    uint32 LaneIds[8];
+    _mm256_storeu_si256((__m256i *)LaneIds, Ids);
+    
+    uint32 FirstLane = 0;
+    while(!(UsedMask & (1 << FirstLane)))
+    {
+        ++FirstLane;
+    }
+    
+    visibility_triangle *First = &Visibility->Triangles[LaneIds[FirstLane] - 1];
+    texture *Texture = First->Texture;
+    
+    //Unused lanes read the record of the first used one
+    visibility_triangle *Triangles[8];
+    bool32 IsOneTriangle = true;
+    bool32 IsOneTexture = true;
+    for(uint32 Lane = 0; Lane < 8; ++Lane)
+    {
+        Triangles[Lane] = LaneIds[Lane] ? &Visibility->Triangles[LaneIds[Lane] - 1] : First;
+        IsOneTriangle &= (Triangles[Lane] == First);
+        IsOneTexture &= (Triangles[Lane]->Texture == Texture);
+    }
+    
+    bool32 IsMaskWrap = (((Texture->Width & (Texture->Width - 1)) == 0) && ((Texture->Height & (Texture->Height - 1)) == 0));
+    if(!IsOneTexture || !IsMaskWrap || ((Texture->BytesPerTexel != 3) && (Texture->BytesPerTexel != 4)))
+    {
+        real32 LaneX[8];
+        real32 LaneY[8];
+        _mm256_storeu_ps(LaneX, PixelX);
+        _mm256_storeu_ps(LaneY, PixelY);
+        
+        for(uint32 Lane = 0; Lane < 8; ++Lane)
+        {
+            if(LaneIds[Lane])
+            {
+                ShadeVisibilityPixel(Visibility, Pixels, PixelIndex + Lane, (uint32)LaneX[Lane], (uint32)LaneY[Lane]);
+            }
+        }
+        
+        return;
+    }
+    
+    //X, Y, OneOverZ, dOneOverZdX, dOneOverZdY, UOverZ, dUOverZdX, dUOverZdY, then VOverZ, dVOverZdX, dVOverZdY, Color
+    __m256 Fields[12];
+    if(IsOneTriangle)
+    {
+        real32 *Values = &First->X;
+        for(uint32 Field = 0; Field < 12; ++Field)
+        {
+            Fields[Field] = _mm256_set1_ps(Values[Field]);
+        }
+    }
+    else
+    {
+        //8 x 8 transpose of the first 8 fields
+        __m256 Rows[8];
+        for(uint32 Lane = 0; Lane < 8; ++Lane)
+        {
+            Rows[Lane] = _mm256_loadu_ps(&Triangles[Lane]->X);
+        }
+        
+        __m256 Pairs[8];
+        for(uint32 Half = 0; Half < 8; Half += 4)
+        {
+            __m256 Low01 = _mm256_unpacklo_ps(Rows[Half + 0], Rows[Half + 1]);
+            __m256 High01 = _mm256_unpackhi_ps(Rows[Half + 0], Rows[Half + 1]);
+            __m256 Low23 = _mm256_unpacklo_ps(Rows[Half + 2], Rows[Half + 3]);
+            __m256 High23 = _mm256_unpackhi_ps(Rows[Half + 2], Rows[Half + 3]);
+            
+            Pairs[Half + 0] = _mm256_shuffle_ps(Low01, Low23, _MM_SHUFFLE(1, 0, 1, 0));
+            Pairs[Half + 1] = _mm256_shuffle_ps(Low01, Low23, _MM_SHUFFLE(3, 2, 3, 2));
+            Pairs[Half + 2] = _mm256_shuffle_ps(High01, High23, _MM_SHUFFLE(1, 0, 1, 0));
+            Pairs[Half + 3] = _mm256_shuffle_ps(High01, High23, _MM_SHUFFLE(3, 2, 3, 2));
+        }
+        
+        for(uint32 Field = 0; Field < 4; ++Field)
+        {
+            Fields[Field] = _mm256_permute2f128_ps(Pairs[Field], Pairs[Field + 4], 0x20);
+            Fields[Field + 4] = _mm256_permute2f128_ps(Pairs[Field], Pairs[Field + 4], 0x31);
+        }
+        
+        //4 x 4 transposes of the other 4, triangles 0 to 3 in the low half and 4 to 7 in the high half
+        __m256 Quads[4];
+        for(uint32 Lane = 0; Lane < 4; ++Lane)
+        {
+            Quads[Lane] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(&Triangles[Lane]->VOverZ)), _mm_loadu_ps(&Triangles[Lane + 4]->VOverZ), 1);
+        }
+        
+        __m256 Low01 = _mm256_unpacklo_ps(Quads[0], Quads[1]);
+        __m256 High01 = _mm256_unpackhi_ps(Quads[0], Quads[1]);
+        __m256 Low23 = _mm256_unpacklo_ps(Quads[2], Quads[3]);
+        __m256 High23 = _mm256_unpackhi_ps(Quads[2], Quads[3]);
+        
+        Fields[8] = _mm256_shuffle_ps(Low01, Low23, _MM_SHUFFLE(1, 0, 1, 0));
+        Fields[9] = _mm256_shuffle_ps(Low01, Low23, _MM_SHUFFLE(3, 2, 3, 2));
+        Fields[10] = _mm256_shuffle_ps(High01, High23, _MM_SHUFFLE(1, 0, 1, 0));
+        Fields[11] = _mm256_shuffle_ps(High01, High23, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    
+    __m256 DeltaX = _mm256_sub_ps(PixelX, Fields[0]);
+    __m256 DeltaY = _mm256_sub_ps(PixelY, Fields[1]);
+    
+    //Same operations in the same order as ShadeVisibilityPixel
+    __m256 OneOverZ = _mm256_add_ps(_mm256_add_ps(Fields[2], _mm256_mul_ps(Fields[3], DeltaX)), _mm256_mul_ps(Fields[4], DeltaY));
+    __m256 UOverZ = _mm256_add_ps(_mm256_add_ps(Fields[5], _mm256_mul_ps(Fields[6], DeltaX)), _mm256_mul_ps(Fields[7], DeltaY));
+    __m256 VOverZ = _mm256_add_ps(_mm256_add_ps(Fields[8], _mm256_mul_ps(Fields[9], DeltaX)), _mm256_mul_ps(Fields[10], DeltaY));
+    
+    //Unused lanes shade the first triangle at their pixel, their texel gather and store are masked off
+    __m256 Z = _mm256_div_ps(_mm256_set1_ps(1.0f), OneOverZ);
+    __m256i TexelU = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(UOverZ, Z), _mm256_set1_ps((real32)Texture->Width)));
+    __m256i TexelV = _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(VOverZ, Z), _mm256_set1_ps((real32)Texture->Height)));
+    TexelU = _mm256_and_si256(TexelU, _mm256_set1_epi32(Texture->Width - 1));
+    TexelV = _mm256_and_si256(TexelV, _mm256_set1_epi32(Texture->Height - 1));
+    
+    __m256i TexelOffsets = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_mullo_epi32(TexelV, _mm256_set1_epi32(Texture->Width)), TexelU), _mm256_set1_epi32(Texture->BytesPerTexel));
+    
+    __m256i Texels;
+    if(Texture->BytesPerTexel == 3)
+    {
+        Texels = _mm256_srli_epi32(_mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (int32 *)((uint8 *)Texture->Bytes - 1), TexelOffsets, Used, 1), 8);
+    }
+    else
+    {
+        Texels = _mm256_and_si256(_mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (int32 *)Texture->Bytes, TexelOffsets, Used, 1), _mm256_set1_epi32(0x00FFFFFF));
+    }
+    Texels = _mm256_or_si256(Texels, _mm256_set1_epi32(0xFF000000));
+    
+    //ModulateColor, (Texel * Color + 255) >> 8 per channel, white leaves the texel as it is
+    __m256i Colors = _mm256_castps_si256(Fields[11]);
+    __m256i White = _mm256_cmpeq_epi32(Colors, _mm256_set1_epi32(-1));
+    if(!_mm256_testc_si256(White, Used))
+    {
+        __m256i ByteZero = _mm256_setzero_si256();
+        __m256i Round = _mm256_set1_epi16(0xFF);
+        __m256i Low = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(Texels, ByteZero), _mm256_unpacklo_epi8(Colors, ByteZero)), Round), 8);
+        __m256i High = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(Texels, ByteZero), _mm256_unpackhi_epi8(Colors, ByteZero)), Round), 8);
+        Texels = _mm256_blendv_epi8(_mm256_packus_epi16(Low, High), Texels, White);
+    }
+    
+    __m256i *Destination = (__m256i *)(Pixels + PixelIndex);
+    _mm256_storeu_si256(Destination, _mm256_blendv_epi8(_mm256_loadu_si256(Destination), Texels, Used));
+    _mm256_storeu_si256((__m256i *)(Visibility->Ids + PixelIndex), _mm256_setzero_si256());
+}
+
+/*
+Shades every pixel with a triangle since the last resolve and empties the buffer again, GetLinearPixels does this before presenting.
+Linear buffers shade 8 pixels of a row at a time, tiled ones two rows of a tile.
+*/
+static void
+ResolveVisibility(win32_pixel_buffer *Buffer)
+{
+    visibility_buffer *Visibility = &Buffer->Visibility;
+    if(!Visibility->Ids)
+    {
+        return;
+    }
+    
+    //Triangles outside the buffer still took an index
+    if((Visibility->MinX >= Visibility->MaxX) || (Visibility->MinY >= Visibility->MaxY))
+    {
+        Visibility->TriangleCount = 0;
+        return;
+    }
+    
+    ResolveFastClearRect(Buffer, Visibility->MinX, Visibility->MinY, Visibility->MaxX, Visibility->MaxY);
+    
+    uint32 *Pixels = (uint32 *)Buffer->Memory;
+    
+    if(Buffer->IsTiled)
+    {
+        uint32 MinTileX = Visibility->MinX >> PIXEL_TILE_SHIFT;
+        uint32 MaxTileX = (Visibility->MaxX + PIXEL_TILE_WIDTH - 1) >> PIXEL_TILE_SHIFT;
+        uint32 MaxTileY = (Visibility->MaxY + PIXEL_TILE_HEIGHT - 1) >> PIXEL_TILE_SHIFT;
+        
+        __m256 TileColumns = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 0.0f, 1.0f, 2.0f, 3.0f);
+        __m256 TileRows = _mm256_setr_ps(0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f);
+        
+        for(uint32 TileY = Visibility->MinY >> PIXEL_TILE_SHIFT; TileY < MaxTileY; ++TileY)
+        {
+            for(uint32 TileX = MinTileX; TileX < MaxTileX; ++TileX)
+            {
+                uint32 TileIndex = ((TileY * Buffer->TileCountX) + TileX) * PIXEL_TILE_SIZE;
+                __m256 PixelX = _mm256_add_ps(TileColumns, _mm256_set1_ps((real32)(TileX << PIXEL_TILE_SHIFT)));
+                __m256 PixelY = _mm256_add_ps(TileRows, _mm256_set1_ps((real32)(TileY << PIXEL_TILE_SHIFT)));
+                
+                ShadeVisibilityGroup(Visibility, Pixels, TileIndex, PixelX, PixelY);
+                ShadeVisibilityGroup(Visibility, Pixels, TileIndex + 8, PixelX, _mm256_add_ps(PixelY, _mm256_set1_ps(2.0f)));
+            }
+        }
+    }
+    else
+    {
+        __m256 Columns = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        
+        for(uint32 Y = Visibility->MinY; Y < (uint32)Visibility->MaxY; ++Y)
+        {
+            uint32 X = Visibility->MinX;
+            uint32 PixelIndex = (Y * Buffer->Width) + X;
+            __m256 PixelY = _mm256_set1_ps((real32)Y);
+            
+            for(; (X + 8) <= (uint32)Visibility->MaxX; X += 8, PixelIndex += 8)
+            {
+                ShadeVisibilityGroup(Visibility, Pixels, PixelIndex, _mm256_add_ps(Columns, _mm256_set1_ps((real32)X)), PixelY);
+            }
+            
+            for(; X < (uint32)Visibility->MaxX; ++X, ++PixelIndex)
+            {
+                if(Visibility->Ids[PixelIndex])
+                {
+                    ShadeVisibilityPixel(Visibility, Pixels, PixelIndex, X, Y);
+                }
+            }
+        }
+    }
+    
+    Visibility->TriangleCount = 0;
+    ResetVisibilityBounds(Buffer);
+}
+
+/*
+Takes the next index for an opaque triangle and records its plane equations, the index is what the raster pass writes in place of the color.
+Bounds are grown to whole pixels like GrowTransparencyBounds.
+*/
+static uint32
+RecordVisibilityTriangle(win32_pixel_buffer *Buffer, texture *Texture, vec5 V1, vec5 V2, vec5 V3, uint32 Color,
+                         real32 MinX, real32 MinY, real32 MaxX, real32 MaxY)
+{
+    visibility_buffer *Visibility = &Buffer->Visibility;
+    Assert(Visibility->TriangleCount < VISIBILITY_MAX_TRIANGLE_COUNT);
+    
+    vec5 Vertices[3] = {V1, V2, V3};
+    gradient Gradients;
+    CalculateGradients(&Gradients, Vertices);
+    
+    visibility_triangle *Triangle = &Visibility->Triangles[Visibility->TriangleCount++];
+    Triangle->X = V1.X;
+    Triangle->Y = V1.Y;
+    Triangle->OneOverZ = Gradients.OneOverZ[0];
+    Triangle->dOneOverZdX = Gradients.dOneOverZdX;
+    Triangle->dOneOverZdY = Gradients.dOneOverZdY;
+    Triangle->UOverZ = Gradients.UOverZ[0];
+    Triangle->dUOverZdX = Gradients.dUOverZdX;
+    Triangle->dUOverZdY = Gradients.dUOverZdY;
+    Triangle->VOverZ = Gradients.VOverZ[0];
+    Triangle->dVOverZdX = Gradients.dVOverZdX;
+    Triangle->dVOverZdY = Gradients.dVOverZdY;
+    Triangle->Color = Color;
+    Triangle->Texture = Texture;
+    
+    int32 PixelMinX = (int32)fmaxf(floorf(MinX), 0.0f);
+    int32 PixelMinY = (int32)fmaxf(floorf(MinY), 0.0f);
+    int32 PixelMaxX = (int32)fminf(ceilf(MaxX) + 1.0f, (real32)Buffer->Width);
+    int32 PixelMaxY = (int32)fminf(ceilf(MaxY) + 1.0f, (real32)Buffer->Height);
+    
+    Visibility->MinX = (PixelMinX < Visibility->MinX) ? PixelMinX : Visibility->MinX;
+    Visibility->MinY = (PixelMinY < Visibility->MinY) ? PixelMinY : Visibility->MinY;
+    Visibility->MaxX = (PixelMaxX > Visibility->MaxX) ? PixelMaxX : Visibility->MaxX;
+    Visibility->MaxY = (PixelMaxY > Visibility->MaxY) ? PixelMaxY : Visibility->MaxY;
+    
+    return Visibility->TriangleCount;
+}
@@ -0,0 +1,11 @@
+/* date = October 19th 2026 7:40 pm */
+
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+//Triangles recorded between two resolves, a full list is shaded and started over
+#define VISIBILITY_MAX_TRIANGLE_COUNT (1 << 18)
+
+#define VISIBILITY_BENCHMARK_FRAMES 8
+
+#endif //VISIBILITY_H
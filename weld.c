@@ -0,0 +1,138 @@
+#include "weld.h"
+
+//Only the position and texture coordinate are hashed, corners with different normals can still weld
+inline uint32 HashVertex(vertex *Vertex)
+{
+    //Position and texture coordinate are the first 5 words of the vertex
+    uint32 *Words = (uint32 *)Vertex;
+    
+    uint32 Result = 2166136261u;
+    for(uint32 Index = 0; Index < 5; ++Index)
+    {
+        Result = (Result ^ Words[Index]) * 16777619u;
+    }
+    
+    Result ^= Result >> 15;
+    
+    return Result;
+}
+
+inline bool32 CanWeldVertices(vertex *A, vertex *B)
+{
+    bool32 Result = ((A->Position.X == B->Position.X) && (A->Position.Y == B->Position.Y) && (A->Position.Z == B->Position.Z) &&
+                     (A->TextureCoord.X == B->TextureCoord.X) && (A->TextureCoord.Y == B->TextureCoord.Y) &&
+                     (DotVec3(A->Normal, B->Normal) >= WELD_NORMAL_COS));
+    
+    return Result;
+}
+
+/*
+Welds the corners of the faces into one vertex buffer at load:
+- Every corner is expanded to a full vertex, corners with equal positions and texture coordinates and close normals become one vertex.
+- Candidates are found through an open addressing hash table that is never more than half full.
+- The normal of a welded vertex is the average of its corners, compared against the normal of its first corner.
+- Vertices are numbered in the order the triangles first use them.
+Mesh->Triangles and Mesh->TriangleCount have to be set, A, B and C of every triangle are written.
+*/
+static void
+WeldVertices(mesh *Mesh, vec3 *Positions, vec2 *TextureCoords, vec3 *Normals, vertex_key *Corners)
+{
+    uint64 CornerCount = 3 * Mesh->TriangleCount;
+    
+    uint64 TableSize = 1;
+    while(TableSize < (2 * CornerCount))
+    {
+        TableSize <<= 1;
+    }
+    
+    //Slots hold 1-based vertex indices, 0 is an empty slot
+    uint32 *Table = (uint32 *)VirtualAlloc(0, TableSize * sizeof(uint32), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    vertex *Welded = (vertex *)VirtualAlloc(0, CornerCount * sizeof(vertex), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    vec3 *NormalSums = (vec3 *)VirtualAlloc(0, CornerCount * sizeof(vec3), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    uint32 VertexCount = 0;
+    
+    for(uint64 CornerIndex = 0; CornerIndex < CornerCount; ++CornerIndex)
+    {
+        vertex_key Key = Corners[CornerIndex];
+        
+        //Adding 0 turns -0 into 0, so the two hash the same
+        vertex Vertex = {0};
+        Vertex.Position = Positions[Key.Position - 1];
+        Vertex.Position = (vec3){Vertex.Position.X + 0.0f, Vertex.Position.Y + 0.0f, Vertex.Position.Z + 0.0f};
+        
+        if(Key.TextureCoord)
+        {
+            Vertex.TextureCoord = TextureCoords[Key.TextureCoord - 1];
+            Vertex.TextureCoord = (vec2){Vertex.TextureCoord.X + 0.0f, Vertex.TextureCoord.Y + 0.0f};
+        }
+        
+        if(Key.Normal)
+        {
+            Vertex.Normal = Normals[Key.Normal - 1];
+        }
+        
+        uint64 Slot = HashVertex(&Vertex) & (TableSize - 1);
+        uint32 VertexIndex = 0;
+        
+        for(;;)
+        {
+            VertexIndex = Table[Slot];
+            
+            if(!VertexIndex)
+            {
+                //Triangles index with 32 bits, bigger scans have to be split before they are welded
+                Assert(VertexCount < 0xFFFFFFFF);
+                Welded[VertexCount++] = Vertex;
+                VertexIndex = VertexCount;
+                Table[Slot] = VertexIndex;
+                break;
+            }
+            
+            if(CanWeldVertices(&Welded[VertexIndex - 1], &Vertex))
+            {
+                break;
+            }
+            
+            Slot = (Slot + 1) & (TableSize - 1);
+        }
+        
+        NormalSums[VertexIndex - 1] = AddVec3(NormalSums[VertexIndex - 1], Vertex.Normal);
+        
+        triangle *Triangle = &Mesh->Triangles[CornerIndex / 3];
+        uint32 Corner = (uint32)(CornerIndex % 3);
+        if(Corner == 0)
+        {
+            Triangle->A = VertexIndex;
+        }
+        else if(Corner == 1)
+        {
+            Triangle->B = VertexIndex;
+        }
+        else
+        {
+            Triangle->C = VertexIndex;
+        }
+    }
+    
+    Mesh->VertexCount = VertexCount;
+    Mesh->Vertices = (vertex *)VirtualAlloc(0, VertexCount * sizeof(vertex), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    
+    for(uint32 VertexIndex = 0; VertexIndex < VertexCount; ++VertexIndex)
+    {
+        Mesh->Vertices[VertexIndex] = Welded[VertexIndex];
+        
+        vec3 Normal = NormalSums[VertexIndex];
+        if(GetMagnitudeVec3(Normal) > 0.0f)
+        {
+            Mesh->Vertices[VertexIndex].Normal = NormalizeVec3(Normal);
+        }
+    }
+    
+    VirtualFree(NormalSums, 0, MEM_RELEASE);
+    VirtualFree(Welded, 0, MEM_RELEASE);
+    VirtualFree(Table, 0, MEM_RELEASE);
+    
+    char OutputBuffer[256];
+    sprintf_s(OutputBuffer, ArrayCount(OutputBuffer), "Welded %llu corners into %u vertices\n", CornerCount, VertexCount);
+    OutputDebugStringA(OutputBuffer);
+}
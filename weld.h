@@ -0,0 +1,18 @@
+/* date = October 19th 2026 4:50 pm */
+
+#ifndef WELD_H
+#define WELD_H
+
+//Corners at the same position and texture coordinate are welded when their normals are within about 60 degrees.
+//Files exported with flat normals still get shared vertices, hard edges past the angle stay split.
+#define WELD_NORMAL_COS 0.5f
+
+//One corner of a face as the OBJ file writes it, 1-based indices into its positions, texture coordinates and normals, 0 when missing
+typedef struct
+{
+    uint32 Position;
+    uint32 TextureCoord;
+    uint32 Normal;
+}vertex_key;
+
+#endif //WELD_H
@@ -0,0 +1,151 @@
+#include "work_queue.h"
+
+/*
+Work queue for splitting a pass across threads:
+- One thread adds entries, the worker threads take them and so does the adding thread once it waits in CompleteAllWork.
+- Taking an entry is a compare exchange on the read index, so every entry runs exactly once.
+- Workers sleep on a semaphore that is released once per entry added, an empty queue costs them nothing.
+An entry is only a callback and its data. A pass over rows adds one entry per thread and every entry pulls rows off a shared counter,
+so the rows balance across threads however uneven they are. Every thread has an arena of its own in the queue, a callback is handed
+the one of the thread it runs on for its scratch memory.
+*/
+
+//Runs the next entry if there is one with the arena of the calling thread, returns false once the queue is empty
+static bool32
+DoNextWorkQueueEntry(work_queue *Queue, memory_arena *Arena)
+{
+    bool32 Result = false;
+    
+    LONG OriginalNextEntryToRead = Queue->NextEntryToRead;
+    if(OriginalNextEntryToRead != Queue->NextEntryToWrite)
+    {
+        Result = true;
+        
+        LONG NewNextEntryToRead = (OriginalNextEntryToRead + 1) % WORK_QUEUE_ENTRY_COUNT;
+        if(InterlockedCompareExchange(&Queue->NextEntryToRead, NewNextEntryToRead, OriginalNextEntryToRead) == OriginalNextEntryToRead)
+        {
+            work_queue_entry Entry = Queue->Entries[OriginalNextEntryToRead];
+            Entry.Callback(Arena, Entry.Data);
+            InterlockedIncrement(&Queue->CompletionCount);
+        }
+    }
+    
+    return Result;
+}
+
+static DWORD WINAPI
+WorkerThreadProc(void *Parameter)
+{
+    work_queue *Queue = (work_queue *)Parameter;
+    
+    //Workers take their arenas in the order they start, which one a worker gets does not matter
+    LONG ThreadIndex = InterlockedIncrement(&Queue->StartedThreadCount) - 1;
+    memory_arena *Arena = &Queue->Arenas[ThreadIndex];
+    
+    for(;;)
+    {
+        if(!DoNextWorkQueueEntry(Queue, Arena))
+        {
+            WaitForSingleObjectEx(Queue->Semaphore, INFINITE, false);
+        }
+    }
+    
+    //Workers run until the process exits, this is never reached
+    return 0;
+}
+
+//ThreadCount is clamped to WORK_QUEUE_MAX_THREAD_COUNT, with 0 CompleteAllWork runs every entry itself
+static void
+InitializeWorkQueue(work_queue *Queue, uint32 ThreadCount)
+{
+    if(ThreadCount > WORK_QUEUE_MAX_THREAD_COUNT)
+    {
+        ThreadCount = WORK_QUEUE_MAX_THREAD_COUNT;
+    }
+    
+    Queue->NextEntryToWrite = 0;
+    Queue->NextEntryToRead = 0;
+    Queue->CompletionGoal = 0;
+    Queue->CompletionCount = 0;
+    Queue->ThreadCount = ThreadCount;
+    Queue->StartedThreadCount = 0;
+    Queue->Semaphore = CreateSemaphoreExA(0, 0, WORK_QUEUE_ENTRY_COUNT, 0, 0, SEMAPHORE_ALL_ACCESS);
+    Assert(Queue->Semaphore);
+    
+    for(uint32 ArenaIndex = 0; ArenaIndex <= ThreadCount; ++ArenaIndex)
+    {
+        InitializeArena(&Queue->Arenas[ArenaIndex], WORK_QUEUE_ARENA_SIZE, 0);
+    }
+    
+    //The threads run until the process exits
+    for(uint32 ThreadIndex = 0; ThreadIndex < ThreadCount; ++ThreadIndex)
+    {
+        HANDLE Thread = CreateThread(0, 0, WorkerThreadProc, Queue, 0, 0);
+        Assert(Thread);
+        CloseHandle(Thread);
+    }
+}
+
+//One worker per logical processor besides the one the caller runs on
+static uint32
+GetWorkerThreadCount(void)
+{
+    SYSTEM_INFO SystemInfo;
+    GetSystemInfo(&SystemInfo);
+    
+    uint32 Result = (SystemInfo.dwNumberOfProcessors > 1) ? (SystemInfo.dwNumberOfProcessors - 1) : 0;
+    return Result;
+}
+
+//The arena of the thread that adds the entries, for the share of a pass it runs itself
+inline memory_arena *
+GetWorkQueueCallerArena(work_queue *Queue)
+{
+    memory_arena *Result = &Queue->Arenas[Queue->ThreadCount];
+    return Result;
+}
+
+//Asserts that no thread of the queue left a temporary memory scope open
+static void
+CheckWorkQueueArenas(work_queue *Queue)
+{
+    for(uint32 ArenaIndex = 0; ArenaIndex <= Queue->ThreadCount; ++ArenaIndex)
+    {
+        CheckArena(&Queue->Arenas[ArenaIndex]);
+    }
+}
+
+//Only the thread that calls CompleteAllWork adds entries
+static void
+AddWorkQueueEntry(work_queue *Queue, work_queue_callback *Callback, void *Data)
+{
+    LONG NewNextEntryToWrite = (Queue->NextEntryToWrite + 1) % WORK_QUEUE_ENTRY_COUNT;
+    Assert(NewNextEntryToWrite != Queue->NextEntryToRead);
+    
+    work_queue_entry *Entry = &Queue->Entries[Queue->NextEntryToWrite];
+    Entry->Callback = Callback;
+    Entry->Data = Data;
+    ++Queue->CompletionGoal;
+    
+    //The entry has to be complete before a worker can see the new write index
+    _WriteBarrier();
+    Queue->NextEntryToWrite = NewNextEntryToWrite;
+    ReleaseSemaphore(Queue->Semaphore, 1, 0);
+}
+
+//The calling thread works through the queue too, and returns once every entry added so far is done
+static void
+CompleteAllWork(work_queue *Queue)
+{
+    while(Queue->CompletionGoal != Queue->CompletionCount)
+    {
+        //The last entries are running on workers, nothing is left to take
+        if(!DoNextWorkQueueEntry(Queue, GetWorkQueueCallerArena(Queue)))
+        {
+            _mm_pause();
+        }
+    }
+    
+    Queue->CompletionGoal = 0;
+    Queue->CompletionCount = 0;
+}
@@ -0,0 +1,9 @@
+/* date = October 19th 2026 11:05 pm */
+
+#ifndef WORK_QUEUE_H
+#define WORK_QUEUE_H
+
+//Reserved for the arena of every thread of a queue, only what the passes push is committed
+#define WORK_QUEUE_ARENA_SIZE MEGABYTE(256)
+
+#endif //WORK_QUEUE_H